@@ -3,19 +3,27 @@
 in vec3 world_position;
 in vec3 world_normal;
 in vec2 uv_coord;
+flat in vec3 instance_diffuse;
 
 out vec4 fragColor;
 
 uniform float ka;
 uniform float kd;
-uniform vec3 lightColors[8];
-uniform int lightsNum;
-uniform int lightTypes[8];
-uniform vec3 lightFunctions[8];
-uniform vec4 lightPositions[8];
-uniform vec4 lightDirections[8];
-uniform float lightAngles[8];
-uniform float lightPenumbras[8];
+
+// every light as 4 texels: color + type, position + angle, direction + penumbra, attenuation.
+// Types: 0 point, 1 directional, 2 spot
+uniform samplerBuffer lightData;
+// lights that reach every pixel (directional, or without falloff)
+uniform int globalLights[8];
+uniform int numGlobalLights;
+// the rest are binned into clusters: screen tiles times exponential slices of view depth
+// from clusterGridBase: per cluster the texel of its first light index and the count
+uniform usamplerBuffer clusterData;
+uniform int clusterGridBase;
+uniform ivec3 clusterCounts;
+uniform vec2 clusterTileSize;         // in pixels
+uniform float clusterDepthScale;      // slice = log(depth) * scale + bias
+uniform float clusterDepthBias;
 
 uniform float ks;
 uniform vec4 camPos;
@@ -28,93 +36,210 @@ uniform vec3 shapeColorS;
 uniform sampler2D txt[8];
 uniform sampler2D noiseMap;
 uniform bool usingTexture;
+uniform bool instanced;
 uniform int txtIndex;
 uniform bool isScrolling;
 uniform float time;
 
-void main() {
-    fragColor = vec4(0.0);
+// cascaded shadow map of one directional light, one layer per slice of the view frustum
+uniform sampler2DArrayShadow shadowCascades;
+uniform int shadowLight;            // index of the light it belongs to, -1 for none
+uniform int numCascades;
+uniform float cascadeSplits[4];     // view distance where each cascade ends
+uniform mat4 cascadeLightSpace[4];
+uniform float shadowBias;
+uniform bool enablePCF;
+uniform mat4 view;
+
+// point and spot light shadows: tiles of one depth atlas holding distance / range.
+// A point light has six tiles in a row, one per cube face in GL face order
+uniform sampler2DShadow shadowAtlas;
+uniform int shadowTile[8];          // first tile of each light, -1 for none
+uniform float shadowRange[8];
+uniform vec4 shadowTiles[24];       // corner (xy) and size (zw) of each tile, in atlas uv
+uniform mat4 spotShadowMatrix[8];
+
+const vec3 CUBE_LOOKS[6] = vec3[6](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 CUBE_UPS[6] = vec3[6](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+float cascadeShadow(vec3 position, vec3 normal, vec3 toLight) {
+    float viewDistance = -(view * vec4(position, 1.0)).z;
+    int cascade = -1;
+    for (int c = 0; c < 4; c++) {
+        if (c < numCascades && viewDistance <= cascadeSplits[c]) {
+            cascade = c;
+            break;
+        }
+    }
+    if (cascade < 0) return 1.0;
+
+    vec4 lightClip = cascadeLightSpace[cascade] * vec4(position, 1.0);
+    vec3 coords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    // steeper surfaces need more bias; further cascades cover more world per depth unit
+    float bias = shadowBias * (1.0 + 2.0 * (1.0 - max(dot(normal, toLight), 0.0))) / float(cascade + 1);
+    float depth = coords.z - bias;
+
+    if (!enablePCF) return texture(shadowCascades, vec4(coords.xy, cascade, depth));
+    // 3x3 taps, each already a 2x2 bilinear comparison
+    vec2 texel = 1.0 / vec2(textureSize(shadowCascades, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowCascades, vec4(coords.xy + vec2(x, y) * texel, cascade, depth));
+        }
+    }
+    return lit / 9.0;
+}
+
+float atlasShadow(int tile, vec2 uv, float reference) {
+    vec4 rect = shadowTiles[tile];
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    // stay half a texel inside the tile, so filtering never reads its neighbours
+    vec2 lo = rect.xy + 0.5 * texel;
+    vec2 hi = rect.xy + rect.zw - 0.5 * texel;
+    vec2 center = rect.xy + clamp(uv, 0.0, 1.0) * rect.zw;
+    if (!enablePCF) return texture(shadowAtlas, vec3(clamp(center, lo, hi), reference));
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowAtlas, vec3(clamp(center + vec2(x, y) * texel, lo, hi), reference));
+        }
+    }
+    return lit / 9.0;
+}
+
+float lightShadow(int light, int type, vec3 lightPos, vec3 position, vec3 normal, vec3 toLight) {
+    int tile = shadowTile[light];
+    if (tile < 0) return 1.0;
+    vec3 fromLight = position - lightPos;
+    float bias = shadowBias * (1.0 + 2.0 * (1.0 - max(dot(normal, toLight), 0.0)));
+    float reference = length(fromLight) / shadowRange[light] - bias;
+
+    vec2 uv;
+    if (type == 2) {
+        vec4 clip = spotShadowMatrix[light] * vec4(position, 1.0);
+        if (clip.w <= 0.0) return 1.0;
+        uv = clip.xy / clip.w * 0.5 + 0.5;
+    } else {
+        // the face the direction points into, projected the same way as lookAt and a 90 degree frustum
+        vec3 a = abs(fromLight);
+        int face = (a.x >= a.y && a.x >= a.z) ? (fromLight.x > 0.0 ? 0 : 1)
+                 : (a.y >= a.z) ? (fromLight.y > 0.0 ? 2 : 3) : (fromLight.z > 0.0 ? 4 : 5);
+        vec3 look = CUBE_LOOKS[face];
+        vec3 right = normalize(cross(look, CUBE_UPS[face]));
+        vec3 up = cross(right, look);
+        uv = vec2(dot(fromLight, right), dot(fromLight, up)) / dot(fromLight, look) * 0.5 + 0.5;
+        tile += face;
+    }
+    return atlasShadow(tile, uv, reference);
+}
+
+// diffuse and specular from light i, on a surface whose diffuse color is already known
+vec3 shadeLight(int i, vec3 diffuseColor, vec4 norm, vec4 directionToCamera, vec4 position) {
+    vec4 color = texelFetch(lightData, 4 * i);
+    vec4 posAngle = texelFetch(lightData, 4 * i + 1);
+    vec4 dirPenumbra = texelFetch(lightData, 4 * i + 2);
+    vec3 lightFunction = texelFetch(lightData, 4 * i + 3).xyz;
+    int type = int(color.w);
+    vec4 lightPos = vec4(posAngle.xyz, 1.0);
+    vec4 lightDir = vec4(dirPenumbra.xyz, 0.0);
+
     vec4 surfaceToLight, reflectionvec;
     float constantsdiffuse, constantsspecular;
-    vec4 norm = normalize(vec4(world_normal, 0.0));
-    vec4 directionToCamera = normalize(camPos-vec4(world_position, 1.0));
     float falloff, curr_angle;
     float inner, outer, inten;
     float dist, f_att = 1.;
-    vec4 position = vec4(world_position, 1.0);
 
-    fragColor[0] += ka*shapeColorA[0];
-    fragColor[1] += ka*shapeColorA[1];
-    fragColor[2] += ka*shapeColorA[2];
-    vec4 temp_tex;
+    if (type == 1) {
+        surfaceToLight = normalize(-lightDir);
+    } else {
+        surfaceToLight = normalize(lightPos - position);
+    }
 
-    for (int i = 0; i < 8; i++) {
-        if (i >= lightsNum) continue;
+    inten = 1;
+    if (type == 2) {
+        inner = posAngle.w-dirPenumbra.w;
+        outer = posAngle.w;
+        curr_angle = acos(dot(surfaceToLight, normalize(-lightDir)));
+        if ((curr_angle - inner)/(outer-inner) == 0) falloff = 0.;
+        else falloff = (-2. * pow((curr_angle - inner)/(outer-inner), 3.)) + (3. * pow((curr_angle - inner)/(outer-inner), 2.));
 
-        if (lightTypes[i] == 1) {
-            surfaceToLight = normalize(-lightDirections[i]);
-        }
-        if (lightTypes[i] == 0 || lightTypes[i] == 2) {
-            surfaceToLight = normalize(lightPositions[i] - position);
+        if (curr_angle > inner && curr_angle <= outer) {
+            inten = max(0.0, 1.0 - falloff);
+        } else if (curr_angle > outer) {
+            inten = 0.;
         }
+    }
 
-        inten = 1;
-        if (lightTypes[i] == 2) {
-            inner = lightAngles[i]-lightPenumbras[i];
-            outer = lightAngles[i];
-            curr_angle = acos(dot(surfaceToLight, normalize(-lightDirections[i])));
-            if ((curr_angle - inner)/(outer-inner) == 0) falloff = 0.;
-            else falloff = (-2. * pow((curr_angle - inner)/(outer-inner), 3.)) + (3. * pow((curr_angle - inner)/(outer-inner), 2.));
-
-            if (curr_angle > inner && curr_angle <= outer) {
-                inten = max(0.0, 1.0 - falloff);
-            } else if (curr_angle > outer) {
-                inten = 0.;
-            }
-        }
+    // shadows belong to the first 8 lights
+    if (i == shadowLight) {
+        inten *= cascadeShadow(position.xyz, norm.xyz, surfaceToLight.xyz);
+    } else if (i < 8 && type != 1) {
+        inten *= lightShadow(i, type, lightPos.xyz, position.xyz, norm.xyz, surfaceToLight.xyz);
+    }
 
-        f_att = 1.;
-        if (lightTypes[i] != 1) {
-            dist = length(lightPositions[i] - position);
-            f_att = min(1., 1./(lightFunctions[i].x + dist * lightFunctions[i].y + lightFunctions[i].z * (dist*dist)));
-        }
+    f_att = 1.;
+    if (type != 1) {
+        dist = length(lightPos - position);
+        f_att = min(1., 1./(lightFunction.x + dist * lightFunction.y + lightFunction.z * (dist*dist)));
+    }
 
-        constantsdiffuse = inten * f_att * max(dot(norm, surfaceToLight), 0.f);
-        if (usingTexture) {
-            temp_tex = texture(txt[txtIndex], uv_coord);
-            if (isScrolling) {
-                vec2 uv = uv_coord;
-                vec2 realuv = uv_coord;
-                uv.x += sin(time * 0.1 + uv.y * 1.0) * 0.01;
-                uv.y += cos(time * 0.1 + uv.y * 1.0) * 0.03; // scrolling
-
-                vec4 displacement_tex = texture(noiseMap, 0.2 * uv);
-                realuv.x += displacement_tex[0];
-                realuv.y += displacement_tex[1];
-                temp_tex = texture(txt[txtIndex], realuv);
-
-            } else {
-                temp_tex = texture(txt[txtIndex], uv_coord);
-            }
-            fragColor[0] += lightColors[i].r * constantsdiffuse * (blend*(temp_tex[0]) + (1-blend)*(kd * shapeColorD[0]));
-            fragColor[1] += lightColors[i].g * constantsdiffuse * (blend*(temp_tex[1]) + (1-blend)*(kd * shapeColorD[1]));
-            fragColor[2] += lightColors[i].b * constantsdiffuse * (blend*(temp_tex[2]) + (1-blend)*(kd * shapeColorD[2]));
+    constantsdiffuse = inten * f_att * max(dot(norm, surfaceToLight), 0.f);
+    vec3 result = color.rgb * constantsdiffuse * diffuseColor;
+
+    reflectionvec = -normalize(surfaceToLight - (2. * (dot(surfaceToLight, norm)) * (norm)));
+    float dotprod = dot(directionToCamera, reflectionvec);
+    if (dotprod == 0) constantsspecular = 0.;
+    else if (shininess == 0) constantsspecular = inten * f_att * ks * 1;
+    else constantsspecular = inten * f_att * ks * pow(max(dotprod, 0.0f), max(0.0, shininess));
+    return result + constantsspecular * color.rgb * shapeColorS;
+}
+
+void main() {
+    fragColor = vec4(0.0);
+    vec4 norm = normalize(vec4(world_normal, 0.0));
+    vec4 directionToCamera = normalize(camPos-vec4(world_position, 1.0));
+    vec4 position = vec4(world_position, 1.0);
+
+    fragColor[0] += ka*shapeColorA[0];
+    fragColor[1] += ka*shapeColorA[1];
+    fragColor[2] += ka*shapeColorA[2];
+
+    // the same for every light, so sampled once
+    vec3 diffuseColor = kd * (instanced ? instance_diffuse : shapeColorD);
+    if (usingTexture) {
+        vec4 temp_tex;
+        if (isScrolling) {
+            vec2 uv = uv_coord;
+            vec2 realuv = uv_coord;
+            uv.x += sin(time * 0.1 + uv.y * 1.0) * 0.01;
+            uv.y += cos(time * 0.1 + uv.y * 1.0) * 0.03; // scrolling
+
+            vec4 displacement_tex = texture(noiseMap, 0.2 * uv);
+            realuv.x += displacement_tex[0];
+            realuv.y += displacement_tex[1];
+            temp_tex = texture(txt[txtIndex], realuv);
 
         } else {
-            fragColor[0] += kd * constantsdiffuse * lightColors[i].r * shapeColorD[0];
-            fragColor[1] += kd * constantsdiffuse * lightColors[i].g * shapeColorD[1];
-            fragColor[2] += kd * constantsdiffuse * lightColors[i].b * shapeColorD[2];
+            temp_tex = texture(txt[txtIndex], uv_coord);
         }
+        diffuseColor = blend*temp_tex.rgb + (1-blend)*(kd * shapeColorD);
+    }
 
-        reflectionvec = -normalize(surfaceToLight - (2. * (dot(surfaceToLight, norm)) * (norm)));
-        float dotprod = dot(directionToCamera, reflectionvec);
-        if (dotprod == 0) constantsspecular = 0.;
-        else if (shininess == 0) constantsspecular = inten * f_att * ks * 1;
-        else constantsspecular = inten * f_att * ks * pow(max(dotprod, 0.0f), max(0.0, shininess));
-        fragColor[0] += constantsspecular * lightColors[i][0] * shapeColorS[0];
-        fragColor[1] += constantsspecular * lightColors[i][1] * shapeColorS[1];
-        fragColor[2] += constantsspecular * lightColors[i][2] * shapeColorS[2];
+    for (int g = 0; g < 8; g++) {
+        if (g >= numGlobalLights) break;
+        fragColor.rgb += shadeLight(globalLights[g], diffuseColor, norm, directionToCamera, position);
+    }
 
+    float viewDepth = -(view * position).z;
+    ivec3 cell = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(log(max(viewDepth, 1e-4)) * clusterDepthScale + clusterDepthBias));
+    cell = clamp(cell, ivec3(0), clusterCounts - 1);
+    int cluster = clusterGridBase + 2 * ((cell.z * clusterCounts.y + cell.y) * clusterCounts.x + cell.x);
+    uint first = texelFetch(clusterData, cluster).r;
+    uint count = texelFetch(clusterData, cluster + 1).r;
+    for (uint k = 0u; k < count; k++) {
+        int i = int(texelFetch(clusterData, int(first + k)).r);
+        fragColor.rgb += shadeLight(i, diffuseColor, norm, directionToCamera, position);
     }
 
     fragColor.r = min(max(fragColor.r, 0.0), 1.0);
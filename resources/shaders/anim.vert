@@ -5,20 +5,31 @@ layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texcoords;
 layout(location = 3) in vec4 joints; // changed from ivec
 layout(location = 4) in vec4 weights;
+// per instance, for the L-system branches
+layout(location = 5) in mat4 instanceModel; // locations 5 to 8
+layout(location = 9) in vec4 instanceDiffuse;
 
 out vec3 world_position;
 out vec3 world_normal;
 out vec2 uv_coord;
+flat out vec3 instance_diffuse;
 
 uniform mat4 model;
 uniform mat4 model_inv_trans;
 
 uniform mat4 view;
 uniform mat4 proj;
-uniform mat4 finalBoneMatrices[100];
+layout(std140) uniform Bones {
+    mat4 finalBoneMatrices[100];
+};
 uniform int animating;
 uniform int numBones;
 uniform bool usingTexture;
+uniform bool instanced; // take the model matrix and diffuse color from the instance attributes
+// instance i is placed by plant plantBase + i % plantCount, 4 texels per matrix
+uniform samplerBuffer plants;
+uniform int plantBase;
+uniform int plantCount;
 
 void main() {
     // compute the world-space position and normal, then pass them to the fragment shader
@@ -31,32 +42,41 @@ void main() {
     if (animating == 1 && numBones > 0 && joints[0] < numBones && joints[1] < numBones && joints[2] < numBones && joints[3] < numBones) {
         if (weights[0] != 0 || weights[1] != 0 || weights[2] != 0 || weights[3] != 0) {
             // normalize?
-        temp_pos = weights[0] * (finalBoneMatrices[int(joints[0])] * temp_pos)
-                    + weights[1] * (finalBoneMatrices[int(joints[1])] * temp_pos)
-                    + weights[2] * (finalBoneMatrices[int(joints[2])] * temp_pos)
-                    + weights[3] * (finalBoneMatrices[int(joints[3])] * temp_pos);
+            mat4 skin = weights[0] * finalBoneMatrices[int(joints[0])]
+                        + weights[1] * finalBoneMatrices[int(joints[1])]
+                        + weights[2] * finalBoneMatrices[int(joints[2])]
+                        + weights[3] * finalBoneMatrices[int(joints[3])];
+            temp_pos = skin * temp_pos;
+            // the normal blends with the same weights and joints as the position
+            temp_normal = skin * temp_normal;
         }
         temp_pos[3] = 1.0;
-        // do normal next
-        temp_normal = (weights[0] * finalBoneMatrices[int(joints[0])]
-                + weights[0] * finalBoneMatrices[int(joints[0])]
-                + weights[0] * finalBoneMatrices[int(joints[0])]
-                + weights[0] * finalBoneMatrices[int(joints[0])]) * temp_normal;
     }
 
 
-    vec4 new_pos = vec4(model * temp_pos);
+    mat4 model_matrix = model;
+    mat4 normal_matrix = model_inv_trans;
+    if (instanced) {
+        int plant = 4 * (plantBase + gl_InstanceID % plantCount);
+        mat4 plant_matrix = mat4(texelFetch(plants, plant), texelFetch(plants, plant + 1),
+                                 texelFetch(plants, plant + 2), texelFetch(plants, plant + 3));
+        model_matrix = plant_matrix * instanceModel;
+        normal_matrix = mat4(transpose(inverse(mat3(model_matrix))));
+        instance_diffuse = instanceDiffuse.rgb;
+    }
+
+    vec4 new_pos = vec4(model_matrix * temp_pos);
 
     world_position = new_pos.xyz;
 
 
-    vec4 new_norm = (model_inv_trans * temp_normal);
+    vec4 new_norm = (normal_matrix * temp_normal);
     new_norm.w = 0;
     new_norm = normalize(new_norm);
 
     world_normal = new_norm.xyz;
 
     // set gl_Position to the object space position transformed to clip space
-    new_pos = vec4(proj * view * model * temp_pos);
+    new_pos = vec4(proj * view * model_matrix * temp_pos);
     gl_Position = new_pos;
 }
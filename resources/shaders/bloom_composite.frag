@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec2 screenUV;
+out vec4 fragColor;
+
+uniform sampler2D sceneTex;
+uniform sampler2D bloomTex;
+uniform vec2 sceneScale;    // extent of the image inside each pooled texture
+uniform vec2 bloomScale;
+uniform float intensity;
+
+void main()
+{
+    vec4 sceneColor = texture(sceneTex, screenUV * sceneScale);
+    vec3 bloom = texture(bloomTex, screenUV * bloomScale).rgb;
+    fragColor = vec4(sceneColor.rgb + intensity * bloom, sceneColor.a);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+in vec2 uv;
+
+uniform sampler2D txt;
+uniform float threshold;
+
+out vec4 fragColor;
+
+void main()
+{
+    // drawn at half resolution, so the linear fetch also averages the 2x2 pixels under it
+    vec3 color = texture(txt, uv).rgb;
+    float brightness = max(color.r, max(color.g, color.b));
+    // only what is over the threshold, scaled down evenly so it keeps its hue
+    float over = max(brightness - threshold, 0.0);
+    fragColor = vec4(color * (over / max(brightness, 1e-4)), 1.0);
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+in vec2 uv;
+
+uniform sampler2D txt;
+uniform vec2 uvScale;
+uniform vec2 texelSize;
+
+// xy: offset in pixels, z: weight. Taps of term t are [tapStart[t], tapStart[t + 1]);
+// a 2D kernel is a single term, a separable one runs one pass per term
+const int MAX_TAPS = 128;
+uniform vec4 taps[MAX_TAPS];
+uniform int tapStart[5];
+uniform int term;
+
+out vec4 fragColor;
+
+void main()
+{
+    // stay inside the image, the pooled texture can be larger
+    vec2 lo = 0.5 * texelSize;
+    vec2 hi = uvScale - 0.5 * texelSize;
+
+    vec4 sum = vec4(0.0);
+    for (int i = tapStart[term]; i < tapStart[term + 1]; i++) {
+        sum += taps[i].z * texture(txt, clamp(uv + taps[i].xy * texelSize, lo, hi));
+    }
+    fragColor = sum;
+}
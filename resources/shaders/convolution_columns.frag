@@ -0,0 +1,41 @@
+#version 330 core
+
+in vec2 screenUV;
+
+// horizontally filtered image of each separable term
+uniform sampler2D rows0;
+uniform sampler2D rows1;
+uniform sampler2D rows2;
+uniform sampler2D rows3;
+uniform vec2 termUVScale[4];
+uniform vec2 termTexelSize[4];
+uniform int numTerms;
+
+const int MAX_TAPS = 128;
+uniform vec4 taps[MAX_TAPS];
+uniform int tapStart[5];
+
+out vec4 fragColor;
+
+vec4 filterColumn(sampler2D rows, int term)
+{
+    vec2 texel = termTexelSize[term];
+    vec2 lo = 0.5 * texel;
+    vec2 hi = termUVScale[term] - 0.5 * texel;
+    vec2 uv = screenUV * termUVScale[term];
+
+    vec4 sum = vec4(0.0);
+    for (int i = tapStart[term]; i < tapStart[term + 1]; i++) {
+        sum += taps[i].z * texture(rows, clamp(uv + taps[i].xy * texel, lo, hi));
+    }
+    return sum;
+}
+
+void main()
+{
+    vec4 sum = filterColumn(rows0, 0);
+    if (numTerms > 1) sum += filterColumn(rows1, 1);
+    if (numTerms > 2) sum += filterColumn(rows2, 2);
+    if (numTerms > 3) sum += filterColumn(rows3, 3);
+    fragColor = sum;
+}
@@ -13,6 +13,7 @@ uniform float weight;             // Ray weight
 uniform int numSamples;           // Number of samples along ray
 uniform vec2 screenSize;          // Screen dimensions
 uniform float facing;             // How much camera faces light (0-1)
+uniform vec2 uvScale;             // Extent of the image inside the (pooled) input textures
 
 void main() {
     // Sample the scene color
@@ -25,7 +26,7 @@ void main() {
     }
 
     // Calculate vector from current pixel to light position
-    vec2 deltaTexCoord = uv - lightScreenPos;
+    vec2 deltaTexCoord = uv - lightScreenPos * uvScale;
 
     // Divide by number of samples and scale by density
     deltaTexCoord *= 1.0 / float(numSamples) * density;
@@ -44,8 +45,8 @@ void main() {
         samplePos -= deltaTexCoord;
 
         // Only sample if within texture bounds
-        if (samplePos.x < 0.0 || samplePos.x > 1.0 ||
-            samplePos.y < 0.0 || samplePos.y > 1.0) {
+        if (samplePos.x < 0.0 || samplePos.x > uvScale.x ||
+            samplePos.y < 0.0 || samplePos.y > uvScale.y) {
             break;
         }
 
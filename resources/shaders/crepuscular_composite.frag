@@ -0,0 +1,47 @@
+#version 330 core
+
+in vec2 screenUV;
+out vec4 fragColor;
+
+uniform sampler2D sceneTex;
+uniform sampler2D raysTex;
+uniform sampler2D depthTex;
+uniform vec2 sceneScale;          // Extent of the image inside each pooled texture
+uniform vec2 raysScale;
+uniform vec2 depthScale;
+uniform vec2 raysSize;            // Size of the low-resolution ray image in texels
+uniform vec2 projParams;          // proj[2][2], proj[3][2]
+
+float viewDistance(vec2 uv) {
+    float ndc = texture(depthTex, uv * depthScale).r * 2.0 - 1.0;
+    return projParams.y / (ndc + projParams.x);
+}
+
+// Joint bilateral upsample: the four nearest low-resolution texels are blended bilinearly,
+// but each is down-weighted by how far its depth is from this pixel's, so rays computed
+// on a background texel do not bleed over a foreground edge (and vice versa).
+void main() {
+    vec4 sceneColor = texture(sceneTex, screenUV * sceneScale);
+    float centerDistance = viewDistance(screenUV);
+
+    vec2 texel = screenUV * raysSize - 0.5;
+    vec2 base = floor(texel);
+    vec2 f = texel - base;
+
+    vec3 rays = vec3(0.0);
+    float totalWeight = 0.0;
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+            // clamped so the border never reads past the image into the rest of the pooled texture
+            vec2 lowUV = clamp(base + vec2(i, j), vec2(0.0), raysSize - 1.0) / raysSize + 0.5 / raysSize;
+            float bilinear = ((i == 0) ? 1.0 - f.x : f.x) * ((j == 0) ? 1.0 - f.y : f.y);
+            float relativeGap = abs(viewDistance(lowUV) - centerDistance) / centerDistance;
+            float w = bilinear / (relativeGap * 50.0 + 0.01);
+            rays += texture(raysTex, lowUV * raysScale).rgb * w;
+            totalWeight += w;
+        }
+    }
+    rays /= max(totalWeight, 1e-5);
+
+    fragColor = vec4(sceneColor.rgb + rays, sceneColor.a);
+}
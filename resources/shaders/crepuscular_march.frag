@@ -0,0 +1,46 @@
+#version 330 core
+
+in vec2 screenUV;
+out vec4 fragColor;
+
+uniform sampler2D maskTex;
+uniform vec2 maskScale;           // Extent of the image inside the pooled mask texture
+uniform vec2 lightScreenPos;      // Light position in screen space [0,1]
+uniform float exposure;           // Ray intensity
+uniform float decay;              // Ray decay factor, per step
+uniform float density;            // Ray density
+uniform float weight;             // Ray weight, per step
+uniform int numSamples;           // Number of samples along ray
+uniform float facing;             // How much camera faces light (0-1)
+
+void main() {
+    // Early exit if camera is facing away from light
+    if (facing < 0.1) {
+        fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    vec2 deltaTexCoord = (screenUV - lightScreenPos) * density / float(numSamples);
+
+    // Interleaved sampling: the four pixels of each 2x2 block start a quarter step
+    // apart, so between them they sample the ray four times as densely. The upsample
+    // gathers a 2x2 block, which puts the offsets back together.
+    ivec2 cell = ivec2(gl_FragCoord.xy) & 1;
+    float offset = float(cell.x) * 0.5 + float(cell.y) * 0.25;
+    vec2 samplePos = screenUV - deltaTexCoord * offset;
+
+    float illuminationDecay = 1.0;
+    vec3 rayColor = vec3(0.0);
+    for (int i = 0; i < numSamples; i++) {
+        samplePos -= deltaTexCoord;
+        if (samplePos.x < 0.0 || samplePos.x > 1.0 ||
+            samplePos.y < 0.0 || samplePos.y > 1.0) {
+            break;
+        }
+        rayColor += texture(maskTex, samplePos * maskScale).rgb * illuminationDecay;
+        illuminationDecay *= decay;
+    }
+
+    // 4.0 undoes the mask's packing
+    fragColor = vec4(rayColor * 4.0 * weight * exposure * facing, 1.0);
+}
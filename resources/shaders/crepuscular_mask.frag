@@ -0,0 +1,25 @@
+#version 330 core
+
+in vec2 screenUV;
+out vec4 fragColor;
+
+uniform sampler2D sceneTex;
+uniform sampler2D depthTex;
+uniform vec2 sceneScale;          // Extent of the image inside each pooled texture
+uniform vec2 depthScale;
+
+// What each ray step in crepuscular.frag adds before decay, computed once per
+// low-resolution texel here instead of once per step per pixel.
+void main() {
+    vec4 sceneColor = texture(sceneTex, screenUV * sceneScale);
+    float depth = texture(depthTex, screenUV * depthScale).r;
+
+    // Enhance effect for pixels that are far away (sky)
+    // or very bright
+    float brightness = dot(sceneColor.rgb, vec3(0.299, 0.587, 0.114));
+    float depthFactor = (depth > 0.9999) ? 2.0 : 1.0;
+    float brightnessFactor = smoothstep(0.5, 1.0, brightness);
+
+    // Divided by the largest factor (2 * 2) so it fits an 8-bit target; the march scales it back
+    fragColor = vec4(sceneColor.rgb * depthFactor * (1.0 + brightnessFactor) * 0.25, 1.0);
+}
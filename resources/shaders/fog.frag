@@ -1,33 +1,53 @@
 #version 330 core
 in vec2 uv;
+in vec2 screenUV;
 
 uniform sampler2D txt;
-uniform sampler2D depthTexture;
+uniform sampler2D depthTex;
+uniform vec2 depthScale;    // extent of the image inside the (pooled) depth texture
+
+uniform mat4 invProj;
+uniform mat4 viewInv;
+uniform vec3 camPos;
+uniform vec3 sunDir;        // towards the sun, zero if there is none
+
+uniform vec3 fogColor;
+uniform vec3 sunColor;
 uniform float density;
+uniform float heightDensity;
+uniform float heightFalloff;
+uniform float baseHeight;
+uniform float sunExponent;
+uniform float skyDistance;
 
 out vec4 fragColor;
 
-float LinearizeDepth(float z)
-{
-    float n = 0.1;  // near plane
-    float f = 100.0; // far plane
-    return (2.0 * n) / (f + n - z * (f - n));
-}
-
 void main()
 {
     vec4 sceneColor = texture(txt, uv);
-    //float depth = LinearizeDepth(texture(depthTexture, uv).r);
-    vec4 depth = texture(depthTexture, uv);
-    float fogMaxDist = 8.0;
-    float fogMinDist = 0.1;
-    vec4  fogColor = vec4(0.4, 0.4, 0.4, 1.0);
-
-    // Calculate fog
-    //float fogFactor = (fogMaxDist - depth) / (fogMaxDist - fogMinDist);
-    //fogFactor = clamp(fogFactor, 0.0, 1.0);
-
-    //fragColor = mix(fogColor, sceneColor, fogFactor);
-    fragColor = 100 * vec4(depth.r);
-    //fragColor = sceneColor;
+    float depth = texture(depthTex, screenUV * depthScale).r;
+
+    // view-space position of this pixel
+    vec4 viewPos = invProj * vec4(vec3(screenUV, depth) * 2.0 - 1.0, 1.0);
+    viewPos /= viewPos.w;
+    vec3 rayDir = normalize(mat3(viewInv) * viewPos.xyz);
+    float dist = (depth >= 1.0) ? skyDistance : length(viewPos.xyz);
+
+    // exponential fog: constant density along the ray
+    float opticalDepth = density * dist;
+
+    // height fog: density heightDensity * exp(-falloff * (y - baseHeight)), integrated
+    // in closed form along the ray from the camera
+    float dy = rayDir.y * dist;
+    float start = heightDensity * exp(-heightFalloff * (camPos.y - baseHeight));
+    float k = heightFalloff * dy;
+    float integral = (abs(k) > 1e-4) ? (1.0 - exp(-k)) / k : 1.0;
+    opticalDepth += start * integral * dist;
+
+    // volumetric in-scattering: the fog looks brighter looking towards the sun
+    float sunAmount = pow(max(dot(rayDir, sunDir), 0.0), sunExponent);
+    vec3 inscatter = mix(fogColor, sunColor, sunAmount);
+
+    float transmittance = exp(-opticalDepth);
+    fragColor = vec4(mix(inscatter, sceneColor.rgb, transmittance), sceneColor.a);
 }
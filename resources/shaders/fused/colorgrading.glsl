@@ -0,0 +1,8 @@
+// Fused form of colorgrading.frag
+uniform sampler3D colorgrade_tLUT;
+uniform float colorgrade_slices;
+
+vec4 colorgrade(vec4 color, vec2 uv)
+{
+    return vec4(sampleLUT(colorgrade_tLUT, colorgrade_slices, color.rgb), 1.0);
+}
@@ -0,0 +1,40 @@
+// Fused form of fog.frag; the fused pass reads the scene target for the depth
+uniform sampler2D fog_depthTex;
+uniform vec2 fog_depthScale;
+
+uniform mat4 fog_invProj;
+uniform mat4 fog_viewInv;
+uniform vec3 fog_camPos;
+uniform vec3 fog_sunDir;
+
+uniform vec3 fog_fogColor;
+uniform vec3 fog_sunColor;
+uniform float fog_density;
+uniform float fog_heightDensity;
+uniform float fog_heightFalloff;
+uniform float fog_baseHeight;
+uniform float fog_sunExponent;
+uniform float fog_skyDistance;
+
+vec4 fog(vec4 color, vec2 uv)
+{
+    float depth = texture(fog_depthTex, screenUV * fog_depthScale).r;
+
+    vec4 viewPos = fog_invProj * vec4(vec3(screenUV, depth) * 2.0 - 1.0, 1.0);
+    viewPos /= viewPos.w;
+    vec3 rayDir = normalize(mat3(fog_viewInv) * viewPos.xyz);
+    float dist = (depth >= 1.0) ? fog_skyDistance : length(viewPos.xyz);
+
+    float opticalDepth = fog_density * dist;
+    float dy = rayDir.y * dist;
+    float start = fog_heightDensity * exp(-fog_heightFalloff * (fog_camPos.y - fog_baseHeight));
+    float k = fog_heightFalloff * dy;
+    float integral = (abs(k) > 1e-4) ? (1.0 - exp(-k)) / k : 1.0;
+    opticalDepth += start * integral * dist;
+
+    float sunAmount = pow(max(dot(rayDir, fog_sunDir), 0.0), fog_sunExponent);
+    vec3 inscatter = mix(fog_fogColor, fog_sunColor, sunAmount);
+
+    float transmittance = exp(-opticalDepth);
+    return vec4(mix(inscatter, color.rgb, transmittance), color.a);
+}
@@ -0,0 +1,6 @@
+// Shared by the fused color grading stages: looks a color up in a slices^3 LUT,
+// mapping [0,1] onto the centers of its first and last texels.
+vec3 sampleLUT(sampler3D lut, float slices, vec3 color)
+{
+    return texture(lut, color * ((slices - 1.0) / slices) + 0.5 / slices).rgb;
+}
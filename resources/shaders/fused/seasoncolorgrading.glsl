@@ -0,0 +1,8 @@
+// Fused form of seasoncolorgrading.frag
+uniform sampler3D seasonColorgrade_tLUT;
+uniform float seasonColorgrade_slices;
+
+vec4 seasonColorgrade(vec4 color, vec2 uv)
+{
+    return vec4(sampleLUT(seasonColorgrade_tLUT, seasonColorgrade_slices, color.rgb), 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+// Writes one layer of a size^3 LUT that is the mix of two others, so the grading
+// pass only needs a single lookup.
+
+uniform sampler3D tLUT1;
+uniform float slices1;
+uniform sampler3D tLUT2;
+uniform float slices2;
+uniform float alpha;
+uniform float size;
+uniform int layer;
+
+out vec4 fragColor;
+
+vec3 lookup(sampler3D lut, float slices, vec3 color)
+{
+    return texture(lut, color * ((slices - 1.0) / slices) + 0.5 / slices).rgb;
+}
+
+void main()
+{
+    vec3 color = vec3(floor(gl_FragCoord.xy), float(layer)) / (size - 1.0);
+    vec3 colF1 = lookup(tLUT1, slices1, color);
+    vec3 colF2 = lookup(tLUT2, slices2, color);
+    fragColor = vec4(alpha * colF2 + (1.0 - alpha) * colF1, 1.0);
+}
@@ -2,18 +2,24 @@
 //in vec3 worldSpacePosition;
 in vec4 particleColor;
 in vec2 UVCoords;
+flat in float layer;
 
 out vec4 color;
 
-uniform sampler2D sprite;
+// one layer per sprite file used by the scene's emitters
+uniform sampler2DArray sprites;
 
 void main()
 {
-    //color = (texture(sprite, TexCoords) * ParticleColor);
+    if (layer >= 0) {
+        color = texture(sprites, vec3(UVCoords, layer)) * particleColor;
+        if (color.a <= 0.01) discard;
+        return;
+    }
+
     vec2 p = UVCoords * 2.0 - 1.0;
     float d = dot(p, p);
     float alpha = 1;
-    vec4 tempColor = vec4(0.8, 0.7, 0.2, 1);
 
     if (d >= 1) {
         discard;
@@ -24,6 +30,6 @@ void main()
     // smooth circular edge
     //alpha = 1.0 - smoothstep(0.5, 1.0, sqrt(d));
 
-    color = vec4(tempColor.rgb, alpha);
+    color = vec4(particleColor.rgb, particleColor.a * alpha);
     //color = vec4(alpha);
 }
@@ -3,10 +3,12 @@ layout (location = 2) in vec3 billboard; // <individual vertices>
 layout (location = 3) in vec4 posAndSize; // <vec3 position, scalar size>
 layout (location = 4) in vec4 color; // <rgba>
 layout (location = 5) in vec2 uv;
+layout (location = 6) in float spriteLayer; // -1 for a round dot
 
 //out vec3 worldSpacePosition;
 out vec4 particleColor;
 out vec2 UVCoords;
+flat out float layer;
 
 //uniform mat4 projection;
 //uniform vec2 offset;
@@ -27,6 +29,7 @@ void main()
     particleColor = color;
     //UVCoords = posAndSize.xy + vec2(0.5);
     UVCoords = uv;
+    layer = spriteLayer;
 
     vec3 camRight = vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
     vec3 camUp = vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
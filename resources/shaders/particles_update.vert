@@ -0,0 +1,52 @@
+#version 330 core
+
+// one particle per vertex: read from one state buffer, captured into the other
+layout(location = 0) in vec4 posSize; // xyz position, w size
+layout(location = 1) in vec4 velLife; // xyz velocity, w remaining life in seconds
+
+out vec4 outPosSize;
+out vec4 outVelLife;
+
+// uniform ranges new particles are drawn from, and this step's physics
+layout(std140) uniform Emitter {
+    vec4 positionMin;
+    vec4 positionMax;
+    vec4 velocityMin;
+    vec4 velocityMax;
+    vec4 sizeLife;     // size min, size max, life min, life max
+    vec4 acceleration; // xyz, w unused
+    vec4 step;         // x dt, y velocity scale, z velocity kept after drag
+    uvec4 seed;        // x changes every frame
+};
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// uniform in [0, 1), a different stream per particle, per frame and per k
+float random(uint k) {
+    return float(hash(uint(gl_VertexID) * 8u + k + hash(seed.x)) >> 8) / 16777216.0;
+}
+
+void main() {
+    float dt = step.x;
+    float life = velLife.w - dt;
+
+    if (life > 0.0) {
+        // same integration as the CPU pool: velocity first, then position with the new velocity
+        vec3 velocity = (velLife.xyz + acceleration.xyz * dt) * step.z;
+        outPosSize = vec4(posSize.xyz + velocity * dt * step.y, posSize.w);
+        outVelLife = vec4(velocity, life);
+    } else {
+        // dead particles come straight back, so the pool stays full
+        vec3 position = mix(positionMin.xyz, positionMax.xyz, vec3(random(0u), random(1u), random(2u)));
+        vec3 velocity = mix(velocityMin.xyz, velocityMax.xyz, vec3(random(3u), random(4u), random(5u)));
+        outPosSize = vec4(position, mix(sizeLife.x, sizeLife.y, random(6u)));
+        outVelLife = vec4(velocity, mix(sizeLife.z, sizeLife.w, random(7u)));
+    }
+}
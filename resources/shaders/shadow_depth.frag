@@ -1,5 +1,6 @@
-// #version 330 core
-// void main()
-// {
-//     // Fragment shader for depth only – nothing needed
-// }
+#version 330 core
+
+void main()
+{
+    // depth only
+}
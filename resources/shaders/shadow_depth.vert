@@ -1,9 +1,31 @@
-// #version 330 core
-// layout(location = 0) in vec3 aPos;
+#version 330 core
 
-// uniform mat4 model;
-// uniform mat4 lightSpace;
+layout(location = 0) in vec3 position;
+layout(location = 3) in vec4 joints;
+layout(location = 4) in vec4 weights;
 
-// void main() {
-//     gl_Position = lightSpace * model * vec4(aPos, 1.0);
-// }
+uniform mat4 model;
+uniform mat4 lightSpace;
+layout(std140) uniform Bones {
+    mat4 finalBoneMatrices[100];
+};
+uniform int animating;
+uniform int numBones;
+
+void main() {
+    vec4 pos = vec4(position, 1.0);
+
+    // same skinning as anim.vert, so animated casters match what the camera sees
+    if (animating == 1 && numBones > 0 && joints[0] < numBones && joints[1] < numBones && joints[2] < numBones && joints[3] < numBones) {
+        if (weights[0] != 0 || weights[1] != 0 || weights[2] != 0 || weights[3] != 0) {
+            mat4 skin = weights[0] * finalBoneMatrices[int(joints[0])]
+                        + weights[1] * finalBoneMatrices[int(joints[1])]
+                        + weights[2] * finalBoneMatrices[int(joints[2])]
+                        + weights[3] * finalBoneMatrices[int(joints[3])];
+            pos = skin * pos;
+        }
+        pos[3] = 1.0;
+    }
+
+    gl_Position = lightSpace * model * pos;
+}
@@ -1,13 +1,11 @@
-// #version 330 core
+#version 330 core
 
-// layout(location = 0) out float FragDistance;
+in vec4 gWorldPos;
 
-// in vec4 vWorldPos;
+uniform vec3 lightPos;
+uniform float farPlane;
 
-// uniform vec3 lightPos;
-// uniform float farPlane;
-
-// void main() {
-//     float dist = length(vWorldPos.xyz - lightPos);
-//     FragDistance = dist / farPlane; // normalized [0,1]
-// }
+void main() {
+    // linear distance, so lookups along any direction compare against the same scale
+    gl_FragDepth = length(gWorldPos.xyz - lightPos) / farPlane;
+}
@@ -6,10 +6,16 @@ layout (location = 1) in vec2 uv_buffer;
 
 // Task 16: create an "out" variable representing a UV coordinate
 out vec2 uv;
+// unscaled [0,1] position on screen, for passes that read targets of different sizes
+out vec2 screenUV;
+
+// the input texture may be larger than the image in it (see RenderTargetPool)
+uniform vec2 uvScale;
 
 void main() {
     // Task 16: assign the UV layout variable to the UV "out" variable
-    uv = uv_buffer;
+    uv = uv_buffer * uvScale;
+    screenUV = uv_buffer;
 
     gl_Position = vec4(position, 1.0);
 }
@@ -3,42 +3,147 @@
 #include <QCoreApplication>
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
 #include "settings.h"
 #include "utils/shaderloader.h"
 #include <glm/gtx/transform.hpp>
 
+namespace {
+// largest gap between the tessellation and the true unit-diameter surface (the chord sagitta)
+float tessellationError(PrimitiveType type, int param1, int param2) {
+    const float radius = 0.5f;
+    switch (type) {
+    case PrimitiveType::PRIMITIVE_SPHERE: {
+        float stackAngle = M_PI / std::max(2, param1);
+        float sliceAngle = 2.f * M_PI / std::max(3, param2);
+        return radius * (1.f - std::cos(std::max(stackAngle, sliceAngle) / 2.f));
+    }
+    case PrimitiveType::PRIMITIVE_CONE:
+    case PrimitiveType::PRIMITIVE_CYLINDER:
+        // param1 only splits flat faces, so the slices are the whole error
+        return radius * (1.f - std::cos(M_PI / std::max(3, param2)));
+    default:
+        // the cube is exact at any subdivision
+        return 0.f;
+    }
+}
+}
+
 void Realtime::buildGeometry() {
-    glGenBuffers(1, &m_sphereIds->shape_vbo);
-    glGenVertexArrays(1, &m_sphereIds->shape_vao);
-    m_sphere->updateParams(settings.shapeParameter1, settings.shapeParameter2);
-    setupPrimitives(m_sphereIds, m_sphere->generateShape(), false, false);
-
-    glGenBuffers(1, &m_cubeIds->shape_vbo);
-    glGenVertexArrays(1, &m_cubeIds->shape_vao);
-    m_cube->updateParams(settings.shapeParameter1);
-    setupPrimitives(m_cubeIds, m_cube->generateShape(), false, false);
-
-    glGenBuffers(1, &m_coneIds->shape_vbo);
-    glGenVertexArrays(1, &m_coneIds->shape_vao);
-    m_cone->updateParams(settings.shapeParameter1, settings.shapeParameter2);
-    setupPrimitives(m_coneIds, m_cone->generateShape(), false, true);
-
-    glGenBuffers(1, &m_cylinderIds->shape_vbo);
-    glGenVertexArrays(1, &m_cylinderIds->shape_vao);
-    m_cylinder->updateParams(settings.shapeParameter1, settings.shapeParameter2);
-    setupPrimitives(m_cylinderIds, m_cylinder->generateShape(), false, true);
+    acquirePrimitiveLods();
 
-    setupLSystems();
+    // the L-system leaves borrow the particle billboard
     setupParticles();
+    setupLSystems();
 
     setupSkybox();
 }
 
+VboVao* Realtime::acquirePrimitive(PrimitiveType type, int param1, int param2) {
+    PrimitiveKey key{type, param1, param2};
+    auto found = m_primitiveCache.find(key);
+    if (found != m_primitiveCache.end()) {
+        // scrubbing back to a tessellation we have already uploaded
+        found->second.lastUsed = ++m_primitiveCacheClock;
+        return &found->second.ids;
+    }
+
+    if ((int)m_primitiveCache.size() >= MAX_CACHED_PRIMITIVES) {
+        // evict the least recently used entry that is not currently on screen
+        auto victim = m_primitiveCache.end();
+        for (auto it = m_primitiveCache.begin(); it != m_primitiveCache.end(); it++) {
+            if (isPrimitiveInUse(&it->second.ids)) continue;
+            if (victim == m_primitiveCache.end() || it->second.lastUsed < victim->second.lastUsed) victim = it;
+        }
+        if (victim != m_primitiveCache.end()) {
+            glDeleteBuffers(1, &victim->second.ids.shape_vbo);
+            glDeleteBuffers(1, &victim->second.ids.shape_ebo);
+            glDeleteVertexArrays(1, &victim->second.ids.shape_vao);
+            m_primitiveCache.erase(victim);
+        }
+    }
+
+    CachedPrimitive& entry = m_primitiveCache[key];
+    entry.lastUsed = ++m_primitiveCacheClock;
+    switch (type) {
+    case PrimitiveType::PRIMITIVE_SPHERE:
+        m_sphere->updateParams(param1, param2);
+        setupIndexedPrimitive(&entry.ids, m_sphere->generateShape(), m_sphere->generateIndices(), false);
+        break;
+    case PrimitiveType::PRIMITIVE_CUBE:
+        m_cube->updateParams(param1);
+        setupIndexedPrimitive(&entry.ids, m_cube->generateShape(), m_cube->generateIndices(), false);
+        break;
+    case PrimitiveType::PRIMITIVE_CONE:
+        m_cone->updateParams(param1, param2);
+        setupIndexedPrimitive(&entry.ids, m_cone->generateShape(), m_cone->generateIndices(), true);
+        break;
+    case PrimitiveType::PRIMITIVE_CYLINDER:
+        m_cylinder->updateParams(param1, param2);
+        setupIndexedPrimitive(&entry.ids, m_cylinder->generateShape(), m_cylinder->generateIndices(), true);
+        break;
+    default:
+        break;
+    }
+    return &entry.ids;
+}
+
+void Realtime::acquirePrimitiveLods() {
+    const PrimitiveType types[] = {PrimitiveType::PRIMITIVE_SPHERE, PrimitiveType::PRIMITIVE_CUBE,
+                                   PrimitiveType::PRIMITIVE_CONE, PrimitiveType::PRIMITIVE_CYLINDER};
+    for (PrimitiveType type: types) {
+        // each level halves both parameters; the shapes clamp them to their own minimums
+        for (int level = 0; level < PRIMITIVE_LOD_LEVELS; level++) {
+            int param1 = std::max(1, settings.shapeParameter1 >> level);
+            int param2 = (type == PrimitiveType::PRIMITIVE_CUBE) ? 0 : std::max(1, settings.shapeParameter2 >> level);
+            PrimitiveLod& lod = m_primitiveLods[type][level];
+            lod.ids = acquirePrimitive(type, param1, param2);
+            lod.error = tessellationError(type, param1, param2);
+        }
+    }
+}
+
+bool Realtime::isPrimitiveInUse(const VboVao* ids) const {
+    for (auto &[type, chain]: m_primitiveLods) {
+        for (const PrimitiveLod& lod: chain) {
+            if (lod.ids == ids) return true;
+        }
+    }
+    return false;
+}
+
+void Realtime::deletePrimitiveCache() {
+    for (auto &[key, entry]: m_primitiveCache) {
+        glDeleteBuffers(1, &entry.ids.shape_vbo);
+        glDeleteBuffers(1, &entry.ids.shape_ebo);
+        glDeleteVertexArrays(1, &entry.ids.shape_vao);
+    }
+    m_primitiveCache.clear();
+    m_primitiveLods.clear();
+}
+
+void Realtime::setupIndexedPrimitive(VboVao* shape_ids, const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices, bool texturing) {
+    glGenBuffers(1, &shape_ids->shape_vbo);
+    glGenBuffers(1, &shape_ids->shape_ebo);
+    glGenVertexArrays(1, &shape_ids->shape_vao);
+    setupPrimitives(shape_ids, vertices, false, texturing);
+
+    // the element buffer binding is VAO state, so attach it while the VAO is bound
+    glBindVertexArray(shape_ids->shape_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape_ids->shape_ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    shape_ids->num_indices = indices.size();
+}
+
 void Realtime::setupLSystems() {
     Cylinder unitCylinder;
     unitCylinder.updateParams(2, 3);
     m_LcylinderData = unitCylinder.generateShape();
+    m_LcylinderIndexCount = unitCylinder.generateIndices().size();
 
     // Generate, and bind vao
     glGenVertexArrays(1, &m_vaoLcylinder);
@@ -58,39 +163,78 @@ void Realtime::setupLSystems() {
 
     // Enable and define attribute 1 to store normals
 
+    glGenBuffers(1, &m_eboLcylinder);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_eboLcylinder);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_LcylinderIndexCount * sizeof(GLuint), unitCylinder.generateIndices().data(), GL_STATIC_DRAW);
+
+    // One model matrix (attributes 5 to 8, a column each) and diffuse color (9) per branch,
+    // filled by paintLSystems whenever the plants are grown; it points them at each batch
+    glGenBuffers(1, &m_vboLinstances);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vboLinstances);
+    for (int column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(5 + column);
+        glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(LSystemInstance),
+                              reinterpret_cast<void *>(offsetof(LSystemInstance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(5 + column, 1);
+    }
+    glEnableVertexAttribArray(9);
+    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(LSystemInstance), reinterpret_cast<void *>(offsetof(LSystemInstance, diffuse)));
+    glVertexAttribDivisor(9, 1);
+
+    // the plants sharing the branches, read by anim.vert
+    m_LSystemPlants.upload(GL_RGBA32F, nullptr, 0, GL_STATIC_DRAW);
+    glUseProgram(m_shader);
+    glUniform1i(glGetUniformLocation(m_shader, "plants"), LSYSTEM_PLANT_TEXTURE_UNIT);
+    glUseProgram(0);
+
     // Clean-up bindings
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // The leaves use the particle billboard, with their own positions, sizes and colors
+    glGenVertexArrays(1, &m_vaoLleaves);
+    glBindVertexArray(m_vaoLleaves);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesBillboard);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+    glGenBuffers(1, &m_vboLleaves);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vboLleaves);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4 * sizeof(GLubyte), (void*)0);
+    glVertexAttribDivisor(4, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesUV);
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // the diffuse color comes from each plant
+    m_LSystemMaterial.cAmbient = glm::vec4(1, 1, 1, 1);
+    m_LSystemMaterial.cSpecular = glm::vec4(0.2, 0.2, 0.2, 1);
+    m_LSystemMaterial.shininess = 0.4;
 
-    // Create L System Data
-    m_LSystemScaler = 1;
-    m_LSystemScaleProgression = 1;
-    m_LSystemIterations = 3;
-    m_axiom = "X";
-    m_rules['X'] = "F+[[X]-X]-F[-FX]+X";
-    m_rules['F'] = "FF";
+    // the plants themselves come from the scene file, see growForest
 }
 
 void Realtime::setupParticles() {
-    m_dt = 0.01;
     m_numParticles = 0;
-    m_maxNumParticles = 150;
-
-    // Initialise Particles
-    for (unsigned int i = 0; i < m_maxNumParticles; ++i) {
-        m_particles.push_back(Particle(glm::vec3(0, 0, 0)));
-
-        for (int j = 0; j < 4; j++) {
-            m_particulePositionSizeData.push_back(0);
-        }
-
-        for (int j = 0; j < 3; j++) {
-            m_particuleColorData.push_back(0);
+    // the emitters themselves come from the scene file, see createEmitters
+
+    // PARTICLE_SORT_BENCHMARK compares the back-to-front sort with std::sort once at startup
+    if (std::getenv("PARTICLE_SORT_BENCHMARK")) {
+        for (int count: {10000, 100000, 1000000}) {
+            ParticlePool::SortTimings timings = ParticlePool::benchmarkSort(count);
+            std::cout << "Particle sort, " << count << " particles: radix " << timings.radix << " ms, next step "
+                      << timings.incremental << " ms (" << (timings.coherent ? "incremental" : "full") << "), std::sort "
+                      << timings.stdSort << " ms" << std::endl;
         }
     }
 
-    m_particleCtm = glm::translate(glm::vec3(0, 0, 0));
-    //m_particleCtm = glm::scale(glm::vec3(5, 5, 5));
+    m_particleCtm = glm::mat4(1.f);
 
     // The VBO containing the 4 vertices of the particles.
     // Thanks to instancing, they will be shared by all particles.
@@ -121,12 +265,9 @@ void Realtime::setupParticles() {
         );
     glVertexAttribDivisor(2, 0);
 
-    // Positions and sizes of the particles
-    glGenBuffers(1, &m_vboParticlesPositionSize);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesPositionSize);
-
-    // Initialize with empty (NULL) buffer : it will be updated later, each frame.
-    glBufferData(GL_ARRAY_BUFFER, m_maxNumParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+    // Positions and sizes, colors and sprite layers of the particles
+    // written into the stream buffer each frame; paintParticles moves the offsets to that frame's range
+    glBindBuffer(GL_ARRAY_BUFFER, m_streamBuffer.buffer());
     glEnableVertexAttribArray(3);
     glVertexAttribPointer(
         3, // attribute. No particular reason for 3, but must match the layout in the shader.
@@ -139,24 +280,22 @@ void Realtime::setupParticles() {
         );
     glVertexAttribDivisor(3, 1);
 
-    // Colors of the particles
-    glGenBuffers(1, &m_vboParticlesColor);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesColor);
-
-    // Initialize with empty (NULL) buffer : it will be updated later, each frame.
-    glBufferData(GL_ARRAY_BUFFER, m_maxNumParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
     glEnableVertexAttribArray(4);
     glVertexAttribPointer(
         4, // attribute. No particular reason for 4, but must match the layout in the shader.
         4, // size : r + g + b + a => 4
         GL_UNSIGNED_BYTE, // type
         GL_TRUE, // normalized? *** YES, this means that the unsigned char[4] will be accessible with a vec4 (floats) in the shader ***
-        4 * sizeof(GLfloat), // stride
+        4 * sizeof(GLubyte), // stride
         //0, // stride
         (void*)0 // array buffer offset
         );
     glVertexAttribDivisor(4, 1);
 
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), (void*)0);
+    glVertexAttribDivisor(6, 1);
+
     std::vector<GLfloat> uvData = {
         0.0f, 0.0f,
         1.0f, 0.0f,
@@ -186,31 +325,196 @@ void Realtime::setupSkybox() {
 }
 
 void Realtime::deleteAllMeshes() {
+    // pose jobs hold pointers into m_meshes
+    waitForAnimationJobs();
     for (auto &[meshfile, vaovbo]: m_meshIds) {
         glDeleteVertexArrays(1, &vaovbo.shape_vao);
         glDeleteBuffers(1, &vaovbo.shape_vbo);
     }
+    for (auto &[meshfile, levels]: m_meshLodIds) {
+        for (VboVao& vaovbo: levels) {
+            glDeleteVertexArrays(1, &vaovbo.shape_vao);
+            glDeleteBuffers(1, &vaovbo.shape_vbo);
+        }
+    }
+
+    for (auto &[meshfile, buffer]: m_skinBuffers) {
+        buffer.destroy();
+    }
 
     m_meshIds.clear();
+    m_meshLodIds.clear();
     m_meshes.clear();
+    m_skinBuffers.clear();
+    m_meshInstances.clear();
 }
 
 void Realtime::rebuildMeshes() {
     deleteAllMeshes();
     std::unordered_set<std::string> meshfiles;
+    std::unordered_map<std::string, SkinningMode> skinningModes;
     for (RenderShapeData& shape: m_renderdata.shapes) {
         if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
             // std::cout << "Found a mesh" << std::endl;
             meshfiles.insert(shape.primitive.meshfile);
+            // skinning is per mesh file; any instance asking for the CPU path selects it
+            if (shape.primitive.skinning != SkinningMode::SKINNING_GPU) skinningModes[shape.primitive.meshfile] = shape.primitive.skinning;
         }
     }
     for (std::string meshfile: meshfiles) {
         glGenBuffers(1, &m_meshIds[meshfile].shape_vbo);
         glGenVertexArrays(1, &m_meshIds[meshfile].shape_vao);
         // create mesh and call update on the new mesh
-        m_meshes[meshfile].updateMesh(meshfile);
-        setupPrimitives(&m_meshIds[meshfile], m_meshes[meshfile].generateShape(), m_meshes[meshfile].hasAnimation, m_meshes[meshfile].hasTextures);
+        Mesh& mesh = m_meshes[meshfile];
+        mesh.updateMesh(meshfile);
+        setupPrimitives(&m_meshIds[meshfile], mesh.generateShape(), mesh.hasAnimation, mesh.hasTextures);
+
+        if (mesh.hasAnimation && skinningModes.count(meshfile) != 0) {
+            mesh.m_skinning = skinningModes[meshfile];
+            m_skinBuffers[meshfile].create(mesh.num_triangles, m_meshIds[meshfile].shape_vbo, mesh.vertexStride(), mesh.hasTextures);
+
+            // check the SIMD kernel against the scalar reference, and the reference against what
+            // anim.vert computes, on the first frame's pose
+            mesh.updateFinalBoneMatrices(0.f);
+            std::cout << "CPU skinning " << meshfile << " (" << Skinning::simdName() << "): max error vs reference "
+                      << Skinning::maxError(mesh.m_skinning, mesh.m_skinStreams, mesh.m_meshAnim.m_pendingBoneMatrices)
+                      << ", linear blend reference vs anim.vert " << gpuSkinningError(meshfile) << std::endl;
+        } else {
+            // CPU-skinned meshes stream their own full-detail buffer, so only the rest get simplified levels
+            mesh.buildLods();
+            for (const MeshSimplify::Result& lod: mesh.m_lods) {
+                VboVao& ids = m_meshLodIds[meshfile].emplace_back();
+                glGenBuffers(1, &ids.shape_vbo);
+                glGenVertexArrays(1, &ids.shape_vao);
+                setupPrimitives(&ids, lod.vertexData, mesh.hasAnimation, mesh.hasTextures);
+            }
+        }
+    }
+
+    // bounding spheres for animation LOD; the ctms are fixed once the scene is parsed
+    for (RenderShapeData& shape: m_renderdata.shapes) {
+        if (shape.primitive.type != PrimitiveType::PRIMITIVE_MESH) continue;
+        const glm::mat4& ctm = shape.ctm;
+        float scale = std::max({glm::length(glm::vec3(ctm[0])), glm::length(glm::vec3(ctm[1])), glm::length(glm::vec3(ctm[2]))});
+        glm::vec3 center(ctm * glm::vec4(0.f, 0.f, 0.f, 1.f));
+        m_meshInstances[shape.primitive.meshfile].push_back(glm::vec4(center, m_meshes[shape.primitive.meshfile].m_boundingRadius * scale));
+    }
+}
+
+// Runs the mesh through anim.vert with identity transforms and reads the skinned positions and
+// normals back with transform feedback, for the largest difference from the CPU linear blend
+// reference. Normals are compared normalized, since the shader normalizes them.
+float Realtime::gpuSkinningError(const std::string& meshfile) {
+    Mesh& mesh = m_meshes[meshfile];
+    const std::vector<glm::mat4>& bones = mesh.m_meshAnim.m_pendingBoneMatrices;
+    int count = mesh.m_skinStreams.count;
+    if (count == 0) return 0.f;
+    // the shader only sees the first MAX_BONES, so the reference gets the same palette
+    std::vector<glm::mat4> palette(bones.begin(), bones.begin() + std::min<int>(bones.size(), MAX_BONES));
+
+    GLuint program = ShaderLoader::createTransformFeedbackProgram(":/resources/shaders/anim.vert", {"world_position", "world_normal"});
+    bindBoneBlock(program);
+    glUseProgram(program);
+    glm::mat4 identity(1.f);
+    for (const char* name: {"model", "model_inv_trans", "view", "proj"}) {
+        glUniformMatrix4fv(glGetUniformLocation(program, name), 1, GL_FALSE, &identity[0][0]);
+    }
+    glUniform1i(glGetUniformLocation(program, "animating"), 1);
+    glUniform1i(glGetUniformLocation(program, "numBones"), palette.size());
+    glUniform1i(glGetUniformLocation(program, "usingTexture"), false);
+    glUniform1i(glGetUniformLocation(program, "instanced"), false);
+
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffers[0]);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_BONES * sizeof(glm::mat4), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, palette.size() * sizeof(glm::mat4), palette.data());
+    glBindBufferBase(GL_UNIFORM_BUFFER, BONE_BLOCK_BINDING, buffers[0]);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffers[1]);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, 6 * count * sizeof(GLfloat), nullptr, GL_STATIC_READ);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1]);
+
+    glBindVertexArray(m_meshIds[meshfile].shape_vao);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, count);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(0);
+
+    std::vector<GLfloat> gpu(6 * count);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, gpu.size() * sizeof(GLfloat), gpu.data());
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glDeleteBuffers(2, buffers);
+    glUseProgram(0);
+    glDeleteProgram(program);
+
+    std::vector<float> reference(6 * count);
+    Skinning::linearBlendReference(mesh.m_skinStreams, palette, reference.data(), 0, count);
+    float maxError = 0.f;
+    for (int v = 0; v < count; v++) {
+        const float* a = &gpu[6 * v];
+        const float* b = &reference[6 * v];
+        glm::vec3 normal(b[3], b[4], b[5]);
+        if (glm::length(normal) > 0.f) normal = glm::normalize(normal);
+        maxError = std::max({maxError, glm::length(glm::vec3(a[0], a[1], a[2]) - glm::vec3(b[0], b[1], b[2])),
+                             glm::length(glm::vec3(a[3], a[4], a[5]) - normal)});
+    }
+    return maxError;
+}
+
+Realtime::ShapeDraw Realtime::bindShapeGeometry(RenderShapeData& shape, bool reselectLod) {
+    ShapeDraw draw;
+    switch (shape.primitive.type) {
+    case PrimitiveType::PRIMITIVE_CONE:
+    case PrimitiveType::PRIMITIVE_CUBE:
+    case PrimitiveType::PRIMITIVE_CYLINDER:
+    case PrimitiveType::PRIMITIVE_SPHERE: {
+        std::array<PrimitiveLod, PRIMITIVE_LOD_LEVELS>& chain = m_primitiveLods[shape.primitive.type];
+        int lod = std::clamp(shape.lod, 0, PRIMITIVE_LOD_LEVELS - 1);
+        if (reselectLod) {
+            float errors[PRIMITIVE_LOD_LEVELS];
+            for (int i = 0; i < PRIMITIVE_LOD_LEVELS; i++) errors[i] = chain[i].error;
+            lod = selectLod(shape, errors, PRIMITIVE_LOD_LEVELS);
+        }
+        VboVao* ids = chain[lod].ids;
+        draw.count = ids->num_indices;
+        draw.indexed = true;
+        glBindVertexArray(ids->shape_vao);
+        break;
+    }
+    default:
+        if (m_meshes.count(shape.primitive.meshfile) == 0) {
+            draw.count = 0;
+        } else if (m_meshLodIds.count(shape.primitive.meshfile) != 0) {
+            Mesh& mesh = m_meshes[shape.primitive.meshfile];
+            int levels = 1 + mesh.m_lods.size();
+            int lod = std::clamp(shape.lod, 0, levels - 1);
+            if (reselectLod) {
+                float errors[1 + std::size(Mesh::LOD_RATIOS)] = {0.f};
+                for (int i = 0; i < (int)mesh.m_lods.size(); i++) errors[i + 1] = mesh.m_lods[i].error;
+                lod = selectLod(shape, errors, levels);
+            }
+            if (lod == 0) {
+                draw.count = mesh.num_triangles;
+                glBindVertexArray(m_meshIds[shape.primitive.meshfile].shape_vao);
+            } else {
+                draw.count = mesh.m_lods[lod - 1].vertexData.size() / mesh.vertexStride();
+                glBindVertexArray(m_meshLodIds[shape.primitive.meshfile][lod - 1].shape_vao);
+            }
+        } else {
+            draw.count = m_meshes[shape.primitive.meshfile].num_triangles;
+            glBindVertexArray(m_meshIds[shape.primitive.meshfile].shape_vao);
+        }
+        if (m_skinBuffers.count(shape.primitive.meshfile) != 0 && m_skinBuffers[shape.primitive.meshfile].ready()) {
+            // already deformed on the CPU, so the shader just transforms it like a static mesh
+            m_skinBuffers[shape.primitive.meshfile].bindForDraw();
+        } else if (m_meshes[shape.primitive.meshfile].hasAnimation) draw.animating = true;
+        break;
     }
+    return draw;
 }
 
 void Realtime::setupPrimitives(VboVao* shape_ids, const std::vector<GLfloat>& triangles, bool anim, bool texturing) {
@@ -0,0 +1,130 @@
+#include "realtime.h"
+
+#include <iostream>
+#include "utils/shaderloader.h"
+#include "utils/stats.h"
+
+namespace {
+// floats per particle in a state buffer: position + size, velocity + life
+constexpr int PARTICLE_STATE_FLOATS = 8;
+}
+
+void Realtime::createGpuParticles() {
+    deleteGpuParticles();
+
+    m_particleUpdateShader = ShaderLoader::createTransformFeedbackProgram(":/resources/shaders/particles_update.vert",
+                                                                          {"outPosSize", "outVelLife"});
+    glUniformBlockBinding(m_particleUpdateShader, glGetUniformBlockIndex(m_particleUpdateShader, "Emitter"), PARTICLE_EMITTER_BINDING);
+
+    // every slot starts as an invisible zero-size particle, with lives staggered so the
+    // emitter fills up over one lifetime instead of all at once
+    m_gpuParticleCount = m_maxNumParticles;
+    std::vector<GLfloat> state(m_gpuParticleCount * PARTICLE_STATE_FLOATS, 0.f);
+    for (int i = 0; i < m_gpuParticleCount; i++) {
+        state[i * PARTICLE_STATE_FLOATS + 7] = m_particleSpawn.lifeMax * i / m_gpuParticleCount;
+    }
+
+    GLsizei stride = PARTICLE_STATE_FLOATS * sizeof(GLfloat);
+    glGenBuffers(2, m_gpuParticleState);
+    glGenVertexArrays(2, m_gpuParticleUpdateVao);
+    glGenVertexArrays(2, m_gpuParticleDrawVao);
+    for (int b = 0; b < 2; b++) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_gpuParticleState[b]);
+        glBufferData(GL_ARRAY_BUFFER, state.size() * sizeof(GLfloat), state.data(), GL_DYNAMIC_COPY);
+
+        glBindVertexArray(m_gpuParticleUpdateVao[b]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(GLfloat)));
+
+        // the same layout particles.vert gets from the CPU path, except the color and sprite layer are constants
+        glBindVertexArray(m_gpuParticleDrawVao[b]);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesBillboard);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+        glVertexAttribDivisor(2, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, m_gpuParticleState[b]);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glVertexAttribDivisor(3, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesUV);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenQueries(1, &m_gpuParticleQuery);
+    m_gpuParticleCurrent = 0;
+    std::cout << "GPU particles: " << m_gpuParticleCount << " in two " << state.size() * sizeof(GLfloat) / 1024
+              << " KB state buffers" << std::endl;
+}
+
+void Realtime::deleteGpuParticles() {
+    if (m_particleUpdateShader) glDeleteProgram(m_particleUpdateShader);
+    if (m_gpuParticleState[0]) glDeleteBuffers(2, m_gpuParticleState);
+    if (m_gpuParticleUpdateVao[0]) glDeleteVertexArrays(2, m_gpuParticleUpdateVao);
+    if (m_gpuParticleDrawVao[0]) glDeleteVertexArrays(2, m_gpuParticleDrawVao);
+    if (m_gpuParticleQuery) glDeleteQueries(1, &m_gpuParticleQuery);
+    m_particleUpdateShader = 0;
+    m_gpuParticleState[0] = m_gpuParticleState[1] = 0;
+    m_gpuParticleUpdateVao[0] = m_gpuParticleUpdateVao[1] = 0;
+    m_gpuParticleDrawVao[0] = m_gpuParticleDrawVao[1] = 0;
+    m_gpuParticleQuery = 0;
+    m_gpuParticleCount = 0;
+}
+
+void Realtime::updateGpuParticles() {
+    if (m_particleUpdateShader == 0) createGpuParticles();
+    // one pass per simulation step published since the last frame
+    int steps = std::min(m_gpuParticleSteps, SIM_MAX_STEPS);
+    m_gpuParticleSteps = 0;
+    if (m_gpuParticleCount == 0 || steps == 0) return;
+
+    // the emitter is the only thing sent each step, a few dozen bytes
+    ParticleEmitterBlock emitter;
+    emitter.positionMin = glm::vec4(m_particleSpawn.positionMin, 0.f);
+    emitter.positionMax = glm::vec4(m_particleSpawn.positionMax, 0.f);
+    emitter.velocityMin = glm::vec4(m_particleSpawn.velocityMin, 0.f);
+    emitter.velocityMax = glm::vec4(m_particleSpawn.velocityMax, 0.f);
+    emitter.sizeLife = glm::vec4(m_particleSpawn.sizeMin, m_particleSpawn.sizeMax, m_particleSpawn.lifeMin, m_particleSpawn.lifeMax);
+    emitter.acceleration = glm::vec4(m_particleGravity, 0.f);
+    float drag = m_emitters.empty() ? 0.f : m_emitters.front().settings.drag;
+    emitter.step = glm::vec4(SIM_STEP, 1.f, std::max(0.f, 1.f - drag * SIM_STEP), 0.f);
+
+    bool timed = statsEnabled() && m_particleStatFrames + 1 == STATS_PERIOD_FRAMES;
+    if (timed) glBeginQuery(GL_TIME_ELAPSED, m_gpuParticleQuery);
+
+    // one point per particle, nothing rasterized: the vertex shader's outputs are the result
+    glUseProgram(m_particleUpdateShader);
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (int i = 0; i < steps; i++) {
+        emitter.seed = glm::uvec4(++m_gpuParticleFrame, 0, 0, 0);
+        GLintptr offset = m_streamBuffer.upload(&emitter, sizeof(ParticleEmitterBlock), m_streamBuffer.uniformAlignment());
+        if (offset < 0) break;
+        glBindBufferRange(GL_UNIFORM_BUFFER, PARTICLE_EMITTER_BINDING, m_streamBuffer.buffer(), offset, sizeof(ParticleEmitterBlock));
+
+        int next = 1 - m_gpuParticleCurrent;
+        glBindVertexArray(m_gpuParticleUpdateVao[m_gpuParticleCurrent]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_gpuParticleState[next]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, m_gpuParticleCount);
+        glEndTransformFeedback();
+        m_gpuParticleCurrent = next;
+    }
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glUseProgram(0);
+
+    if (timed) glEndQuery(GL_TIME_ELAPSED);
+    if (timed) {
+        // waits for this frame's steps, once every few seconds
+        GLuint64 nanos = 0;
+        glGetQueryObjectui64v(m_gpuParticleQuery, GL_QUERY_RESULT, &nanos);
+        std::cout << "GPU particles: " << m_gpuParticleCount << " live, update " << nanos / 1000.f << " us for "
+                  << steps << " steps" << std::endl;
+    }
+    if (++m_particleStatFrames == STATS_PERIOD_FRAMES) m_particleStatFrames = 0;
+}
@@ -0,0 +1,193 @@
+#include "realtime.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "utils/stats.h"
+
+float Realtime::lightRange(const SceneLightData& light) {
+    float c = light.function.x, l = light.function.y, q = light.function.z;
+    float target = 256.f - c;
+    float range = MAX_LIGHT_RANGE;
+    if (q > 0.f) range = (-l + std::sqrt(l * l + 4.f * q * target)) / (2.f * q);
+    else if (l > 0.f) range = target / l;
+    return std::clamp(range, 1.f, MAX_LIGHT_RANGE);
+}
+
+void Realtime::uploadLights() {
+    std::vector<glm::vec4> texels;
+    m_globalLights.clear();
+    m_clusteredLights.clear();
+    m_clusteredRanges.clear();
+    for (int i = 0; i < (int)m_renderdata.lights.size(); i++) {
+        const SceneLightData& light = m_renderdata.lights[i];
+        float type = 0.f;
+        if (light.type == LightType::LIGHT_DIRECTIONAL) type = 1.f;
+        else if (light.type == LightType::LIGHT_SPOT) type = 2.f;
+        texels.push_back(glm::vec4(glm::vec3(light.color), type));
+        texels.push_back(glm::vec4(glm::vec3(light.pos), light.angle));
+        texels.push_back(glm::vec4(glm::vec3(light.dir), light.penumbra));
+        texels.push_back(glm::vec4(light.function, 0.f));
+
+        float range = lightRange(light);
+        if (light.type != LightType::LIGHT_DIRECTIONAL && range < MAX_LIGHT_RANGE) {
+            m_clusteredLights.push_back(i);
+            m_clusteredRanges.push_back(range);
+        } else if ((int)m_globalLights.size() < MAX_GLOBAL_LIGHTS) {
+            m_globalLights.push_back(i);
+        } else {
+            std::cerr << "Too many lights without falloff, skipping light " << i << std::endl;
+        }
+    }
+    m_lightData.upload(GL_RGBA32F, texels.data(), texels.size() * sizeof(glm::vec4));
+    std::cout << "Lights: " << m_clusteredLights.size() << " clustered, " << m_globalLights.size() << " global" << std::endl;
+}
+
+void Realtime::buildLightClusters() {
+    const int numClusters = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+    // slice k covers view depths near * (far / near)^(k / Z) to the next one
+    auto sliceDepth = [&](int k) { return near * std::pow(far / near, k / float(CLUSTERS_Z)); };
+
+    if (m_clusterProj != m_proj) {
+        // a view-space box around each cluster; x = ndc * depth / proj[0][0] at either end
+        m_clusterProj = m_proj;
+        m_clusterMin.resize(numClusters);
+        m_clusterMax.resize(numClusters);
+        for (int z = 0; z < CLUSTERS_Z; z++) {
+            float d0 = sliceDepth(z), d1 = sliceDepth(z + 1);
+            for (int y = 0; y < CLUSTERS_Y; y++) {
+                float ndcY0 = -1.f + 2.f * y / CLUSTERS_Y, ndcY1 = -1.f + 2.f * (y + 1) / CLUSTERS_Y;
+                for (int x = 0; x < CLUSTERS_X; x++) {
+                    float ndcX0 = -1.f + 2.f * x / CLUSTERS_X, ndcX1 = -1.f + 2.f * (x + 1) / CLUSTERS_X;
+                    int c = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+                    m_clusterMin[c] = glm::vec3(std::min(ndcX0 * d0, ndcX0 * d1) / m_proj[0][0],
+                                                std::min(ndcY0 * d0, ndcY0 * d1) / m_proj[1][1], -d1);
+                    m_clusterMax[c] = glm::vec3(std::max(ndcX1 * d0, ndcX1 * d1) / m_proj[0][0],
+                                                std::max(ndcY1 * d0, ndcY1 * d1) / m_proj[1][1], -d0);
+                }
+            }
+        }
+    }
+
+    m_clusterLists.resize(numClusters);
+    for (std::vector<GLuint>& list: m_clusterLists) list.clear();
+
+    float logDepthScale = CLUSTERS_Z / std::log(far / near);
+    auto depthSlice = [&](float depth) {
+        return std::clamp(int(std::floor(std::log(std::max(depth, near) / near) * logDepthScale)), 0, CLUSTERS_Z - 1);
+    };
+    auto ndcTile = [](float ndc, int count) {
+        return std::clamp(int(std::floor((ndc + 1.f) / 2.f * count)), 0, count - 1);
+    };
+
+    for (int l = 0; l < (int)m_clusteredLights.size(); l++) {
+        const SceneLightData& light = m_renderdata.lights[m_clusteredLights[l]];
+        float radius = m_clusteredRanges[l];
+        glm::vec3 center(m_cam.view * glm::vec4(glm::vec3(light.pos), 1.f));
+        float depthMin = -center.z - radius, depthMax = -center.z + radius;
+        if (depthMax < near || depthMin > far) continue;
+
+        // conservative tile range: x / depth over the sphere's box, unless it reaches behind the near plane
+        int x0 = 0, x1 = CLUSTERS_X - 1, y0 = 0, y1 = CLUSTERS_Y - 1;
+        if (depthMin > near) {
+            float xs[4] = {(center.x - radius) / depthMin, (center.x - radius) / depthMax,
+                           (center.x + radius) / depthMin, (center.x + radius) / depthMax};
+            float ys[4] = {(center.y - radius) / depthMin, (center.y - radius) / depthMax,
+                           (center.y + radius) / depthMin, (center.y + radius) / depthMax};
+            float ndcX0 = *std::min_element(xs, xs + 4) * m_proj[0][0], ndcX1 = *std::max_element(xs, xs + 4) * m_proj[0][0];
+            float ndcY0 = *std::min_element(ys, ys + 4) * m_proj[1][1], ndcY1 = *std::max_element(ys, ys + 4) * m_proj[1][1];
+            if (ndcX1 < -1.f || ndcX0 > 1.f || ndcY1 < -1.f || ndcY0 > 1.f) continue;
+            x0 = ndcTile(ndcX0, CLUSTERS_X);
+            x1 = ndcTile(ndcX1, CLUSTERS_X);
+            y0 = ndcTile(ndcY0, CLUSTERS_Y);
+            y1 = ndcTile(ndcY1, CLUSTERS_Y);
+        }
+
+        for (int z = depthSlice(depthMin); z <= depthSlice(depthMax); z++) {
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    int c = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+                    glm::vec3 closest = glm::clamp(center, m_clusterMin[c], m_clusterMax[c]);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radius * radius) m_clusterLists[c].push_back(m_clusteredLights[l]);
+                }
+            }
+        }
+    }
+
+    size_t entries = 0;
+    int maxLights = 0;
+    for (const std::vector<GLuint>& list: m_clusterLists) {
+        entries += list.size();
+        maxLights = std::max(maxLights, (int)list.size());
+    }
+
+    // grid then lists, written straight into the stream buffer; offsets in the grid are absolute texels
+    StreamBuffer::Allocation allocation = m_streamBuffer.allocate((2 * numClusters + entries) * sizeof(GLuint), sizeof(GLuint));
+    if (allocation.data == nullptr) return;
+    GLuint* grid = static_cast<GLuint*>(allocation.data);
+    GLuint* lights = grid + 2 * numClusters;
+    m_clusterGridBase = allocation.offset / sizeof(GLuint);
+    GLuint next = m_clusterGridBase + 2 * numClusters;
+    for (int c = 0; c < numClusters; c++) {
+        grid[2 * c] = next;
+        grid[2 * c + 1] = m_clusterLists[c].size();
+        lights = std::copy(m_clusterLists[c].begin(), m_clusterLists[c].end(), lights);
+        next += m_clusterLists[c].size();
+    }
+    m_streamBuffer.commit(allocation);
+
+    if (m_clusterData == 0) glGenTextures(1, &m_clusterData);
+    if (m_clusterDataGeneration != m_streamBuffer.generation()) {
+        // texture buffers see the whole buffer, so the view only changes when the buffer does
+        glBindTexture(GL_TEXTURE_BUFFER, m_clusterData);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, m_streamBuffer.buffer());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        m_clusterDataGeneration = m_streamBuffer.generation();
+    }
+
+    m_clusterStatEntries += entries;
+    m_clusterStatMax = std::max(m_clusterStatMax, maxLights);
+    if (++m_clusterStatFrames == STATS_PERIOD_FRAMES) {
+        if (statsEnabled()) {
+            std::cout << "Light clusters: " << m_clusteredLights.size() << " lights, average "
+                      << m_clusterStatEntries / float(STATS_PERIOD_FRAMES * numClusters) << " per cluster, at most "
+                      << m_clusterStatMax << std::endl;
+        }
+        m_clusterStatFrames = 0;
+        m_clusterStatEntries = 0;
+        m_clusterStatMax = 0;
+    }
+}
+
+void Realtime::bindLightClustersToShader(GLuint shader) {
+    glUniform1i(glGetUniformLocation(shader, "lightData"), LIGHT_DATA_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(shader, "clusterData"), CLUSTER_DATA_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(shader, "clusterGridBase"), m_clusterGridBase);
+    glUniform1i(glGetUniformLocation(shader, "numGlobalLights"), m_globalLights.size());
+    if (!m_globalLights.empty()) {
+        glUniform1iv(glGetUniformLocation(shader, "globalLights"), m_globalLights.size(), m_globalLights.data());
+    }
+
+    // the scene is drawn at the widget's size, from the bottom left of its target
+    glUniform3i(glGetUniformLocation(shader, "clusterCounts"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    glUniform2f(glGetUniformLocation(shader, "clusterTileSize"), size().width() * m_devicePixelRatio / CLUSTERS_X,
+                size().height() * m_devicePixelRatio / CLUSTERS_Y);
+    float logDepthScale = CLUSTERS_Z / std::log(far / near);
+    glUniform1f(glGetUniformLocation(shader, "clusterDepthScale"), logDepthScale);
+    glUniform1f(glGetUniformLocation(shader, "clusterDepthBias"), -std::log(near) * logDepthScale);
+
+    glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lightData.texture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_DATA_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_clusterData);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Realtime::deleteLightResources() {
+    m_lightData.destroy();
+    if (m_clusterData) glDeleteTextures(1, &m_clusterData);
+    m_clusterData = 0;
+    m_clusterDataGeneration = -1;
+    m_clusterProj = glm::mat4(0.f);
+}
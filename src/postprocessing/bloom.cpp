@@ -0,0 +1,59 @@
+#include "bloom.h"
+#include "utils/shaderloader.h"
+
+std::string Bloom::frag_shader = ":/resources/shaders/bloom_threshold.frag";
+
+Bloom::Bloom(int width, int height)
+    : PostProcess(frag_shader, width, height)
+{
+    m_blur = std::make_unique<Convolution>(Convolution::gaussianKernel(BLUR_RADIUS, BLUR_SIGMA), width, height);
+    m_blur->setScale(0.5f);
+    m_compositeShader = ShaderLoader::createShaderProgram(":/resources/shaders/texture.vert", ":/resources/shaders/bloom_composite.frag");
+}
+
+void Bloom::destroyShaders() {
+    glDeleteProgram(m_compositeShader);
+    m_blur->destroyShaders();
+    glDeleteProgram(m_blur->getShader());
+    m_blur->destroyVertex();
+}
+
+void Bloom::addPasses(RenderGraph& graph, const std::string& input, const std::string& output) {
+    // threshold -> blur, both at half resolution, then added back at full resolution
+    std::string bright = output + "BloomBright";
+    std::string blurred = output + "BloomBlur";
+    graph.addPass({bright, {input}, bright, 0.5f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        setInput(inputs[0]);
+        paintTexture();
+    }});
+    m_blur->addPasses(graph, bright, blurred);
+    graph.addPass({output, {input, blurred}, output, 1.f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        paintComposite(inputs[0], inputs[1]);
+    }});
+}
+
+void Bloom::paintTexture() {
+    glUseProgram(getShader());
+    glUniform1f(glGetUniformLocation(getShader(), "threshold"), m_threshold);
+    PostProcess::paintTexture();
+}
+
+void Bloom::paintComposite(const RenderTarget* input, const RenderTarget* bloom) {
+    glUseProgram(m_compositeShader);
+    glUniform1i(glGetUniformLocation(m_compositeShader, "sceneTex"), 0);
+    glUniform1i(glGetUniformLocation(m_compositeShader, "bloomTex"), 1);
+    glUniform2fv(glGetUniformLocation(m_compositeShader, "sceneScale"), 1, &input->uvScale()[0]);
+    glUniform2fv(glGetUniformLocation(m_compositeShader, "bloomScale"), 1, &bloom->uvScale()[0]);
+    glUniform1f(glGetUniformLocation(m_compositeShader, "intensity"), m_intensity);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, input->color);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bloom->color);
+    drawFullscreenQuad();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
@@ -0,0 +1,33 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "postprocess.h"
+#include "convolution.h"
+#include <memory>
+
+// Bright parts of the image bleed light into their surroundings: a threshold pass keeps
+// what is over m_threshold at half resolution, a Gaussian Convolution (one horizontal and
+// one vertical folded pass) spreads it, and a composite adds it back onto the image.
+class Bloom : public PostProcess
+{
+public:
+    Bloom(int width, int height);
+    void paintTexture() override;
+    void addPasses(RenderGraph& graph, const std::string& input, const std::string& output) override;
+    void destroyShaders();
+    static std::string frag_shader;
+
+private:
+    void paintComposite(const RenderTarget* input, const RenderTarget* bloom);
+
+    std::unique_ptr<Convolution> m_blur;
+    GLuint m_compositeShader;
+
+    // Bloom parameters; the blur is in half-resolution pixels
+    static constexpr int BLUR_RADIUS = 12;
+    static constexpr float BLUR_SIGMA = 5.f;
+    float m_threshold = 0.75f;
+    float m_intensity = 0.6f;
+};
+
+#endif // BLOOM_H
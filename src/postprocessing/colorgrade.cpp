@@ -1,8 +1,6 @@
 #include "colorgrade.h"
+#include "lut3d.h"
 #include <iostream>
-#include <QDebug>
-#include <QDir>
-#include <QImageReader>
 
 std::string Colorgrade::frag_shader = ":/resources/shaders/colorgrading.frag";
 
@@ -11,35 +9,7 @@ Colorgrade::Colorgrade(std::string LUT, int num_slices, int width, int height, b
 {
     // initialize the color grading variables (LUTs, etc)
     m_num_slices = num_slices;
-    QString LUT_filepath = QString(LUT.c_str());
-    m_LUT_image = QImage(LUT_filepath);
-
-    QImageReader reader(LUT.c_str());
-
-    qDebug() << "format:" << reader.format();
-    qDebug() << "size:" << reader.size();
-    qDebug() << "canRead:" << reader.canRead();
-
-    QImage img = reader.read();
-    qDebug() << "img null:" << img.isNull();
-    qDebug() << "reader error:" << reader.error() << reader.errorString();
-    qDebug() << "QImage format:" << m_LUT_image.format();
-
-
-    qDebug() << "Images in resource:" << QDir(":/resources/images").entryList();
-
-    if (mirror) {
-        m_LUT_image = m_LUT_image.convertToFormat(QImage::Format_RGBA8888).mirrored();
-    } else {
-        m_LUT_image = m_LUT_image.convertToFormat(QImage::Format_RGBA8888);
-    }
-    glGenTextures(1, &m_LUT_texture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_LUT_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_LUT_image.width(), m_LUT_image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, m_LUT_image.bits());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    m_LUT_texture = Lut3D::loadStrip(LUT, num_slices, mirror);
 
     // Task 19: Generate and bind an empty texture, set its min/mag filter interpolation, then unbind
     /*glGenTextures(1, &m_fbo_depthTexture);
@@ -102,7 +72,7 @@ void Colorgrade::paintTexture() {
     GLuint LUT_location = glGetUniformLocation(getShader(), "tLUT");
     glUniform1i(LUT_location, 1);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_LUT_texture);
+    glBindTexture(GL_TEXTURE_3D, m_LUT_texture);
     //glUseProgram(0);
 
     //glUseProgram(getShader());
@@ -116,5 +86,12 @@ void Colorgrade::paintTexture() {
     PostProcess::paintTexture();
 
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void Colorgrade::setFusedUniforms(GLuint shader) {
+    glUniform1f(glGetUniformLocation(shader, "colorgrade_slices"), m_num_slices);
+    glUniform1i(glGetUniformLocation(shader, "colorgrade_tLUT"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, m_LUT_texture);
 }
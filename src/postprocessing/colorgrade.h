@@ -10,11 +10,13 @@ class Colorgrade : public PostProcess
 public:
     Colorgrade(std::string LUT, int num_slices, int width, int height, bool mirror = false);
     void paintTexture() override;
+    std::string fusedFunction() const override { return "colorgrade"; }
+    std::string fusedSnippet() const override { return ":/resources/shaders/fused/colorgrading.glsl"; }
+    void setFusedUniforms(GLuint shader) override;
     static std::string frag_shader;
 
 private:
-    QImage m_LUT_image;
-    GLuint m_LUT_texture;
+    GLuint m_LUT_texture; // 3D, see Lut3D
     GLuint m_fbo_depthTexture; // temporary for test
     int m_num_slices;
 };
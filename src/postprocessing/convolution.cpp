@@ -1,32 +1,273 @@
 #include "convolution.h"
+#include "utils/shaderloader.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 #include <stdexcept>
 
-Convolution::Convolution(std::vector<float> kernel, float offset, int width, int height, std::string frag_shader)
+std::string Convolution::frag_shader = ":/resources/shaders/convolution.frag";
+
+namespace {
+// relative Frobenius norm below which the remainder of the kernel is ignored
+constexpr float SEPARABLE_TOLERANCE = 1e-3f;
+constexpr int POWER_ITERATIONS = 100;
+}
+
+Convolution::Convolution(std::vector<float> kernel, int width, int height)
     : PostProcess(frag_shader, width, height)
 {
-    if (kernel.size() != 9) {
-        throw std::runtime_error("Only 3x3 kernels are supported!");
+    m_size = std::lround(std::sqrt(float(kernel.size())));
+    if (m_size * m_size != (int)kernel.size() || m_size % 2 == 0) {
+        throw std::runtime_error("Convolution kernels must be square with an odd size!");
+    }
+    int half = m_size / 2;
+
+    std::vector<Tap> direct;
+    for (int r = 0; r < m_size; r++) {
+        for (int c = 0; c < m_size; c++) {
+            float w = kernel[r * m_size + c];
+            if (w != 0.f) direct.push_back(Tap(c - half, half - r, w));
+        }
+    }
+
+    float residual;
+    std::vector<SeparableTerm> terms = decompose(kernel, m_size, MAX_TERMS, SEPARABLE_TOLERANCE, residual);
+    std::vector<std::vector<Tap>> rowTaps, columnTaps;
+    int rowCount = 0, columnCount = 0;
+    for (const SeparableTerm& term: terms) {
+        rowTaps.push_back(foldTaps(term.row, glm::vec2(1.f, 0.f)));
+        columnTaps.push_back(foldTaps(term.column, glm::vec2(0.f, -1.f)));
+        rowCount += rowTaps.back().size();
+        columnCount += columnTaps.back().size();
     }
-    m_kernel = kernel;
-    m_offset = offset;
+    bool separableFits = !terms.empty() && rowCount <= MAX_TAPS && columnCount <= MAX_TAPS;
+    bool exact = residual <= SEPARABLE_TOLERANCE;
+    // an extra pass costs roughly a few fetches' worth of bandwidth for the intermediate
+    int separableCost = rowCount + columnCount + 4 * (int)terms.size();
 
+    if (separableFits && exact && separableCost < (int)direct.size()) {
+        m_terms = terms;
+    } else if ((int)direct.size() <= MAX_TAPS) {
+        m_terms.clear();
+    } else if (separableFits) {
+        // too large for one pass and not low-rank: keep the strongest terms
+        m_terms = terms;
+        std::cout << "Convolution: approximating " << m_size << "x" << m_size << " kernel with " << terms.size()
+                  << " separable terms (residual " << residual * 100.f << "%)" << std::endl;
+    } else {
+        throw std::runtime_error("Convolution kernel is too large!");
+    }
+
+    if (m_terms.empty()) {
+        uploadTaps(getShader(), {direct});
+    } else {
+        uploadTaps(getShader(), rowTaps);
+        m_columnShader = ShaderLoader::createShaderProgram(":/resources/shaders/texture.vert", ":/resources/shaders/convolution_columns.frag");
+        uploadTaps(m_columnShader, columnTaps);
+    }
 }
 
-void Convolution::paintTexture() {
-    float offsets[9][2] = {
-        { -m_offset,  m_offset  },  // top-left
-        {  0.0f,    m_offset  },  // top-center
-        {  m_offset,  m_offset  },  // top-right
-        { -m_offset,  0.0f    },  // center-left
-        {  0.0f,    0.0f    },  // center-center
-        {  m_offset,  0.0f    },  // center - right
-        { -m_offset, -m_offset  },  // bottom-left
-        {  0.0f,   -m_offset  },  // bottom-center
-        {  m_offset, -m_offset  }   // bottom-right
+void Convolution::destroyShaders() {
+    if (m_columnShader != 0) glDeleteProgram(m_columnShader);
+    m_columnShader = 0;
+}
+
+std::vector<Convolution::SeparableTerm> Convolution::decompose(const std::vector<float>& kernel, int size, int maxTerms, float tolerance, float& residual) {
+    // rank-1 terms of the SVD by power iteration, deflating the kernel after each
+    std::vector<double> remainder(kernel.begin(), kernel.end());
+    auto frobenius = [&]() {
+        double sum = 0;
+        for (double w: remainder) sum += w * w;
+        return std::sqrt(sum);
     };
+    double norm = frobenius();
+    std::vector<SeparableTerm> terms;
+    residual = 0.f;
+    if (norm == 0.0) return terms;
+
+    std::vector<double> u(size), v(size);
+    for (int t = 0; t < maxTerms; t++) {
+        residual = frobenius() / norm;
+        if (residual <= tolerance) break;
+
+        // start from the strongest row, which is never orthogonal to the top singular vector
+        int best = 0;
+        double bestNorm = -1;
+        for (int r = 0; r < size; r++) {
+            double rowNorm = 0;
+            for (int c = 0; c < size; c++) rowNorm += remainder[r * size + c] * remainder[r * size + c];
+            if (rowNorm > bestNorm) { bestNorm = rowNorm; best = r; }
+        }
+        for (int c = 0; c < size; c++) v[c] = remainder[best * size + c] / std::sqrt(bestNorm);
+
+        double sigma = 0;
+        for (int i = 0; i < POWER_ITERATIONS; i++) {
+            // u = R v / |R v|, v = R^T u / |R^T u|
+            double uNorm = 0;
+            for (int r = 0; r < size; r++) {
+                u[r] = 0;
+                for (int c = 0; c < size; c++) u[r] += remainder[r * size + c] * v[c];
+                uNorm += u[r] * u[r];
+            }
+            uNorm = std::sqrt(uNorm);
+            for (double& x: u) x /= uNorm;
+
+            double vNorm = 0;
+            for (int c = 0; c < size; c++) {
+                v[c] = 0;
+                for (int r = 0; r < size; r++) v[c] += remainder[r * size + c] * u[r];
+                vNorm += v[c] * v[c];
+            }
+            vNorm = std::sqrt(vNorm);
+            for (double& x: v) x /= vNorm;
+
+            bool converged = std::abs(vNorm - sigma) <= 1e-9 * vNorm;
+            sigma = vNorm;
+            if (converged) break;
+        }
+
+        // split sigma evenly, and keep the row weights summing positive so blur kernels fold
+        double rowSum = 0;
+        for (double x: v) rowSum += x;
+        double sign = rowSum < 0 ? -1.0 : 1.0;
+        SeparableTerm term;
+        for (int r = 0; r < size; r++) term.column.push_back(sign * u[r] * std::sqrt(sigma));
+        for (int c = 0; c < size; c++) term.row.push_back(sign * v[c] * std::sqrt(sigma));
+        terms.push_back(term);
+
+        for (int r = 0; r < size; r++) {
+            for (int c = 0; c < size; c++) remainder[r * size + c] -= sigma * u[r] * v[c];
+        }
+    }
+    residual = frobenius() / norm;
+    return terms;
+}
+
+std::vector<Convolution::Tap> Convolution::foldTaps(const std::vector<float>& weights, glm::vec2 axis) {
+    // w0 * T(x) + w1 * T(x + 1) is one linear fetch at x + w1 / (w0 + w1) when both have the same sign
+    int half = weights.size() / 2;
+    std::vector<Tap> taps;
+    for (int i = 0; i < (int)weights.size(); i++) {
+        float w0 = weights[i];
+        if (std::abs(w0) < 1e-7f) continue;
+        float offset = i - half;
+        if (i + 1 < (int)weights.size() && std::abs(weights[i + 1]) >= 1e-7f && (w0 > 0) == (weights[i + 1] > 0)) {
+            float w1 = weights[i + 1];
+            offset += w1 / (w0 + w1);
+            w0 += w1;
+            i++;
+        }
+        taps.push_back(Tap(axis * offset, w0));
+    }
+    return taps;
+}
+
+void Convolution::uploadTaps(GLuint shader, const std::vector<std::vector<Tap>>& groups) {
+    // offsets and weights never change, so they live in the program rather than being set every frame
+    std::vector<glm::vec4> taps;
+    GLint starts[MAX_TERMS + 1] = {0};
+    for (int g = 0; g < (int)groups.size(); g++) {
+        for (const Tap& tap: groups[g]) taps.push_back(glm::vec4(tap, 0.f));
+        starts[g + 1] = taps.size();
+    }
+    glUseProgram(shader);
+    if (!taps.empty()) glUniform4fv(glGetUniformLocation(shader, "taps"), taps.size(), &taps[0][0]);
+    glUniform1iv(glGetUniformLocation(shader, "tapStart"), MAX_TERMS + 1, starts);
+    glUseProgram(0);
+}
+
+void Convolution::addPasses(RenderGraph& graph, const std::string& input, const std::string& output) {
+    if (m_terms.empty()) {
+        graph.addPass({output, {input}, output, m_scale, false, [this](const std::vector<const RenderTarget*>& inputs) {
+            paintRows(inputs[0], 0);
+        }});
+        return;
+    }
+
+    // one horizontal pass per term into a signed half-float target, then one pass that
+    // runs every term's vertical filter and sums them
+    std::vector<std::string> rows;
+    for (int t = 0; t < (int)m_terms.size(); t++) {
+        std::string name = output + "ConvolutionRows" + std::to_string(t);
+        rows.push_back(name);
+        graph.addPass({name, {input}, name, m_scale, false, [this, t](const std::vector<const RenderTarget*>& inputs) {
+            paintRows(inputs[0], t);
+        }, GL_RGBA16F});
+    }
+    graph.addPass({output, rows, output, m_scale, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        paintColumns(inputs);
+    }});
+}
+
+void Convolution::paintTexture() {
+    paintRows(m_input, 0);
+}
+
+void Convolution::paintRows(const RenderTarget* input, int term) {
+    setInput(input);
     glUseProgram(getShader());
-    glUniform2fv(glGetUniformLocation(getShader(), "offsets"), 9, (float*)offsets);
-    glUniform1fv(glGetUniformLocation(getShader(), "kernel"), 9, m_kernel.data());
+    glUniform1i(glGetUniformLocation(getShader(), "term"), term);
+    glUniform2f(glGetUniformLocation(getShader(), "texelSize"), 1.f / input->allocWidth, 1.f / input->allocHeight);
     glUseProgram(0);
     PostProcess::paintTexture();
 }
+
+void Convolution::paintColumns(const std::vector<const RenderTarget*>& rows) {
+    glUseProgram(m_columnShader);
+    glUniform1i(glGetUniformLocation(m_columnShader, "numTerms"), rows.size());
+    for (int t = 0; t < (int)rows.size(); t++) {
+        std::string index = std::to_string(t);
+        glUniform1i(glGetUniformLocation(m_columnShader, ("rows" + index).c_str()), t);
+        glm::vec2 uvScale = rows[t]->uvScale();
+        glUniform2f(glGetUniformLocation(m_columnShader, ("termUVScale[" + index + "]").c_str()), uvScale.x, uvScale.y);
+        glUniform2f(glGetUniformLocation(m_columnShader, ("termTexelSize[" + index + "]").c_str()),
+                    1.f / rows[t]->allocWidth, 1.f / rows[t]->allocHeight);
+        glActiveTexture(GL_TEXTURE0 + t);
+        glBindTexture(GL_TEXTURE_2D, rows[t]->color);
+    }
+    drawFullscreenQuad();
+    for (int t = (int)rows.size() - 1; t >= 0; t--) {
+        glActiveTexture(GL_TEXTURE0 + t);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glUseProgram(0);
+}
+
+std::vector<float> Convolution::gaussianKernel(int radius, float sigma) {
+    int size = 2 * radius + 1;
+    std::vector<float> weights(size);
+    float sum = 0.f;
+    for (int i = 0; i < size; i++) {
+        float x = i - radius;
+        weights[i] = std::exp(-x * x / (2.f * sigma * sigma));
+        sum += weights[i];
+    }
+    std::vector<float> kernel(size * size);
+    for (int r = 0; r < size; r++) {
+        for (int c = 0; c < size; c++) kernel[r * size + c] = weights[r] * weights[c] / (sum * sum);
+    }
+    return kernel;
+}
+
+std::vector<float> Convolution::boxKernel(int radius) {
+    int size = 2 * radius + 1;
+    return std::vector<float>(size * size, 1.f / (size * size));
+}
+
+std::vector<float> Convolution::discKernel(int radius) {
+    int size = 2 * radius + 1;
+    std::vector<float> kernel(size * size, 0.f);
+    float limit = (radius + 0.5f) * (radius + 0.5f);
+    int count = 0;
+    for (int r = 0; r < size; r++) {
+        for (int c = 0; c < size; c++) {
+            float x = c - radius, y = r - radius;
+            if (x * x + y * y <= limit) {
+                kernel[r * size + c] = 1.f;
+                count++;
+            }
+        }
+    }
+    for (float& w: kernel) w /= count;
+    return kernel;
+}
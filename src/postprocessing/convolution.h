@@ -2,18 +2,60 @@
 #define CONVOLUTION_H
 
 #include <vector>
+#include <glm/glm.hpp>
 #include "postprocessing/postprocess.h"
+
+// Convolves the image with a square kernel of any odd size (row-major, first row on top).
+// The kernel is split into a sum of separable row/column terms once, on construction:
+// a rank-1 kernel (box, Gaussian, ...) becomes one horizontal and one vertical pass,
+// a low-rank one a few of them, and small full-rank kernels stay a single 2D pass,
+// whichever takes fewer texture fetches. Adjacent taps of the same sign are folded into
+// one bilinear fetch, so a Gaussian of radius r costs about r + 1 fetches per direction.
 class Convolution : public PostProcess
 {
 public:
-    Convolution(std::vector<float> kernel, float offset, int width, int height, std::string frag_shader = ":/resources/shaders/convolution.frag");
+    Convolution(std::vector<float> kernel, int width, int height);
     void paintTexture() override;
+    void addPasses(RenderGraph& graph, const std::string& input, const std::string& output) override;
+    void destroyShaders();
+    // size of this filter's passes relative to the viewport, for prefilters run at reduced resolution
+    void setScale(float scale) { m_scale = scale; }
+
+    bool isSeparable() const { return !m_terms.empty(); }
+    int numTerms() const { return m_terms.size(); }
+
+    // kernels for the usual prefilters: blur / bloom spread, and a flat bokeh disc for depth of field
+    static std::vector<float> gaussianKernel(int radius, float sigma);
+    static std::vector<float> boxKernel(int radius);
+    static std::vector<float> discKernel(int radius);
+
+    // kernel ~= sum over terms of column * row^T, largest singular value first. Stops once the
+    // remainder is below `tolerance` of the kernel's norm or after maxTerms terms
+    struct SeparableTerm {
+        std::vector<float> column;
+        std::vector<float> row;
+    };
+    static std::vector<SeparableTerm> decompose(const std::vector<float>& kernel, int size, int maxTerms, float tolerance, float& residual);
+
     static std::string frag_shader;
-    static constexpr int KERNEL_SIZE = 9;
+    static constexpr int MAX_TERMS = 4;
+    // per program; each tap is one vec4 uniform, well under the GL 4.1 minimum of 256
+    static constexpr int MAX_TAPS = 128;
 
 private:
-    std::vector<float> m_kernel;
-    float m_offset;
+    // (x, y, weight) in pixels of the input
+    using Tap = glm::vec3;
+    // pairs neighbouring same-signed weights into one bilinear fetch between them
+    static std::vector<Tap> foldTaps(const std::vector<float>& weights, glm::vec2 axis);
+    void uploadTaps(GLuint shader, const std::vector<std::vector<Tap>>& groups);
+
+    void paintRows(const RenderTarget* input, int term);
+    void paintColumns(const std::vector<const RenderTarget*>& rows);
+
+    int m_size;
+    float m_scale = 1.f;
+    std::vector<SeparableTerm> m_terms; // empty when the kernel runs as a single 2D pass
+    GLuint m_columnShader = 0;
 };
 
 #endif // CONVOLUTION_H
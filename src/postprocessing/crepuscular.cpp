@@ -1,5 +1,8 @@
 #include "crepuscular.h"
+#include "utils/shaderloader.h"
+#include "utils/stats.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
 #include <iostream>
 
 std::string Crepuscular::frag_shader = ":/resources/shaders/crepuscular.frag";
@@ -13,30 +16,20 @@ Crepuscular::Crepuscular(int width, int height,
     , m_renderData(renderData)
     , m_projMatrix(projMatrix)
 {
-    // Create depth texture attachment
-    glGenTextures(1, &m_depthTexture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
-                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // Attach depth texture to FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, getFramebuffer());
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                           GL_TEXTURE_2D, m_depthTexture, 0);
+    m_maskShader = ShaderLoader::createShaderProgram(":/resources/shaders/texture.vert", ":/resources/shaders/crepuscular_mask.frag");
+    m_marchShader = ShaderLoader::createShaderProgram(":/resources/shaders/texture.vert", ":/resources/shaders/crepuscular_march.frag");
+    m_compositeShader = ShaderLoader::createShaderProgram(":/resources/shaders/texture.vert", ":/resources/shaders/crepuscular_composite.frag");
+}
 
-    // Check framebuffer completeness
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (status != GL_FRAMEBUFFER_COMPLETE) {
-        std::cerr << "Crepuscular FBO not complete: " << status << std::endl;
-    }
+void Crepuscular::destroyShaders() {
+    glDeleteProgram(m_maskShader);
+    glDeleteProgram(m_marchShader);
+    glDeleteProgram(m_compositeShader);
+    if (m_timerQuery != 0) glDeleteQueries(1, &m_timerQuery);
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void Crepuscular::setQuality(int quality) {
+    m_quality = std::max(0, std::min(2, quality));
 }
 
 void Crepuscular::updateCameraAndScene(Camera* camera, RenderData* renderData, glm::mat4* projMatrix) {
@@ -45,19 +38,38 @@ void Crepuscular::updateCameraAndScene(Camera* camera, RenderData* renderData, g
     m_projMatrix = projMatrix;
 }
 
-void Crepuscular::paintTexture() {
-    glUseProgram(getShader());
-
-    // Bind scene color texture to unit 0
-    GLuint sceneTexLoc = glGetUniformLocation(getShader(), "sceneTex");
-    glUniform1i(sceneTexLoc, 0);
+void Crepuscular::addPasses(RenderGraph& graph, const std::string& input, const std::string& output) {
+    // depth always comes from the scene target, since an earlier effect's output has none
+    if (m_quality == 0) {
+        graph.addPass({output, {input, RenderGraph::SCENE}, output, 1.f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+            m_sceneDepth = inputs[1];
+            setInput(inputs[0]);
+            beginTiming();
+            paintTexture();
+            endTiming();
+        }});
+        return;
+    }
 
-    // Bind depth texture to unit 2
-    GLuint depthTexLoc = glGetUniformLocation(getShader(), "depthTex");
-    glUniform1i(depthTexLoc, 2);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+    // emission mask -> radial march, both at reduced resolution, then a depth-aware upsample
+    float scale = 1.f / (1 << m_quality);
+    std::string mask = output + "CrepuscularMask";
+    std::string rays = output + "CrepuscularRays";
+    graph.addPass({mask, {input, RenderGraph::SCENE}, mask, scale, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        beginTiming();
+        setInput(inputs[0]);
+        paintMask(inputs[1]);
+    }});
+    graph.addPass({rays, {mask}, rays, scale, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        paintMarch(inputs[0]);
+    }});
+    graph.addPass({output, {input, RenderGraph::SCENE, rays}, output, 1.f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        paintComposite(inputs[0], inputs[1], inputs[2]);
+        endTiming();
+    }});
+}
 
+void Crepuscular::lightOnScreen(glm::vec2& lightScreenUV, float& facing) {
     // Compute light screen-space position
     glm::vec3 lightWorldPos(0.0f);
     bool foundLight = false;
@@ -76,7 +88,7 @@ void Crepuscular::paintTexture() {
         foundLight = true;
     }
 
-    glm::vec2 lightScreenUV(0.5f, 0.5f);
+    lightScreenUV = glm::vec2(0.5f, 0.5f);
     if (foundLight) {
         glm::vec4 clip = (*m_projMatrix) * m_camera->view * glm::vec4(lightWorldPos, 1.0f);
         if (clip.w != 0.0f) {
@@ -85,27 +97,48 @@ void Crepuscular::paintTexture() {
         }
     }
 
-    glUniform2f(glGetUniformLocation(getShader(), "lightScreenPos"),
-                lightScreenUV.x, lightScreenUV.y);
+    // Compute facing factor
+    glm::vec3 camForward = glm::normalize(glm::vec3(m_camera->look));
+    glm::vec3 lightDir = glm::normalize(lightWorldPos - glm::vec3(m_camera->pos));
+    facing = glm::dot(camForward, lightDir);
+    if (facing < 0.f) facing = 0.f;
+}
+
+void Crepuscular::setRayUniforms(GLuint shader, int stepRatio) {
+    glm::vec2 lightScreenUV;
+    float facing;
+    lightOnScreen(lightScreenUV, facing);
+    glUniform2f(glGetUniformLocation(shader, "lightScreenPos"), lightScreenUV.x, lightScreenUV.y);
+    glUniform1f(glGetUniformLocation(shader, "facing"), facing);
+
+    // Set crepuscular ray parameters. Taking 1/stepRatio of the samples over the same ray
+    // length, each step stands in for stepRatio of the original ones
+    glUniform1f(glGetUniformLocation(shader, "exposure"), m_exposure);
+    glUniform1f(glGetUniformLocation(shader, "decay"), std::pow(m_decay, float(stepRatio)));
+    glUniform1f(glGetUniformLocation(shader, "density"), m_density);
+    glUniform1f(glGetUniformLocation(shader, "weight"), m_weight * stepRatio);
+    glUniform1i(glGetUniformLocation(shader, "numSamples"), m_numSamples / stepRatio);
+}
+
+void Crepuscular::paintTexture() {
+    glUseProgram(getShader());
+
+    // Bind scene color texture to unit 0
+    GLuint sceneTexLoc = glGetUniformLocation(getShader(), "sceneTex");
+    glUniform1i(sceneTexLoc, 0);
+
+    // Bind the scene's depth to unit 2
+    GLuint depthTexLoc = glGetUniformLocation(getShader(), "depthTex");
+    glUniform1i(depthTexLoc, 2);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_sceneDepth->depth);
 
-    // Set crepuscular ray parameters
-    glUniform1f(glGetUniformLocation(getShader(), "exposure"), m_exposure);
-    glUniform1f(glGetUniformLocation(getShader(), "decay"), m_decay);
-    glUniform1f(glGetUniformLocation(getShader(), "density"), m_density);
-    glUniform1f(glGetUniformLocation(getShader(), "weight"), m_weight);
-    glUniform1i(glGetUniformLocation(getShader(), "numSamples"), m_numSamples);
+    setRayUniforms(getShader(), 1);
 
     // Viewport size
     glUniform2f(glGetUniformLocation(getShader(), "screenSize"),
                 float(m_fbo_width), float(m_fbo_height));
 
-    // Compute facing factor
-    glm::vec3 camForward = glm::normalize(glm::vec3(m_camera->look));
-    glm::vec3 lightDir = glm::normalize(lightWorldPos - glm::vec3(m_camera->pos));
-    float facing = glm::dot(camForward, lightDir);
-    if (facing < 0.f) facing = 0.f;
-    glUniform1f(glGetUniformLocation(getShader(), "facing"), facing);
-
     // Call parent's paint method to draw the fullscreen quad
     PostProcess::paintTexture();
 
@@ -113,3 +146,92 @@ void Crepuscular::paintTexture() {
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
+
+void Crepuscular::paintMask(const RenderTarget* scene) {
+    glUseProgram(m_maskShader);
+    glUniform1i(glGetUniformLocation(m_maskShader, "sceneTex"), 0);
+    glUniform1i(glGetUniformLocation(m_maskShader, "depthTex"), 2);
+    glUniform2fv(glGetUniformLocation(m_maskShader, "sceneScale"), 1, &m_input->uvScale()[0]);
+    glUniform2fv(glGetUniformLocation(m_maskShader, "depthScale"), 1, &scene->uvScale()[0]);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_input->color);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, scene->depth);
+    drawFullscreenQuad();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Crepuscular::paintMarch(const RenderTarget* mask) {
+    glUseProgram(m_marchShader);
+    glUniform1i(glGetUniformLocation(m_marchShader, "maskTex"), 0);
+    glUniform2fv(glGetUniformLocation(m_marchShader, "maskScale"), 1, &mask->uvScale()[0]);
+    setRayUniforms(m_marchShader, 1 << m_quality);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mask->color);
+    drawFullscreenQuad();
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Crepuscular::paintComposite(const RenderTarget* input, const RenderTarget* scene, const RenderTarget* rays) {
+    glUseProgram(m_compositeShader);
+    glUniform1i(glGetUniformLocation(m_compositeShader, "sceneTex"), 0);
+    glUniform1i(glGetUniformLocation(m_compositeShader, "raysTex"), 1);
+    glUniform1i(glGetUniformLocation(m_compositeShader, "depthTex"), 2);
+    glUniform2fv(glGetUniformLocation(m_compositeShader, "sceneScale"), 1, &input->uvScale()[0]);
+    glUniform2fv(glGetUniformLocation(m_compositeShader, "raysScale"), 1, &rays->uvScale()[0]);
+    glUniform2fv(glGetUniformLocation(m_compositeShader, "depthScale"), 1, &scene->uvScale()[0]);
+    glUniform2f(glGetUniformLocation(m_compositeShader, "raysSize"), rays->width, rays->height);
+    // enough of the projection to turn stored depth back into view distance
+    glUniform2f(glGetUniformLocation(m_compositeShader, "projParams"), (*m_projMatrix)[2][2], (*m_projMatrix)[3][2]);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, input->color);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, rays->color);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, scene->depth);
+    drawFullscreenQuad();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
+
+void Crepuscular::beginTiming() {
+    if (!statsEnabled()) return;
+    if (m_timerQuery == 0) glGenQueries(1, &m_timerQuery);
+    if (m_timerPending) {
+        // read last frame's result without stalling; if it is not back yet, skip timing this frame
+        GLint available = 0;
+        glGetQueryObjectiv(m_timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(m_timerQuery, GL_QUERY_RESULT, &ns);
+        m_timerPending = false;
+        m_gpuNs += ns;
+        if (++m_timedFrames == STATS_PERIOD_FRAMES) {
+            const char* resolution[] = {"full", "half", "quarter"};
+            std::cout << "Crepuscular rays (" << resolution[m_quality] << " res): "
+                      << (m_gpuNs / m_timedFrames) * 1e-6 << " ms GPU per frame" << std::endl;
+            m_gpuNs = 0;
+            m_timedFrames = 0;
+        }
+    }
+    glBeginQuery(GL_TIME_ELAPSED, m_timerQuery);
+    m_timing = true;
+}
+
+void Crepuscular::endTiming() {
+    if (!m_timing) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    m_timing = false;
+    m_timerPending = true;
+}
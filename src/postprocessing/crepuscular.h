@@ -14,14 +14,42 @@ public:
                 RenderData* renderData,
                 glm::mat4* projMatrix);
     void paintTexture() override;
+    void addPasses(RenderGraph& graph, const std::string& input, const std::string& output) override;
     void updateCameraAndScene(Camera* camera, RenderData* renderData, glm::mat4* projMatrix);
+    // 0 marches every pixel; 1 and 2 march at half and quarter resolution and upsample
+    void setQuality(int quality);
+    void destroyShaders();
     static std::string frag_shader;
 
 private:
-    GLuint m_depthTexture;
+    // light position in screen uv and how directly the camera faces it
+    void lightOnScreen(glm::vec2& lightScreenUV, float& facing);
+    void setRayUniforms(GLuint shader, int stepRatio);
+
+    // reduced-resolution path
+    void paintMask(const RenderTarget* scene);
+    void paintMarch(const RenderTarget* mask);
+    void paintComposite(const RenderTarget* input, const RenderTarget* scene, const RenderTarget* rays);
+
+    // GPU time of all the passes, reported every STATS_PERIOD_FRAMES frames when LOG_STATS is set
+    void beginTiming();
+    void endTiming();
+
     Camera* m_camera;
     RenderData* m_renderData;
     glm::mat4* m_projMatrix;
+    const RenderTarget* m_sceneDepth = nullptr;
+
+    GLuint m_maskShader;
+    GLuint m_marchShader;
+    GLuint m_compositeShader;
+    int m_quality = 1;
+
+    GLuint m_timerQuery = 0;
+    bool m_timerPending = false;
+    bool m_timing = false;
+    double m_gpuNs = 0;
+    int m_timedFrames = 0;
 
     // Crepuscular ray parameters
     float m_exposure = 0.1f;
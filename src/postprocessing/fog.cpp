@@ -1,84 +1,80 @@
-// #include "fog.h"
-// #include <iostream>
-// #include <QDebug>
-// #include <QDir>
-// #include <QImageReader>
+#include "fog.h"
 
-// std::string Fog::frag_shader = ":/resources/shaders/fog.frag";
+std::string Fog::frag_shader = ":/resources/shaders/fog.frag";
 
-// Fog::Fog(float density, int width, int height)
-//     : PostProcess(frag_shader, width, height)
-// {
-//     std::cout << "start tjhois" << std::endl;
-//     m_density = density;
+Fog::Fog(int width, int height,
+         Camera* camera,
+         RenderData* renderData,
+         glm::mat4* projMatrix)
+    : PostProcess(frag_shader, width, height)
+    , m_camera(camera)
+    , m_renderData(renderData)
+    , m_projMatrix(projMatrix)
+{
+}
 
-//     // Task 19: Generate and bind an empty texture, set its min/mag filter interpolation, then unbind
-//     glGenTextures(1, &m_fbo_depthTexture);
-//     glActiveTexture(GL_TEXTURE2);
-//     glBindTexture(GL_TEXTURE_2D, m_fbo_depthTexture);
-//     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_fbo_width, m_fbo_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-//     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-//     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-//     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-//     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-//     glBindTexture(GL_TEXTURE_2D, 0);
+void Fog::updateCameraAndScene(Camera* camera, RenderData* renderData, glm::mat4* projMatrix) {
+    m_camera = camera;
+    m_renderData = renderData;
+    m_projMatrix = projMatrix;
+}
 
-//     glBindFramebuffer(GL_FRAMEBUFFER, getFramebuffer());
-//     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_fbo_depthTexture, 0);
-//     //glDrawBuffer(GL_NONE);
-//     //glReadBuffer(GL_NONE);
+void Fog::addPasses(RenderGraph& graph, const std::string& input, const std::string& output) {
+    // depth comes from the scene target; when fog is first in the chain both reads are the same target
+    graph.addPass({output, {input, RenderGraph::SCENE}, output, 1.f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        m_sceneDepth = inputs[1];
+        setInput(inputs[0]);
+        paintTexture();
+    }});
+}
 
-//     // After setting up FBO, check what's wrong:
-//     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-//     if (status != GL_FRAMEBUFFER_COMPLETE) {
-//         std::cerr << "Framebuffer is not complete: ";
-//         switch(status) {
-//         case GL_FRAMEBUFFER_UNDEFINED:
-//             std::cerr << "GL_FRAMEBUFFER_UNDEFINED" << std::endl;
-//             break;
-//         case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:
-//             std::cerr << "GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT" << std::endl;
-//             break;
-//         case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT:
-//             std::cerr << "GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT" << std::endl;
-//             break;
-//         case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER:
-//             std::cerr << "GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER" << std::endl;
-//             break;
-//         case GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER:
-//             std::cerr << "GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER" << std::endl;
-//             break;
-//         case GL_FRAMEBUFFER_UNSUPPORTED:
-//             std::cerr << "GL_FRAMEBUFFER_UNSUPPORTED" << std::endl;
-//             break;
-//         case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE:
-//             std::cerr << "GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE" << std::endl;
-//             break;
-//         default:
-//             std::cerr << "Unknown error " << status << std::endl;
-//             break;
-//         }
-//     }
+void Fog::paintTexture() {
+    glUseProgram(getShader());
+    setFogUniforms(getShader(), "");
 
-//     //glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_fbo_depthTexture, 0);
-//     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-// }
+    PostProcess::paintTexture();
 
-// void Fog::paintTexture() {
-//     //glEnable(GL_DEPTH_TEST);
-//     //glDepthMask(GL_TRUE);
-//     glUseProgram(getShader());
-//     // set the color grading related uniforms
-//     GLuint density_location = glGetUniformLocation(getShader(), "density");
-//     glUniform1f(density_location, m_density);
-//     GLuint depth_texture_location = glGetUniformLocation(getShader(), "depthTexture");
-//     glUniform1i(depth_texture_location, 2);
-//     glActiveTexture(GL_TEXTURE2);
-//     glBindTexture(GL_TEXTURE_2D, m_fbo_depthTexture);
-//     //glUseProgram(0);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
 
-//     PostProcess::paintTexture();
+void Fog::setFusedUniforms(GLuint shader) {
+    setFogUniforms(shader, "fog_");
+}
 
-//     glActiveTexture(GL_TEXTURE2);
-//     glBindTexture(GL_TEXTURE_2D, 0);
-// }
+void Fog::setFogUniforms(GLuint shader, const std::string& prefix) {
+    auto location = [&](const char* name) {
+        return glGetUniformLocation(shader, (prefix + name).c_str());
+    };
+
+    glUniform1i(location("depthTex"), 2);
+    glUniform2fv(location("depthScale"), 1, &m_sceneDepth->uvScale()[0]);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, m_sceneDepth->depth);
+
+    // rays are rebuilt in view space and turned into world space for the height term
+    glm::mat4 invProj = glm::inverse(*m_projMatrix);
+    glUniformMatrix4fv(location("invProj"), 1, GL_FALSE, &invProj[0][0]);
+    glUniformMatrix4fv(location("viewInv"), 1, GL_FALSE, &m_camera->viewInv[0][0]);
+    glUniform3fv(location("camPos"), 1, &m_camera->pos[0]);
+
+    // the first directional light scatters through the fog; without one there is no glow
+    glm::vec3 sunDir(0.f);
+    for (const SceneLightData &L : m_renderData->lights) {
+        if (L.type == LightType::LIGHT_DIRECTIONAL) {
+            sunDir = -glm::normalize(glm::vec3(L.dir));
+            break;
+        }
+    }
+    glUniform3fv(location("sunDir"), 1, &sunDir[0]);
+
+    glUniform3fv(location("fogColor"), 1, &m_color[0]);
+    glUniform3fv(location("sunColor"), 1, &m_sunColor[0]);
+    glUniform1f(location("density"), m_density);
+    glUniform1f(location("heightDensity"), m_heightDensity);
+    glUniform1f(location("heightFalloff"), m_heightFalloff);
+    glUniform1f(location("baseHeight"), m_baseHeight);
+    glUniform1f(location("sunExponent"), m_sunExponent);
+    glUniform1f(location("skyDistance"), m_skyDistance);
+}
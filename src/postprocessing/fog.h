@@ -1,23 +1,50 @@
 #ifndef FOG_H
 #define FOG_H
 
-#include <QCoreApplication>
-#include <QtGui/qimage.h>
 #include "postprocess.h"
+#include "../camera.h"
+#include "../utils/sceneparser.h"
+#include <glm/glm.hpp>
 
+// Distance, height and sun-scattering fog in one pass. The view-space position of every
+// pixel is rebuilt from the scene's depth target, so no extra depth buffer is needed.
 class Fog : public PostProcess
 {
 public:
-    Fog(float density, int width, int height);
+    Fog(int width, int height,
+        Camera* camera,
+        RenderData* renderData,
+        glm::mat4* projMatrix);
     void paintTexture() override;
+    void addPasses(RenderGraph& graph, const std::string& input, const std::string& output) override;
+    void updateCameraAndScene(Camera* camera, RenderData* renderData, glm::mat4* projMatrix);
     static std::string frag_shader;
 
+    // per pixel apart from the depth, which the fused pass reads from the scene target for it
+    std::string fusedFunction() const override { return "fog"; }
+    std::string fusedSnippet() const override { return ":/resources/shaders/fused/fog.glsl"; }
+    void setFusedUniforms(GLuint shader) override;
+    bool fusedReadsSceneDepth() const override { return true; }
+    void setSceneDepth(const RenderTarget* scene) override { m_sceneDepth = scene; }
+
 private:
-    QImage m_LUT_image;
-    GLuint m_LUT_texture;
-    int m_density;
+    // the fused snippet's uniforms are the same with a "fog_" prefix
+    void setFogUniforms(GLuint shader, const std::string& prefix);
+
+    Camera* m_camera;
+    RenderData* m_renderData;
+    glm::mat4* m_projMatrix;
+    const RenderTarget* m_sceneDepth = nullptr;
 
-    GLuint m_fbo_depthTexture;
+    // Fog parameters
+    glm::vec3 m_color = glm::vec3(0.55f, 0.6f, 0.68f);
+    glm::vec3 m_sunColor = glm::vec3(1.f, 0.85f, 0.6f);
+    float m_density = 0.01f;        // uniform extinction per unit of distance
+    float m_heightDensity = 0.08f;  // extinction at m_baseHeight, falling off exponentially above it
+    float m_heightFalloff = 0.35f;
+    float m_baseHeight = 0.f;
+    float m_sunExponent = 8.f;      // how tightly the forward scattering hugs the sun
+    float m_skyDistance = 60.f;     // distance the sky is fogged as if it were at
 };
 
 #endif // FOG_H
@@ -0,0 +1,86 @@
+#include "fusedpostprocess.h"
+#include "utils/shaderloader.h"
+#include <iostream>
+
+std::map<std::string, GLuint> FusedPostProcess::s_programs;
+
+FusedPostProcess::FusedPostProcess(std::vector<PostProcess*> stages, int width, int height)
+    : PostProcess(programFor(stages), width, height)
+    , m_stages(std::move(stages))
+{
+}
+
+bool FusedPostProcess::canAppend(const std::vector<PostProcess*>& stages, const PostProcess* next) {
+    if (next->fusedFunction().empty()) return false;
+    for (const PostProcess* stage: stages) {
+        if (stage->fusedFunction() == next->fusedFunction()) return false;
+    }
+    return true;
+}
+
+std::string FusedPostProcess::generateSource(const std::vector<PostProcess*>& stages) {
+    std::string source =
+        "#version 330 core\n"
+        "\n"
+        "in vec2 uv;\n"
+        "in vec2 screenUV;\n"
+        "uniform sampler2D txt;\n"
+        "out vec4 fragColor;\n"
+        "\n";
+    source += ShaderLoader::readFile(":/resources/shaders/fused/lut.glsl") + "\n";
+    for (const PostProcess* stage: stages) {
+        source += ShaderLoader::readFile(stage->fusedSnippet().c_str()) + "\n";
+    }
+
+    source += "void main()\n{\n    vec4 color = texture(txt, uv);\n";
+    for (const PostProcess* stage: stages) {
+        source += "    color = " + stage->fusedFunction() + "(color, uv);\n";
+    }
+    source += "    fragColor = color;\n}\n";
+    return source;
+}
+
+GLuint FusedPostProcess::programFor(const std::vector<PostProcess*>& stages) {
+    std::string signature;
+    for (const PostProcess* stage: stages) {
+        signature += stage->fusedFunction() + ";";
+    }
+    auto found = s_programs.find(signature);
+    if (found != s_programs.end()) return found->second;
+
+    GLuint program = ShaderLoader::createShaderProgramFromSource(":/resources/shaders/texture.vert", generateSource(stages));
+    std::cout << "Built fused post-process program for " << signature << std::endl;
+    s_programs[signature] = program;
+    return program;
+}
+
+void FusedPostProcess::clearProgramCache() {
+    for (auto &[signature, program]: s_programs) {
+        glDeleteProgram(program);
+    }
+    s_programs.clear();
+}
+
+void FusedPostProcess::addPasses(RenderGraph& graph, const std::string& input, const std::string& output) {
+    bool readsDepth = false;
+    for (const PostProcess* stage: m_stages) readsDepth |= stage->fusedReadsSceneDepth();
+    if (!readsDepth) {
+        PostProcess::addPasses(graph, input, output);
+        return;
+    }
+    graph.addPass({output, {input, RenderGraph::SCENE}, output, 1.f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        for (PostProcess* stage: m_stages) {
+            if (stage->fusedReadsSceneDepth()) stage->setSceneDepth(inputs[1]);
+        }
+        setInput(inputs[0]);
+        paintTexture();
+    }});
+}
+
+void FusedPostProcess::paintTexture() {
+    glUseProgram(getShader());
+    for (PostProcess* stage: m_stages) {
+        stage->setFusedUniforms(getShader());
+    }
+    PostProcess::paintTexture();
+}
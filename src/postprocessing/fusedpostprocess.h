@@ -0,0 +1,32 @@
+#ifndef FUSEDPOSTPROCESS_H
+#define FUSEDPOSTPROCESS_H
+
+#include "postprocess.h"
+#include <map>
+#include <vector>
+
+// Several per-pixel effects run as one full-screen pass. The fragment shader is generated
+// from each stage's GLSL snippet and applies them in order to a single texture fetch, so
+// the intermediate targets between them are never written or read back.
+class FusedPostProcess : public PostProcess
+{
+public:
+    // stages must all be fusible and stay owned by the caller
+    FusedPostProcess(std::vector<PostProcess*> stages, int width, int height);
+    void paintTexture() override;
+    void addPasses(RenderGraph& graph, const std::string& input, const std::string& output) override;
+
+    // stages a fused chain can be extended with; each function can only appear once per program
+    static bool canAppend(const std::vector<PostProcess*>& stages, const PostProcess* next);
+    static void clearProgramCache();
+
+private:
+    // programs are shared between chains with the same signature (the ordered stage functions)
+    static GLuint programFor(const std::vector<PostProcess*>& stages);
+    static std::string generateSource(const std::vector<PostProcess*>& stages);
+    static std::map<std::string, GLuint> s_programs;
+
+    std::vector<PostProcess*> m_stages;
+};
+
+#endif // FUSEDPOSTPROCESS_H
@@ -0,0 +1,38 @@
+#include "lut3d.h"
+#include <QtGui/qimage.h>
+#include <iostream>
+#include <vector>
+
+GLuint Lut3D::loadStrip(const std::string& path, int slices, bool mirror) {
+    QImage image = QImage(QString(path.c_str())).convertToFormat(QImage::Format_RGBA8888);
+    if (mirror) image = image.mirrored();
+    if (image.width() < slices * slices || image.height() < slices) {
+        std::cerr << "LUT " << path << " is smaller than " << slices * slices << "x" << slices << std::endl;
+        return 0;
+    }
+
+    // texel (r, g, b) of the cube is column b * slices + r, row g of the strip
+    std::vector<unsigned char> texels(slices * slices * slices * 4);
+    for (int b = 0; b < slices; b++) {
+        for (int g = 0; g < slices; g++) {
+            const unsigned char* row = image.constScanLine(g);
+            for (int r = 0; r < slices; r++) {
+                const unsigned char* src = row + (b * slices + r) * 4;
+                unsigned char* dst = &texels[((b * slices + g) * slices + r) * 4];
+                dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3];
+            }
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, slices, slices, slices, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return texture;
+}
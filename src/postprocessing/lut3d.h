@@ -0,0 +1,13 @@
+#ifndef LUT3D_H
+#define LUT3D_H
+
+#include "GL/glew.h"
+#include <string>
+
+namespace Lut3D {
+    // Reads a strip LUT (`slices` square tiles side by side, blue selecting the tile) and
+    // uploads it as a slices^3 GL_TEXTURE_3D with trilinear filtering. The image is not kept.
+    GLuint loadStrip(const std::string& path, int slices, bool mirror = false);
+}
+
+#endif // LUT3D_H
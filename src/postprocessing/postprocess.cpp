@@ -24,7 +24,17 @@ PostProcess::PostProcess(std::string frag_shader, int width, int height, std::st
     m_frag_shader = frag_shader;
     m_fbo_width = width;
     m_fbo_height = height;
+    createQuad();
+}
 
+PostProcess::PostProcess(GLuint shader, int width, int height) {
+    m_shader = shader;
+    m_fbo_width = width;
+    m_fbo_height = height;
+    createQuad();
+}
+
+void PostProcess::createQuad() {
     // Generate and bind a VBO and a VAO for a fullscreen quad
     glGenBuffers(1, &m_fullscreen_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, m_fullscreen_vbo);
@@ -42,41 +52,9 @@ PostProcess::PostProcess(std::string frag_shader, int width, int height, std::st
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
-    makeFBO();
     m_start_time = std::chrono::high_resolution_clock::now();
 }
 
-void PostProcess::makeFBO() {
-    // Task 19: Generate and bind an empty texture, set its min/mag filter interpolation, then unbind
-    glGenTextures(1, &m_fbo_texture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_fbo_width, m_fbo_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // Task 20: Generate and bind a renderbuffer of the right size, set its format, then unbind
-    glGenRenderbuffers(1, &m_fbo_renderbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, m_fbo_renderbuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_fbo_width, m_fbo_height);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    // Task 18: Generate and bind an FBO
-    glGenFramebuffers(1, &m_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-
-    // Task 21: Add our texture as a color attachment, and our renderbuffer as a depth+stencil attachment, to our FBO
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fbo_texture, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_fbo_renderbuffer);
-
-    // Task 22: Unbind the FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    // std::cout << "end" << std::endl;
-}
-
 float PostProcess::getTime() {
     auto now = std::chrono::high_resolution_clock::now();
     std::chrono::duration<float> elapsed = now - m_start_time;
@@ -92,34 +70,34 @@ GLuint PostProcess::getShader() {
     return m_shader;
 }
 
-GLuint PostProcess::getTexture() {
-    return m_fbo_texture;
-}
-
-GLuint PostProcess::getFramebuffer() {
-    return m_fbo;
-}
-
 void PostProcess::paintTexture() {
     glUseProgram(m_shader);
     GLuint txt_location = glGetUniformLocation(m_shader, "txt");
     glUniform1i(txt_location, 0);
     glUniform1f(glGetUniformLocation(getShader(), "time"), getTime());
+    // pooled targets can be larger than the image they hold
+    glm::vec2 uvScale = m_input->uvScale();
+    glUniform2f(glGetUniformLocation(m_shader, "uvScale"), uvScale.x, uvScale.y);
 
-    glBindVertexArray(m_fullscreen_vao);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
+    glBindTexture(GL_TEXTURE_2D, m_input->color);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    drawFullscreenQuad();
     glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
     glUseProgram(0);
 }
 
-void PostProcess::destroyFBO() {
-    glDeleteTextures(1, &m_fbo_texture);
-    glDeleteRenderbuffers(1, &m_fbo_renderbuffer);
-    glDeleteFramebuffers(1, &m_fbo);
+void PostProcess::drawFullscreenQuad() {
+    glBindVertexArray(m_fullscreen_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+}
+
+void PostProcess::addPasses(RenderGraph& graph, const std::string& input, const std::string& output) {
+    graph.addPass({output, {input}, output, 1.f, false, [this](const std::vector<const RenderTarget*>& inputs) {
+        setInput(inputs[0]);
+        paintTexture();
+    }});
 }
 
 void PostProcess::destroyVertex() {
@@ -2,6 +2,7 @@
 #define POSTPROCESS_H
 
 #include "GL/glew.h"
+#include "rendergraph.h"
 #include <string>
 #include <vector>
 #include <chrono>
@@ -10,34 +11,49 @@ class PostProcess
 {
 public:
     PostProcess(std::string frag_shader, int width, int height, std::string vertex_shader = ":/resources/shaders/texture.vert");
-    void makeFBO();
     void updateRes(int width, int height);
     GLuint getShader();
-    GLuint getTexture();
-    GLuint getFramebuffer();
+    // the target this effect reads from; the render graph sets it before every paint
+    void setInput(const RenderTarget* input) { m_input = input; }
     virtual void paintTexture();
-    void destroyFBO();
     void destroyVertex();
+    // adds the pass(es) for this effect to the frame graph, reading `input` and writing `output`
+    virtual void addPasses(RenderGraph& graph, const std::string& input, const std::string& output);
+
+    // Per-pixel effects can also run as one stage of a generated shader (see FusedPostProcess).
+    // fusedSnippet is a GLSL file defining `vec4 <fusedFunction>(vec4 color, vec2 uv)`; effects
+    // that read neighbouring pixels leave both empty and always get their own pass
+    virtual std::string fusedFunction() const { return ""; }
+    virtual std::string fusedSnippet() const { return ""; }
+    // binds this effect's textures and sets its uniforms on the fused program
+    virtual void setFusedUniforms(GLuint shader) {}
+    // fusible effects that also sample the scene's depth; the fused pass then reads
+    // RenderGraph::SCENE too and hands it over before setFusedUniforms
+    virtual bool fusedReadsSceneDepth() const { return false; }
+    virtual void setSceneDepth(const RenderTarget* scene) {}
 
     static std::vector<GLfloat> fullscreen_quad_data;
 
     virtual ~PostProcess() {}
 
 protected:
+    // for programs built at runtime rather than loaded from a file
+    PostProcess(GLuint shader, int width, int height);
+    void drawFullscreenQuad();
+
     int m_fbo_width;
     int m_fbo_height;
+    const RenderTarget* m_input = nullptr;
 
 private:
     GLuint m_shader;
-    GLuint m_fbo;
-    GLuint m_fbo_texture;
-    GLuint m_fbo_renderbuffer;
     GLuint m_fullscreen_vbo;
     GLuint m_fullscreen_vao;
     std::string m_frag_shader;
 
     std::chrono::high_resolution_clock::time_point m_start_time;
     float getTime();
+    void createQuad();
 
 
 
@@ -0,0 +1,87 @@
+#include "rendergraph.h"
+#include <iostream>
+#include <unordered_map>
+
+const std::string RenderGraph::BACKBUFFER = "backbuffer";
+const std::string RenderGraph::SCENE = "scene";
+
+void RenderGraph::addPass(RenderPass pass) {
+    m_passes.push_back(std::move(pass));
+    m_compiled = false;
+}
+
+void RenderGraph::clear() {
+    m_passes.clear();
+    m_releaseAfter.clear();
+    m_compiled = false;
+}
+
+void RenderGraph::compile() {
+    std::unordered_map<std::string, int> writer;
+    std::unordered_map<std::string, int> lastRead;
+    for (int i = 0; i < (int)m_passes.size(); i++) {
+        for (const std::string& input: m_passes[i].reads) {
+            if (writer.count(input) == 0) {
+                std::cerr << "Render pass " << m_passes[i].name << " reads " << input << " before anything writes it" << std::endl;
+            }
+            lastRead[input] = i;
+        }
+        const std::string& output = m_passes[i].writes;
+        if (output != BACKBUFFER && writer.count(output) != 0) {
+            std::cerr << "Render pass " << m_passes[i].name << " writes " << output << ", already written by "
+                      << m_passes[writer[output]].name << std::endl;
+        }
+        writer[output] = i;
+    }
+
+    m_releaseAfter.assign(m_passes.size(), {});
+    for (auto &[resource, pass]: writer) {
+        if (resource == BACKBUFFER) continue;
+        // never read: free it right after it is written
+        int last = (lastRead.count(resource) != 0 && lastRead[resource] > pass) ? lastRead[resource] : pass;
+        m_releaseAfter[last].push_back(resource);
+    }
+    m_compiled = true;
+}
+
+void RenderGraph::execute(RenderTargetPool& pool, int width, int height, GLuint defaultFramebuffer) {
+    if (!m_compiled) compile();
+
+    std::unordered_map<std::string, RenderTarget*> live;
+    std::vector<const RenderTarget*> inputs;
+    RenderTarget* replaced = nullptr;
+    for (int i = 0; i < (int)m_passes.size(); i++) {
+        RenderPass& pass = m_passes[i];
+
+        inputs.clear();
+        for (const std::string& input: pass.reads) {
+            inputs.push_back(live.count(input) != 0 ? live[input] : nullptr);
+        }
+
+        if (pass.writes == BACKBUFFER) {
+            glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+            glViewport(0, 0, width, height);
+        } else {
+            // acquired before this pass's inputs are released, so a pass never reads its own output
+            RenderTarget* target = pool.acquire(width * pass.scale, height * pass.scale, pass.depth, pass.format);
+            // a second writer replaces the earlier target, which goes back once this pass has read it
+            if (live.count(pass.writes) != 0) replaced = live[pass.writes];
+            live[pass.writes] = target;
+            glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+            glViewport(0, 0, target->width, target->height);
+        }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        pass.execute(inputs);
+
+        if (replaced != nullptr) {
+            pool.release(replaced);
+            replaced = nullptr;
+        }
+
+        for (const std::string& resource: m_releaseAfter[i]) {
+            pool.release(live[resource]);
+            live.erase(resource);
+        }
+    }
+    pool.endFrame();
+}
@@ -0,0 +1,45 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include "rendertargetpool.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// One step of the frame: reads some named resources and writes one. Writing
+// RenderGraph::BACKBUFFER draws straight into the window's framebuffer.
+struct RenderPass {
+    std::string name;
+    std::vector<std::string> reads;
+    std::string writes;
+    float scale = 1.f;  // output size relative to the viewport
+    bool depth = false; // output needs a depth attachment
+    std::function<void(const std::vector<const RenderTarget*>& inputs)> execute;
+    GLenum format = GL_RGBA8;
+};
+
+// Orders nothing itself: passes run in the order they were added. What it does is
+// work out when each intermediate is last read, so its target goes back to the pool
+// straight away and a chain of N effects ping-pongs between two or three textures.
+class RenderGraph
+{
+public:
+    static const std::string BACKBUFFER;
+    // the scene's color + depth, written by the first pass
+    static const std::string SCENE;
+
+    void addPass(RenderPass pass);
+    void clear();
+    bool empty() const { return m_passes.empty(); }
+    void execute(RenderTargetPool& pool, int width, int height, GLuint defaultFramebuffer);
+
+private:
+    void compile();
+
+    std::vector<RenderPass> m_passes;
+    // resources whose last reader is pass i, released once it has run
+    std::vector<std::vector<std::string>> m_releaseAfter;
+    bool m_compiled = false;
+};
+
+#endif // RENDERGRAPH_H
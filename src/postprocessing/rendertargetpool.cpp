@@ -0,0 +1,110 @@
+#include "rendertargetpool.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+int roundUp(int value, int granularity) {
+    return ((value + granularity - 1) / granularity) * granularity;
+}
+}
+
+RenderTarget* RenderTargetPool::acquire(int width, int height, bool withDepth, GLenum format) {
+    width = std::max(1, width);
+    height = std::max(1, height);
+
+    // smallest free target that is large enough
+    Entry* best = nullptr;
+    for (Entry& entry: m_entries) {
+        if (entry.inUse || entry.withDepth != withDepth || entry.format != format) continue;
+        RenderTarget& t = *entry.target;
+        if (t.allocWidth < width || t.allocHeight < height) continue;
+        if (best == nullptr || t.allocWidth * t.allocHeight < best->target->allocWidth * best->target->allocHeight) best = &entry;
+    }
+    if (best == nullptr) {
+        m_entries.push_back(Entry{std::make_unique<RenderTarget>(), withDepth, format});
+        best = &m_entries.back();
+        allocate(*best, roundUp(width, SIZE_GRANULARITY), roundUp(height, SIZE_GRANULARITY));
+    }
+
+    best->inUse = true;
+    best->lastUsedFrame = m_frame;
+    best->target->width = width;
+    best->target->height = height;
+    return best->target.get();
+}
+
+void RenderTargetPool::release(RenderTarget* target) {
+    for (Entry& entry: m_entries) {
+        if (entry.target.get() == target) {
+            entry.inUse = false;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::endFrame() {
+    m_frame++;
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->inUse && m_frame - it->lastUsedFrame > IDLE_FRAMES_BEFORE_FREE) {
+            free(*it);
+            it = m_entries.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void RenderTargetPool::destroy() {
+    for (Entry& entry: m_entries) {
+        free(entry);
+    }
+    m_entries.clear();
+}
+
+void RenderTargetPool::allocate(Entry& entry, int width, int height) {
+    RenderTarget& t = *entry.target;
+    t.allocWidth = width;
+    t.allocHeight = height;
+    m_allocations++;
+
+    glGenTextures(1, &t.color);
+    glBindTexture(GL_TEXTURE_2D, t.color);
+    GLenum type = (entry.format == GL_RGBA16F) ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE;
+    glTexImage2D(GL_TEXTURE_2D, 0, entry.format, width, height, 0, GL_RGBA, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (entry.withDepth) {
+        // a texture rather than a renderbuffer so later passes can sample scene depth
+        glGenTextures(1, &t.depth);
+        glBindTexture(GL_TEXTURE_2D, t.depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &t.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t.color, 0);
+    if (entry.withDepth) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, t.depth, 0);
+    }
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Render target FBO not complete: " << status << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderTargetPool::free(Entry& entry) {
+    RenderTarget& t = *entry.target;
+    glDeleteFramebuffers(1, &t.fbo);
+    glDeleteTextures(1, &t.color);
+    if (t.depth != 0) glDeleteTextures(1, &t.depth);
+    t = RenderTarget();
+}
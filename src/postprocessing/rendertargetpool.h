@@ -0,0 +1,61 @@
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include "GL/glew.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+// Offscreen color target (plus an optional depth texture) handed out by RenderTargetPool.
+// Storage is rounded up, so only the bottom-left width x height region holds this frame's image
+struct RenderTarget {
+    GLuint fbo = 0;
+    GLuint color = 0;
+    GLuint depth = 0; // 0 for color-only targets
+    int width = 0;
+    int height = 0;
+    int allocWidth = 0;
+    int allocHeight = 0;
+
+    // maps a [0,1] uv over the used region onto the allocated texture
+    glm::vec2 uvScale() const { return glm::vec2(float(width) / allocWidth, float(height) / allocHeight); }
+};
+
+// Transient render targets shared by every post-process pass. Targets are reused across
+// frames and across passes whose lifetimes do not overlap, and a resize only allocates
+// when the new size outgrows what is already there.
+class RenderTargetPool
+{
+public:
+    // format is the color's internal format: GL_RGBA8, or GL_RGBA16F for signed / high-precision intermediates
+    RenderTarget* acquire(int width, int height, bool withDepth, GLenum format = GL_RGBA8);
+    void release(RenderTarget* target);
+    // frees targets that have gone unused for a while, e.g. after the window shrank
+    void endFrame();
+    void destroy();
+
+    int numTargets() const { return m_entries.size(); }
+    int numAllocations() const { return m_allocations; }
+
+private:
+    // sizes are rounded up to this, so dragging the window edge does not reallocate every frame
+    static constexpr int SIZE_GRANULARITY = 256;
+    static constexpr int IDLE_FRAMES_BEFORE_FREE = 120;
+
+    struct Entry {
+        std::unique_ptr<RenderTarget> target;
+        bool withDepth = false;
+        GLenum format = GL_RGBA8;
+        bool inUse = false;
+        long lastUsedFrame = 0;
+    };
+
+    void allocate(Entry& entry, int width, int height);
+    void free(Entry& entry);
+
+    std::vector<Entry> m_entries;
+    long m_frame = 0;
+    int m_allocations = 0;
+};
+
+#endif // RENDERTARGETPOOL_H
@@ -1,4 +1,7 @@
 #include "seasoncolorgrade.h"
+#include "lut3d.h"
+#include "utils/shaderloader.h"
+#include <algorithm>
 
 std::string SeasonColorgrade::frag_shader = ":/resources/shaders/seasoncolorgrading.frag";
 
@@ -8,25 +11,25 @@ SeasonColorgrade::SeasonColorgrade(std::array<std::string, n_LUTs> LUTs, std::ar
 
     m_num_slices = num_slices;
     for (int i = 0; i < n_LUTs; i++) {
-        std::string LUT = LUTs[i];
-        int num_slice = num_slices[i];
-        GLuint texture_slot = TXTSLOTSTART + i;
-
-        QString LUT_filepath = QString(LUT.c_str());
-        m_LUT_images[i] = QImage(LUT_filepath);
-        m_LUT_images[i] = m_LUT_images[i].convertToFormat(QImage::Format_RGBA8888);
-
-        glGenTextures(1, &m_LUT_textures[i]);
-        glActiveTexture(texture_slot);
-        glBindTexture(GL_TEXTURE_2D, m_LUT_textures[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_LUT_images[i].width(), m_LUT_images[i].height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, m_LUT_images[i].bits());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        m_LUT_textures[i] = Lut3D::loadStrip(LUTs[i], num_slices[i]);
+        m_blended_size = std::max(m_blended_size, num_slices[i]);
     }
+
+    glGenTextures(1, &m_blended_LUT);
+    glBindTexture(GL_TEXTURE_3D, m_blended_LUT);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, m_blended_size, m_blended_size, m_blended_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    m_bake_shader = ShaderLoader::createShaderProgram(":/resources/shaders/texture.vert", ":/resources/shaders/lutbake.frag");
+    glGenFramebuffers(1, &m_bake_fbo);
 }
 
-void SeasonColorgrade::paintTexture() {
+void SeasonColorgrade::seasonBlend(int& szn1, int& szn2, float& alpha) const {
     // represents float values for winter, spring, summer, fall
     // eps to guarantee that m_season is > first val and < last val
     float eps = 0.0001;
@@ -34,35 +37,77 @@ void SeasonColorgrade::paintTexture() {
 
     int i = 0;
     while (m_season > season_floats[i]) i++;
-    int szn1 = i - 1; // i > 0 since m_season > season_floats[0]
-    int szn2 = i;
-    float alpha = (m_season - season_floats[szn1]) / (season_floats[szn2] - season_floats[szn1]);
-
-    glUseProgram(getShader());
-
-    glUniform1f(glGetUniformLocation(getShader(), "alpha"), alpha);
+    szn1 = i - 1; // i > 0 since m_season > season_floats[0]
+    szn2 = i;
+    alpha = (m_season - season_floats[szn1]) / (season_floats[szn2] - season_floats[szn1]);
+}
 
-    glUniform1f(glGetUniformLocation(getShader(), "slices1"), m_num_slices[szn1]);
-    glUniform1f(glGetUniformLocation(getShader(), "slices2"), m_num_slices[szn2]);
-    glUniform1i(glGetUniformLocation(getShader(), "tLUT1"), SLOTSTART + szn1);
-    glUniform1i(glGetUniformLocation(getShader(), "tLUT2"), SLOTSTART + szn2);
+void SeasonColorgrade::bakeBlend() {
+    int szn1, szn2;
+    float alpha;
+    seasonBlend(szn1, szn2, alpha);
+
+    // this runs in the middle of the frame, so put the caller's target back afterwards
+    GLint prevFramebuffer;
+    GLint prevViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+
+    glUseProgram(m_bake_shader);
+    glUniform1f(glGetUniformLocation(m_bake_shader, "alpha"), alpha);
+    glUniform1f(glGetUniformLocation(m_bake_shader, "slices1"), m_num_slices[szn1]);
+    glUniform1f(glGetUniformLocation(m_bake_shader, "slices2"), m_num_slices[szn2]);
+    glUniform1f(glGetUniformLocation(m_bake_shader, "size"), m_blended_size);
+    glUniform1i(glGetUniformLocation(m_bake_shader, "tLUT1"), SLOTSTART + 1);
+    glUniform1i(glGetUniformLocation(m_bake_shader, "tLUT2"), SLOTSTART + 2);
+    glActiveTexture(TXTSLOTSTART + 1);
+    glBindTexture(GL_TEXTURE_3D, m_LUT_textures[szn1]);
+    glActiveTexture(TXTSLOTSTART + 2);
+    glBindTexture(GL_TEXTURE_3D, m_LUT_textures[szn2]);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_bake_fbo);
+    glViewport(0, 0, m_blended_size, m_blended_size);
+    for (int layer = 0; layer < m_blended_size; layer++) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_blended_LUT, 0, layer);
+        glUniform1i(glGetUniformLocation(m_bake_shader, "layer"), layer);
+        drawFullscreenQuad();
+    }
 
-    glActiveTexture(TXTSLOTSTART + szn1);
-    glBindTexture(GL_TEXTURE_2D, m_LUT_textures[szn1]);
+    glActiveTexture(TXTSLOTSTART + 1);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(TXTSLOTSTART + 2);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFramebuffer);
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    m_baked_season = m_season;
+}
 
-    glActiveTexture(TXTSLOTSTART + szn2);
-    glBindTexture(GL_TEXTURE_2D, m_LUT_textures[szn2]);
+void SeasonColorgrade::setFusedUniforms(GLuint shader) {
+    if (m_baked_season != m_season) {
+        bakeBlend();
+        glUseProgram(shader);
+    }
 
-    // glUseProgram(0);
-    PostProcess::paintTexture();
+    glUniform1f(glGetUniformLocation(shader, "seasonColorgrade_slices"), m_blended_size);
+    glUniform1i(glGetUniformLocation(shader, "seasonColorgrade_tLUT"), SLOTSTART);
+    glActiveTexture(TXTSLOTSTART);
+    glBindTexture(GL_TEXTURE_3D, m_blended_LUT);
+}
 
-    glActiveTexture(TXTSLOTSTART + szn1);
-    glBindTexture(GL_TEXTURE_2D, 0);
+void SeasonColorgrade::paintTexture() {
+    if (m_baked_season != m_season) bakeBlend();
 
-    glActiveTexture(TXTSLOTSTART + szn2);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(getShader());
 
+    glUniform1f(glGetUniformLocation(getShader(), "slices"), m_blended_size);
+    glUniform1i(glGetUniformLocation(getShader(), "tLUT"), SLOTSTART);
 
+    glActiveTexture(TXTSLOTSTART);
+    glBindTexture(GL_TEXTURE_3D, m_blended_LUT);
 
+    // glUseProgram(0);
+    PostProcess::paintTexture();
 
+    glActiveTexture(TXTSLOTSTART);
+    glBindTexture(GL_TEXTURE_3D, 0);
 }
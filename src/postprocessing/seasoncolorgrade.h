@@ -2,7 +2,7 @@
 #define SEASONCOLORGRADE_H
 
 #include "postprocessing/postprocess.h"
-#include <QtGui/qimage.h>
+#include <array>
 
 constexpr int n_LUTs = 4;
 constexpr GLuint TXTSLOTSTART = GL_TEXTURE16;
@@ -13,14 +13,29 @@ class SeasonColorgrade : public PostProcess
 public:
     SeasonColorgrade(std::array<std::string, n_LUTs> LUTs, std::array<int, n_LUTs> num_slices, int width, int height);
     void paintTexture() override;
+    std::string fusedFunction() const override { return "seasonColorgrade"; }
+    std::string fusedSnippet() const override { return ":/resources/shaders/fused/seasoncolorgrading.glsl"; }
+    void setFusedUniforms(GLuint shader) override;
+    // the blended LUT is rebaked on the next paint, and only if the season really moved
     void setSeason(float season) { m_season = std::max(0.f, std::min(1.f, season)); }
     static std::string frag_shader;
 
 private:
-    std::array<QImage, n_LUTs> m_LUT_images;
-    std::array<GLuint, n_LUTs> m_LUT_textures;
+    // the two LUTs either side of m_season and how far it is between them
+    void seasonBlend(int& szn1, int& szn2, float& alpha) const;
+    // renders the mix of those two LUTs into m_blended_LUT, one layer per draw
+    void bakeBlend();
+
+    std::array<GLuint, n_LUTs> m_LUT_textures; // 3D, see Lut3D
     std::array<int, n_LUTs> m_num_slices;
 
+    // cached mix for m_baked_season, so grading a pixel is a single 3D fetch
+    GLuint m_blended_LUT = 0;
+    int m_blended_size = 0;
+    GLuint m_bake_shader = 0;
+    GLuint m_bake_fbo = 0;
+    float m_baked_season = -1.f;
+
     float m_season = 0.f;
 };
 
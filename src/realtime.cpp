@@ -4,14 +4,18 @@
 #include <QMouseEvent>
 #include <QKeyEvent>
 #include <iostream>
+#include <cstddef>
+#include <cstdlib>
 #include "postprocessing/seasoncolorgrade.h"
 #include "settings.h"
 #include "utils/shaderloader.h"
+#include "utils/stats.h"
 #include <glm/gtx/transform.hpp>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "postprocessing/crepuscular.h"
+#include "postprocessing/fog.h"
 
 // Helper structures for light space calculations
 struct LightSpace {
@@ -53,36 +57,42 @@ Realtime::Realtime(QWidget *parent)
 
 void Realtime::finish() {
     killTimer(m_timer);
+    // null if the window closed before initializeGL ran
+    if (m_simulation) m_simulation->wait();
+    waitForAnimationJobs();
     this->makeCurrent();
 
     // Students: anything requiring OpenGL calls when the program exits should be done here
 
-    glDeleteBuffers(1, &m_sphereIds->shape_vbo);
-    glDeleteBuffers(1, &m_cubeIds->shape_vbo);
-    glDeleteBuffers(1, &m_coneIds->shape_vbo);
-    glDeleteBuffers(1, &m_cylinderIds->shape_vbo);
-    glDeleteVertexArrays(1, &m_sphereIds->shape_vao);
-    glDeleteVertexArrays(1, &m_cubeIds->shape_vao);
-    glDeleteVertexArrays(1, &m_coneIds->shape_vao);
-    glDeleteVertexArrays(1, &m_cylinderIds->shape_vao);
+    deletePrimitiveCache();
 
     delete m_sphere;
     delete m_cube;
     delete m_cylinder;
     delete m_cone;
-    delete m_sphereIds;
-    delete m_cubeIds;
-    delete m_cylinderIds;
-    delete m_coneIds;
     glDeleteProgram(m_shader);
 
     for (int i = 0; i < m_postprocesses.size(); i++) {
-        m_postprocesses[i]->destroyFBO();
+        if (auto* crep = dynamic_cast<Crepuscular*>(m_postprocesses[i].get())) {
+            crep->destroyShaders();
+        } else if (auto* bloom = dynamic_cast<Bloom*>(m_postprocesses[i].get())) {
+            bloom->destroyShaders();
+        }
         glDeleteProgram(m_postprocesses[i]->getShader());
         m_postprocesses[i]->destroyVertex();
     }
+    for (auto& fused: m_fusedPostprocesses) {
+        fused->destroyVertex();
+    }
+    FusedPostProcess::clearProgramCache();
+    m_targetPool.destroy();
 
-    // deleteShadowResources();
+    deleteShadowResources();
+    deleteLightResources();
+    deleteGpuParticles();
+    glDeleteTextures(1, &m_particleSprites);
+    m_LSystemPlants.destroy();
+    m_streamBuffer.destroy();
 
     this->doneCurrent();
 }
@@ -90,6 +100,14 @@ void Realtime::finish() {
 void Realtime::initializeGL() {
     m_devicePixelRatio = this->devicePixelRatio();
 
+    // ANIM_THREADS overrides the worker count, e.g. to measure how pose evaluation scales
+    int animThreads = ThreadPool::defaultWorkerCount();
+    if (const char* env = std::getenv("ANIM_THREADS")) animThreads = std::max(0, std::atoi(env) - 1);
+    m_threadPool = std::make_unique<ThreadPool>(animThreads);
+    std::cout << "Animation pool: " << m_threadPool->numWorkers() << " workers + main thread" << std::endl;
+    m_simulation = std::make_unique<SimScheduler>(m_threadPool.get(), SIM_STEP, SIM_MAX_STEPS);
+    registerSimulationTasks();
+
     m_timer = startTimer(1000/60);
     m_elapsedTimer.start();
 
@@ -114,6 +132,7 @@ void Realtime::initializeGL() {
 
 
     m_shader = ShaderLoader::createShaderProgram(":/resources/shaders/anim.vert", ":/resources/shaders/anim.frag");
+    bindBoneBlock(m_shader);
     //m_l_system_shader = ShaderLoader::createShaderProgram(":/resources/shaders/default.vert", ":/resources/shaders/default.frag");
     m_skybox_shader = ShaderLoader::createShaderProgram(":/resources/shaders/skybox.vert", ":/resources/shaders/skybox.frag");
     m_particleShader = ShaderLoader::createShaderProgram(":/resources/shaders/particles.vert", ":/resources/shaders/particles.frag");
@@ -122,17 +141,20 @@ void Realtime::initializeGL() {
         m_skybox_vbo[i] *= m_skybox_size;
     }
 
+    m_streamBuffer.create(STREAM_FRAME_BYTES);
     buildGeometry();
     rebuildMeshes();
     sceneChanged();
 
-    // if (!m_renderdata.lights.empty()) {
-    //     createShadowResources();
-    // }
-
     // postprocessing pipeline initialization
     // m_postprocesses.push_back(std::make_unique<Colorgrade>(":/resources/images/greeny.png", 16, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio));
-    //m_postprocesses.push_back(std::make_unique<Fog>(5.0f, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio));
+    m_postprocesses.push_back(std::make_unique<Fog>(
+        size().width() * m_devicePixelRatio,
+        size().height() * m_devicePixelRatio,
+        &m_cam,
+        &m_renderdata,
+        &m_proj
+        ));
     m_postprocesses.push_back(std::make_unique<Crepuscular>(
         size().width() * m_devicePixelRatio,         // width
         size().height() * m_devicePixelRatio,        // height
@@ -140,6 +162,7 @@ void Realtime::initializeGL() {
         &m_renderdata,                               // RenderData pointer
         &m_proj                                      // Projection matrix pointer
         ));
+    m_postprocesses.push_back(std::make_unique<Bloom>(size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio));
     std::array<std::string, n_LUTs> LUTs = {
         ":/resources/images/Cold_Ice.png",
         ":/resources/images/greeny.png",
@@ -152,6 +175,52 @@ void Realtime::initializeGL() {
         slices,
         size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio)
     );
+    buildPostGraph();
+}
+
+void Realtime::buildPostGraph() {
+    m_postGraph.clear();
+    for (auto& fused: m_fusedPostprocesses) {
+        fused->destroyVertex();
+    }
+    m_fusedPostprocesses.clear();
+    m_postGraphFused = settings.fusePostprocesses;
+    m_postGraphCrepuscularQuality = settings.crepuscularQuality;
+    m_postGraphBloom = settings.bloom;
+    if (m_postprocesses.empty()) return;
+
+    // split the chain into passes; with fusing on, consecutive per-pixel effects share one
+    std::vector<std::vector<PostProcess*>> passes;
+    for (auto& effect: m_postprocesses) {
+        if (!m_postGraphBloom && dynamic_cast<Bloom*>(effect.get()) != nullptr) continue;
+        if (m_postGraphFused && !passes.empty() && !passes.back().front()->fusedFunction().empty()
+            && FusedPostProcess::canAppend(passes.back(), effect.get())) {
+            passes.back().push_back(effect.get());
+        } else {
+            passes.push_back({effect.get()});
+        }
+    }
+
+    // the one depth texture of the frame, kept with the scene color for fog and the crepuscular rays to sample
+    m_postGraph.addPass({RenderGraph::SCENE, {}, RenderGraph::SCENE, 1.f, true, [this](const std::vector<const RenderTarget*>&) {
+        paintScene();
+    }});
+    int width = size().width() * m_devicePixelRatio;
+    int height = size().height() * m_devicePixelRatio;
+    std::string input = RenderGraph::SCENE;
+    for (int i = 0; i < passes.size(); i++) {
+        PostProcess* effect = passes[i].front();
+        if (passes[i].size() > 1) {
+            m_fusedPostprocesses.push_back(std::make_unique<FusedPostProcess>(passes[i], width, height));
+            effect = m_fusedPostprocesses.back().get();
+        }
+        if (auto* crep = dynamic_cast<Crepuscular*>(effect)) {
+            crep->setQuality(m_postGraphCrepuscularQuality);
+        }
+        std::string output = (i + 1 == passes.size()) ? RenderGraph::BACKBUFFER : "post" + std::to_string(i);
+        effect->addPasses(m_postGraph, input, output);
+        input = output;
+    }
 }
 
 void Realtime::drawSkybox() {
@@ -189,165 +258,187 @@ void Realtime::drawSkybox() {
     glDepthMask(GL_TRUE);
 }
 
+// runs as a simulation task: builds into m_LSystemPending, which paint never reads
 void Realtime::updateLSystems() {
-    QString output = generateLSystemString(m_rules, m_axiom, m_LSystemIterations);
-    SceneNode *LSystem;
-    LSystem = createLSystemNode(output);
-    //m_LSystems.push_back(&LSystem);
-    m_LSystemMetaData.shapes.clear();
-    glm::mat4 identityMat(1.0f);
-    SceneParser::parseRecursive(m_LSystemMetaData, LSystem, identityMat);
-    m_LSystemScaler = 0.25;
-
-    for (int i = 0; i < m_LSystemMetaData.shapes.size(); i++) {
-        m_LSystemMetaData.shapes[i].ctm *= glm::translate(glm::vec3(0, 0, 7));
-        m_LSystemMetaData.shapes[i].ctm *= glm::scale(m_LSystemScaler * glm::vec3(0.15, 1, 0.15));
-    }
+    // nothing to do until the scene's plants change
+    if (m_LSystemKey == m_renderdata.plants) return;
+    auto start = std::chrono::steady_clock::now();
+
+    m_LSystemPending = LSystemForest();
+    growForest(m_renderdata.plants, m_LSystemPending);
+
+    m_LSystemKey = m_renderdata.plants;
+    m_LSystemPendingReady = true;
+    std::cout << "L-system: grew " << m_LSystemPending.plants.size() << " plants from " << m_LSystemPending.batches.size()
+              << " variants, " << m_LSystemPending.branches.size() << " branches and " << m_LSystemPending.leaves.size()
+              << " leaves in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms" << std::endl;
+}
 
-    m_LSystemIterationsChanged = false;
+void Realtime::publishLSystems() {
+    if (!m_LSystemPendingReady) return;
+    std::swap(m_LSystemForest, m_LSystemPending);
+    m_LSystemPendingReady = false;
+    m_LSystemUploaded = false;
 }
 
 void Realtime::paintLSystems() {
-    glUseProgram(m_shader);
-    glBindVertexArray(m_vaoLcylinder);
-
-    //In case you updated a buffer
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    if (updateToggle) {
-        updateLSystems();
-        updateToggle = true;
+    // the instance buffers only change when the plants are grown again
+    if (!m_LSystemUploaded) {
+        const LSystemForest& forest = m_LSystemForest;
+        glBindBuffer(GL_ARRAY_BUFFER, m_vboLinstances);
+        glBufferData(GL_ARRAY_BUFFER, forest.branches.size() * sizeof(LSystemInstance), forest.branches.data(), GL_STATIC_DRAW);
+        m_LSystemPlants.upload(GL_RGBA32F, forest.plants.data(), forest.plants.size() * sizeof(glm::mat4), GL_STATIC_DRAW);
+        // leaf positions and sizes, then their colors
+        m_LSystemLeafCount = forest.leaves.size();
+        GLsizeiptr colors = m_LSystemLeafCount * sizeof(glm::vec4);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vboLleaves);
+        glBufferData(GL_ARRAY_BUFFER, colors + m_LSystemLeafCount * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, colors, forest.leaves.data());
+        glBufferSubData(GL_ARRAY_BUFFER, colors, m_LSystemLeafCount * sizeof(uint32_t), forest.leafColors.data());
+        glBindVertexArray(m_vaoLleaves);
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4 * sizeof(GLubyte), reinterpret_cast<void*>(colors));
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_LSystemBatches = forest.batches;
+        m_LSystemUploaded = true;
     }
 
-    for (int i = 0; i < m_LSystemMetaData.shapes.size(); i++) {
-        //Shininess and ctm uniforms depends on specific shape
-        // Task 6: pass in m_model as a uniform into the shader program
-        GLint modelLocation = glGetUniformLocation(m_shader, "model");
-        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &m_LSystemMetaData.shapes[i].ctm[0][0]);
-        GLint shininessLocation = glGetUniformLocation(m_shader, "m_shininess");
-        glUniform1f(shininessLocation, m_LSystemMetaData.shapes[i].primitive.material.shininess);
-        //GLint animatingLocation = glGetUniformLocation(m_shader, "animating");
-        //glUniform1i(animatingLocation, 0);
-        glUniform1i(glGetUniformLocation(m_shader, "animating"), 0);
+    if (!m_LSystemBatches.empty()) {
+        glUseProgram(m_shader);
+        glBindVertexArray(m_vaoLcylinder);
 
-        // Shape-specific colours
-        GLint cAmbientLocation = glGetUniformLocation(m_shader, "cAmbient");
-        GLint cDiffuseLocation = glGetUniformLocation(m_shader, "cDiffuse");
-        GLint cSpecularLocation = glGetUniformLocation(m_shader, "cSpecular");
-        glm::vec4 ambient = m_LSystemMetaData.shapes[i].primitive.material.cAmbient;
-        glm::vec4 diffuse = m_LSystemMetaData.shapes[i].primitive.material.cDiffuse;
-        glm::vec4 specular = m_LSystemMetaData.shapes[i].primitive.material.cSpecular;
-        glUniform4f(cAmbientLocation, ambient[0], ambient[1], ambient[2], ambient[3]);
-        glUniform4f(cDiffuseLocation, diffuse[0], diffuse[1], diffuse[2], diffuse[3]);
-        glUniform4f(cSpecularLocation, specular[0], specular[1], specular[2], specular[3]);
-
-        // Draw Command
-        //std::cout << "size of data" << m_LcylinderData.size() << std::endl;
-        glDrawArrays(GL_TRIANGLES, 0, m_LcylinderData.size() / 6);
+        // everything but the diffuse color is shared by the branches
+        glUniform1i(glGetUniformLocation(m_shader, "instanced"), 1);
+        glUniform1i(glGetUniformLocation(m_shader, "animating"), 0);
+        glUniform1i(glGetUniformLocation(m_shader, "usingTexture"), 0);
+        glUniform1f(glGetUniformLocation(m_shader, "shininess"), m_LSystemMaterial.shininess);
+        glUniform1f(glGetUniformLocation(m_shader, "blend"), 0.f);
+        glUniform3fv(glGetUniformLocation(m_shader, "shapeColorA"), 1, &m_LSystemMaterial.cAmbient[0]);
+        glUniform3fv(glGetUniformLocation(m_shader, "shapeColorS"), 1, &m_LSystemMaterial.cSpecular[0]);
+        glActiveTexture(GL_TEXTURE0 + LSYSTEM_PLANT_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, m_LSystemPlants.texture);
+        glActiveTexture(GL_TEXTURE0);
+
+        // instance i of a batch is branch i / plantCount of plant i % plantCount: the branch attributes
+        // step once per plantCount instances, and the shader fetches the plant
+        GLint plantBaseLocation = glGetUniformLocation(m_shader, "plantBase");
+        GLint plantCountLocation = glGetUniformLocation(m_shader, "plantCount");
+        glBindBuffer(GL_ARRAY_BUFFER, m_vboLinstances);
+        for (const LSystemForest::Batch& batch: m_LSystemBatches) {
+            GLintptr offset = batch.firstBranch * sizeof(LSystemInstance);
+            for (int column = 0; column < 4; column++) {
+                glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(LSystemInstance),
+                                      reinterpret_cast<void*>(offset + offsetof(LSystemInstance, model) + column * sizeof(glm::vec4)));
+                glVertexAttribDivisor(5 + column, batch.plantCount);
+            }
+            glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(LSystemInstance),
+                                  reinterpret_cast<void*>(offset + offsetof(LSystemInstance, diffuse)));
+            glVertexAttribDivisor(9, batch.plantCount);
+            glUniform1i(plantBaseLocation, batch.firstPlant);
+            glUniform1i(plantCountLocation, batch.plantCount);
+            glDrawElementsInstanced(GL_TRIANGLES, m_LcylinderIndexCount, GL_UNSIGNED_INT, nullptr, batch.branchCount * batch.plantCount);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUniform1i(glGetUniformLocation(m_shader, "instanced"), 0);
+        glBindVertexArray(0);
+    }
 
+    if (settings.lSystemLeaves && m_LSystemLeafCount > 0) {
+        // leaves are opaque discs, so unlike particles they write depth and need no sorting
+        glDisable(GL_BLEND);
+        glUseProgram(m_particleShader);
+        glUniformMatrix4fv(glGetUniformLocation(m_particleShader, "viewMatrix"), 1, GL_FALSE, &m_cam.view[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(m_particleShader, "projectionMatrix"), 1, GL_FALSE, &m_proj[0][0]);
+        glm::mat4 identity(1.f);
+        glUniformMatrix4fv(glGetUniformLocation(m_particleShader, "modelMatrix"), 1, GL_FALSE, &identity[0][0]);
+        glBindVertexArray(m_vaoLleaves);
+        glVertexAttrib1f(6, -1.f);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_LSystemLeafCount);
+        glBindVertexArray(0);
     }
 
     glUseProgram(0);
 }
 
 void Realtime::paintParticles() {
-    //if (m_tesselationChanged) {
-    if (true) {
-        //m_particleVelocityGlobal = m_param1;
-        m_particleVelocityGlobal = 5;
-    }
+    if (settings.gpuParticles) updateGpuParticles();
 
     glUseProgram(m_particleShader);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glBindVertexArray(m_vaoParticles);
 
     // Task 7: pass in m_view and m_proj
     GLint viewLocation = glGetUniformLocation(m_particleShader, "viewMatrix");
     glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &m_cam.view[0][0]);
     GLint projLocation = glGetUniformLocation(m_particleShader, "projectionMatrix");
     glUniformMatrix4fv(projLocation, 1, GL_FALSE, &m_proj[0][0]);
+    // the CPU pools are simulated in world space, the GPU emitter in its own
+    glm::mat4 particleCtm = settings.gpuParticles ? m_particleCtm : glm::mat4(1.f);
     GLint particleCTMLocation = glGetUniformLocation(m_particleShader, "modelMatrix");
-    glUniformMatrix4fv(particleCTMLocation, 1, GL_FALSE, &m_particleCtm[0][0]);
-
-    particleUpdate();
-
-    //glm::vec3 worldSpacePos = m_particleCtm * glm::vec4(m_particulePositionSizeData[0], m_particulePositionSizeData[1], m_particulePositionSizeData[2], 1);
-    //glm::vec3 glPos = m_sceneCam.getProjectionMatrix() * m_sceneCam.getViewMatrix() * glm::vec4(worldSpacePos, 1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesPositionSize);
-    glBufferData(GL_ARRAY_BUFFER, m_maxNumParticles * 4 * sizeof(GLfloat), m_particulePositionSizeData.data(), GL_STREAM_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_vboParticlesColor);
-    glBufferData(GL_ARRAY_BUFFER, m_maxNumParticles * 4 * sizeof(GLfloat), m_particuleColorData.data(), GL_STREAM_DRAW);
+    glUniformMatrix4fv(particleCTMLocation, 1, GL_FALSE, &particleCtm[0][0]);
+    glActiveTexture(GL_TEXTURE0 + PARTICLE_SPRITE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_particleSprites);
+
+    int numInstances;
+    if (settings.gpuParticles) {
+        // drawn straight from the buffer the update just wrote
+        glBindVertexArray(m_gpuParticleDrawVao[m_gpuParticleCurrent]);
+        SceneColor color = m_emitters.empty() ? SceneColor(1.f) : m_emitters.front().settings.colorStart;
+        glVertexAttrib4f(4, color.r, color.g, color.b, color.a);
+        glVertexAttrib1f(6, m_emitters.empty() ? -1.f : m_emitters.front().spriteLayer);
+        numInstances = m_gpuParticleCount;
+    } else {
+        glBindVertexArray(m_vaoParticles);
+        particleUpdate();
+
+        // the update wrote every visible emitter's particles into the stream buffer; point the instances at them
+        GLintptr colors = m_particleInstanceOffset + m_numParticles * 4 * sizeof(GLfloat);
+        GLintptr layers = colors + m_numParticles * 4 * sizeof(GLubyte);
+        glBindBuffer(GL_ARRAY_BUFFER, m_streamBuffer.buffer());
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void*>(m_particleInstanceOffset));
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4 * sizeof(GLubyte), reinterpret_cast<void*>(colors));
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), reinterpret_cast<void*>(layers));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        numInstances = m_numParticles;
+    }
 
     //glDrawArrays(GL_TRIANGLES, 0, m_particleVertexData.size() / 6);
     glDepthMask(GL_FALSE);
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_numParticles);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numInstances);
     glDepthMask(GL_TRUE);
 }
 
 void Realtime::paintScene() {
     // 1. Render shadow maps FIRST
-    // renderShadowMaps();
+    renderShadowMaps();
 
     // 2. Then render the main scene
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     drawSkybox();
     glUseProgram(m_shader);
 
-    if (m_cameraPath != std::nullopt) {
-        std::optional<PosRot> pathPosRot = m_cameraPath->get(getPathTime());
-        if (pathPosRot == std::nullopt) {
-            m_cameraPath = std::nullopt;
-        }
-        else {
-            updateCameraFromPath(*pathPosRot);
-            declareCameraUniforms();
-        }
+    if (m_cameraMoved) {
+        declareCameraUniforms();
+        m_cameraMoved = false;
     }
 
     // Bind shadow maps to the shader
-    // bindShadowMapsToShader(m_shader);
+    bindShadowMapsToShader(m_shader);
+
+    // bin the lights for this frame's view
+    buildLightClusters();
+    bindLightClustersToShader(m_shader);
 
-    GLuint vertices;
-    int animating;
     bool usingTexture;
 
     // for each shape: bind vao, decl shape uniforms, draw, unbind, repeat
     for (RenderShapeData &shape: m_renderdata.shapes) {
-        animating = 0;
-        switch (shape.primitive.type) {
-        case PrimitiveType::PRIMITIVE_CONE:
-            vertices = m_cone->num_triangles;
-            usingTexture = shape.primitive.material.textureMap.isUsed;
-            glBindVertexArray(m_coneIds->shape_vao);
-            break;
-        case PrimitiveType::PRIMITIVE_CUBE:
-            vertices = m_cube->num_triangles;
-            usingTexture = shape.primitive.material.textureMap.isUsed;
-            glBindVertexArray(m_cubeIds->shape_vao);
-            break;
-        case PrimitiveType::PRIMITIVE_CYLINDER:
-            vertices = m_cylinder->num_triangles;
-            usingTexture = shape.primitive.material.textureMap.isUsed;
-            glBindVertexArray(m_cylinderIds->shape_vao);
-            break;
-        case PrimitiveType::PRIMITIVE_SPHERE:
-            vertices = m_sphere->num_triangles;
-            usingTexture = shape.primitive.material.textureMap.isUsed;
-            glBindVertexArray(m_sphereIds->shape_vao);
-            break;
-        default:
-            if (m_meshes.count(shape.primitive.meshfile) == 0) {
-                vertices = 0;
-            } else {
-                vertices = m_meshes[shape.primitive.meshfile].num_triangles;
-                glBindVertexArray(m_meshIds[shape.primitive.meshfile].shape_vao);
-            }
-            if (m_meshes[shape.primitive.meshfile].hasAnimation) animating = 1;
+        ShapeDraw draw = bindShapeGeometry(shape, true);
+        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
             usingTexture = m_meshes[shape.primitive.meshfile].hasTextures;
-            break;
+        } else {
+            usingTexture = shape.primitive.material.textureMap.isUsed;
         }
 
         // TEXTURING
@@ -375,27 +466,22 @@ void Realtime::paintScene() {
         checkGLError("After declSpecificUniforms");  // <-- ADD THIS
 
         // ANIMATION
-        glUniform1i(glGetUniformLocation(m_shader, "animating"), animating);
-        if (animating) {
-            int num = m_meshes[shape.primitive.meshfile].m_meshAnim.m_finalBoneMatrices.size();
-            float finalMatrices[num*16];
-            for (int i = 0; i < num; i++) {
-                for (int j = 0; j < 16; j++) {
-                    finalMatrices[16*i + j] = m_meshes[shape.primitive.meshfile].m_meshAnim.m_finalBoneMatrices[i][j/4][j%4];
-                }
-            }
-            glUniform1i(glGetUniformLocation(m_shader, "numBones"), num);
-            glUniformMatrix4fv(glGetUniformLocation(m_shader, "finalBoneMatrices"), num, GL_FALSE, finalMatrices);
-        }
+        glUniform1i(glGetUniformLocation(m_shader, "animating"), draw.animating);
+        if (draw.animating) declBoneUniforms(m_shader, m_meshes[shape.primitive.meshfile]);
 
         // DRAWING
-        glDrawArrays(GL_TRIANGLES, 0, vertices);
+        if (draw.indexed) glDrawElements(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT, nullptr);
+        else glDrawArrays(GL_TRIANGLES, 0, draw.count);
 
         // UNBINDING
         glBindTexture(GL_TEXTURE_2D, 0);
         glBindVertexArray(0);
     }
 
+    for (auto &[key, buffer]: m_skinBuffers) {
+        buffer.fenceDraw();
+    }
+
     paintLSystems();
     paintParticles();
 
@@ -403,38 +489,28 @@ void Realtime::paintScene() {
 }
 
 void Realtime::paintGL() {
+    m_streamBuffer.beginFrame();
+    m_boneOffsets.clear();
+
     if (m_postprocesses.size() == 0) {
         paintScene();
-        return;
+    } else {
+        // the scene and each effect draw into pooled targets, the last effect into the window
+        m_postGraph.execute(m_targetPool, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio, defaultFramebufferObject());
     }
 
-    glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_postprocesses[0]->getFramebuffer());
-    paintScene();
-
-    // Outputs contents of each framebuffer into the next post-process as input
-    for (int i = 1; i < m_postprocesses.size(); i++) {
-        // glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
-        glBindFramebuffer(GL_FRAMEBUFFER, m_postprocesses[i]->getFramebuffer());
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_postprocesses[i-1]->paintTexture();
-    }
-
-    // Draws contents of final post-process
-    // glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
-    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
-    glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    m_postprocesses[m_postprocesses.size()-1]->paintTexture();
+    m_streamBuffer.endFrame();
 }
 
 void Realtime::resizeGL(int w, int h) {
     // Tells OpenGL how big the screen is
     glViewport(0, 0, size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
+    // the target pool picks up the new size on the next frame, reallocating only if it outgrew its reserve
     for (int i = 0; i < m_postprocesses.size(); i++) {
-        m_postprocesses[i]->destroyFBO();
         m_postprocesses[i]->updateRes(size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
-        m_postprocesses[i]->makeFBO();
+    }
+    for (auto& fused: m_fusedPostprocesses) {
+        fused->updateRes(size().width() * m_devicePixelRatio, size().height() * m_devicePixelRatio);
     }
 
     // Students: anything requiring OpenGL calls when the program starts should be done here
@@ -442,6 +518,8 @@ void Realtime::resizeGL(int w, int h) {
 
 void Realtime::sceneChanged() {
     makeCurrent();
+    // the tasks hold pointers into the meshes and emitters about to be rebuilt
+    m_simulation->wait();
     std::string filepath = "scenefiles/realtime/extra_credit/finalscene.json";
     SceneParser::parse(filepath, m_renderdata);
 
@@ -449,16 +527,17 @@ void Realtime::sceneChanged() {
     rebuildCamera();
     rebuildMatrices();
     rebuildMeshes();
+    createEmitters(filepath);
 
-    // Recreate shadow resources for new scene
-    // if (!m_renderdata.lights.empty()) {
-    //     createShadowResources();
-    // }
+    // Recreate shadow resources for new scene (picks its directional light again)
+    createShadowResources();
 
-    // Update crepuscular rays if active
+    // Update the depth-based effects if active
     for (auto& pp : m_postprocesses) {
         if (auto* crep = dynamic_cast<Crepuscular*>(pp.get())) {
             crep->updateCameraAndScene(&m_cam, &m_renderdata, &m_proj);
+        } else if (auto* fog = dynamic_cast<Fog*>(pp.get())) {
+            fog->updateCameraAndScene(&m_cam, &m_renderdata, &m_proj);
         }
     }
 
@@ -476,24 +555,18 @@ void Realtime::settingsChanged() {
         }
     }
     makeCurrent();
-    if (m_sphereIds->shape_vao != 0 && m_sphereIds->shape_vbo != 0) {
-        m_sphere->updateParams(settings.shapeParameter1, settings.shapeParameter2);
-        setupPrimitives(m_sphereIds, m_sphere->generateShape());
+    if (settings.fusePostprocesses != m_postGraphFused || settings.crepuscularQuality != m_postGraphCrepuscularQuality
+        || settings.bloom != m_postGraphBloom) {
+        buildPostGraph();
     }
-
-    if (m_cubeIds->shape_vao != 0 && m_cubeIds->shape_vbo != 0) {
-        m_cube->updateParams(settings.shapeParameter1);
-        setupPrimitives(m_cubeIds, m_cube->generateShape());
+    // only touches the GPU on a cache miss, so scrubbing the sliders back and forth is cheap
+    if (!m_primitiveLods.empty()) {
+        acquirePrimitiveLods();
     }
-
-    if (m_coneIds->shape_vao != 0 && m_coneIds->shape_vbo != 0) {
-        m_cone->updateParams(settings.shapeParameter1, settings.shapeParameter2);
-        setupPrimitives(m_coneIds, m_cone->generateShape(), false, true);
-    }
-
-    if (m_cylinderIds->shape_vao != 0 && m_cylinderIds->shape_vbo != 0) {
-        m_cylinder->updateParams(settings.shapeParameter1, settings.shapeParameter2);
-        setupPrimitives(m_cylinderIds, m_cylinder->generateShape(), false, true);
+    bool cascadesChanged = m_shadowLight >= 0 && std::clamp(settings.shadowCascades, 2, MAX_CASCADES) != m_numCascades;
+    bool atlasChanged = !m_shadowedLights.empty() && settings.shadowAtlasSize != m_shadowAtlasSetting;
+    if (cascadesChanged || atlasChanged) {
+        createShadowResources();
     }
 
     if (m_shader != 0 && (settings.nearPlane != near || settings.farPlane != far)) {
@@ -506,574 +579,25 @@ void Realtime::settingsChanged() {
     // if nearPlane or farPlane changed update camera settings
 }
 
-// // ============================================================================
-// // SHADOW MAPPING HELPER FUNCTIONS
-// // ============================================================================
-
-// static LightSpace makeOrthoForDirectional(const SceneLightData &L)
-// {
-//     LightSpace ls;
-
-//     glm::vec3 center(0.0f, 0.0f, 0.0f);
-//     glm::vec3 lightDir = glm::normalize(glm::vec3(L.dir));
-//     float distance = 100.0f;
-//     glm::vec3 pos = center - lightDir * distance;
-
-//     glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
-//     if (fabs(glm::dot(up, lightDir)) > 0.99f) {
-//         up = glm::vec3(1.0f, 0.0f, 0.0f);
-//     }
-
-//     ls.view = glm::lookAt(pos, center, up);
-
-//     float orthoSize = 5.0f;
-//     float nearP = 1.0f;
-//     float farP = distance + 100.0f;
-//     ls.proj = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, nearP, farP);
-
-//     return ls;
-// }
-
-// static LightSpace makePerspectiveForSpot(const SceneLightData &L)
-// {
-//     LightSpace ls;
-
-//     glm::vec3 pos = glm::vec3(L.pos);
-//     glm::vec3 dir = glm::normalize(glm::vec3(L.dir));
-
-//     glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
-//     if (fabs(glm::dot(up, dir)) > 0.99f) up = glm::vec3(1.0f, 0.0f, 0.0f);
-
-//     ls.view = glm::lookAt(pos, pos + dir, up);
-
-//     float angle = L.angle;
-//     if (angle > 3.14159265f) {
-//         angle = glm::radians(angle);
-//     }
-//     float fovy = glm::clamp(2.0f * angle, 0.01f, glm::radians(170.0f));
-
-//     float aspect = 1.0f;
-//     float nearP = 0.1f;
-//     float farP = 100.0f;
-
-//     ls.proj = glm::perspective(fovy, aspect, nearP, farP);
-
-//     return ls;
-// }
-
-// static CubeLightSpace makeCubeFaceMatrices(const SceneLightData &L)
-// {
-//     CubeLightSpace cs;
-
-//     glm::vec3 pos = glm::vec3(L.pos);
-
-//     std::array<glm::vec3,6> looks = {
-//         glm::vec3( 1, 0, 0),
-//         glm::vec3(-1, 0, 0),
-//         glm::vec3( 0, 1, 0),
-//         glm::vec3( 0,-1, 0),
-//         glm::vec3( 0, 0, 1),
-//         glm::vec3( 0, 0,-1)
-//     };
-
-//     std::array<glm::vec3,6> ups = {
-//         glm::vec3(0,-1,0),
-//         glm::vec3(0,-1,0),
-//         glm::vec3(0,0,1),
-//         glm::vec3(0,0,-1),
-//         glm::vec3(0,-1,0),
-//         glm::vec3(0,-1,0)
-//     };
-
-//     float nearP = 0.1f;
-//     float farP  = 100.0f;
-//     cs.proj = glm::perspective(glm::radians(90.0f), 1.0f, nearP, farP);
-
-//     for (int i = 0; i < 6; ++i) {
-//         cs.views[i] = glm::lookAt(pos, pos + looks[i], ups[i]);
-//     }
-
-//     return cs;
-// }
-
-// // ============================================================================
-// // SHADOW RESOURCE MANAGEMENT
-// // ============================================================================
-
-// void Realtime::createShadowResources() {
-//     checkGLError("START of createShadowResources");
-
-//     deleteShadowResources();
-//     checkGLError("After deleteShadowResources");
-
-//     int count = std::min<int>((int)m_renderdata.lights.size(), MAX_SHADOW_CASTERS);
-//     m_shadowMaps.resize(count);
-
-//     std::cout << "Creating shadow resources for " << count << " lights" << std::endl;
-
-//     for (int i = 0; i < count; ++i) {
-//         // std::cout << "Creating shadow map " << i << std::endl;
-//         checkGLError("Start of loop iteration");
-
-//         const SceneLightData &L = m_renderdata.lights[i];
-//         ShadowMap sm;
-//         sm.lightIndex = i;
-
-//         if (L.type == LightType::LIGHT_DIRECTIONAL) {
-//             // std::cout << "  Light " << i << " is DIRECTIONAL" << std::endl;
-//             sm.type = ShadowType::Directional;
-//             sm.enabled = true;
-//             sm.size = DEFAULT_SHADOW_SIZE;
-
-//             glGenTextures(1, &sm.depthTex);
-//             checkGLError("After glGenTextures");
-
-//             glBindTexture(GL_TEXTURE_2D, sm.depthTex);
-//             checkGLError("After glBindTexture");
-
-//             glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, sm.size, sm.size, 0,
-//                          GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-//             checkGLError("After glTexImage2D");
-
-//             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-//             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-//             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-//             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-//             checkGLError("After texture parameters");
-
-//             float borderColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
-//             glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-//             checkGLError("After border color");
-
-//             glGenFramebuffers(1, &sm.fbo);
-//             checkGLError("After glGenFramebuffers");
-
-//             // **BIND AND CONFIGURE THE FRAMEBUFFER**
-//             glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo);
-//             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sm.depthTex, 0);
-
-//             // **CRITICAL: Tell OpenGL we're not rendering any color data**
-//             glDrawBuffer(GL_NONE);
-//             glReadBuffer(GL_NONE);
-
-//             // **Check framebuffer completeness**
-//             GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-//             if (status != GL_FRAMEBUFFER_COMPLETE) {
-//                 std::cerr << "Framebuffer incomplete for light " << i << ": " << status << std::endl;
-//             }
-
-//             glBindFramebuffer(GL_FRAMEBUFFER, 0);
-//             checkGLError("After framebuffer setup");
-
-//         } else if (L.type == LightType::LIGHT_SPOT) {
-//             // std::cout << "  Light " << i << " is SPOT" << std::endl;
-//             // Same checks for spot...
-
-//         } else if (L.type == LightType::LIGHT_POINT) {
-//             // std::cout << "  Light " << i << " is POINT" << std::endl;
-//             // sm.type = ShadowType::Point;
-//             // sm.enabled = true;
-
-//             // glGenTextures(1, &sm.depthTex);
-//             // checkGLError("After glGenTextures (point)");
-
-//             // glBindTexture(GL_TEXTURE_CUBE_MAP, sm.depthTex);
-//             // checkGLError("After glBindTexture CUBE_MAP");
-
-//             // for (unsigned int face = 0; face < 6; ++face) {
-//             //     glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_R32F,
-//             //                  sm.size, sm.size, 0, GL_RED, GL_FLOAT, NULL);
-//             //     checkGLError("After glTexImage2D for cube face");
-//             // }
-
-//             // glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-//             // glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-//             // glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-//             // glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-//             // glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-//             // checkGLError("After cube map texture parameters");
-
-//             // glGenFramebuffers(1, &sm.fbo);
-//             // checkGLError("After glGenFramebuffers (point)");
-
-//             // GLuint rboDepth = 0;
-//             // glGenRenderbuffers(1, &rboDepth);
-//             // checkGLError("After glGenRenderbuffers");
-
-//             // glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-//             // checkGLError("After glBindRenderbuffer");
-
-//             // glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, sm.size, sm.size);
-//             // checkGLError("After glRenderbufferStorage");
-
-//             // sm.rbo = rboDepth;
-//             sm.type = ShadowType::None;
-//             sm.enabled = false;
-//         } else {
-//             // std::cout << "  Light " << i << " is NONE/UNKNOWN" << std::endl;
-//             sm.type = ShadowType::None;
-//             sm.enabled = false;
-//         }
-
-//         m_shadowMaps[i] = sm;
-//         checkGLError("After storing shadow map");
-//     }
-
-//     // Load depth shaders
-//     // std::cout << "Loading shadow shaders..." << std::endl;
-//     checkGLError("Before loading depth shader");
-
-//     m_depthShader = ShaderLoader::createShaderProgram(
-//         ":/resources/shaders/shadow_depth.vert",
-//         ":/resources/shaders/shadow_depth.frag"
-//         );
-//     checkGLError("After loading depth shader");
-
-//     std::cout << "Depth shader ID: " << m_depthShader << std::endl;
-
-//     m_depthPointShader = ShaderLoader::createShaderProgram(
-//         ":/resources/shaders/shadow_depth_point.vert",
-//         ":/resources/shaders/shadow_depth_point.frag"
-//         );
-//     checkGLError("After loading depth point shader");
-
-//     std::cout << "Depth point shader ID: " << m_depthPointShader << std::endl;
-
-//     checkGLError("END of createShadowResources");
-// }
-
-// void Realtime::deleteShadowResources() {
-//     for (auto &sm : m_shadowMaps) {
-//         if (sm.fbo) {
-//             glDeleteFramebuffers(1, &sm.fbo);
-//             sm.fbo = 0;
-//         }
-//         if (sm.depthTex) {
-//             glDeleteTextures(1, &sm.depthTex);
-//             sm.depthTex = 0;
-//         }
-//         if (sm.rbo) {
-//             glDeleteRenderbuffers(1, &sm.rbo);
-//             sm.rbo = 0;
-//         }
-//     }
-//     m_shadowMaps.clear();
-
-//     if (m_depthShader) {
-//         glDeleteProgram(m_depthShader);
-//         m_depthShader = 0;
-//     }
-//     if (m_depthPointShader) {
-//         glDeleteProgram(m_depthPointShader);
-//         m_depthPointShader = 0;
-//     }
-// }
-
-// // ============================================================================
-// // SHADOW MAP RENDERING
-// // ============================================================================
-
-// void Realtime::renderShadowMaps() {
-//     // std::cerr << m_shadowMaps.empty() << ", " << m_depthShader << std::endl;
-//     if (m_shadowMaps.empty()) return;
-//     if (!m_depthShader) return;
-
-//     checkGLError("START of renderShadowMaps");
-
-//     GLint prevViewport[4];
-//     glGetIntegerv(GL_VIEWPORT, prevViewport);
-
-//     glUseProgram(m_depthShader);
-//     checkGLError("After glUseProgram(m_depthShader)");
-
-//     for (size_t si = 0; si < m_shadowMaps.size(); ++si) {
-//         ShadowMap &sm = m_shadowMaps[si];
-//         if (!sm.enabled || sm.type == ShadowType::None) continue;
-
-//         // std::cout << "Processing shadow map " << si << " type: " << (int)sm.type << std::endl;
-//         checkGLError("Start of shadow map iteration");
-
-//         const SceneLightData &L = m_renderdata.lights[sm.lightIndex];
-
-//         // Directional and Spot lights (2D depth maps)
-//         if (sm.type == ShadowType::Directional || sm.type == ShadowType::Spot) {
-//             glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo);
-//             // checkGLError("After glBindFramebuffer");
-
-//             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-//                                    GL_TEXTURE_2D, sm.depthTex, 0);
-//             checkGLError("After glFramebufferTexture2D");
-
-//             // glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-//             glDrawBuffer(GL_NONE);
-//             glReadBuffer(GL_NONE);
-//             checkGLError("After glDrawBuffer(GL_NONE)");
-
-//             glViewport(0, 0, sm.size, sm.size);
-//             checkGLError("After glViewport");
-
-//             glClear(GL_DEPTH_BUFFER_BIT);
-//             // checkGLError("After glClear");
-
-//             LightSpace LS;
-//             if (sm.type == ShadowType::Directional) {
-//                 LS = makeOrthoForDirectional(L);
-//             } else {
-//                 LS = makePerspectiveForSpot(L);
-//             }
-
-//             glm::mat4 lightSpace = LS.proj * LS.view;
-//             sm.lightSpaceMatrix = lightSpace;
-
-//             GLint locModel = glGetUniformLocation(m_depthShader, "model");
-//             GLint locLightSpace = glGetUniformLocation(m_depthShader, "lightSpace");
-
-//             if (locLightSpace != -1)
-//                 glUniformMatrix4fv(locLightSpace, 1, GL_FALSE, glm::value_ptr(lightSpace));
-
-//             // Render each shape
-//             for (const RenderShapeData &shape : m_renderdata.shapes) {
-//                 if (locModel != -1)
-//                     glUniformMatrix4fv(locModel, 1, GL_FALSE, &shape.ctm[0][0]);
-
-//                 // Bind appropriate VAO
-//                 switch (shape.primitive.type) {
-//                 case PrimitiveType::PRIMITIVE_CONE:
-//                     glBindVertexArray(m_coneIds->shape_vao);
-//                     glDrawArrays(GL_TRIANGLES, 0, m_cone->num_triangles);
-//                     break;
-//                 case PrimitiveType::PRIMITIVE_CUBE:
-//                     glBindVertexArray(m_cubeIds->shape_vao);
-//                     glDrawArrays(GL_TRIANGLES, 0, m_cube->num_triangles);
-//                     break;
-//                 case PrimitiveType::PRIMITIVE_CYLINDER:
-//                     glBindVertexArray(m_cylinderIds->shape_vao);
-//                     glDrawArrays(GL_TRIANGLES, 0, m_cylinder->num_triangles);
-//                     break;
-//                 case PrimitiveType::PRIMITIVE_SPHERE:
-//                     glBindVertexArray(m_sphereIds->shape_vao);
-//                     glDrawArrays(GL_TRIANGLES, 0, m_sphere->num_triangles);
-//                     break;
-//                 default:
-//                     if (m_meshes.count(shape.primitive.meshfile) > 0) {
-//                         glBindVertexArray(m_meshIds[shape.primitive.meshfile].shape_vao);
-//                         glDrawArrays(GL_TRIANGLES, 0, m_meshes[shape.primitive.meshfile].num_triangles);
-//                     }
-//                     break;
-//                 }
-//             }
-
-//             glBindVertexArray(0);
-//             glBindFramebuffer(GL_FRAMEBUFFER, 0);
-//         }
-//         // Point lights (cubemap)
-//         else if (sm.type == ShadowType::Point) {
-//             glUseProgram(m_depthPointShader);
-
-//             float nearp = 0.1f;
-//             float farp = m_pointLightFar;
-
-//             CubeLightSpace CS = makeCubeFaceMatrices(L);
-
-//             GLint locModel = glGetUniformLocation(m_depthPointShader, "model");
-//             GLint locView = glGetUniformLocation(m_depthPointShader, "view");
-//             GLint locProj = glGetUniformLocation(m_depthPointShader, "proj");
-//             GLint locLightPos = glGetUniformLocation(m_depthPointShader, "lightPos");
-//             GLint locFarPlane = glGetUniformLocation(m_depthPointShader, "farPlane");
-
-//             glm::vec3 lightPos = glm::vec3(L.pos);
-//             if (locLightPos != -1) glUniform3f(locLightPos, lightPos.x, lightPos.y, lightPos.z);
-//             if (locFarPlane != -1) glUniform1f(locFarPlane, farp);
-
-//             glBindFramebuffer(GL_FRAMEBUFFER, sm.fbo);
-//             glViewport(0, 0, sm.size, sm.size);
-
-//             for (int face = 0; face < 6; ++face) {
-//                 glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-//                                        GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, sm.depthTex, 0);
-//                 glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-//                                           GL_RENDERBUFFER, sm.rbo);
-//                 glDrawBuffer(GL_COLOR_ATTACHMENT0);
-
-//                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-//                 glm::mat4 viewMat = CS.views[face];
-//                 glm::mat4 projMat = CS.proj;
-
-//                 if (locView != -1) glUniformMatrix4fv(locView, 1, GL_FALSE, glm::value_ptr(viewMat));
-//                 if (locProj != -1) glUniformMatrix4fv(locProj, 1, GL_FALSE, glm::value_ptr(projMat));
-
-//                 for (const RenderShapeData &shape : m_renderdata.shapes) {
-//                     if (locModel != -1) glUniformMatrix4fv(locModel, 1, GL_FALSE, &shape.ctm[0][0]);
-
-//                     switch (shape.primitive.type) {
-//                     case PrimitiveType::PRIMITIVE_CONE:
-//                         glBindVertexArray(m_coneIds->shape_vao);
-//                         glDrawArrays(GL_TRIANGLES, 0, m_cone->num_triangles);
-//                         break;
-//                     case PrimitiveType::PRIMITIVE_CUBE:
-//                         glBindVertexArray(m_cubeIds->shape_vao);
-//                         glDrawArrays(GL_TRIANGLES, 0, m_cube->num_triangles);
-//                         break;
-//                     case PrimitiveType::PRIMITIVE_CYLINDER:
-//                         glBindVertexArray(m_cylinderIds->shape_vao);
-//                         glDrawArrays(GL_TRIANGLES, 0, m_cylinder->num_triangles);
-//                         break;
-//                     case PrimitiveType::PRIMITIVE_SPHERE:
-//                         glBindVertexArray(m_sphereIds->shape_vao);
-//                         glDrawArrays(GL_TRIANGLES, 0, m_sphere->num_triangles);
-//                         break;
-//                     default:
-//                         if (m_meshes.count(shape.primitive.meshfile) > 0) {
-//                             glBindVertexArray(m_meshIds[shape.primitive.meshfile].shape_vao);
-//                             glDrawArrays(GL_TRIANGLES, 0, m_meshes[shape.primitive.meshfile].num_triangles);
-//                         }
-//                         break;
-//                     }
-//                 }
-//             }
-
-//             glBindVertexArray(0);
-//             glBindFramebuffer(GL_FRAMEBUFFER, 0);
-//             glUseProgram(0);
-//         }
-//     }
-
-//     glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
-//     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-//     glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);  // CRITICAL!
-//     glDrawBuffer(GL_BACK);   // or GL_COLOR_ATTACHMENT0 if using FBOs
-//     glReadBuffer(GL_BACK);
-//     glUseProgram(0);
-//     checkGLError("END of renderShadowMaps");
-
-// }
-
-// // ============================================================================
-// // BIND SHADOW MAPS TO SHADER
-// // ============================================================================
-
-// void Realtime::bindShadowMapsToShader(GLuint shader) {
-//     // std::cout << "=== Binding shadow maps to shader " << shader << " ===" << std::endl;
-//     checkGLError("START of bindShadowMapsToShader");
-
-//     int baseUnit = 8;
-//     int count = (int)m_shadowMaps.size();
-
-//     // std::cout << "Number of shadow maps: " << count << std::endl;
-
-//     // Initialize all shadow types to 0 (no shadow)
-//     for (int i = 0; i < MAX_SHADOW_CASTERS; ++i) {
-//         std::string stName = "shadowType[" + std::to_string(i) + "]";
-//         GLint stLoc = glGetUniformLocation(shader, stName.c_str());
-//         // std::cout << "  shadowType[" << i << "] location: " << stLoc << std::endl;
-//         if (stLoc != -1) {
-//             glUniform1i(stLoc, 0);
-//             checkGLError(("After setting shadowType[" + std::to_string(i) + "]").c_str());
-//         }
-//     }
-
-//     GLint locShadowBias = glGetUniformLocation(shader, "shadowBias");
-//     GLint locEnablePCF = glGetUniformLocation(shader, "enablePCF");
-//     GLint locPointFarPlane = glGetUniformLocation(shader, "pointLightFar");
-
-//     // std::cout << "  shadowBias loc: " << locShadowBias << std::endl;
-//     // std::cout << "  enablePCF loc: " << locEnablePCF << std::endl;
-//     // std::cout << "  pointLightFar loc: " << locPointFarPlane << std::endl;
-
-//     if (locShadowBias != -1) {
-//         glUniform1f(locShadowBias, m_shadowBias);
-//         checkGLError("After shadowBias");
-//     }
-//     if (locEnablePCF != -1) {
-//         glUniform1i(locEnablePCF, m_enablePCF ? 1 : 0);
-//         checkGLError("After enablePCF");
-//     }
-//     if (locPointFarPlane != -1) {
-//         glUniform1f(locPointFarPlane, m_pointLightFar);
-//         checkGLError("After pointFarPlane");
-//     }
-
-//     for (int i = 0; i < count; ++i) {
-//         const ShadowMap &sm = m_shadowMaps[i];
-
-//         // std::cout << "Processing shadow map " << i << ":" << std::endl;
-//         // std::cout << "  enabled: " << sm.enabled << ", type: " << (int)sm.type << std::endl;
-
-//         int typeInt = 0;
-//         if (!sm.enabled) typeInt = 0;
-//         else if (sm.type == ShadowType::Directional) typeInt = 1;
-//         else if (sm.type == ShadowType::Spot) typeInt = 2;
-//         else if (sm.type == ShadowType::Point) typeInt = 3;
-
-//         std::string stName = "shadowType[" + std::to_string(i) + "]";
-//         GLint stLoc = glGetUniformLocation(shader, stName.c_str());
-//         if (stLoc != -1) {
-//             glUniform1i(stLoc, typeInt);
-//             checkGLError(("After shadowType[" + std::to_string(i) + "]").c_str());
-//         }
-
-//         std::string lsName = "lightSpace[" + std::to_string(i) + "]";
-//         GLint lsLoc = glGetUniformLocation(shader, lsName.c_str());
-//         // std::cout << "  lightSpace[" << i << "] loc: " << lsLoc << std::endl;
-//         if (lsLoc != -1) {
-//             glUniformMatrix4fv(lsLoc, 1, GL_FALSE, glm::value_ptr(sm.lightSpaceMatrix));
-//             checkGLError(("After lightSpace[" + std::to_string(i) + "]").c_str());
-//         }
-
-//         if (!sm.enabled) continue;
-
-//         if (sm.type == ShadowType::Directional || sm.type == ShadowType::Spot) {
-//             // std::cout << "  Binding 2D shadow map to unit " << (baseUnit + i) << std::endl;
-
-//             glActiveTexture(GL_TEXTURE0 + baseUnit + i);
-//             checkGLError(("After glActiveTexture for shadow " + std::to_string(i)).c_str());
-
-//             glBindTexture(GL_TEXTURE_2D, sm.depthTex);
-//             checkGLError(("After glBindTexture 2D for shadow " + std::to_string(i)).c_str());
-
-//             std::string sampName = "shadowMap[" + std::to_string(i) + "]";
-//             GLint sampLoc = glGetUniformLocation(shader, sampName.c_str());
-//             // std::cout << "  shadowMap[" << i << "] loc: " << sampLoc << std::endl;
-//             if (sampLoc != -1) {
-//                 glUniform1i(sampLoc, baseUnit + i);
-//                 checkGLError(("After shadowMap sampler " + std::to_string(i)).c_str());
-//             }
-//         } else if (sm.type == ShadowType::Point) {
-//             // std::cout << "  Binding cubemap shadow to unit " << (baseUnit + i) << std::endl;
-
-//             glActiveTexture(GL_TEXTURE0 + baseUnit + i);
-//             checkGLError(("After glActiveTexture for cubemap " + std::to_string(i)).c_str());
-
-//             glBindTexture(GL_TEXTURE_CUBE_MAP, sm.depthTex);
-//             checkGLError(("After glBindTexture CUBE_MAP for shadow " + std::to_string(i)).c_str());
-
-//             std::string sampName = "shadowCube[" + std::to_string(i) + "]";
-//             GLint sampLoc = glGetUniformLocation(shader, sampName.c_str());
-//             // std::cout << "  shadowCube[" << i << "] loc: " << sampLoc << std::endl;
-//             if (sampLoc != -1) {
-//                 glUniform1i(sampLoc, baseUnit + i);
-//                 checkGLError(("After shadowCube sampler " + std::to_string(i)).c_str());
-//             }
-//         }
-//     }
-
-//     glActiveTexture(GL_TEXTURE0);
-//     checkGLError("After resetting to GL_TEXTURE0");
-
-//     // std::cout << "=== END bindShadowMapsToShader ===" << std::endl;
-// }
-
 // ================== Camera Paths!
 void Realtime::activateCameraPath(CameraPath cameraPath) {
     m_cameraPath = cameraPath;
-    m_pathStartTime = std::chrono::high_resolution_clock::now();
+    m_pathStartTime = m_simulation->lastStep().renderTime();
 }
 
-float Realtime::getPathTime() {
-    auto now = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<float> elapsed = now - m_pathStartTime;;
-    return elapsed.count();
+void Realtime::stepCameraPath(const SimStep& step) {
+    // the path is a function of time, so it is sampled at the render time instead of stepped
+    if (m_cameraPath != std::nullopt) {
+        std::optional<PosRot> pathPosRot = m_cameraPath->get(step.renderTime() - m_pathStartTime);
+        if (pathPosRot == std::nullopt) {
+            m_cameraPath = std::nullopt;
+        } else {
+            updateCameraFromPath(*pathPosRot);
+            m_cameraMoved = true;
+        }
+    }
+    m_simViewProj = m_proj * m_cam.view;
+    m_simEye = glm::vec3(m_cam.pos);
 }
 
 void Realtime::updateCameraFromPath(PosRot posRot) {
@@ -1185,6 +709,176 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
     }
 }
 
+int Realtime::animationStep(const std::string& meshfile, const Frustum& frustum) {
+    // the pose is shared by every instance of a mesh, so the most demanding visible instance decides
+    int step = 0;
+    float tanHalfFov = std::tan(m_cam.heightAngle / 2.f);
+    for (const glm::vec4& instance: m_meshInstances[meshfile]) {
+        glm::vec3 center(instance);
+        float radius = instance.w;
+        if (!frustum.intersectsSphere(center, radius)) continue;
+
+        float distance = std::max(glm::length(center - glm::vec3(m_cam.pos)), 0.001f);
+        float screenSize = radius / (distance * tanHalfFov);
+        int level = 0;
+        for (int i = 0; i < 3; i++) {
+            if (distance > settings.animLodDistance[i] || screenSize < settings.animLodScreenSize[i]) level = i + 1;
+        }
+        step = (step == 0) ? (1 << level) : std::min(step, 1 << level);
+        if (step == 1) break;
+    }
+    return step;
+}
+
+int Realtime::selectLod(RenderShapeData& shape, const float* errors, int levels) {
+    // object-space error -> pixels: scale by the ctm, then project at the instance's distance
+    const glm::mat4& ctm = shape.ctm;
+    float scale = std::max({glm::length(glm::vec3(ctm[0])), glm::length(glm::vec3(ctm[1])), glm::length(glm::vec3(ctm[2]))});
+    float distance = glm::length(glm::vec3(ctm[3]) - glm::vec3(m_cam.pos));
+    float viewportHeight = size().height() * m_devicePixelRatio;
+    float pixelsPerUnit = viewportHeight / (2.f * std::max(distance, 0.001f) * std::tan(m_cam.heightAngle / 2.f));
+    float threshold = settings.lodPixelError;
+
+    // refine as soon as the current level is visibly off, but only coarsen once the next
+    // level is well under the threshold, so an instance near the boundary does not flicker
+    const float hysteresis = 0.75f;
+    int lod = std::clamp(shape.lod, 0, levels - 1);
+    while (lod > 0 && errors[lod] * scale * pixelsPerUnit > threshold) lod--;
+    while (lod + 1 < levels && errors[lod + 1] * scale * pixelsPerUnit < threshold * hysteresis) lod++;
+    shape.lod = lod;
+    return lod;
+}
+
+void Realtime::registerSimulationTasks() {
+    // the camera goes first: everything culled or sorted is for where it ends up
+    SimScheduler::TaskId camera = m_simulation->addTask({"camera path", [this](const SimStep& step) {
+        stepCameraPath(step);
+    }, nullptr, {}, true});
+    // animation maps skin buffers, so it launches its pose jobs from the main thread
+    m_simulation->addTask({"animation", [this](const SimStep& step) {
+        launchAnimationJobs(std::max(0.0, step.renderTime() - m_animRenderTime));
+        m_animRenderTime = step.renderTime();
+    }, [this](const SimStep&) {
+        waitForAnimationJobs();
+    }, {camera}, true});
+    m_simulation->addTask({"particles", [this](const SimStep& step) {
+        stepParticles(step);
+    }, [this](const SimStep& step) {
+        publishParticles(step);
+    }, {camera}});
+    m_simulation->addTask({"l-systems", [this](const SimStep&) {
+        updateLSystems();
+    }, [this](const SimStep&) {
+        publishLSystems();
+    }, {}});
+}
+
+void Realtime::launchAnimationJobs(float deltaTime) {
+    Frustum frustum(m_proj * m_cam.view);
+    for (auto &[key, meshval]: m_meshes) {
+        if (meshval.hasAnimation) {
+            AnimState& anim = meshval.m_meshAnim;
+            float duration = anim.m_animation.m_duration;
+            float timestep = deltaTime + anim.m_currentTime;
+            int step = animationStep(key, frustum);
+
+            anim.m_currentTime += deltaTime;
+            if (anim.m_currentTime >= duration) {
+                anim.m_currentTime = 0.0;
+            }
+            if (step == 0) {
+                // culled: only the clock moves, and the key poses are reseeded once it is visible again
+                anim.m_nextKeyPose.clear();
+                anim.m_lodStep = 0;
+                anim.m_lodTick = 0;
+                continue;
+            }
+
+            bool keyTick = false;
+            float alpha = 0.f;
+            if (step != anim.m_lodStep) {
+                anim.m_lodStep = step;
+                anim.m_lodTick = 0;
+                anim.m_nextKeyPose.clear();
+            }
+            if (step > 1) {
+                keyTick = (anim.m_lodTick == 0);
+                alpha = anim.m_lodTick / (float)step;
+                anim.m_lodTick = (anim.m_lodTick + 1) % step;
+            }
+            // assumes the tick length stays roughly constant until the next key
+            float keyTimestep = timestep + step * deltaTime;
+            if (duration > 0.f) keyTimestep = std::fmod(keyTimestep, duration);
+
+            Mesh* mesh = &meshval;
+            float* skinned = nullptr;
+            if (m_skinBuffers.count(key) != 0) {
+                makeCurrent();
+                skinned = m_skinBuffers[key].beginWrite();
+            }
+            anim.m_pendingReady = true;
+            // each job only writes its own mesh's pending buffer
+            m_threadPool->submit(m_animJobs, [this, mesh, step, keyTick, alpha, timestep, keyTimestep, skinned] {
+                auto start = std::chrono::steady_clock::now();
+                if (step == 1) mesh->updateFinalBoneMatrices(timestep);
+                else if (keyTick) mesh->sampleKeyPose(timestep, keyTimestep);
+                else mesh->blendKeyPoses(alpha, timestep, keyTimestep);
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                m_animWorkNs.fetch_add(ns, std::memory_order_relaxed);
+                if (skinned == nullptr) return;
+
+                // the pose is ready, so fan the vertices out; idle workers steal the chunks
+                constexpr int chunk = 4096;
+                int count = mesh->m_skinStreams.count;
+                m_skinVertices.fetch_add(count, std::memory_order_relaxed);
+                for (int begin = 0; begin < count; begin += chunk) {
+                    int end = std::min(count, begin + chunk);
+                    m_threadPool->submit(m_animJobs, [this, mesh, skinned, begin, end] {
+                        auto start = std::chrono::steady_clock::now();
+                        mesh->skinPendingPose(skinned, begin, end);
+                        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                        m_skinNs.fetch_add(ns, std::memory_order_relaxed);
+                    });
+                }
+            });
+        }
+    }
+}
+
+void Realtime::waitForAnimationJobs() {
+    if (!m_threadPool) return;
+    auto start = std::chrono::steady_clock::now();
+    m_threadPool->wait(m_animJobs);
+    m_animWaitNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto &[key, meshval]: m_meshes) {
+        if (meshval.hasAnimation) meshval.swapBoneMatrices();
+    }
+    if (!m_skinBuffers.empty()) {
+        makeCurrent();
+        for (auto &[key, buffer]: m_skinBuffers) {
+            buffer.endWrite();
+        }
+    }
+
+    // pose cost vs. time the GUI thread actually blocked, averaged over a few seconds
+    if (++m_animStatTicks == STATS_PERIOD_FRAMES) {
+        long long workNs = m_animWorkNs.exchange(0);
+        long long skinNs = m_skinNs.exchange(0);
+        long long skinVertices = m_skinVertices.exchange(0);
+        if (statsEnabled()) {
+            std::cout << "Animation: " << (workNs / m_animStatTicks) * 1e-6 << " ms of pose work, "
+                      << (m_animWaitNs / m_animStatTicks) * 1e-6 << " ms blocked per tick ("
+                      << m_threadPool->numWorkers() + 1 << " threads)" << std::endl;
+            if (skinNs > 0) {
+                std::cout << "CPU skinning: " << skinVertices * 1e3 / skinNs << " Mverts/s per thread" << std::endl;
+            }
+        }
+        m_animWaitNs = 0;
+        m_animStatTicks = 0;
+    }
+}
+
 void Realtime::timerEvent(QTimerEvent *event) {
     /*
         W: Translates the camera in the direction of the look vector
@@ -1203,17 +897,6 @@ void Realtime::timerEvent(QTimerEvent *event) {
     float deltaTime = elapsedms * 0.001f;
     m_elapsedTimer.restart();
 
-    for (auto &[key, meshval]: m_meshes) {
-        if (meshval.hasAnimation) {
-            meshval.updateFinalBoneMatrices(deltaTime + meshval.m_meshAnim.m_currentTime);
-            meshval.m_meshAnim.m_currentTime += deltaTime;
-
-            if (meshval.m_meshAnim.m_currentTime >= meshval.m_meshAnim.m_animation.m_duration) {
-                meshval.m_meshAnim.m_currentTime = 0.0;
-            }
-        }
-    }
-
     bool updatedoccurred = false;
     // Use deltaTime and m_keyMap here to move around
     if (m_keyMap[Qt::Key_W]) {
@@ -1258,6 +941,9 @@ void Realtime::timerEvent(QTimerEvent *event) {
         declareCameraUniforms();
         glUseProgram(0);
     }
+
+    // publish what was simulated during the last frame, then start on the next steps
+    m_simulation->launch(deltaTime, settings.threadedSimulation);
     update(); // asks for a PaintGL() call to occur
 }
 
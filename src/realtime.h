@@ -7,13 +7,17 @@
 #include "postprocessing/convolution.h"
 #include "postprocessing/fog.h"
 #include "postprocessing/crepuscular.h"
+#include "postprocessing/bloom.h"
 #include "postprocessing/seasoncolorgrade.h"
+#include "postprocessing/rendergraph.h"
+#include "postprocessing/fusedpostprocess.h"
 #ifdef __APPLE__
 #define GL_SILENCE_DEPRECATION
 #endif
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <array>
 #include <unordered_map>
 #include <QElapsedTimer>
 #include <QOpenGLWidget>
@@ -27,12 +31,39 @@
 #include <shapes/Cone.h>
 #include <shapes/Cylinder.h>
 #include <shapes/mesh.h>
-#include <particles.h>
+#include "utils/threadpool.h"
+#include "utils/simscheduler.h"
+#include "utils/lsystemgrammar.h"
+#include "utils/frustum.h"
+#include "utils/texturebuffer.h"
+#include "utils/quadtreeallocator.h"
+#include "utils/particlepool.h"
+#include "utils/streambuffer.h"
 
 
 struct VboVao {
     GLuint shape_vbo = 0;
     GLuint shape_vao = 0;
+    GLuint shape_ebo = 0;  // only set for indexed primitives
+    GLsizei num_indices = 0;
+};
+
+// Tessellated primitives already uploaded to the GPU, keyed by (shape, param1, param2)
+struct PrimitiveKey {
+    PrimitiveType type;
+    int param1;
+    int param2;
+    auto operator<=>(const PrimitiveKey&) const = default;
+};
+
+struct CachedPrimitive {
+    VboVao ids;
+    long lastUsed = 0;
+};
+
+struct PrimitiveLod {
+    VboVao* ids = nullptr;
+    float error = 0.f; // object-space deviation from the true surface
 };
 
 class Realtime : public QOpenGLWidget
@@ -50,8 +81,12 @@ public:
     void rebuildMatrices();
     void rebuildCamera();
     void setupPrimitives(VboVao* shape_ids, const std::vector<GLfloat>& triangles, bool anim = false, bool texturing = false);
+    void setupIndexedPrimitive(VboVao* shape_ids, const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices, bool texturing);
+    VboVao* acquirePrimitive(PrimitiveType type, int param1, int param2);
+    void deletePrimitiveCache();
     void deleteAllMeshes();
     void rebuildMeshes();
+    float gpuSkinningError(const std::string& meshfile);
     void buildGeometry();
     void initializeTextures(std::string filepath);
     void setupSkybox();
@@ -61,15 +96,12 @@ public:
     void setupLSystems();
     void setupParticles();
     void particleUpdate();
-    int FindUnusedParticle();
-    QString generateLSystemString(std::map<QChar, QString> rules, QString axiom, int numIterations);
-    SceneNode* createLSystemNode(QString data);
-    SceneNode* createLSystemNodeHelper(QString data, float localScale, float angle);
+    void stepParticles(const SimStep& step);
+    void publishParticles(const SimStep& step);
     void updateLSystems();
+    void publishLSystems();
     void paintLSystems();
     void paintParticles();
-    void makeFBO();
-    void paintFog();
 
     // Shadow mapping methods
     void createShadowResources();
@@ -114,63 +146,208 @@ private:
     float near, far;
 
     Sphere* m_sphere = new Sphere();
-    VboVao* m_sphereIds = new VboVao();
-
     Cube* m_cube = new Cube();
-    VboVao* m_cubeIds = new VboVao();
-
     Cone* m_cone = new Cone();
-    VboVao* m_coneIds = new VboVao();
-
     Cylinder* m_cylinder = new Cylinder();
-    VboVao* m_cylinderIds = new VboVao();
+
+    static constexpr int MAX_CACHED_PRIMITIVES = 32;
+    std::map<PrimitiveKey, CachedPrimitive> m_primitiveCache;
+    long m_primitiveCacheClock = 0;
+
+    // LOD chain per primitive type, finest first; the ids point into m_primitiveCache
+    // and the map stays empty until the geometry has been built
+    static constexpr int PRIMITIVE_LOD_LEVELS = 3;
+    std::unordered_map<PrimitiveType, std::array<PrimitiveLod, PRIMITIVE_LOD_LEVELS>> m_primitiveLods;
+    void acquirePrimitiveLods();
+    bool isPrimitiveInUse(const VboVao* ids) const;
+    int selectLod(RenderShapeData& shape, const float* errors, int levels);
+
+    // binds the shape's VAO and says how to draw it; without reselectLod the level chosen
+    // for the camera last time is reused (the shadow passes draw what the camera sees)
+    struct ShapeDraw {
+        GLsizei count = 0;
+        bool indexed = false;
+        bool animating = false; // skinned in the vertex shader, needs the bone matrices
+    };
+    ShapeDraw bindShapeGeometry(RenderShapeData& shape, bool reselectLod);
+    void declBoneUniforms(GLuint shader, Mesh& mesh);
+
+    // Everything rewritten each frame (particle instances, bone palettes, light cluster lists,
+    // the particle emitter block) is sub-allocated from this one ring, which paintGL opens and
+    // fences around the frame. Bone palettes go in once per mesh per frame as a Bones uniform
+    // block and every pass that skins that mesh binds the same range.
+    static constexpr GLuint BONE_BLOCK_BINDING = 1;
+    static constexpr int MAX_BONES = 100; // finalBoneMatrices in the vertex shaders
+    static constexpr GLsizeiptr STREAM_FRAME_BYTES = 1 << 20;
+    void bindBoneBlock(GLuint shader);
+    StreamBuffer m_streamBuffer;
+    std::unordered_map<const Mesh*, GLintptr> m_boneOffsets; // this frame's palette per mesh
+    int m_boneGeneration = -1;
 
     std::unordered_map<std::string, Mesh> m_meshes;
     std::unordered_map<std::string, VboVao> m_meshIds;
+    std::unordered_map<std::string, std::vector<VboVao>> m_meshLodIds; // simplified levels 1.. of each mesh
+
+    // Animation jobs: poses for the next tick are evaluated on the pool while the current frame draws
+    std::unique_ptr<ThreadPool> m_threadPool;
+    TaskGroup m_animJobs;
+    std::atomic<long long> m_animWorkNs{0};
+    std::atomic<long long> m_skinNs{0};
+    std::atomic<long long> m_skinVertices{0};
+    std::unordered_map<std::string, SkinnedMeshBuffer> m_skinBuffers; // meshes skinned on the CPU
+    long long m_animWaitNs = 0;
+    int m_animStatTicks = 0;
+    std::unordered_map<std::string, std::vector<glm::vec4>> m_meshInstances; // world bounding sphere per instance
+    int animationStep(const std::string& meshfile, const Frustum& frustum);
+    void launchAnimationJobs(float deltaTime);
+    void waitForAnimationJobs();
+
+    // Simulation: the camera path, animation, particles and L-systems advance in fixed steps,
+    // launched by timerEvent and published at the start of the next tick, so each frame draws
+    // what was simulated while the one before it was drawn
+    static constexpr float SIM_STEP = 1.f / 60.f;
+    static constexpr int SIM_MAX_STEPS = 8;
+    void registerSimulationTasks();
+    std::unique_ptr<SimScheduler> m_simulation;
+    glm::mat4 m_simViewProj; // the camera the pool tasks cull and sort for
+    glm::vec3 m_simEye;
+    double m_animRenderTime = 0.0;
 
     // L-System Details
-    std::vector<SceneNode*> m_LSystems;
-    RenderData m_LSystemMetaData;
-    float m_LSystemScaler;
-    float m_LSystemScaleProgression;
-    float m_LSystemIterations;
-    bool m_LSystemIterationsChanged;
-    std::map<QChar, QString> m_rules;
-    QString m_axiom;
-    float m_angle = (5.0 / 36.0) * M_PI;
+    // Plants come from the scene file. Each one's rules are compiled into an LSystemGrammar and
+    // grown into a few variants, one thread pool job each (deterministic rules only need one),
+    // and its instances are scattered and share those variants. The turtle writes instance data
+    // straight away: a model matrix and diffuse color per cylinder, in the plant's space. Each
+    // variant is drawn with one instanced call over its branches times its plants, the plant
+    // matrices read from a texture buffer, and the leaves, a billboard at every branch tip, are
+    // drawn as one more batch with the particle shader. The rest of the material is shared.
+    struct LSystemInstance {
+        glm::mat4 model;
+        glm::vec4 diffuse;
+    };
+    // one grown variant, in the plant's space
+    struct LSystemGeometry {
+        std::vector<LSystemInstance> branches;
+        std::vector<glm::vec4> leaves; // position and size
+    };
+    struct LSystemForest {
+        struct Batch {
+            int firstBranch, branchCount;
+            int firstPlant, plantCount;
+        };
+        std::vector<LSystemInstance> branches; // every variant's, one after the other
+        std::vector<glm::mat4> plants;         // grouped by variant
+        std::vector<Batch> batches;            // a variant and the plants that use it
+        std::vector<glm::vec4> leaves;         // world space, position and size
+        std::vector<uint32_t> leafColors;      // RGBA8
+    };
+    // appends a cylinder per branch and a leaf per tip
+    void interpretLSystem(const LSystemString& data, const ScenePlant& plant, LSystemGeometry& geometry);
+    void growForest(const std::vector<RenderPlantData>& plants, LSystemForest& forest);
+    std::optional<std::vector<RenderPlantData>> m_LSystemKey; // what m_LSystemForest was grown from
+    LSystemForest m_LSystemForest;
+    LSystemForest m_LSystemPending; // built by the simulation task, swapped in by publishLSystems
+    bool m_LSystemPendingReady = false;
+    bool m_LSystemUploaded = true; // false until paint has copied m_LSystemForest to the instance buffers
+    SceneMaterial m_LSystemMaterial;
+    static constexpr float LSYSTEM_LEAF_SIZE = 0.6f; // billboard width, in segment lengths
+    static constexpr int LSYSTEM_PLANT_TEXTURE_UNIT = 14;
+    GLuint m_vboLinstances;
+    GLuint m_vaoLleaves;
+    GLuint m_vboLleaves;
+    // 4 texels per plant, the columns of its matrix
+    TextureBuffer m_LSystemPlants;
+    std::vector<LSystemForest::Batch> m_LSystemBatches;
+    GLsizei m_LSystemLeafCount = 0;
     GLuint m_vboLcylinder;
     GLuint m_vaoLcylinder;
+    GLuint m_eboLcylinder;
+    GLsizei m_LcylinderIndexCount;
     std::vector<GLfloat> m_LcylinderData;
     GLuint m_l_system_shader;
-    bool updateToggle = true;
 
     // Particle Details
+    // Every emitter in the scene file has its own pool, simulated in world space so one
+    // instanced draw takes them all. Emitters whose bounds are out of view are paused; the
+    // rest are drawn farthest first, each sorted back to front, and their sprites share one
+    // texture array.
+    struct ParticleEmitter {
+        SceneEmitter settings;
+        glm::mat4 ctm;
+        ParticlePool pool;
+        ParticlePool::SpawnRanges spawn; // in the emitter's space
+        float spawnDebt = 0.f;           // fraction of a particle owed by the rate
+        float spriteLayer = -1.f;        // -1 draws the procedural disc
+        glm::vec3 center;                // world-space sphere around everywhere a particle can reach
+        float radius = 0.f;
+        bool visible = false;
+    };
+    static constexpr int PARTICLE_SPRITE_TEXTURE_UNIT = 15;
+    static constexpr int PARTICLE_SPRITE_SIZE = 128;
+
+    void createEmitters(const std::string& scenePath);
+    void cullEmitters();
+    void stepEmitter(ParticleEmitter& emitter, float dt);
+
+    std::vector<ParticleEmitter> m_emitters;
+    std::vector<int> m_emitterOrder; // visible emitters, farthest first
+    // instances for one frame, packed by the particle task and copied into the stream buffer by paint
+    struct ParticleFrame {
+        std::vector<float> posSize;
+        std::vector<uint32_t> colors;
+        std::vector<float> layers;
+        int emitters = 0;
+    };
+    ParticleFrame m_particleFrames[2];
+    int m_particleFront = 0; // the frame paint reads; the task packs the other
+    GLuint m_particleSprites = 0;
     int m_numParticles;
-    int m_maxNumParticles;
-    std::vector<Particle> m_particles;
-    float m_dt;
     GLuint m_particleShader;
     GLuint m_vboParticlesBillboard;
-    GLuint m_vboParticlesPositionSize;
-    GLuint m_vboParticlesColor;
     GLuint m_vboParticlesUV;
     GLuint m_vaoParticles;
-    int m_lastUsedParticle = 0;
     std::vector<GLfloat> m_particleVertexData;
-    std::vector<GLfloat> m_particulePositionSizeData;
-    std::vector<GLfloat> m_particuleColorData;
+    GLintptr m_particleInstanceOffset = 0; // this frame's instances in the stream buffer
+    int m_particleStatFrames = 0;
+    // written by the emitter jobs
+    std::atomic<long long> m_particleStatNanos{0};
+    std::atomic<long long> m_particleSortNanos{0};
+    std::atomic<int> m_particleSorts{0};
+    std::atomic<int> m_particleSortsCoherent{0};
+
+    // GPU particles (settings.gpuParticles): the state never leaves the GPU. Two buffers take
+    // turns; a transform feedback pass reads one, steps every particle (respawning dead ones
+    // from the Emitter uniform block) into the other, and the draw reads that one directly.
+    static constexpr GLuint PARTICLE_EMITTER_BINDING = 0;
+
+    // std140 layout of the Emitter block in particles_update.vert
+    struct ParticleEmitterBlock {
+        glm::vec4 positionMin, positionMax;
+        glm::vec4 velocityMin, velocityMax;
+        glm::vec4 sizeLife;
+        glm::vec4 acceleration;
+        glm::vec4 step;
+        glm::uvec4 seed;
+    };
+
+    void createGpuParticles();
+    void deleteGpuParticles();
+    void updateGpuParticles();
+
+    GLuint m_particleUpdateShader = 0;
+    GLuint m_gpuParticleState[2] = {0, 0};     // per particle: position + size, velocity + life
+    GLuint m_gpuParticleUpdateVao[2] = {0, 0}; // reads state[i] as points
+    GLuint m_gpuParticleDrawVao[2] = {0, 0};   // reads state[i] as instances
+    GLuint m_gpuParticleQuery = 0;
+    int m_gpuParticleCurrent = 0; // the buffer holding the latest step
+    int m_gpuParticleCount = 0;
+    uint32_t m_gpuParticleFrame = 0;
+    int m_gpuParticleSteps = 0; // simulation steps published since the last update
+    // the GPU path runs the first emitter only, in its own space
+    ParticlePool::SpawnRanges m_particleSpawn;
+    glm::vec3 m_particleGravity;
+    int m_maxNumParticles = 0;
     glm::mat4 m_particleCtm;
-    float m_particleVelocityGlobal;
-
-    // Fog Details
-    GLuint m_fbo_texture;
-    GLuint m_fbo_depthTexture;
-    GLuint m_fbo_width;
-    GLuint m_fbo_height;
-    GLuint m_fbo_renderbuffer;
-    GLuint m_fbo;
-    GLuint m_defaultFBO;
-    GLuint m_fogShader;
 
     // Scrolling Details
     float time_elapsed = 0;
@@ -180,6 +357,14 @@ private:
     std::vector<GLuint> m_skybox;
     //postprocessing
     std::vector<std::unique_ptr<PostProcess>> m_postprocesses;
+    // scene -> each effect in m_postprocesses -> window, with targets drawn from the pool
+    RenderGraph m_postGraph;
+    RenderTargetPool m_targetPool;
+    std::vector<std::unique_ptr<FusedPostProcess>> m_fusedPostprocesses; // runs of fusible effects from m_postprocesses
+    bool m_postGraphFused = false;
+    int m_postGraphCrepuscularQuality = -1;
+    bool m_postGraphBloom = false;
+    void buildPostGraph();
 
     GLuint m_skybox_vbo_id = 0, m_skybox_vao_id = 0;
     int m_skybox_size = 1;
@@ -228,33 +413,118 @@ private:
     };
 
     // camera paths
-    std::chrono::high_resolution_clock::time_point m_pathStartTime;
-    float getPathTime();
+    double m_pathStartTime = 0.0; // simulation time
     std::optional<CameraPath> m_cameraPath;
+    bool m_cameraMoved = false;   // the path moved the camera since the last frame
+    void stepCameraPath(const SimStep& step);
     void updateCameraFromPath(PosRot posRot);
 
     // --- Shadow mapping ---
-    static constexpr int MAX_SHADOW_CASTERS = 8;
-    static constexpr int DEFAULT_SHADOW_SIZE = 2048;
-
-    enum class ShadowType { None = 0, Directional = 1, Spot = 2, Point = 3 };
+    // The first directional light gets cascaded shadows: the view frustum (up to
+    // settings.shadowDistance) is cut into slices, and each slice gets its own ortho
+    // map in one layer of a depth texture array, fit tightly around it.
+    static constexpr int MAX_CASCADES = 4;
+    static constexpr int CASCADE_SIZE = 2048;
+    static constexpr int SHADOW_TEXTURE_UNIT = 10;
+    static constexpr int SHADOW_ATLAS_TEXTURE_UNIT = 11;
+
+    struct ShadowCascade {
+        float splitFar = 0.f; // view distance where the slice ends
+        glm::mat4 lightSpace;
+        std::vector<int> casters; // indices into m_renderdata.shapes
+    };
 
-    struct ShadowMap {
-        ShadowType type = ShadowType::None;
-        bool enabled = false;
-        GLuint fbo = 0;
-        GLuint depthTex = 0;
-        int size = DEFAULT_SHADOW_SIZE;
+    // world bounding sphere of a shape, false if it has no geometry
+    bool shapeBounds(const RenderShapeData& shape, glm::vec3& center, float& radius);
+    void fitCascade(ShadowCascade& cascade, float splitNear, float splitFar, const glm::vec3& lightDir);
+
+    // Point and spot lights share one depth atlas (settings.shadowAtlasSize squared, the whole
+    // memory budget). Each frame every light asks for a tile size from how large its range
+    // looks on screen; a quadtree hands out the tiles, the brightest and largest lights
+    // first, halving requests that do not fit. A point light takes six tiles, one per
+    // cube face, all drawn in one pass through viewport-indexed layered rendering. A light
+    // only redraws when its tiles were reassigned or something in its range moved.
+    static constexpr int MAX_SHADOW_TILES = 24;
+    static constexpr int MIN_SHADOW_TILE = 64;
+    static constexpr int MAX_SHADOW_TILE = 1024;
+
+    struct ShadowedLight {
         int lightIndex = -1;
-        glm::mat4 lightSpaceMatrix;
-        GLuint rbo = 0;
+        bool point = true; // otherwise a spot light
+        int requestedSize = 0; // what it asked for; the tiles can be smaller when the atlas is full
+        int tileSize = 0;      // 0 while it has no tiles
+        std::vector<QuadtreeAllocator::Rect> tiles;
+        float importance = 0.f;
+        bool valid = false; // the tiles hold the casters below as they are now
+        glm::vec3 position;
+        glm::vec3 direction;
+        float range = 0.f;
+        glm::mat4 faceMatrices[6]; // proj * view of each tile
+        std::vector<int> casters;
+        std::vector<int> faceMasks; // bit f: the caster reaches tile f
+        std::vector<glm::mat4> casterCtms;
     };
 
-    std::vector<ShadowMap> m_shadowMaps;
+    void assignShadowTiles();
+    void renderLightShadows();
+    // collects this frame's casters, and returns whether the tiles are out of date
+    bool updateShadowCasters(ShadowedLight& shadow);
+
+    std::vector<ShadowedLight> m_shadowedLights;
+    QuadtreeAllocator m_shadowAtlasTiles;
+    int m_shadowAtlasSetting = 0; // settings.shadowAtlasSize it was made for, before rounding
+    GLuint m_shadowAtlas = 0;
+    GLuint m_shadowAtlasFbo = 0;
+    GLuint m_depthAtlasShader = 0;
+    int m_shadowRedraws = 0;
+    int m_shadowAtlasStatFrames = 0;
+
+    int m_shadowLight = -1; // index into m_renderdata.lights, -1 without a directional light
+    int m_numCascades = 0;
+    std::array<ShadowCascade, MAX_CASCADES> m_cascades;
+    GLuint m_cascadeArray = 0;
+    GLuint m_shadowFbo = 0;
     GLuint m_depthShader = 0;
-    GLuint m_depthPointShader = 0;
     bool m_enablePCF = true;
-    float m_shadowBias = 0.003f;
-    float m_pointLightFar = 50.0f;
-    bool m_shadowSettingsDirty = false;
+    float m_shadowBias = 0.0015f;
+    int m_shadowStatFrames = 0;
+    long long m_shadowStatCasters[MAX_CASCADES] = {0};
+
+    // --- Clustered lighting ---
+    // Every frame the point and spot lights are binned on the CPU into a grid of clusters
+    // (screen tiles times exponential depth slices), and anim.frag only shades the lights
+    // listed for its pixel's cluster. Directional lights, and lights whose falloff reaches
+    // past MAX_LIGHT_RANGE, light everything and are kept in a short global list instead.
+    // GL 4.1 has no storage buffers, so the lights and lists live in texture buffers; the
+    // grid and lists are rewritten every frame into the stream buffer, one R32UI view over it.
+    static constexpr int CLUSTERS_X = 16;
+    static constexpr int CLUSTERS_Y = 9;
+    static constexpr int CLUSTERS_Z = 24;
+    static constexpr int MAX_GLOBAL_LIGHTS = 8;
+    static constexpr float MAX_LIGHT_RANGE = 100.f;
+    static constexpr int LIGHT_DATA_TEXTURE_UNIT = 12;
+    static constexpr int CLUSTER_DATA_TEXTURE_UNIT = 13;
+
+    // where a point or spot light's attenuation stops changing an 8-bit pixel, at most MAX_LIGHT_RANGE
+    static float lightRange(const SceneLightData& light);
+    void uploadLights();
+    void buildLightClusters();
+    void bindLightClustersToShader(GLuint shader);
+    void deleteLightResources();
+
+    TextureBuffer m_lightData;     // 4 texels per light: color + type, position + angle, direction + penumbra, attenuation
+    // per cluster an offset and count of light indices, then the indices cluster after cluster
+    GLuint m_clusterData = 0;
+    int m_clusterDataGeneration = -1; // the stream buffer the view was made for
+    GLint m_clusterGridBase = 0;      // texel where this frame's grid starts
+    std::vector<GLint> m_globalLights;
+    std::vector<int> m_clusteredLights;
+    std::vector<float> m_clusteredRanges;
+    // view-space bounds of every cluster, rebuilt when the projection changes
+    std::vector<glm::vec3> m_clusterMin, m_clusterMax;
+    glm::mat4 m_clusterProj = glm::mat4(0.f);
+    std::vector<std::vector<GLuint>> m_clusterLists;
+    int m_clusterStatFrames = 0;
+    long long m_clusterStatEntries = 0;
+    int m_clusterStatMax = 0;
 };
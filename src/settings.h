@@ -16,6 +16,33 @@ struct Settings {
     bool extraCredit3 = false;
     bool extraCredit4 = false;
     float season = 0.0f;
+    // animation LOD: past each distance, or below each fraction of the screen height,
+    // skinned meshes drop to 1/2, 1/4 and then 1/8 of the tick rate
+    float animLodDistance[3] = {15.f, 30.f, 60.f};
+    float animLodScreenSize[3] = {0.25f, 0.1f, 0.04f};
+    // geometry LOD: the coarsest level whose projected error stays under this many pixels is drawn
+    float lodPixelError = 1.f;
+    // run consecutive per-pixel post-processes (color grading, ...) as one generated shader
+    bool fusePostprocesses = true;
+    // crepuscular rays are marched at full (0), half (1) or quarter (2) resolution
+    int crepuscularQuality = 1;
+    // Gaussian bloom around the brightest parts of the image
+    bool bloom = true;
+    // cascaded shadows of the directional light: number of cascades (2 to 4), and how far they reach
+    int shadowCascades = 3;
+    float shadowDistance = 40.f;
+    // point and spot light shadows: side of the shared atlas (its whole memory), and a scale on
+    // the tile size each light asks for from its size on screen
+    int shadowAtlasSize = 4096;
+    float shadowResolutionScale = 1.f;
+    // simulate the particles on the GPU with transform feedback instead of on the CPU
+    bool gpuParticles = false;
+    // CPU particles: draw them farthest first so blending is right
+    bool sortParticles = true;
+    // run the simulation tasks (particles, L-systems, ...) on the thread pool while the scene draws
+    bool threadedSimulation = true;
+    // draw a billboard leaf at the end of every L-system branch
+    bool lSystemLeaves = true;
 };
 
 
@@ -0,0 +1,537 @@
+#include "realtime.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "settings.h"
+#include "utils/frustum.h"
+#include "utils/shaderloader.h"
+#include "utils/stats.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+// blend between logarithmic (lambda 1) and uniform (lambda 0) split distances
+constexpr float CASCADE_SPLIT_LAMBDA = 0.75f;
+// unit primitives fit in a sphere through the corners of the unit cube
+const float PRIMITIVE_RADIUS = std::sqrt(3.f) / 2.f;
+// skinned meshes can leave their bind-pose bounds
+constexpr float ANIMATED_BOUNDS_PADDING = 1.5f;
+constexpr float LIGHT_SHADOW_NEAR = 0.05f;
+constexpr int MAX_SHADOW_ATLAS_SIZE = 8192;
+// a tile only shrinks once the light needs less than this much of the smaller size,
+// so lights at the edge of a size step do not get redrawn every frame
+constexpr float SHADOW_TILE_SHRINK = 0.75f;
+
+// cube faces in GL order (+X, -X, +Y, -Y, +Z, -Z)
+const glm::vec3 CUBE_LOOKS[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+const glm::vec3 CUBE_UPS[6] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+
+// bit f set when a sphere (relative to the light) reaches into the 90 degree pyramid of face f
+int cubeFaceMask(const glm::vec3& center, float radius) {
+    if (glm::length(center) <= radius) return 0x3f;
+    int mask = 0;
+    float slack = radius * std::sqrt(2.f);
+    for (int f = 0; f < 6; f++) {
+        int axis = f / 2;
+        float a = (f % 2 == 0) ? center[axis] : -center[axis];
+        float u = center[(axis + 1) % 3], v = center[(axis + 2) % 3];
+        // the face's four side planes are a = |u| and a = |v|
+        if (a - std::abs(u) >= -slack && a - std::abs(v) >= -slack) mask |= 1 << f;
+    }
+    return mask;
+}
+
+// whether a sphere (relative to the light) reaches into a cone around dir
+bool coneReaches(const glm::vec3& center, float radius, const glm::vec3& dir, float angle) {
+    float along = glm::dot(center, dir);
+    float across = std::sqrt(std::max(glm::dot(center, center) - along * along, 0.f));
+    // signed distance from the center to the cone's side
+    return std::cos(angle) * across - std::sin(angle) * along <= radius && along >= -radius;
+}
+}
+
+void Realtime::createShadowResources() {
+    deleteShadowResources();
+
+    m_shadowLight = -1;
+    int tiles = 0;
+    for (int i = 0; i < (int)m_renderdata.lights.size() && i < 8; i++) {
+        const SceneLightData& light = m_renderdata.lights[i];
+        if (light.type == LightType::LIGHT_DIRECTIONAL) {
+            if (m_shadowLight < 0) m_shadowLight = i;
+            continue;
+        }
+        bool point = light.type == LightType::LIGHT_POINT;
+        int count = point ? 6 : 1;
+        if (tiles + count > MAX_SHADOW_TILES) continue;
+        ShadowedLight shadow;
+        shadow.lightIndex = i;
+        shadow.point = point;
+        m_shadowedLights.push_back(shadow);
+        tiles += count;
+    }
+
+    if (!m_shadowedLights.empty()) {
+        int atlasSize = MAX_SHADOW_TILE;
+        while (atlasSize < settings.shadowAtlasSize && atlasSize < MAX_SHADOW_ATLAS_SIZE) atlasSize *= 2;
+        m_shadowAtlasTiles = QuadtreeAllocator(atlasSize, MIN_SHADOW_TILE);
+        m_shadowAtlasSetting = settings.shadowAtlasSize;
+
+        glGenTextures(1, &m_shadowAtlas);
+        glBindTexture(GL_TEXTURE_2D, m_shadowAtlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, atlasSize, atlasSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &m_shadowAtlasFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_shadowAtlasFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_shadowAtlas, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Shadow atlas framebuffer incomplete: " << status << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // gl_ViewportIndex in the geometry shader picks the tile
+        m_depthAtlasShader = ShaderLoader::createShaderProgram(":/resources/shaders/shadow_depth_point.vert",
+                                                               ":/resources/shaders/shadow_depth_point.geom",
+                                                               ":/resources/shaders/shadow_depth_point.frag");
+        bindBoneBlock(m_depthAtlasShader);
+        std::cout << "Shadow atlas of " << atlasSize << "x" << atlasSize << " for " << m_shadowedLights.size()
+                  << " point and spot lights" << std::endl;
+    }
+    if (m_shadowLight < 0) return;
+
+    m_numCascades = std::clamp(settings.shadowCascades, 2, MAX_CASCADES);
+
+    // hardware depth comparison with linear filtering gives a bilinear 2x2 PCF per fetch
+    glGenTextures(1, &m_cascadeArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_cascadeArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, CASCADE_SIZE, CASCADE_SIZE, m_numCascades, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &m_shadowFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_shadowFbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cascadeArray, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Shadow framebuffer incomplete: " << status << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    m_depthShader = ShaderLoader::createShaderProgram(":/resources/shaders/shadow_depth.vert", ":/resources/shaders/shadow_depth.frag");
+    bindBoneBlock(m_depthShader);
+    std::cout << "Cascaded shadows for light " << m_shadowLight << ": " << m_numCascades << " cascades of "
+              << CASCADE_SIZE << "x" << CASCADE_SIZE << std::endl;
+}
+
+void Realtime::deleteShadowResources() {
+    m_shadowedLights.clear();
+    m_shadowAtlasTiles = QuadtreeAllocator();
+    if (m_shadowAtlasFbo) glDeleteFramebuffers(1, &m_shadowAtlasFbo);
+    if (m_shadowAtlas) glDeleteTextures(1, &m_shadowAtlas);
+    if (m_depthAtlasShader) glDeleteProgram(m_depthAtlasShader);
+    m_shadowAtlasFbo = 0;
+    m_shadowAtlas = 0;
+    m_depthAtlasShader = 0;
+    if (m_shadowFbo) glDeleteFramebuffers(1, &m_shadowFbo);
+    if (m_cascadeArray) glDeleteTextures(1, &m_cascadeArray);
+    if (m_depthShader) glDeleteProgram(m_depthShader);
+    m_shadowFbo = 0;
+    m_cascadeArray = 0;
+    m_depthShader = 0;
+    m_numCascades = 0;
+    m_shadowLight = -1;
+}
+
+bool Realtime::shapeBounds(const RenderShapeData& shape, glm::vec3& center, float& radius) {
+    const glm::mat4& ctm = shape.ctm;
+    float scale = std::max({glm::length(glm::vec3(ctm[0])), glm::length(glm::vec3(ctm[1])), glm::length(glm::vec3(ctm[2]))});
+    center = glm::vec3(ctm[3]);
+    if (shape.primitive.type != PrimitiveType::PRIMITIVE_MESH) {
+        radius = PRIMITIVE_RADIUS * scale;
+        return true;
+    }
+    auto mesh = m_meshes.find(shape.primitive.meshfile);
+    if (mesh == m_meshes.end()) return false;
+    radius = mesh->second.m_boundingRadius * scale;
+    if (mesh->second.hasAnimation) radius *= ANIMATED_BOUNDS_PADDING;
+    return true;
+}
+
+void Realtime::fitCascade(ShadowCascade& cascade, float splitNear, float splitFar, const glm::vec3& lightDir) {
+    // corners of this slice of the view frustum, in world space (x extent matches rebuildMatrices)
+    float aspect = size().width() / (float)size().height();
+    float tanY = std::tan(m_cam.heightAngle / 2.f);
+    float tanX = std::tan(m_cam.heightAngle * aspect / 2.f);
+    glm::vec3 corners[8];
+    int n = 0;
+    for (float d: {splitNear, splitFar}) {
+        for (int sy = -1; sy <= 1; sy += 2) {
+            for (int sx = -1; sx <= 1; sx += 2) {
+                corners[n++] = glm::vec3(m_cam.viewInv * glm::vec4(sx * d * tanX, sy * d * tanY, -d, 1.f));
+            }
+        }
+    }
+
+    // a bounding sphere keeps the box the same size however the camera turns, and snapping its
+    // center to whole texels keeps the edges from crawling as the camera moves
+    glm::vec3 center(0.f);
+    for (const glm::vec3& corner: corners) center += corner / 8.f;
+    float radius = 0.f;
+    for (const glm::vec3& corner: corners) radius = std::max(radius, glm::length(corner - center));
+    radius = std::ceil(radius * 16.f) / 16.f;
+
+    glm::vec3 up = (std::abs(lightDir.y) > 0.99f) ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.f), lightDir, up);
+    glm::vec3 lightCenter(lightView * glm::vec4(center, 1.f));
+    float texel = 2.f * radius / CASCADE_SIZE;
+    lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+    lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+
+    // casters: overlap the box sideways, and are not entirely past the slice (further along the light)
+    float nearZ = lightCenter.z + radius;
+    float farZ = lightCenter.z - radius;
+    cascade.casters.clear();
+    for (int i = 0; i < (int)m_renderdata.shapes.size(); i++) {
+        glm::vec3 casterCenter;
+        float casterRadius;
+        if (!shapeBounds(m_renderdata.shapes[i], casterCenter, casterRadius)) continue;
+        glm::vec3 p(lightView * glm::vec4(casterCenter, 1.f));
+        if (std::abs(p.x - lightCenter.x) > radius + casterRadius) continue;
+        if (std::abs(p.y - lightCenter.y) > radius + casterRadius) continue;
+        if (p.z + casterRadius < farZ) continue;
+        // the depth range reaches back to the furthest caster towards the light
+        nearZ = std::max(nearZ, p.z + casterRadius);
+        cascade.casters.push_back(i);
+    }
+
+    glm::mat4 lightProj = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                                     lightCenter.y - radius, lightCenter.y + radius,
+                                     -nearZ, -farZ);
+    cascade.lightSpace = lightProj * lightView;
+    cascade.splitFar = splitFar;
+}
+
+void Realtime::renderShadowMaps() {
+    renderLightShadows();
+    if (m_shadowLight < 0 || m_depthShader == 0) return;
+
+    // cascade splits: mostly logarithmic so every cascade covers about the same screen area
+    float shadowNear = near;
+    float shadowFar = std::min(far, settings.shadowDistance);
+    glm::vec3 lightDir = glm::normalize(glm::vec3(m_renderdata.lights[m_shadowLight].dir));
+    float splitNear = shadowNear;
+    for (int c = 0; c < m_numCascades; c++) {
+        float p = (c + 1) / float(m_numCascades);
+        float logSplit = shadowNear * std::pow(shadowFar / shadowNear, p);
+        float uniformSplit = shadowNear + (shadowFar - shadowNear) * p;
+        float splitFar = CASCADE_SPLIT_LAMBDA * logSplit + (1.f - CASCADE_SPLIT_LAMBDA) * uniformSplit;
+        fitCascade(m_cascades[c], splitNear, splitFar, lightDir);
+        splitNear = splitFar;
+    }
+
+    // drawn in the middle of the scene pass, so its target and viewport are put back after
+    GLint prevFbo, prevViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_shadowFbo);
+    glViewport(0, 0, CASCADE_SIZE, CASCADE_SIZE);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.f, 4.f);
+    glUseProgram(m_depthShader);
+    GLint locModel = glGetUniformLocation(m_depthShader, "model");
+    GLint locLightSpace = glGetUniformLocation(m_depthShader, "lightSpace");
+    GLint locAnimating = glGetUniformLocation(m_depthShader, "animating");
+
+    for (int c = 0; c < m_numCascades; c++) {
+        ShadowCascade& cascade = m_cascades[c];
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cascadeArray, 0, c);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glUniformMatrix4fv(locLightSpace, 1, GL_FALSE, &cascade.lightSpace[0][0]);
+
+        for (int i: cascade.casters) {
+            RenderShapeData& shape = m_renderdata.shapes[i];
+            ShapeDraw draw = bindShapeGeometry(shape, false);
+            if (draw.count == 0) continue;
+            glUniformMatrix4fv(locModel, 1, GL_FALSE, &shape.ctm[0][0]);
+            glUniform1i(locAnimating, draw.animating);
+            if (draw.animating) declBoneUniforms(m_depthShader, m_meshes[shape.primitive.meshfile]);
+            if (draw.indexed) glDrawElements(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT, nullptr);
+            else glDrawArrays(GL_TRIANGLES, 0, draw.count);
+        }
+        m_shadowStatCasters[c] += cascade.casters.size();
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+
+    if (++m_shadowStatFrames == STATS_PERIOD_FRAMES) {
+        if (statsEnabled()) {
+            std::cout << "Shadow cascades: average casters of " << m_renderdata.shapes.size() << " shapes:";
+            for (int c = 0; c < m_numCascades; c++) std::cout << " " << m_shadowStatCasters[c] / STATS_PERIOD_FRAMES;
+            std::cout << std::endl;
+        }
+        for (int c = 0; c < m_numCascades; c++) m_shadowStatCasters[c] = 0;
+        m_shadowStatFrames = 0;
+    }
+}
+
+void Realtime::assignShadowTiles() {
+    Frustum frustum(m_proj * m_cam.view);
+    glm::vec3 camPos(m_cam.pos);
+    float pixelsPerUnit = size().height() * m_devicePixelRatio / (2.f * std::tan(m_cam.heightAngle / 2.f));
+
+    std::vector<ShadowedLight*> pending;
+    for (ShadowedLight& shadow: m_shadowedLights) {
+        const SceneLightData& light = m_renderdata.lights[shadow.lightIndex];
+        glm::vec3 position(light.pos);
+        float range = lightRange(light);
+
+        // how many pixels the light's reach covers on screen; nothing when it is out of view
+        float pixels = 0.f;
+        if (frustum.intersectsSphere(position, range)) {
+            float distance = glm::length(position - camPos);
+            pixels = (distance <= range) ? MAX_SHADOW_TILE : range * pixelsPerUnit / distance;
+            pixels *= settings.shadowResolutionScale;
+        }
+        shadow.importance = pixels * std::max({light.color.r, light.color.g, light.color.b});
+
+        int wanted = 0;
+        if (pixels > 0.f) {
+            wanted = MIN_SHADOW_TILE;
+            while (wanted < pixels && wanted < MAX_SHADOW_TILE) wanted *= 2;
+            if (wanted < shadow.requestedSize && pixels > SHADOW_TILE_SHRINK * shadow.requestedSize / 2.f) {
+                wanted = shadow.requestedSize;
+            }
+        }
+        // unchanged lights keep their tiles (and their contents); ones that got nothing try again
+        if (wanted == shadow.requestedSize && (wanted == 0 || !shadow.tiles.empty())) continue;
+
+        for (const QuadtreeAllocator::Rect& tile: shadow.tiles) m_shadowAtlasTiles.free(tile);
+        shadow.tiles.clear();
+        shadow.tileSize = 0;
+        shadow.valid = false;
+        shadow.requestedSize = wanted;
+        if (wanted > 0) pending.push_back(&shadow);
+    }
+
+    // brightest and largest first; whatever does not fit gets half the size, down to the minimum
+    std::sort(pending.begin(), pending.end(), [](const ShadowedLight* a, const ShadowedLight* b) {
+        return a->importance > b->importance;
+    });
+    for (ShadowedLight* shadow: pending) {
+        int count = shadow->point ? 6 : 1;
+        for (int tileSize = shadow->requestedSize; tileSize >= MIN_SHADOW_TILE; tileSize /= 2) {
+            QuadtreeAllocator::Rect tile;
+            while ((int)shadow->tiles.size() < count && m_shadowAtlasTiles.allocate(tileSize, tile)) {
+                shadow->tiles.push_back(tile);
+            }
+            if ((int)shadow->tiles.size() == count) {
+                shadow->tileSize = tileSize;
+                break;
+            }
+            for (const QuadtreeAllocator::Rect& partial: shadow->tiles) m_shadowAtlasTiles.free(partial);
+            shadow->tiles.clear();
+        }
+    }
+}
+
+bool Realtime::updateShadowCasters(ShadowedLight& shadow) {
+    const SceneLightData& light = m_renderdata.lights[shadow.lightIndex];
+    glm::vec3 position(light.pos);
+    glm::vec3 direction = shadow.point ? glm::vec3(0.f) : glm::normalize(glm::vec3(light.dir));
+    float range = lightRange(light);
+    bool dirty = !shadow.valid || position != shadow.position || direction != shadow.direction || range != shadow.range;
+
+    std::vector<int> casters;
+    std::vector<int> faceMasks;
+    for (int i = 0; i < (int)m_renderdata.shapes.size(); i++) {
+        glm::vec3 center;
+        float radius;
+        if (!shapeBounds(m_renderdata.shapes[i], center, radius)) continue;
+        if (glm::length(center - position) - radius >= range) continue;
+        int mask;
+        if (shadow.point) mask = cubeFaceMask(center - position, radius);
+        else mask = coneReaches(center - position, radius, direction, light.angle) ? 1 : 0;
+        if (mask == 0) continue;
+        casters.push_back(i);
+        faceMasks.push_back(mask);
+    }
+    dirty = dirty || casters != shadow.casters;
+
+    for (int k = 0; k < (int)casters.size() && !dirty; k++) {
+        const RenderShapeData& shape = m_renderdata.shapes[casters[k]];
+        // a skinned caster changes shape without its ctm moving
+        bool animated = shape.primitive.type == PrimitiveType::PRIMITIVE_MESH && m_meshes[shape.primitive.meshfile].hasAnimation;
+        dirty = animated || shape.ctm != shadow.casterCtms[k];
+    }
+    if (!dirty) return false;
+
+    shadow.position = position;
+    shadow.direction = direction;
+    shadow.range = range;
+    shadow.casters = std::move(casters);
+    shadow.faceMasks = std::move(faceMasks);
+    shadow.casterCtms.clear();
+    for (int i: shadow.casters) shadow.casterCtms.push_back(m_renderdata.shapes[i].ctm);
+
+    if (shadow.point) {
+        glm::mat4 proj = glm::perspective(glm::radians(90.f), 1.f, LIGHT_SHADOW_NEAR, range);
+        for (int f = 0; f < 6; f++) {
+            shadow.faceMatrices[f] = proj * glm::lookAt(position, position + CUBE_LOOKS[f], CUBE_UPS[f]);
+        }
+    } else {
+        float fov = std::min(2.f * light.angle, glm::radians(170.f));
+        glm::vec3 up = (std::abs(direction.y) > 0.99f) ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+        shadow.faceMatrices[0] = glm::perspective(fov, 1.f, LIGHT_SHADOW_NEAR, range) * glm::lookAt(position, position + direction, up);
+    }
+    return true;
+}
+
+void Realtime::renderLightShadows() {
+    if (m_shadowedLights.empty() || m_depthAtlasShader == 0) return;
+    assignShadowTiles();
+
+    GLint prevFbo, prevViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+    bool drew = false;
+
+    for (ShadowedLight& shadow: m_shadowedLights) {
+        if (shadow.tiles.empty() || !updateShadowCasters(shadow)) continue;
+
+        if (!drew) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_shadowAtlasFbo);
+            glEnable(GL_DEPTH_TEST);
+            glDepthMask(GL_TRUE);
+            // no polygon offset: it does not apply to gl_FragDepth, so anim.frag biases instead
+            glUseProgram(m_depthAtlasShader);
+            drew = true;
+        }
+
+        // clear only this light's tiles, and point viewport t at tile t
+        glEnable(GL_SCISSOR_TEST);
+        for (int t = 0; t < (int)shadow.tiles.size(); t++) {
+            const QuadtreeAllocator::Rect& tile = shadow.tiles[t];
+            glScissor(tile.x, tile.y, tile.size, tile.size);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glViewportIndexedf(t, tile.x, tile.y, tile.size, tile.size);
+        }
+        glDisable(GL_SCISSOR_TEST);
+
+        glUniformMatrix4fv(glGetUniformLocation(m_depthAtlasShader, "faceMatrices"), shadow.tiles.size(), GL_FALSE, &shadow.faceMatrices[0][0][0]);
+        glUniform3fv(glGetUniformLocation(m_depthAtlasShader, "lightPos"), 1, &shadow.position[0]);
+        glUniform1f(glGetUniformLocation(m_depthAtlasShader, "farPlane"), shadow.range);
+        GLint locModel = glGetUniformLocation(m_depthAtlasShader, "model");
+        GLint locFaceMask = glGetUniformLocation(m_depthAtlasShader, "faceMask");
+        GLint locAnimating = glGetUniformLocation(m_depthAtlasShader, "animating");
+
+        // one draw per caster covers every tile it reaches
+        for (int k = 0; k < (int)shadow.casters.size(); k++) {
+            RenderShapeData& shape = m_renderdata.shapes[shadow.casters[k]];
+            ShapeDraw draw = bindShapeGeometry(shape, false);
+            if (draw.count == 0) continue;
+            glUniformMatrix4fv(locModel, 1, GL_FALSE, &shape.ctm[0][0]);
+            glUniform1i(locFaceMask, shadow.faceMasks[k]);
+            glUniform1i(locAnimating, draw.animating);
+            if (draw.animating) declBoneUniforms(m_depthAtlasShader, m_meshes[shape.primitive.meshfile]);
+            if (draw.indexed) glDrawElements(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT, nullptr);
+            else glDrawArrays(GL_TRIANGLES, 0, draw.count);
+        }
+        shadow.valid = true;
+        m_shadowRedraws++;
+    }
+
+    if (drew) {
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+        // also resets every indexed viewport
+        glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    }
+
+    if (++m_shadowAtlasStatFrames == STATS_PERIOD_FRAMES) {
+        if (statsEnabled()) {
+            int shadowed = 0;
+            for (const ShadowedLight& shadow: m_shadowedLights) shadowed += !shadow.tiles.empty();
+            float atlasArea = float(m_shadowAtlasTiles.size()) * m_shadowAtlasTiles.size();
+            std::cout << "Shadow atlas: " << 100.f * m_shadowAtlasTiles.usedArea() / atlasArea << "% used by " << shadowed
+                      << " of " << m_shadowedLights.size() << " lights, " << m_shadowRedraws << " redraws" << std::endl;
+        }
+        m_shadowRedraws = 0;
+        m_shadowAtlasStatFrames = 0;
+    }
+}
+
+void Realtime::bindShadowMapsToShader(GLuint shader) {
+    // always point the sampler at its own unit, so it never shares one with a 2D sampler
+    glUniform1i(glGetUniformLocation(shader, "shadowCascades"), SHADOW_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(shader, "shadowLight"), m_shadowLight);
+
+    glUniform1i(glGetUniformLocation(shader, "shadowAtlas"), SHADOW_ATLAS_TEXTURE_UNIT);
+
+    // per light: its first tile (-1 for none) and depth range; per tile: where it is in the atlas
+    GLint shadowTile[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    GLfloat shadowRange[8] = {0.f};
+    glm::mat4 spotMatrices[8];
+    glm::vec4 tileRects[MAX_SHADOW_TILES];
+    int numTiles = 0;
+    float atlasSize = m_shadowAtlasTiles.size();
+    for (const ShadowedLight& shadow: m_shadowedLights) {
+        // tiles that were just handed out hold nothing yet
+        if (!shadow.valid || shadow.tiles.empty()) continue;
+        shadowTile[shadow.lightIndex] = numTiles;
+        shadowRange[shadow.lightIndex] = shadow.range;
+        spotMatrices[shadow.lightIndex] = shadow.faceMatrices[0];
+        for (const QuadtreeAllocator::Rect& tile: shadow.tiles) {
+            tileRects[numTiles++] = glm::vec4(tile.x, tile.y, tile.size, tile.size) / atlasSize;
+        }
+    }
+    glUniform1iv(glGetUniformLocation(shader, "shadowTile"), 8, shadowTile);
+    glUniform1fv(glGetUniformLocation(shader, "shadowRange"), 8, shadowRange);
+    glUniformMatrix4fv(glGetUniformLocation(shader, "spotShadowMatrix"), 8, GL_FALSE, &spotMatrices[0][0][0]);
+    if (numTiles > 0) glUniform4fv(glGetUniformLocation(shader, "shadowTiles"), numTiles, &tileRects[0][0]);
+    glActiveTexture(GL_TEXTURE0 + SHADOW_ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_shadowAtlas);
+    glActiveTexture(GL_TEXTURE0);
+    if (m_shadowLight < 0) return;
+
+    float splits[MAX_CASCADES];
+    glm::mat4 lightSpaces[MAX_CASCADES];
+    for (int c = 0; c < m_numCascades; c++) {
+        splits[c] = m_cascades[c].splitFar;
+        lightSpaces[c] = m_cascades[c].lightSpace;
+    }
+    glUniform1i(glGetUniformLocation(shader, "numCascades"), m_numCascades);
+    glUniform1fv(glGetUniformLocation(shader, "cascadeSplits"), m_numCascades, splits);
+    glUniformMatrix4fv(glGetUniformLocation(shader, "cascadeLightSpace"), m_numCascades, GL_FALSE, &lightSpaces[0][0][0]);
+    glUniform1f(glGetUniformLocation(shader, "shadowBias"), m_shadowBias);
+    glUniform1i(glGetUniformLocation(shader, "enablePCF"), m_enablePCF);
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_cascadeArray);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -1,15 +1,17 @@
 #include "Cone.h"
 
 void Cone::updateParams(int param1, int param2) {
-    m_vertexData.clear(); // std::vector<float>();
+    m_shape.clear();
     m_param1 = std::max(1, param1);
     m_param2 = std::max(3, param2);
+    // per slice: a cap fan triangle, p1 - 1 cap tiles, a tip triangle and p1 - 1 slope tiles
+    int indicesPerSlice = 2 * (3 + 6 * (m_param1 - 1));
+    m_shape.reserve(m_param2 * indicesPerSlice / 2, m_param2 * indicesPerSlice);
     setVertexData();
 }
 
-void Cone::addCapUV(glm::vec3 pos) {
-    m_vertexData.push_back(pos.x+0.5);
-    m_vertexData.push_back(pos.z+0.5);
+glm::vec2 Cone::capUV(glm::vec3 pos) {
+    return glm::vec2(pos.x+0.5, pos.z+0.5);
 }
 
 void Cone::makeCapTile(glm::vec3 topLeft,
@@ -19,26 +21,14 @@ void Cone::makeCapTile(glm::vec3 topLeft,
     glm::vec3 topLeftToBottomLeft = bottomLeft-topLeft;
     glm::vec3 topLeftToTopRight = topRight-topLeft;
     glm::vec3 normal = glm::normalize(glm::cross(topLeftToBottomLeft, topLeftToTopRight));
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, normal);
-    addCapUV(topLeft);
-    insertVec3(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, normal);
-    addCapUV(bottomLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, normal);
-    addCapUV(bottomRight);
-
-
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, normal);
-    addCapUV(topLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, normal);
-    addCapUV(bottomRight);
-    insertVec3(m_vertexData, topRight);
-    insertVec3(m_vertexData, normal);
-    addCapUV(topRight);
+    insertVertex(topLeft, normal, capUV(topLeft));
+    insertVertex(bottomLeft, normal, capUV(bottomLeft));
+    insertVertex(bottomRight, normal, capUV(bottomRight));
+
+
+    insertVertex(topLeft, normal, capUV(topLeft));
+    insertVertex(bottomRight, normal, capUV(bottomRight));
+    insertVertex(topRight, normal, capUV(topRight));
 }
 
 void Cone::makeCapSlice(float currentTheta, float nextTheta) {
@@ -52,15 +42,9 @@ void Cone::makeCapSlice(float currentTheta, float nextTheta) {
     glm::vec3 firstTopRight = glm::vec3((step)*glm::cos(nextTheta), -m_radius, (step)*glm::sin(nextTheta));
     glm::vec3 center = glm::vec3(0, -m_radius, 0);
     glm::vec3 normal = glm::normalize(glm::cross(firstTopLeft-center, firstTopRight-center));
-    insertVec3(m_vertexData, firstTopRight);
-    insertVec3(m_vertexData, normal);
-    addCapUV(firstTopRight);
-    insertVec3(m_vertexData, center);
-    insertVec3(m_vertexData, normal);
-    addCapUV(center);
-    insertVec3(m_vertexData, firstTopLeft);
-    insertVec3(m_vertexData, normal);
-    addCapUV(firstTopLeft);
+    insertVertex(firstTopRight, normal, capUV(firstTopRight));
+    insertVertex(center, normal, capUV(center));
+    insertVertex(firstTopLeft, normal, capUV(firstTopLeft));
 
     float rad = step;
     for (int i = 0; i < m_param1-1; i++) { // float rad = step; rad < m_radius; rad += step
@@ -82,39 +66,26 @@ glm::vec3 Cone::calcNorm(glm::vec3& pt) {
     return glm::normalize(glm::vec3{ xNorm, yNorm, zNorm });
 }
 
-void Cone::addSlopeUV(glm::vec3 pos) {
+glm::vec2 Cone::slopeUV(glm::vec3 pos) {
     float u, v;
     v = pos.y + 0.5;
     float angle = atan2(pos.z, pos.x);
     if (angle < 0) u = -angle/(2*M_PI);
     else u = 1 - (angle/(2*M_PI));
-    m_vertexData.push_back(u);
-    m_vertexData.push_back(v);
+    return glm::vec2(u, v);
 }
 
 void Cone::makeSlopeTile(glm::vec3 topLeft,
                          glm::vec3 topRight,
                          glm::vec3 bottomLeft,
                          glm::vec3 bottomRight) {
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, calcNorm(topLeft));
-    addSlopeUV(topLeft);
-    insertVec3(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, calcNorm(bottomLeft));
-    addSlopeUV(bottomLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, calcNorm(bottomRight));
-    addSlopeUV(bottomRight);
-
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, calcNorm(topLeft));
-    addSlopeUV(topLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, calcNorm(bottomRight));
-    addSlopeUV(bottomRight);
-    insertVec3(m_vertexData, topRight);
-    insertVec3(m_vertexData, calcNorm(topRight));
-    addSlopeUV(topRight);
+    insertVertex(topLeft, calcNorm(topLeft), slopeUV(topLeft));
+    insertVertex(bottomLeft, calcNorm(bottomLeft), slopeUV(bottomLeft));
+    insertVertex(bottomRight, calcNorm(bottomRight), slopeUV(bottomRight));
+
+    insertVertex(topLeft, calcNorm(topLeft), slopeUV(topLeft));
+    insertVertex(bottomRight, calcNorm(bottomRight), slopeUV(bottomRight));
+    insertVertex(topRight, calcNorm(topRight), slopeUV(topRight));
 }
 
 void Cone::makeSlopeSlice(float currentTheta, float nextTheta) {
@@ -127,15 +98,9 @@ void Cone::makeSlopeSlice(float currentTheta, float nextTheta) {
 
     glm::vec3 baseTop = bottomLeft+(float)(m_param1-1)*goingUpFromLeft;
     glm::vec3 baseTop2 = bottomRight+(float)(m_param1-1)*goingUpFromRight;
-    insertVec3(m_vertexData, baseTop);
-    insertVec3(m_vertexData, calcNorm(baseTop));
-    addSlopeUV(baseTop);
-    insertVec3(m_vertexData, topPoint);
-    insertVec3(m_vertexData, glm::normalize((calcNorm(bottomRight)+calcNorm(bottomLeft))/2.f));
-    addSlopeUV(topPoint);
-    insertVec3(m_vertexData, baseTop2);
-    insertVec3(m_vertexData, calcNorm(baseTop2));
-    addSlopeUV(baseTop2);
+    insertVertex(baseTop, calcNorm(baseTop), slopeUV(baseTop));
+    insertVertex(topPoint, glm::normalize((calcNorm(bottomRight)+calcNorm(bottomLeft))/2.f), slopeUV(topPoint));
+    insertVertex(baseTop2, calcNorm(baseTop2), slopeUV(baseTop2));
 
     for (int i = 0; i < m_param1-1; i++) {
         makeSlopeTile(bottomLeft+(float)i*goingUpFromLeft, bottomRight+(float)i*goingUpFromRight,
@@ -152,14 +117,12 @@ void Cone::setVertexData() {
         makeSlopeSlice(theta, theta+thetaStep);
     }
 
-    num_triangles = m_vertexData.size()/8;
+    num_triangles = m_shape.indices().size();
 }
 
 
-// Inserts a glm::vec3 into a vector of floats.
-// This will come in handy if you want to take advantage of vectors to build your shape!
-void Cone::insertVec3(std::vector<float> &data, glm::vec3 v) {
-    data.push_back(v.x);
-    data.push_back(v.y);
-    data.push_back(v.z);
+// Emits one triangle corner; corners shared between tiles collapse into a single vertex
+void Cone::insertVertex(glm::vec3 pos, glm::vec3 normal, glm::vec2 uv) {
+    float attributes[8] = {pos.x, pos.y, pos.z, normal.x, normal.y, normal.z, uv.x, uv.y};
+    m_shape.addVertex(attributes);
 }
@@ -2,16 +2,18 @@
 
 #include <vector>
 #include <glm/glm.hpp>
+#include "shapebuilder.h"
 
 class Cone
 {
 public:
     void updateParams(int param1, int param2);
-    std::vector<float> generateShape() { return m_vertexData; }
-    int num_triangles = 0;
+    const std::vector<float>& generateShape() const { return m_shape.vertices(); }
+    const std::vector<unsigned int>& generateIndices() const { return m_shape.indices(); }
+    int num_triangles = 0; // index count, i.e. what gets passed to glDrawElements
 
 private:
-    void insertVec3(std::vector<float> &data, glm::vec3 v);
+    void insertVertex(glm::vec3 pos, glm::vec3 normal, glm::vec2 uv);
     void setVertexData();
     void makeCapTile(glm::vec3 topLeft,
                      glm::vec3 topRight,
@@ -24,11 +26,11 @@ private:
                        glm::vec3 bottomRight);
     void makeSlopeSlice(float currentTheta, float nextTheta);
     glm::vec3 calcNorm(glm::vec3& pt);
-    void addSlopeUV(glm::vec3 pos);
-    void addCapUV(glm::vec3 pos);
+    glm::vec2 slopeUV(glm::vec3 pos);
+    glm::vec2 capUV(glm::vec3 pos);
 
 
-    std::vector<float> m_vertexData;
+    ShapeBuilder m_shape{8};
     int m_param1;
     int m_param2;
     float m_radius = 0.5;
@@ -1,8 +1,10 @@
 #include "Cube.h"
 
 void Cube::updateParams(int param1) {
-    m_vertexData.clear(); //  = std::vector<float>();
+    m_shape.clear();
     m_param1 = std::max(1, param1);
+    // faces keep their own vertices because the normals differ along the edges
+    m_shape.reserve(6 * (m_param1 + 1) * (m_param1 + 1), 36 * m_param1 * m_param1);
     setVertexData();
 }
 
@@ -14,19 +16,13 @@ void Cube::makeTile(glm::vec3 topLeft,
     glm::vec3 topLeftToBottomLeft = bottomLeft-topLeft;
     glm::vec3 topLeftToTopRight = topRight-topLeft;
     glm::vec3 normal = glm::normalize(glm::cross(topLeftToBottomLeft, topLeftToTopRight));
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, normal);
-    insertVec3(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, normal);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, normal);
-
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, normal);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, normal);
-    insertVec3(m_vertexData, topRight);
-    insertVec3(m_vertexData, normal);
+    insertVertex(topLeft, normal);
+    insertVertex(bottomLeft, normal);
+    insertVertex(bottomRight, normal);
+
+    insertVertex(topLeft, normal);
+    insertVertex(bottomRight, normal);
+    insertVertex(topRight, normal);
 }
 
 void Cube::makeFace(glm::vec3 topLeft,
@@ -101,13 +97,11 @@ void Cube::setVertexData() {
              glm::vec3(-0.5f, 0.5f, -0.5f),
              glm::vec3(-0.5f, -0.5f, -0.5f));
 
-    num_triangles = m_vertexData.size()/6;
+    num_triangles = m_shape.indices().size();
 }
 
-// Inserts a glm::vec3 into a vector of floats.
-// This will come in handy if you want to take advantage of vectors to build your shape!
-void Cube::insertVec3(std::vector<float> &data, glm::vec3 v) {
-    data.push_back(v.x);
-    data.push_back(v.y);
-    data.push_back(v.z);
+// Emits one triangle corner; corners shared between tiles collapse into a single vertex
+void Cube::insertVertex(glm::vec3 pos, glm::vec3 normal) {
+    float attributes[6] = {pos.x, pos.y, pos.z, normal.x, normal.y, normal.z};
+    m_shape.addVertex(attributes);
 }
@@ -2,9 +2,12 @@
 #include "iostream"
 
 void Cylinder::updateParams(int param1, int param2) {
-    m_vertexData.clear(); // = std::vector<float>();
+    m_shape.clear();
     m_param1 = std::max(1, param1);
     m_param2 = std::max(3, param2);
+    // per slice: two cap fan triangles, 2 * (p1 - 1) cap tiles and p1 side tiles
+    int indicesPerSlice = 2 * (3 + 6 * (m_param1 - 1)) + 6 * m_param1;
+    m_shape.reserve(m_param2 * indicesPerSlice / 2, m_param2 * indicesPerSlice);
     setVertexData();
 }
 
@@ -18,36 +21,14 @@ void Cylinder::setVertexData() {
         makeSlopeSlice(theta, theta+thetaStep);
     }
 
-    num_triangles = m_vertexData.size()/(8);
-    //num_triangles = 72;
-}
-
-// Inserts a glm::vec3 into a vector of floats.
-// This will come in handy if you want to take advantage of vectors to build your shape!
-void Cylinder::insertVec3(std::vector<float> &data, glm::vec3 v) {
-    data.push_back(v.x);
-    m_debugData.push_back("pos/normalx");
-    data.push_back(v.y);
-    m_debugData.push_back("pos/normaly");
-    data.push_back(v.z);
-    m_debugData.push_back("pos/normalz");
-}
-
-void Cylinder::insertUV(std::vector<float> &data, glm::vec3 v) {
-    glm::vec2 uv = glm::vec2((v.x / m_radius) * 0.5f + 0.5f, (v.z / m_radius) * 0.5f + 0.5f);
-
-    //std::cout << "uvx: " << uv.x << std::endl;
-    //std::cout << "uvy: " << uv.y << std::endl;
-    data.push_back(uv.x);
-    m_debugData.push_back("uvx");
-    data.push_back(uv.y);
-    m_debugData.push_back("uvx");
+    num_triangles = m_shape.indices().size();
 }
 
+// Emits one triangle corner with planar uvs; corners shared between tiles collapse into a single vertex
 void Cylinder::insertVertex(glm::vec3 vertexPos, glm::vec3 normal) {
-    insertVec3(m_vertexData, vertexPos);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, vertexPos);
+    glm::vec2 uv = glm::vec2((vertexPos.x / m_radius) * 0.5f + 0.5f, (vertexPos.z / m_radius) * 0.5f + 0.5f);
+    float attributes[8] = {vertexPos.x, vertexPos.y, vertexPos.z, normal.x, normal.y, normal.z, uv.x, uv.y};
+    m_shape.addVertex(attributes);
 }
 
 void Cylinder::makeCapTile(glm::vec3 topLeft,
@@ -60,26 +41,10 @@ void Cylinder::makeCapTile(glm::vec3 topLeft,
     insertVertex(topLeft, normal);
     insertVertex(bottomLeft, normal);
     insertVertex(bottomRight, normal);
-    /*insertVec3(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, bottomRight);
-*/
+
     insertVertex(topLeft, normal);
     insertVertex(bottomRight, normal);
     insertVertex(topRight, normal);
-/*
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, topLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, topRight);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, topRight);*/
 }
 
 void Cylinder::makeCapSlice(float currentTheta, float nextTheta) {
@@ -92,15 +57,6 @@ void Cylinder::makeCapSlice(float currentTheta, float nextTheta) {
     glm::vec3 firstTopRight = glm::vec3((step)*glm::cos(nextTheta), -m_radius, (step)*glm::sin(nextTheta));
     glm::vec3 center = glm::vec3(0, -m_radius, 0);
     glm::vec3 normal = glm::normalize(glm::cross(firstTopLeft-center, firstTopRight-center));
-    /*insertVec3(m_vertexData, firstTopRight);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, firstTopRight);
-    insertVec3(m_vertexData, center);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, center);
-    insertVec3(m_vertexData, firstTopLeft);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, firstTopLeft);*/
 
     insertVertex(firstTopRight, normal);
     insertVertex(center, normal);
@@ -128,15 +84,6 @@ void Cylinder::makeCapSliceTop(float currentTheta, float nextTheta) {
     glm::vec3 firstTopLeft = glm::vec3((step)*glm::cos(nextTheta), m_radius, (step)*glm::sin(nextTheta));
     glm::vec3 center = glm::vec3(0, m_radius, 0);
     glm::vec3 normal = glm::normalize(glm::cross(firstTopLeft-center, firstTopRight-center));
-    /*insertVec3(m_vertexData, firstTopRight);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, firstTopRight);
-    insertVec3(m_vertexData, center);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, center);
-    insertVec3(m_vertexData, firstTopLeft);
-    insertVec3(m_vertexData, normal);
-    insertUV(m_vertexData, firstTopLeft);*/
 
     insertVertex(firstTopRight, normal);
     insertVertex(center, normal);
@@ -157,26 +104,6 @@ void Cylinder::makeSlopeTile(glm::vec3 topLeft,
                              glm::vec3 topRight,
                              glm::vec3 bottomLeft,
                              glm::vec3 bottomRight) {
-    /*insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, calcNorm(topLeft));
-    insertUV(m_vertexData, topLeft);
-    insertVec3(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, calcNorm(bottomLeft));
-    insertUV(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, calcNorm(bottomRight));
-    insertUV(m_vertexData, bottomRight);
-
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, calcNorm(topLeft));
-    insertUV(m_vertexData, topLeft);
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, calcNorm(bottomRight));
-    insertUV(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, topRight);
-    insertVec3(m_vertexData, calcNorm(topRight));
-    insertUV(m_vertexData, topRight);
-*/
     insertVertex(topLeft, calcNorm(topLeft));
     insertVertex(bottomLeft, calcNorm(bottomLeft));
     insertVertex(bottomRight, calcNorm(bottomRight));
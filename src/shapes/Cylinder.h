@@ -1,19 +1,18 @@
 #pragma once
 
 #include <vector>
-#include <string>
 #include <glm/glm.hpp>
+#include "shapebuilder.h"
 
 class Cylinder
 {
 public:
     void updateParams(int param1, int param2);
-    std::vector<float> generateShape() { return m_vertexData; }
-    int num_triangles = 0;
+    const std::vector<float>& generateShape() const { return m_shape.vertices(); }
+    const std::vector<unsigned int>& generateIndices() const { return m_shape.indices(); }
+    int num_triangles = 0; // index count, i.e. what gets passed to glDrawElements
 
 private:
-    void insertVec3(std::vector<float> &data, glm::vec3 v);
-    void insertUV(std::vector<float> &data, glm::vec3 v);
     void setVertexData();
     void insertVertex(glm::vec3 vertexPos, glm::vec3 normal);
 
@@ -30,8 +29,7 @@ private:
     void makeSlopeSlice(float currentTheta, float nextTheta);
     glm::vec3 calcNorm(glm::vec3& pt);
 
-    std::vector<float> m_vertexData;
-    std::vector<std::string> m_debugData;
+    ShapeBuilder m_shape{8};
     int m_param1;
     int m_param2;
     float m_radius = 0.5;
@@ -2,9 +2,11 @@
 #include <iostream>
 
 void Sphere::updateParams(int param1, int param2) {
-    m_vertexData.clear(); // = std::vector<float>();
+    m_shape.clear();
     m_param1 = std::max(2, param1);
     m_param2 = std::max(3, param2);
+    // (p1 + 1) * (p2 + 1) shared vertices, two triangles per tile
+    m_shape.reserve((m_param1 + 1) * (m_param2 + 1), 6 * m_param1 * m_param2);
     setVertexData();
 }
 
@@ -15,19 +17,13 @@ void Sphere::makeTile(glm::vec3 topLeft,
     // Task 5: Implement the makeTile() function for a Sphere
     // Note: this function is very similar to the makeTile() function for Cube,
     //       but the normals are calculated in a different way!
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, glm::normalize(topLeft));
-    insertVec3(m_vertexData, bottomLeft);
-    insertVec3(m_vertexData, glm::normalize(bottomLeft));
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, glm::normalize(bottomRight));
+    insertVertex(topLeft, glm::normalize(topLeft));
+    insertVertex(bottomLeft, glm::normalize(bottomLeft));
+    insertVertex(bottomRight, glm::normalize(bottomRight));
 
-    insertVec3(m_vertexData, topLeft);
-    insertVec3(m_vertexData, glm::normalize(topLeft));
-    insertVec3(m_vertexData, bottomRight);
-    insertVec3(m_vertexData, glm::normalize(bottomRight));
-    insertVec3(m_vertexData, topRight);
-    insertVec3(m_vertexData, glm::normalize(topRight));
+    insertVertex(topLeft, glm::normalize(topLeft));
+    insertVertex(bottomRight, glm::normalize(bottomRight));
+    insertVertex(topRight, glm::normalize(topRight));
 }
 
 void Sphere::makeWedge(float currentTheta, float nextTheta) {
@@ -69,13 +65,11 @@ void Sphere::setVertexData() {
     // Uncomment these lines to make sphere for Task 7:
 
     makeSphere();
-    num_triangles = m_vertexData.size()/6;
+    num_triangles = m_shape.indices().size();
 }
 
-// Inserts a glm::vec3 into a vector of floats.
-// This will come in handy if you want to take advantage of vectors to build your shape!
-void Sphere::insertVec3(std::vector<float> &data, glm::vec3 v) {
-    data.push_back(v.x);
-    data.push_back(v.y);
-    data.push_back(v.z);
+// Emits one triangle corner; corners shared between tiles collapse into a single vertex
+void Sphere::insertVertex(glm::vec3 pos, glm::vec3 normal) {
+    float attributes[6] = {pos.x, pos.y, pos.z, normal.x, normal.y, normal.z};
+    m_shape.addVertex(attributes);
 }
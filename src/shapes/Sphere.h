@@ -2,16 +2,18 @@
 
 #include <vector>
 #include <glm/glm.hpp>
+#include "shapebuilder.h"
 
 class Sphere
 {
 public:
     void updateParams(int param1, int param2);
-    std::vector<float> generateShape() { return m_vertexData; }
-    int num_triangles = 0;
+    const std::vector<float>& generateShape() const { return m_shape.vertices(); }
+    const std::vector<unsigned int>& generateIndices() const { return m_shape.indices(); }
+    int num_triangles = 0; // index count, i.e. what gets passed to glDrawElements
 
 private:
-    void insertVec3(std::vector<float> &data, glm::vec3 v);
+    void insertVertex(glm::vec3 pos, glm::vec3 normal);
     void setVertexData();
     void makeTile(glm::vec3 topLeft,
                   glm::vec3 topRight,
@@ -20,7 +22,7 @@ private:
     void makeWedge(float currTheta, float nextTheta);
     void makeSphere();
 
-    std::vector<float> m_vertexData;
+    ShapeBuilder m_shape{6};
     float m_radius = 0.5;
     int m_param1;
     int m_param2;
@@ -84,11 +84,29 @@ void Mesh::updateMesh(std::string meshfile) {
     m_vertexData.clear();
 
     setVertexData(meshfile.c_str());
-    num_triangles = m_vertexData.size()/(6 + ((hasAnimation) ? 8 : 0) + ((hasTextures) ? 2 : 0));
+    num_triangles = m_vertexData.size()/vertexStride();
+    m_boundingRadius = 0.f;
+    for (int i = 0; i + 2 < (int)m_vertexData.size(); i += vertexStride()) {
+        m_boundingRadius = std::max(m_boundingRadius, glm::length(glm::make_vec3(&m_vertexData[i])));
+    }
+    if (hasAnimation) {
+        // joints/weights follow position, normal and (optionally) texcoords
+        m_skinStreams.fromInterleaved(m_vertexData, vertexStride(), 6 + ((hasTextures) ? 2 : 0));
+    }
     // if (hasAnimation) num_triangles = m_vertexData.size()/14;
     std::cout << num_triangles << std::endl;
 }
 
+void Mesh::buildLods() {
+    m_lods.clear();
+    // each level is simplified from the original so errors do not compound
+    for (float ratio: LOD_RATIOS) {
+        m_lods.push_back(MeshSimplify::simplify(m_vertexData, vertexStride(), ratio));
+        std::cout << "  lod " << m_lods.size() << ": " << m_lods.back().vertexData.size() / vertexStride()
+                  << " vertices, error " << m_lods.back().error << std::endl;
+    }
+}
+
 glm::mat4 Mesh::getLocalTransformPreprocessing(cgltf_node* node) {
     cgltf_float out[16];
     cgltf_node_transform_local(node, out);
@@ -400,7 +418,7 @@ glm::mat4 Mesh::getMatrixFromTRS(glm::vec3 t, glm::quat r, glm::vec3 s) {
 glm::mat4 Mesh::transformForBone(int bone, float timestep) {
     // need to better understand the process
     // return m_meshAnim.m_finalBoneMatrices[bone] = glm::inverse(m_meshAnim.m_animation.m_allBones[bone].m_toBoneSpace); // temp
-    if (m_meshAnim.m_visited[bone]) return m_meshAnim.m_finalBoneMatrices[bone];
+    if (m_meshAnim.m_visited[bone]) return m_meshAnim.m_pendingBoneMatrices[bone];
     else m_meshAnim.m_visited[bone] = true;
     Bone* relevant = &m_meshAnim.m_animation.m_allBones[bone];
     glm::mat4 localTransform;
@@ -417,7 +435,7 @@ glm::mat4 Mesh::transformForBone(int bone, float timestep) {
     else {
         worldBone = relevant->m_constParentTransform * localTransform;
     }
-    m_meshAnim.m_finalBoneMatrices[bone] = worldBone;
+    m_meshAnim.m_pendingBoneMatrices[bone] = worldBone;
 
     return worldBone;
 
@@ -427,20 +445,52 @@ void Mesh::updateFinalBoneMatrices(float timestep) {
     // run this at every deltaTime
     // go through nodes, traverse to parents recursively to get final transform matrix
     // create a visited array
-    m_meshAnim.m_finalBoneMatrices.clear();
-    m_meshAnim.m_visited.clear(); // time complexity of clear()?
-    for (int i = 0; i < m_meshAnim.m_animation.m_allBones.size(); i++) {
-        m_meshAnim.m_finalBoneMatrices.push_back(glm::mat4(1.0));
-        m_meshAnim.m_visited.push_back(false);
-    }
-    for (int i = 0; i < m_meshAnim.m_visited.size(); i++) {
+    int numBones = m_meshAnim.m_animation.m_allBones.size();
+    m_meshAnim.m_pendingBoneMatrices.assign(numBones, glm::mat4(1.0));
+    m_meshAnim.m_visited.assign(numBones, false);
+    for (int i = 0; i < numBones; i++) {
         transformForBone(i, timestep);
     }
-    for (int i = 0; i < m_meshAnim.m_visited.size(); i++) {
-        m_meshAnim.m_finalBoneMatrices[i] = m_meshAnim.m_finalBoneMatrices[i] * m_meshAnim.m_animation.m_allBones[i].m_toBoneSpace;
-    }
     // multiply all by inv bind matrices
+    for (int i = 0; i < numBones; i++) {
+        m_meshAnim.m_pendingBoneMatrices[i] = m_meshAnim.m_pendingBoneMatrices[i] * m_meshAnim.m_animation.m_allBones[i].m_toBoneSpace;
+    }
+}
+
+void Mesh::swapBoneMatrices() {
+    // culled meshes skip their job, and their pending buffer holds an older pose
+    if (!m_meshAnim.m_pendingReady) return;
+    m_meshAnim.m_pendingReady = false;
+    std::swap(m_meshAnim.m_finalBoneMatrices, m_meshAnim.m_pendingBoneMatrices);
+}
+
+void Mesh::sampleKeyPose(float timestep, float keyTimestep) {
+    // the previous key was sampled for this tick, so show it and look ahead to the next key
+    if (m_meshAnim.m_nextKeyPose.size() != m_meshAnim.m_animation.m_allBones.size()) {
+        updateFinalBoneMatrices(timestep);
+        m_meshAnim.m_nextKeyPose = m_meshAnim.m_pendingBoneMatrices;
+    }
+    std::swap(m_meshAnim.m_prevKeyPose, m_meshAnim.m_nextKeyPose);
+    updateFinalBoneMatrices(keyTimestep);
+    m_meshAnim.m_nextKeyPose = m_meshAnim.m_pendingBoneMatrices;
+    m_meshAnim.m_pendingBoneMatrices = m_meshAnim.m_prevKeyPose;
+}
+
+void Mesh::blendKeyPoses(float alpha, float timestep, float keyTimestep) {
+    int numBones = m_meshAnim.m_prevKeyPose.size();
+    if ((int)m_meshAnim.m_nextKeyPose.size() != numBones || numBones != (int)m_meshAnim.m_animation.m_allBones.size()) {
+        sampleKeyPose(timestep, keyTimestep);
+        return;
+    }
+    m_meshAnim.m_pendingBoneMatrices.resize(numBones);
+    for (int i = 0; i < numBones; i++) {
+        // componentwise blend, the same approximation linear blend skinning already makes
+        m_meshAnim.m_pendingBoneMatrices[i] = m_meshAnim.m_prevKeyPose[i] * (1.f - alpha) + m_meshAnim.m_nextKeyPose[i] * alpha;
+    }
+}
 
+void Mesh::skinPendingPose(float* dst, int begin, int end) const {
+    Skinning::skin(m_skinning, m_skinStreams, m_meshAnim.m_pendingBoneMatrices, dst, begin, end);
 }
 
 void Mesh::fillVec3FromAccessor(cgltf_accessor* acc, std::vector<glm::vec3>& vertices) {
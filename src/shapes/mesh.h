@@ -8,6 +8,8 @@
 #include <string>
 
 #include "cgltf.h"
+#include "skinning.h"
+#include "meshsimplify.h"
 
 struct KeyframeVec3 {
     float time;
@@ -73,13 +75,24 @@ public:
 
 class AnimState {
 public:
+    // front buffer, read by the renderer; the pose job writes m_pendingBoneMatrices
+    // and the two are swapped once the job is known to have finished
     std::vector<glm::mat4> m_finalBoneMatrices;
+    std::vector<glm::mat4> m_pendingBoneMatrices;
     std::vector<bool> m_visited;
     Anim m_animation;
     float m_currentTime;
     float m_deltaTime;
+    bool m_pendingReady = false; // a job has written m_pendingBoneMatrices since the last swap
+
+    // animation LOD: a throttled mesh samples a key pose every m_lodStep ticks and blends in between
+    int m_lodStep = 1;
+    int m_lodTick = 0;
+    std::vector<glm::mat4> m_prevKeyPose;
+    std::vector<glm::mat4> m_nextKeyPose;
     AnimState()
         : m_finalBoneMatrices(),
+        m_pendingBoneMatrices(),
         m_visited(),
         m_animation(),
         m_currentTime(0.0f),
@@ -92,6 +105,7 @@ public:
               float currentTime,
               float deltaTime)
         : m_finalBoneMatrices(std::move(finalBones)),
+        m_pendingBoneMatrices(),
         m_visited(std::move(visited)),
         m_animation(std::move(animation)),
         m_currentTime(currentTime),
@@ -108,7 +122,26 @@ public:
     bool hasAnimation = false;
     bool hasTextures = false;
     AnimState m_meshAnim;
+    // evaluates the pose into the pending buffer; only touches this mesh, so safe to run as a job
     void updateFinalBoneMatrices(float timestep);
+    void swapBoneMatrices();
+
+    // CPU skinning: deforms the pending pose into dst (6 floats per vertex) for vertices [begin, end)
+    SkinningMode m_skinning = SkinningMode::SKINNING_GPU;
+    SkinStreams m_skinStreams;
+    int vertexStride() const { return 6 + ((hasAnimation) ? 8 : 0) + ((hasTextures) ? 2 : 0); }
+    void skinPendingPose(float* dst, int begin, int end) const;
+
+    // LOD key poses; both write the pending buffer like updateFinalBoneMatrices does
+    void sampleKeyPose(float timestep, float keyTimestep);
+    // samples a key instead when the two keys to blend between are not both there
+    void blendKeyPoses(float alpha, float timestep, float keyTimestep);
+    float m_boundingRadius = 0.f; // bind pose, object space
+
+    // simplified copies of the vertex data, finest first; level 0 is generateShape() itself
+    static constexpr float LOD_RATIOS[2] = {0.5f, 0.25f};
+    std::vector<MeshSimplify::Result> m_lods;
+    void buildLods();
 
 
 private:
@@ -0,0 +1,226 @@
+#include "meshsimplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+namespace {
+
+// symmetric 4x4 error quadric, stored as its 10 unique coefficients
+struct Quadric {
+    double a[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    double weight = 0; // total area folded in, to turn the error back into a distance
+
+    static Quadric fromPlane(double x, double y, double z, double w, double weight) {
+        Quadric q;
+        q.a[0] = x * x * weight; q.a[1] = x * y * weight; q.a[2] = x * z * weight; q.a[3] = x * w * weight;
+        q.a[4] = y * y * weight; q.a[5] = y * z * weight; q.a[6] = y * w * weight;
+        q.a[7] = z * z * weight; q.a[8] = z * w * weight;
+        q.a[9] = w * w * weight;
+        q.weight = weight;
+        return q;
+    }
+    Quadric& operator+=(const Quadric& other) {
+        for (int i = 0; i < 10; i++) a[i] += other.a[i];
+        weight += other.weight;
+        return *this;
+    }
+    double error(const glm::vec3& v) const {
+        double x = v.x, y = v.y, z = v.z;
+        return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+               + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+               + a[7] * z * z + 2 * a[8] * z
+               + a[9];
+    }
+};
+
+struct Collapse {
+    double cost;
+    int from;
+    int to;
+    int version; // stamp of `from` when queued; stale entries are skipped
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+struct PositionKey {
+    int32_t x, y, z;
+    bool operator<(const PositionKey& o) const {
+        if (x != o.x) return x < o.x;
+        if (y != o.y) return y < o.y;
+        return z < o.z;
+    }
+};
+
+PositionKey quantize(const float* p) {
+    return {(int32_t)std::lround(p[0] * 1e5f), (int32_t)std::lround(p[1] * 1e5f), (int32_t)std::lround(p[2] * 1e5f)};
+}
+
+}
+
+MeshSimplify::Result MeshSimplify::simplify(const std::vector<float>& vertexData, int stride, float targetRatio) {
+    Result result;
+    int corners = vertexData.size() / stride;
+    int numTriangles = corners / 3;
+    if (numTriangles == 0) {
+        result.vertexData = vertexData;
+        return result;
+    }
+
+    // 1. weld corners whose attributes all match, giving an indexed mesh to collapse on
+    std::vector<int> vertexOf(corners);
+    std::vector<int> firstCorner;
+    {
+        std::map<std::vector<int32_t>, int> lookup;
+        std::vector<int32_t> key(stride);
+        for (int c = 0; c < corners; c++) {
+            for (int k = 0; k < stride; k++) key[k] = (int32_t)std::lround(vertexData[c * stride + k] * 1e5f);
+            auto inserted = lookup.emplace(key, (int)firstCorner.size());
+            if (inserted.second) firstCorner.push_back(c);
+            vertexOf[c] = inserted.first->second;
+        }
+    }
+    int numVertices = firstCorner.size();
+    std::vector<glm::vec3> positions(numVertices);
+    for (int v = 0; v < numVertices; v++) {
+        positions[v] = glm::vec3(vertexData[firstCorner[v] * stride], vertexData[firstCorner[v] * stride + 1], vertexData[firstCorner[v] * stride + 2]);
+    }
+
+    std::vector<glm::ivec3> triangles(numTriangles);
+    std::vector<bool> alive(numTriangles, true);
+    std::vector<std::vector<int>> vertexTriangles(numVertices);
+    for (int t = 0; t < numTriangles; t++) {
+        triangles[t] = glm::ivec3(vertexOf[3 * t], vertexOf[3 * t + 1], vertexOf[3 * t + 2]);
+        for (int k = 0; k < 3; k++) vertexTriangles[triangles[t][k]].push_back(t);
+    }
+
+    // 2. lock seams (one position, several attribute sets) and open borders
+    std::vector<bool> locked(numVertices, false);
+    {
+        std::map<PositionKey, int> sharing;
+        for (int v = 0; v < numVertices; v++) sharing[quantize(&positions[v].x)]++;
+        for (int v = 0; v < numVertices; v++) {
+            if (sharing[quantize(&positions[v].x)] > 1) locked[v] = true;
+        }
+        std::map<std::pair<int, int>, int> edgeUse;
+        for (const glm::ivec3& tri: triangles) {
+            for (int k = 0; k < 3; k++) {
+                int a = tri[k], b = tri[(k + 1) % 3];
+                edgeUse[{std::min(a, b), std::max(a, b)}]++;
+            }
+        }
+        for (auto &[edge, uses]: edgeUse) {
+            if (uses == 1) locked[edge.first] = locked[edge.second] = true;
+        }
+    }
+
+    // 3. per-vertex quadrics from the area-weighted planes of the surrounding triangles
+    std::vector<Quadric> quadrics(numVertices);
+    for (const glm::ivec3& tri: triangles) {
+        glm::vec3 n = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+        float area = glm::length(n);
+        if (area <= 0.f) continue;
+        n /= area;
+        Quadric q = Quadric::fromPlane(n.x, n.y, n.z, -glm::dot(n, positions[tri[0]]), area * 0.5);
+        for (int k = 0; k < 3; k++) quadrics[tri[k]] += q;
+    }
+
+    std::vector<int> version(numVertices, 0);
+    std::vector<int> remap(numVertices);
+    for (int v = 0; v < numVertices; v++) remap[v] = v;
+    auto resolve = [&](int v) {
+        while (remap[v] != v) v = remap[v];
+        return v;
+    };
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto pushCollapses = [&](int from) {
+        if (locked[from]) return;
+        for (int t: vertexTriangles[from]) {
+            if (!alive[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                int to = triangles[t][k];
+                if (to == from) continue;
+                Quadric q = quadrics[from];
+                q += quadrics[to];
+                // mean squared distance to the merged planes
+                double cost = (q.weight > 0) ? std::max(0.0, q.error(positions[to])) / q.weight : 0.0;
+                queue.push({cost, from, to, version[from]});
+            }
+        }
+    };
+    for (int v = 0; v < numVertices; v++) pushCollapses(v);
+
+    // 4. collapse the cheapest edge until we reach the target, rejecting collapses that fold triangles over
+    int liveTriangles = numTriangles;
+    int target = std::max(1, (int)(numTriangles * targetRatio));
+    while (liveTriangles > target && !queue.empty()) {
+        Collapse c = queue.top();
+        queue.pop();
+        if (c.version != version[c.from] || remap[c.from] != c.from || remap[c.to] != c.to) continue;
+
+        bool flips = false;
+        for (int t: vertexTriangles[c.from]) {
+            if (!alive[t]) continue;
+            const glm::ivec3& tri = triangles[t];
+            if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) continue;
+            glm::vec3 p[3], moved[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = positions[tri[k]];
+                moved[k] = (tri[k] == c.from) ? positions[c.to] : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= 0.f) {
+                flips = true;
+                break;
+            }
+        }
+        if (flips) continue;
+
+        remap[c.from] = c.to;
+        quadrics[c.to] += quadrics[c.from];
+        result.error = std::max(result.error, (float)std::sqrt(c.cost));
+        for (int t: vertexTriangles[c.from]) {
+            if (!alive[t]) continue;
+            glm::ivec3& tri = triangles[t];
+            for (int k = 0; k < 3; k++) {
+                if (tri[k] == c.from) tri[k] = c.to;
+            }
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+                alive[t] = false;
+                liveTriangles--;
+            } else {
+                vertexTriangles[c.to].push_back(t);
+            }
+        }
+        vertexTriangles[c.from].clear();
+        version[c.to]++;
+        pushCollapses(c.to);
+        // neighbours' queued costs referenced the old quadric of `to`
+        for (int t: vertexTriangles[c.to]) {
+            if (!alive[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                int n = triangles[t][k];
+                if (n != c.to) {
+                    version[n]++;
+                    pushCollapses(n);
+                }
+            }
+        }
+    }
+
+    // 5. expand back into the de-indexed layout the renderer draws with glDrawArrays
+    result.vertexData.reserve(liveTriangles * 3 * stride);
+    for (int t = 0; t < numTriangles; t++) {
+        if (!alive[t]) continue;
+        for (int k = 0; k < 3; k++) {
+            const float* src = &vertexData[firstCorner[resolve(triangles[t][k])] * stride];
+            result.vertexData.insert(result.vertexData.end(), src, src + stride);
+        }
+    }
+    return result;
+}
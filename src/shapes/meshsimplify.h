@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert) for the de-indexed
+// triangle lists Mesh builds. Collapses are half-edge (the survivor keeps its own
+// attributes, so skinning weights and uvs stay valid) and vertices on uv/normal
+// seams or open borders are locked so the silhouette does not tear.
+namespace MeshSimplify {
+
+struct Result {
+    std::vector<float> vertexData; // same stride and layout as the input, still de-indexed
+    float error = 0.f;             // largest collapse error, roughly in object-space units
+};
+
+Result simplify(const std::vector<float>& vertexData, int stride, float targetRatio);
+
+}
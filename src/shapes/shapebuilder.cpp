@@ -0,0 +1,48 @@
+#include "shapebuilder.h"
+
+#include <cmath>
+
+void ShapeBuilder::clear() {
+    m_vertexData.clear();
+    m_indexData.clear();
+    m_lookup.clear();
+}
+
+void ShapeBuilder::reserve(int numVertices, int numIndices) {
+    m_vertexData.reserve(numVertices * m_stride);
+    m_indexData.reserve(numIndices);
+    m_lookup.reserve(numVertices);
+}
+
+bool ShapeBuilder::VertexKey::operator==(const VertexKey& other) const {
+    for (int i = 0; i < MAX_STRIDE; i++) {
+        if (q[i] != other.q[i]) return false;
+    }
+    return true;
+}
+
+std::size_t ShapeBuilder::VertexKeyHash::operator()(const VertexKey& key) const {
+    std::size_t hash = 0;
+    for (int i = 0; i < MAX_STRIDE; i++) {
+        hash ^= std::hash<int32_t>()(key.q[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+void ShapeBuilder::addVertex(const float* attributes) {
+    VertexKey key;
+    for (int i = 0; i < m_stride && i < MAX_STRIDE; i++) {
+        key.q[i] = (int32_t)std::lround(attributes[i] * 1e5f);
+    }
+
+    auto found = m_lookup.find(key);
+    if (found != m_lookup.end()) {
+        m_indexData.push_back(found->second);
+        return;
+    }
+
+    unsigned int index = m_vertexData.size() / m_stride;
+    m_vertexData.insert(m_vertexData.end(), attributes, attributes + m_stride);
+    m_lookup.emplace(key, index);
+    m_indexData.push_back(index);
+}
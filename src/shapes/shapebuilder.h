@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// Collects triangle corners into an indexed mesh, reusing a vertex whenever every
+// attribute (position, normal, uv...) matches one that was already emitted
+class ShapeBuilder
+{
+public:
+    // the dedup key holds at most this many attributes per vertex
+    static constexpr int MAX_STRIDE = 8;
+
+    explicit ShapeBuilder(int stride) : m_stride(stride) { assert(stride > 0 && stride <= MAX_STRIDE); }
+
+    void clear();
+    void reserve(int numVertices, int numIndices);
+    // appends one triangle corner; attributes must hold `stride` floats
+    void addVertex(const float* attributes);
+
+    const std::vector<float>& vertices() const { return m_vertexData; }
+    const std::vector<unsigned int>& indices() const { return m_indexData; }
+
+private:
+    struct VertexKey {
+        // attributes snapped to a fine grid so corners rebuilt from slightly different math still merge
+        int32_t q[MAX_STRIDE] = {};
+        bool operator==(const VertexKey& other) const;
+    };
+    struct VertexKeyHash {
+        std::size_t operator()(const VertexKey& key) const;
+    };
+
+    int m_stride;
+    std::vector<float> m_vertexData;
+    std::vector<unsigned int> m_indexData;
+    std::unordered_map<VertexKey, unsigned int, VertexKeyHash> m_lookup;
+};
@@ -0,0 +1,493 @@
+#include "skinning.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SKINNING_AVX 1
+#endif
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define SKINNING_SSE 1
+#endif
+
+void SkinStreams::fromInterleaved(const std::vector<float>& data, int stride, int jointOffset) {
+    count = data.size() / stride;
+    for (std::vector<float>* stream: {&px, &py, &pz, &nx, &ny, &nz}) {
+        stream->resize(count);
+    }
+    for (int k = 0; k < 4; k++) {
+        joints[k].resize(count);
+        weights[k].resize(count);
+    }
+
+    for (int v = 0; v < count; v++) {
+        const float* vertex = &data[v * stride];
+        px[v] = vertex[0]; py[v] = vertex[1]; pz[v] = vertex[2];
+        nx[v] = vertex[3]; ny[v] = vertex[4]; nz[v] = vertex[5];
+        for (int k = 0; k < 4; k++) {
+            joints[k][v] = (int)vertex[jointOffset + k];
+            weights[k][v] = vertex[jointOffset + 4 + k];
+        }
+    }
+}
+
+namespace {
+
+// mirrors the guards in anim.vert: out-of-range joints or zero weights leave the vertex in bind pose
+inline bool skinnable(const SkinStreams& in, int v, int numBones) {
+    bool anyWeight = false;
+    for (int k = 0; k < 4; k++) {
+        if (in.joints[k][v] < 0 || in.joints[k][v] >= numBones) return false;
+        anyWeight |= in.weights[k][v] != 0.f;
+    }
+    return anyWeight;
+}
+
+inline void copyBindPose(const SkinStreams& in, int v, float* out) {
+    out[0] = in.px[v]; out[1] = in.py[v]; out[2] = in.pz[v];
+    out[3] = in.nx[v]; out[4] = in.ny[v]; out[5] = in.nz[v];
+}
+
+struct DualQuat {
+    glm::quat real;
+    glm::quat dual;
+};
+
+DualQuat toDualQuat(const glm::mat4& m) {
+    // strip scale from the basis before extracting the rotation
+    glm::mat3 basis(glm::normalize(glm::vec3(m[0])), glm::normalize(glm::vec3(m[1])), glm::normalize(glm::vec3(m[2])));
+    glm::quat r = glm::normalize(glm::quat_cast(basis));
+    glm::vec3 t(m[3]);
+    glm::quat d = glm::quat(0.f, t.x, t.y, t.z) * r * 0.5f;
+    return {r, d};
+}
+
+// every bone as 8 floats, real then dual, each x y z w, so the lane kernels can gather from it
+constexpr int DQ_FLOATS = 8;
+std::vector<float> dualQuatTable(const std::vector<DualQuat>& dqs) {
+    std::vector<float> table(DQ_FLOATS * dqs.size());
+    for (int b = 0; b < (int)dqs.size(); b++) {
+        const DualQuat& dq = dqs[b];
+        float* entry = &table[DQ_FLOATS * b];
+        entry[0] = dq.real.x; entry[1] = dq.real.y; entry[2] = dq.real.z; entry[3] = dq.real.w;
+        entry[4] = dq.dual.x; entry[5] = dq.dual.y; entry[6] = dq.dual.z; entry[7] = dq.dual.w;
+    }
+    return table;
+}
+
+void dualQuaternionVertex(const SkinStreams& in, const std::vector<DualQuat>& dqs, int v, float* out) {
+    const DualQuat& pivot = dqs[in.joints[0][v]];
+    glm::quat real(0.f, 0.f, 0.f, 0.f), dual(0.f, 0.f, 0.f, 0.f);
+    for (int k = 0; k < 4; k++) {
+        float weight = in.weights[k][v];
+        if (weight == 0.f) continue;
+        const DualQuat& dq = dqs[in.joints[k][v]];
+        // keep every quaternion in the same hemisphere as the first so the blend takes the short way round
+        if (glm::dot(dq.real, pivot.real) < 0.f) weight = -weight;
+        real = real + dq.real * weight;
+        dual = dual + dq.dual * weight;
+    }
+    float len = glm::length(real);
+    real = real * (1.f / len);
+    dual = dual * (1.f / len);
+
+    glm::vec3 p(in.px[v], in.py[v], in.pz[v]);
+    glm::vec3 n(in.nx[v], in.ny[v], in.nz[v]);
+    glm::vec3 r(real.x, real.y, real.z), d(dual.x, dual.y, dual.z);
+    glm::vec3 translation = 2.f * (real.w * d - dual.w * r + glm::cross(r, d));
+    p = real * p + translation;
+    n = real * n;
+    out[0] = p.x; out[1] = p.y; out[2] = p.z;
+    out[3] = n.x; out[4] = n.y; out[5] = n.z;
+}
+
+// The lane kernels below are written once against these wrappers: WIDTH consecutive vertices
+// are read straight from the SoA streams into one register per attribute, and the bone data
+// each lane needs is gathered by its joint index.
+#ifdef SKINNING_SSE
+struct Sse {
+    static constexpr int WIDTH = 4;
+    using Vec = __m128;
+    using Index = const int*; // offsets into the bone table, one per lane
+    static Vec load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, Vec a) { _mm_store_ps(p, a); }
+    static Vec zero() { return _mm_setzero_ps(); }
+    static Vec set1(float a) { return _mm_set1_ps(a); }
+    static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+    static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+    static Vec invSqrt(Vec a) { return _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(a)); }
+    // a with the sign flipped in the lanes where b is negative
+    static Vec flipSign(Vec a, Vec b) { return _mm_xor_ps(a, _mm_and_ps(b, _mm_set1_ps(-0.f))); }
+    static Index index(const int* offsets) { return offsets; }
+    static Vec gather(const float* table, Index index, int element) {
+        return _mm_setr_ps(table[index[0] + element], table[index[1] + element], table[index[2] + element], table[index[3] + element]);
+    }
+};
+#endif
+
+#ifdef SKINNING_AVX
+struct Avx {
+    static constexpr int WIDTH = 8;
+    using Vec = __m256;
+    using Index = __m256i;
+    static Vec load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, Vec a) { _mm256_store_ps(p, a); }
+    static Vec zero() { return _mm256_setzero_ps(); }
+    static Vec set1(float a) { return _mm256_set1_ps(a); }
+    static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+    static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    static Vec invSqrt(Vec a) { return _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(a)); }
+    static Vec flipSign(Vec a, Vec b) { return _mm256_xor_ps(a, _mm256_and_ps(b, _mm256_set1_ps(-0.f))); }
+    static Index index(const int* offsets) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets)); }
+    static Vec gather(const float* table, Index index, int element) { return _mm256_i32gather_ps(table + element, index, 4); }
+};
+#endif
+
+// Skins [begin, end) a register of vertices at a time and returns where it stopped; the few
+// vertices left over are for the scalar code. Lanes that fail the anim.vert guards gather from
+// bone 0 (their results are thrown away) and get their bind pose written instead.
+template <typename S, typename Kernel>
+int skinLanes(const SkinStreams& in, int numBones, float* dst, int begin, int end, Kernel kernel) {
+    constexpr int W = S::WIDTH;
+    alignas(32) float result[6][W];
+    alignas(32) int offsets[4][W];
+    int v = begin;
+    for (; v + W <= end; v += W) {
+        bool lanes[W];
+        bool any = false;
+        for (int l = 0; l < W; l++) {
+            lanes[l] = skinnable(in, v + l, numBones);
+            any |= lanes[l];
+        }
+        if (any) {
+            for (int k = 0; k < 4; k++) {
+                for (int l = 0; l < W; l++) offsets[k][l] = lanes[l] ? in.joints[k][v + l] : 0;
+            }
+            kernel(v, offsets, result);
+        }
+        for (int l = 0; l < W; l++) {
+            float* out = dst + 6 * (v + l);
+            if (!lanes[l]) {
+                copyBindPose(in, v + l, out);
+                continue;
+            }
+            for (int c = 0; c < 6; c++) out[c] = result[c][l];
+        }
+    }
+    return v;
+}
+
+template <typename S>
+int linearBlendLanes(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+    using Vec = typename S::Vec;
+    constexpr int W = S::WIDTH;
+    const float* table = bones.empty() ? nullptr : glm::value_ptr(bones[0]);
+    return skinLanes<S>(in, bones.size(), dst, begin, end, [&](int v, int (&offsets)[4][W], float (&result)[6][W]) {
+        // the upper 3x4 of the blended matrix, column major; its bottom row never reaches the output
+        Vec m[12];
+        for (Vec& e: m) e = S::zero();
+        for (int k = 0; k < 4; k++) {
+            for (int l = 0; l < W; l++) offsets[k][l] *= 16;
+            typename S::Index index = S::index(offsets[k]);
+            Vec w = S::load(&in.weights[k][v]);
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 3; r++) {
+                    m[3 * c + r] = S::add(m[3 * c + r], S::mul(w, S::gather(table, index, 4 * c + r)));
+                }
+            }
+        }
+        Vec x = S::load(&in.px[v]), y = S::load(&in.py[v]), z = S::load(&in.pz[v]);
+        Vec nx = S::load(&in.nx[v]), ny = S::load(&in.ny[v]), nz = S::load(&in.nz[v]);
+        for (int r = 0; r < 3; r++) {
+            S::store(result[r], S::add(S::add(S::mul(m[r], x), S::mul(m[3 + r], y)), S::add(S::mul(m[6 + r], z), m[9 + r])));
+            S::store(result[3 + r], S::add(S::add(S::mul(m[r], nx), S::mul(m[3 + r], ny)), S::mul(m[6 + r], nz)));
+        }
+    });
+}
+
+template <typename S>
+int dualQuaternionLanes(const SkinStreams& in, const std::vector<float>& table, float* dst, int begin, int end) {
+    using Vec = typename S::Vec;
+    constexpr int W = S::WIDTH;
+    int numBones = table.size() / DQ_FLOATS;
+    return skinLanes<S>(in, numBones, dst, begin, end, [&](int v, int (&offsets)[4][W], float (&result)[6][W]) {
+        for (int k = 0; k < 4; k++) {
+            for (int l = 0; l < W; l++) offsets[k][l] *= DQ_FLOATS;
+        }
+        Vec pivot[4];
+        typename S::Index pivotIndex = S::index(offsets[0]);
+        for (int e = 0; e < 4; e++) pivot[e] = S::gather(table.data(), pivotIndex, e);
+
+        // real x y z w, then dual x y z w
+        Vec q[8];
+        for (Vec& e: q) e = S::zero();
+        for (int k = 0; k < 4; k++) {
+            typename S::Index index = S::index(offsets[k]);
+            Vec dq[8];
+            for (int e = 0; e < 8; e++) dq[e] = S::gather(table.data(), index, e);
+            // same hemisphere as the first bone, as in the scalar version
+            Vec dot = S::add(S::add(S::mul(dq[0], pivot[0]), S::mul(dq[1], pivot[1])), S::add(S::mul(dq[2], pivot[2]), S::mul(dq[3], pivot[3])));
+            Vec w = S::flipSign(S::load(&in.weights[k][v]), dot);
+            for (int e = 0; e < 8; e++) q[e] = S::add(q[e], S::mul(w, dq[e]));
+        }
+        Vec inv = S::invSqrt(S::add(S::add(S::mul(q[0], q[0]), S::mul(q[1], q[1])), S::add(S::mul(q[2], q[2]), S::mul(q[3], q[3]))));
+        for (Vec& e: q) e = S::mul(e, inv);
+
+        // cross(a, b), one component at a time
+        auto cross = [](const Vec* a, const Vec* b, Vec* out) {
+            out[0] = S::sub(S::mul(a[1], b[2]), S::mul(a[2], b[1]));
+            out[1] = S::sub(S::mul(a[2], b[0]), S::mul(a[0], b[2]));
+            out[2] = S::sub(S::mul(a[0], b[1]), S::mul(a[1], b[0]));
+        };
+        // v + 2 * (w * (r x v) + r x (r x v)), the rotation glm applies for quat * vec3
+        auto rotate = [&](Vec* p) {
+            Vec uv[3], uuv[3];
+            cross(q, p, uv);
+            cross(q, uv, uuv);
+            Vec two = S::set1(2.f);
+            for (int e = 0; e < 3; e++) p[e] = S::add(p[e], S::mul(S::add(S::mul(uv[e], q[3]), uuv[e]), two));
+        };
+        Vec rd[3];
+        cross(q, q + 4, rd);
+        Vec p[3] = {S::load(&in.px[v]), S::load(&in.py[v]), S::load(&in.pz[v])};
+        Vec n[3] = {S::load(&in.nx[v]), S::load(&in.ny[v]), S::load(&in.nz[v])};
+        rotate(p);
+        rotate(n);
+        for (int e = 0; e < 3; e++) {
+            // translation 2 * (real.w * d - dual.w * r + r x d)
+            Vec t = S::add(S::sub(S::mul(q[3], q[4 + e]), S::mul(q[7], q[e])), rd[e]);
+            S::store(result[e], S::add(p[e], S::add(t, t)));
+            S::store(result[3 + e], n[e]);
+        }
+    });
+}
+
+}
+
+void Skinning::linearBlendReference(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+    int numBones = bones.size();
+    for (int v = begin; v < end; v++) {
+        float* out = dst + 6 * v;
+        if (!skinnable(in, v, numBones)) {
+            copyBindPose(in, v, out);
+            continue;
+        }
+        glm::mat4 blended(0.f);
+        for (int k = 0; k < 4; k++) {
+            blended += in.weights[k][v] * bones[in.joints[k][v]];
+        }
+        glm::vec4 p = blended * glm::vec4(in.px[v], in.py[v], in.pz[v], 1.f);
+        glm::vec4 n = blended * glm::vec4(in.nx[v], in.ny[v], in.nz[v], 0.f);
+        out[0] = p.x; out[1] = p.y; out[2] = p.z;
+        out[3] = n.x; out[4] = n.y; out[5] = n.z;
+    }
+}
+
+void Skinning::linearBlend(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+#if defined(SKINNING_AVX)
+    begin = linearBlendLanes<Avx>(in, bones, dst, begin, end);
+#elif defined(SKINNING_SSE)
+    begin = linearBlendLanes<Sse>(in, bones, dst, begin, end);
+#endif
+    linearBlendReference(in, bones, dst, begin, end);
+}
+
+void Skinning::dualQuaternionReference(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+    int numBones = bones.size();
+    // bones are few compared to vertices, so convert them once per call
+    std::vector<DualQuat> dqs(numBones);
+    for (int b = 0; b < numBones; b++) {
+        dqs[b] = toDualQuat(bones[b]);
+    }
+    for (int v = begin; v < end; v++) {
+        float* out = dst + 6 * v;
+        if (!skinnable(in, v, numBones)) {
+            copyBindPose(in, v, out);
+            continue;
+        }
+        dualQuaternionVertex(in, dqs, v, out);
+    }
+}
+
+void Skinning::dualQuaternion(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+    int numBones = bones.size();
+    std::vector<DualQuat> dqs(numBones);
+    for (int b = 0; b < numBones; b++) {
+        dqs[b] = toDualQuat(bones[b]);
+    }
+#if defined(SKINNING_AVX)
+    begin = dualQuaternionLanes<Avx>(in, dualQuatTable(dqs), dst, begin, end);
+#elif defined(SKINNING_SSE)
+    begin = dualQuaternionLanes<Sse>(in, dualQuatTable(dqs), dst, begin, end);
+#endif
+    for (int v = begin; v < end; v++) {
+        float* out = dst + 6 * v;
+        if (!skinnable(in, v, numBones)) {
+            copyBindPose(in, v, out);
+            continue;
+        }
+        dualQuaternionVertex(in, dqs, v, out);
+    }
+}
+
+void Skinning::skin(SkinningMode mode, const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+    switch (mode) {
+    case SkinningMode::SKINNING_CPU_DUAL_QUATERNION:
+        dualQuaternion(in, bones, dst, begin, end);
+        break;
+    default:
+        linearBlend(in, bones, dst, begin, end);
+        break;
+    }
+}
+
+void Skinning::skinReference(SkinningMode mode, const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end) {
+    switch (mode) {
+    case SkinningMode::SKINNING_CPU_DUAL_QUATERNION:
+        dualQuaternionReference(in, bones, dst, begin, end);
+        break;
+    default:
+        linearBlendReference(in, bones, dst, begin, end);
+        break;
+    }
+}
+
+const char* Skinning::simdName() {
+#if defined(SKINNING_AVX)
+    return "AVX2";
+#elif defined(SKINNING_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
+
+float Skinning::maxError(SkinningMode mode, const SkinStreams& in, const std::vector<glm::mat4>& bones) {
+    std::vector<float> fast(6 * in.count), reference(6 * in.count);
+    skin(mode, in, bones, fast.data(), 0, in.count);
+    skinReference(mode, in, bones, reference.data(), 0, in.count);
+    float maxError = 0.f;
+    for (int i = 0; i < (int)fast.size(); i++) {
+        maxError = std::max(maxError, std::abs(fast[i] - reference[i]));
+    }
+    return maxError;
+}
+
+void SkinnedMeshBuffer::create(int numVertices, GLuint sourceVbo, int sourceStride, bool texturing) {
+    destroy();
+    m_numVertices = numVertices;
+    m_segmentBytes = sizeof(GLfloat) * 6 * numVertices;
+    m_persistent = GLEW_ARB_buffer_storage;
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    if (m_persistent) {
+        glGenBuffers(1, &m_vbos[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbos[0]);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, m_segmentBytes * PERSISTENT_SEGMENTS, nullptr, flags);
+        m_mapped = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, m_segmentBytes * PERSISTENT_SEGMENTS, flags));
+    } else {
+        glGenBuffers(ORPHAN_BUFFERS, m_vbos);
+        for (GLuint vbo: m_vbos) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, m_segmentBytes, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    if (texturing) {
+        // texcoords sit right after position + normal in the source layout
+        glBindBuffer(GL_ARRAY_BUFFER, sourceVbo);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sourceStride * sizeof(GLfloat), reinterpret_cast<void*>(6 * sizeof(GLfloat)));
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void SkinnedMeshBuffer::destroy() {
+    for (GLsync& fence: m_fences) {
+        if (fence != nullptr) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (m_persistent && m_mapped != nullptr) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbos[0]);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    if (m_vao != 0) {
+        glDeleteBuffers(m_persistent ? 1 : ORPHAN_BUFFERS, m_vbos);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+    m_vbos[0] = m_vbos[1] = 0;
+    m_vao = 0;
+    m_mapped = nullptr;
+    m_writeSegment = m_drawSegment = -1;
+}
+
+float* SkinnedMeshBuffer::beginWrite() {
+    if (m_persistent) {
+        m_writeSegment = (m_drawSegment + 1) % PERSISTENT_SEGMENTS;
+        GLsync& fence = m_fences[m_writeSegment];
+        if (fence != nullptr) {
+            // with three segments this fence is two frames old and has almost always signalled
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        return m_mapped + 6 * m_numVertices * m_writeSegment;
+    }
+
+    // orphan the buffer that is not being drawn and map its fresh storage
+    m_writeSegment = (m_drawSegment + 1) % ORPHAN_BUFFERS;
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbos[m_writeSegment]);
+    glBufferData(GL_ARRAY_BUFFER, m_segmentBytes, nullptr, GL_STREAM_DRAW);
+    float* mapped = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, m_segmentBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (mapped == nullptr) m_writeSegment = -1;
+    return mapped;
+}
+
+void SkinnedMeshBuffer::endWrite() {
+    if (m_writeSegment < 0) return;
+    if (!m_persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbos[m_writeSegment]);
+        if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+            // contents were lost (e.g. display mode change); keep drawing the previous pose
+            std::cout << "skinned vertex buffer was corrupted while mapped" << std::endl;
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            m_writeSegment = -1;
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    m_drawSegment = m_writeSegment;
+    m_writeSegment = -1;
+}
+
+void SkinnedMeshBuffer::bindForDraw() {
+    glBindVertexArray(m_vao);
+    GLuint vbo = m_persistent ? m_vbos[0] : m_vbos[m_drawSegment];
+    GLsizeiptr offset = m_persistent ? m_segmentBytes * m_drawSegment : 0;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void*>(offset));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void*>(offset + 3 * sizeof(GLfloat)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SkinnedMeshBuffer::fenceDraw() {
+    if (!m_persistent || m_drawSegment < 0) return;
+    GLsync& fence = m_fences[m_drawSegment];
+    if (fence != nullptr) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+#include "utils/scenedata.h"
+
+// Structure-of-arrays copy of a skinned mesh's bind pose, so the CPU kernels read
+// each attribute as a contiguous stream instead of striding through the interleaved VBO
+struct SkinStreams {
+    int count = 0;
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+    std::array<std::vector<int>, 4> joints;
+    std::array<std::vector<float>, 4> weights;
+
+    // stride/jointOffset describe the interleaved layout built by Mesh::setVertexData
+    void fromInterleaved(const std::vector<float>& data, int stride, int jointOffset);
+};
+
+// All kernels write interleaved position + normal (6 floats per vertex) for vertices [begin, end).
+// The SIMD kernels skin 4 (SSE) or 8 (AVX2, built with -DSKINNING_AVX=ON) consecutive vertices
+// per iteration straight from the SoA streams; the leftover vertices go through the scalar code.
+namespace Skinning {
+    // linear blend skinning; same math as anim.vert
+    void linearBlend(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end);
+    // plain scalar version, kept as the reference the SIMD path is checked against
+    void linearBlendReference(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end);
+    // dual quaternion skinning; bone scale is dropped since DQS only blends rigid transforms
+    void dualQuaternion(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end);
+    void dualQuaternionReference(const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end);
+    void skin(SkinningMode mode, const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end);
+    void skinReference(SkinningMode mode, const SkinStreams& in, const std::vector<glm::mat4>& bones, float* dst, int begin, int end);
+
+    // which kernel this build uses, for the load-time log
+    const char* simdName();
+    // largest component difference between the SIMD kernel and the reference
+    float maxError(SkinningMode mode, const SkinStreams& in, const std::vector<glm::mat4>& bones);
+}
+
+// Streaming position/normal buffer for a CPU-skinned mesh, plus the VAO that draws it.
+// With ARB_buffer_storage the buffer is persistently mapped and split into fenced
+// segments; otherwise two buffers are orphaned and mapped in turn.
+class SkinnedMeshBuffer
+{
+public:
+    // sourceVbo/sourceStride provide the texcoords when the mesh is textured
+    void create(int numVertices, GLuint sourceVbo, int sourceStride, bool texturing);
+    void destroy();
+
+    // GL thread only: returns the region the next skinning job may fill
+    float* beginWrite();
+    // GL thread only, once the job is done: that region becomes the one that is drawn
+    void endWrite();
+    bool ready() const { return m_drawSegment >= 0; }
+
+    void bindForDraw();
+    // call after the frame's draws so the segment is not reused while the GPU reads it
+    void fenceDraw();
+
+private:
+    static constexpr int PERSISTENT_SEGMENTS = 3;
+    static constexpr int ORPHAN_BUFFERS = 2;
+
+    bool m_persistent = false;
+    int m_numVertices = 0;
+    GLsizeiptr m_segmentBytes = 0;
+    GLuint m_vao = 0;
+    GLuint m_vbos[ORPHAN_BUFFERS] = {0, 0};
+    GLsync m_fences[PERSISTENT_SEGMENTS] = {nullptr, nullptr, nullptr};
+    float* m_mapped = nullptr;
+    int m_writeSegment = -1;
+    int m_drawSegment = -1;
+};
@@ -4,6 +4,7 @@
 #include <QMouseEvent>
 #include <QKeyEvent>
 #include <QString>
+#include <algorithm>
 #include <iostream>
 #include "settings.h"
 #include "utils/shaderloader.h"
@@ -43,46 +44,8 @@ void Realtime::declGeneralUniforms() { // how often do i do this - every vao/vbo
     glUniform1f(loc_ks, m_renderdata.globalData.ks);
 
     // --- LIGHT DATA ---
-    GLfloat lightColors[8*3]; // scenecolor is 0 to 1 i think
-    GLfloat lightFunctions[8*3];
-    GLfloat lightPenumbras[8];
-    GLfloat lightAngles[8];
-    GLint lightTypes[8];
-    GLfloat lightPositions[8*4];
-    GLfloat lightDirections[8*4];
-    for (int i = 0; i < m_renderdata.lights.size(); i++) {
-        for (int j = 0; j < 3; j++) lightColors[i*3+j] = m_renderdata.lights[i].color[j];
-        switch (m_renderdata.lights[i].type) {
-        case LightType::LIGHT_DIRECTIONAL:
-            lightTypes[i] = 1;
-            for (int j = 0; j < 4; j++) lightDirections[i*4+j] = m_renderdata.lights[i].dir[j];
-            break;
-        case LightType::LIGHT_POINT:
-            lightTypes[i] = 0;
-            for (int j = 0; j < 3; j++) lightFunctions[i*3+j] = m_renderdata.lights[i].function[j];
-            for (int j = 0; j < 4; j++) lightPositions[i*4+j] = m_renderdata.lights[i].pos[j];
-            break;
-        case LightType::LIGHT_SPOT:
-            lightTypes[i] = 2;
-            lightAngles[i] = m_renderdata.lights[i].angle;
-            lightPenumbras[i] = m_renderdata.lights[i].penumbra;
-            for (int j = 0; j < 3; j++) lightFunctions[i*3+j] = m_renderdata.lights[i].function[j];
-            for (int j = 0; j < 4; j++) lightDirections[i*4+j] = m_renderdata.lights[i].dir[j];
-            for (int j = 0; j < 4; j++) lightPositions[i*4+j] = m_renderdata.lights[i].pos[j];
-            break;
-        default:
-            break;
-        }
-    }
-    glUniform1i(glGetUniformLocation(m_shader, "lightsNum"), m_renderdata.lights.size());
-    glUniform3fv(glGetUniformLocation(m_shader, "lightColors"), 8, lightColors);
-    glUniform1iv(glGetUniformLocation(m_shader, "lightTypes"), 8, lightTypes);
-    glUniform1fv(glGetUniformLocation(m_shader, "lightPenumbras"), 8, lightPenumbras);
-    glUniform1fv(glGetUniformLocation(m_shader, "lightAngles"), 8, lightAngles);
-    glUniform3fv(glGetUniformLocation(m_shader, "lightFunctions"), 8, lightFunctions);
-    glUniform4fv(glGetUniformLocation(m_shader, "lightPositions"), 8, lightPositions);
-    glUniform4fv(glGetUniformLocation(m_shader, "lightDirections"), 8, lightDirections);
-
+    // any number of lights, in a texture buffer; which ones reach each pixel is decided per frame
+    uploadLights();
 }
 
 void Realtime::declSpecificUniforms(RenderShapeData& shape) { // is it bad to pass a whole matrix
@@ -105,6 +68,40 @@ void Realtime::declSpecificUniforms(RenderShapeData& shape) { // is it bad to pa
     glUniform3fv(glGetUniformLocation(m_shader, "shapeColorS"), 1, shapeColorS);
 }
 
+void Realtime::declBoneUniforms(GLuint shader, Mesh& mesh) {
+    const std::vector<glm::mat4>& bones = mesh.m_meshAnim.m_finalBoneMatrices;
+    int num = std::min<int>(bones.size(), MAX_BONES);
+    glUniform1i(glGetUniformLocation(shader, "numBones"), num);
+    if (num == 0) return;
+
+    // the palette goes into the stream buffer the first time a pass draws the mesh this frame;
+    // after that (other passes, other instances) the same range is bound again
+    if (m_boneGeneration != m_streamBuffer.generation()) {
+        m_boneOffsets.clear();
+        m_boneGeneration = m_streamBuffer.generation();
+    }
+    auto found = m_boneOffsets.find(&mesh);
+    if (found == m_boneOffsets.end()) {
+        // the block is always bound at its full declared size, unused bones are left as they are
+        StreamBuffer::Allocation allocation = m_streamBuffer.allocate(MAX_BONES * sizeof(glm::mat4), m_streamBuffer.uniformAlignment());
+        if (allocation.data == nullptr) return;
+        std::copy(bones.begin(), bones.begin() + num, static_cast<glm::mat4*>(allocation.data));
+        m_streamBuffer.commit(allocation);
+        // allocating may have outgrown the buffer, and the cache with it
+        if (m_boneGeneration != m_streamBuffer.generation()) {
+            m_boneOffsets.clear();
+            m_boneGeneration = m_streamBuffer.generation();
+        }
+        found = m_boneOffsets.emplace(&mesh, allocation.offset).first;
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, BONE_BLOCK_BINDING, m_streamBuffer.buffer(), found->second, MAX_BONES * sizeof(glm::mat4));
+}
+
+void Realtime::bindBoneBlock(GLuint shader) {
+    GLuint block = glGetUniformBlockIndex(shader, "Bones");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(shader, block, BONE_BLOCK_BINDING);
+}
+
 void Realtime::rebuildCamera() {
     glm::vec3 look = glm::vec3(m_renderdata.cameraData.look);
 
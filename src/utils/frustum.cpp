@@ -0,0 +1,22 @@
+#include "utils/frustum.h"
+
+Frustum::Frustum(const glm::mat4& viewProj) {
+    // Gribb/Hartmann: each plane is the fourth row of the matrix plus or minus one of the others
+    glm::mat4 m = glm::transpose(viewProj);
+    m_planes[0] = m[3] + m[0]; // left
+    m_planes[1] = m[3] - m[0]; // right
+    m_planes[2] = m[3] + m[1]; // bottom
+    m_planes[3] = m[3] - m[1]; // top
+    m_planes[4] = m[3] + m[2]; // near
+    m_planes[5] = m[3] - m[2]; // far
+    for (glm::vec4& plane: m_planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+    for (const glm::vec4& plane: m_planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
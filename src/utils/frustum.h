@@ -0,0 +1,19 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// View frustum as six inward-facing planes, pulled straight out of a projection * view matrix
+class Frustum
+{
+public:
+    Frustum() = default;
+    explicit Frustum(const glm::mat4& viewProj);
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+private:
+    glm::vec4 m_planes[6];
+};
+
+#endif // FRUSTUM_H
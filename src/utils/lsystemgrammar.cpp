@@ -0,0 +1,419 @@
+#include "utils/lsystemgrammar.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+LSystemRandom::LSystemRandom(uint32_t seed) {
+    // spread nearby seeds apart, and keep the state off zero where xorshift stays stuck
+    seed = (seed ^ 61u) ^ (seed >> 16);
+    seed *= 9u;
+    seed ^= seed >> 4;
+    seed *= 0x27d4eb2du;
+    seed ^= seed >> 15;
+    state = seed ? seed : 0x9e3779b9u;
+}
+
+uint32_t LSystemRandom::next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float LSystemGrammar::Expression::evaluate(const float* params) const {
+    if (code.empty()) return 1.f;
+    float stack[MAX_STACK];
+    int top = 0;
+    for (const Instruction& instruction: code) {
+        if (instruction.op == Instruction::CONSTANT) {
+            stack[top++] = instruction.value;
+            continue;
+        }
+        if (instruction.op == Instruction::PARAMETER) {
+            stack[top++] = params[instruction.index];
+            continue;
+        }
+        if (instruction.op == Instruction::NEGATE) {
+            stack[top - 1] = -stack[top - 1];
+            continue;
+        }
+        float b = stack[--top];
+        float& a = stack[top - 1];
+        switch (instruction.op) {
+        case Instruction::ADD: a = a + b; break;
+        case Instruction::SUBTRACT: a = a - b; break;
+        case Instruction::MULTIPLY: a = a * b; break;
+        case Instruction::DIVIDE: a = a / b; break;
+        case Instruction::POWER: a = std::pow(a, b); break;
+        case Instruction::LESS: a = a < b; break;
+        case Instruction::GREATER: a = a > b; break;
+        case Instruction::LESS_EQUAL: a = a <= b; break;
+        case Instruction::GREATER_EQUAL: a = a >= b; break;
+        case Instruction::EQUAL: a = a == b; break;
+        case Instruction::NOT_EQUAL: a = a != b; break;
+        case Instruction::AND: a = a != 0.f && b != 0.f; break;
+        case Instruction::OR: a = a != 0.f || b != 0.f; break;
+        default: break;
+        }
+    }
+    return stack[0];
+}
+
+// Recursive descent over one rule's text. Expressions have the usual precedence:
+// || then && then comparisons, + -, * /, unary -, and ^ binding tightest.
+class LSystemGrammar::Parser {
+public:
+    Parser(const std::string& text, const std::vector<std::string>& formals) : m_text(text), m_formals(formals) {}
+
+    // modules up to the end of the text; parameters are expressions of the formals
+    bool modules(std::vector<Module>& out) {
+        while (skipSpace()) {
+            unsigned char symbol = m_text[m_pos++];
+            if (symbol == '(' || symbol == ')' || symbol == ',') return fail("unexpected '" + std::string(1, symbol) + "'");
+            Module module{symbol, {}};
+            if (skipSpace() && m_text[m_pos] == '(') {
+                m_pos++;
+                do {
+                    module.params.emplace_back();
+                    if (!expression(module.params.back())) return false;
+                } while (accept(","));
+                if (!accept(")")) return fail("expected ')'");
+            }
+            out.push_back(std::move(module));
+        }
+        return true;
+    }
+
+    // a whole condition
+    bool condition(Expression& out) {
+        if (!expression(out)) return false;
+        if (skipSpace()) return fail("unexpected '" + std::string(1, m_text[m_pos]) + "'");
+        return true;
+    }
+
+    // a predecessor: one symbol, optionally with a list of formal parameter names
+    static bool predecessor(const std::string& text, unsigned char& symbol, std::vector<std::string>& formals) {
+        Parser parser(text, formals);
+        if (!parser.skipSpace()) return parser.fail("missing symbol");
+        symbol = text[parser.m_pos++];
+        if (parser.accept("(")) {
+            do {
+                parser.skipSpace();
+                size_t begin = parser.m_pos;
+                while (parser.m_pos < text.size() && (std::isalnum((unsigned char)text[parser.m_pos]) || text[parser.m_pos] == '_')) {
+                    parser.m_pos++;
+                }
+                if (begin == parser.m_pos || std::isdigit((unsigned char)text[begin])) return parser.fail("expected a parameter name");
+                formals.push_back(text.substr(begin, parser.m_pos - begin));
+            } while (parser.accept(","));
+            if (!parser.accept(")")) return parser.fail("expected ')'");
+        }
+        if (parser.skipSpace()) return parser.fail("a predecessor is a single symbol");
+        return true;
+    }
+
+private:
+    bool expression(Expression& out) {
+        m_depth = 0;
+        return orExpression(out.code);
+    }
+
+    bool orExpression(std::vector<Instruction>& code) {
+        if (!andExpression(code)) return false;
+        while (accept("||")) {
+            if (!andExpression(code)) return false;
+            emit(code, Instruction::OR);
+        }
+        return true;
+    }
+
+    bool andExpression(std::vector<Instruction>& code) {
+        if (!comparison(code)) return false;
+        while (accept("&&")) {
+            if (!comparison(code)) return false;
+            emit(code, Instruction::AND);
+        }
+        return true;
+    }
+
+    bool comparison(std::vector<Instruction>& code) {
+        if (!sum(code)) return false;
+        // two character operators first, so "<=" is not read as "<"
+        static const std::pair<const char*, Instruction::Op> operators[] = {
+            {"<=", Instruction::LESS_EQUAL}, {">=", Instruction::GREATER_EQUAL}, {"==", Instruction::EQUAL},
+            {"!=", Instruction::NOT_EQUAL}, {"<", Instruction::LESS}, {">", Instruction::GREATER}};
+        for (auto& [token, op]: operators) {
+            if (accept(token)) {
+                if (!sum(code)) return false;
+                emit(code, op);
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool sum(std::vector<Instruction>& code) {
+        if (!product(code)) return false;
+        while (true) {
+            Instruction::Op op;
+            if (accept("+")) op = Instruction::ADD;
+            else if (accept("-")) op = Instruction::SUBTRACT;
+            else return true;
+            if (!product(code)) return false;
+            emit(code, op);
+        }
+    }
+
+    bool product(std::vector<Instruction>& code) {
+        if (!unary(code)) return false;
+        while (true) {
+            Instruction::Op op;
+            if (accept("*")) op = Instruction::MULTIPLY;
+            else if (accept("/")) op = Instruction::DIVIDE;
+            else return true;
+            if (!unary(code)) return false;
+            emit(code, op);
+        }
+    }
+
+    bool unary(std::vector<Instruction>& code) {
+        if (accept("-")) {
+            if (!unary(code)) return false;
+            emit(code, Instruction::NEGATE);
+            return true;
+        }
+        if (!primary(code)) return false;
+        if (accept("^")) {
+            if (!unary(code)) return false;
+            emit(code, Instruction::POWER);
+        }
+        return true;
+    }
+
+    bool primary(std::vector<Instruction>& code) {
+        if (!skipSpace()) return fail("expected a value");
+        if (accept("(")) {
+            if (!orExpression(code)) return false;
+            if (!accept(")")) return fail("expected ')'");
+            return true;
+        }
+        const char* begin = m_text.c_str() + m_pos;
+        if (std::isdigit((unsigned char)*begin) || *begin == '.') {
+            char* end;
+            float value = std::strtof(begin, &end);
+            m_pos += end - begin;
+            return push(code, Instruction{Instruction::CONSTANT, value, 0});
+        }
+        size_t start = m_pos;
+        while (m_pos < m_text.size() && (std::isalnum((unsigned char)m_text[m_pos]) || m_text[m_pos] == '_')) m_pos++;
+        std::string name = m_text.substr(start, m_pos - start);
+        auto found = std::find(m_formals.begin(), m_formals.end(), name);
+        if (name.empty() || found == m_formals.end()) {
+            return fail(name.empty() ? "expected a value" : "unknown parameter \"" + name + "\"");
+        }
+        return push(code, Instruction{Instruction::PARAMETER, 0.f, int(found - m_formals.begin())});
+    }
+
+    bool push(std::vector<Instruction>& code, Instruction instruction) {
+        code.push_back(instruction);
+        if (++m_depth > MAX_STACK) return fail("expression is nested too deeply");
+        return true;
+    }
+
+    // binary operators take two values and leave one
+    void emit(std::vector<Instruction>& code, Instruction::Op op) {
+        code.push_back(Instruction{op, 0.f, 0});
+        if (op != Instruction::NEGATE) m_depth--;
+    }
+
+    // false at the end of the text, otherwise stops on the next non-space character
+    bool skipSpace() {
+        while (m_pos < m_text.size() && std::isspace((unsigned char)m_text[m_pos])) m_pos++;
+        return m_pos < m_text.size();
+    }
+
+    bool accept(const char* token) {
+        skipSpace();
+        size_t length = std::strlen(token);
+        if (m_text.compare(m_pos, length, token) != 0) return false;
+        m_pos += length;
+        return true;
+    }
+
+    bool fail(const std::string& message) {
+        std::cout << "L-system: " << message << " at " << m_pos << " in \"" << m_text << "\"" << std::endl;
+        return false;
+    }
+
+    const std::string& m_text;
+    const std::vector<std::string>& m_formals;
+    size_t m_pos = 0;
+    int m_depth = 0; // values on the stack so far
+};
+
+bool LSystemGrammar::compile(const ScenePlant& plant) {
+    for (auto& productions: m_productions) productions.clear();
+    m_axiom.clear();
+    m_plain = true;
+    m_stochastic = false;
+
+    std::vector<std::string> none;
+    if (!Parser(plant.axiom, none).modules(m_axiom)) return false;
+    for (const Module& module: m_axiom) m_plain &= module.params.empty();
+
+    for (const ScenePlantRule& rule: plant.rules) {
+        unsigned char symbol;
+        std::vector<std::string> formals;
+        if (!Parser::predecessor(rule.predecessor, symbol, formals)) return false;
+        Production production;
+        production.arity = formals.size();
+        production.weight = rule.weight;
+        if (!Parser(rule.successor, formals).modules(production.successor)) return false;
+        if (!rule.condition.empty() && !Parser(rule.condition, formals).condition(production.condition)) return false;
+
+        m_plain &= production.arity == 0 && production.condition.code.empty();
+        for (const Module& module: production.successor) m_plain &= module.params.empty();
+        m_productions[symbol].push_back(std::move(production));
+        if (m_productions[symbol].size() > 1) {
+            m_plain = false;
+            m_stochastic = true;
+        }
+    }
+    return true;
+}
+
+LSystemString LSystemGrammar::generate(int iterations, uint32_t seed) const {
+    iterations = std::max(0, iterations);
+    return m_plain ? generatePlain(iterations) : generateModules(iterations, seed);
+}
+
+namespace {
+struct Expander {
+    std::array<std::string, 256> rules;
+    std::array<bool, 256> hasRule{};
+    // length[k][c]: how long c is after k rewrites
+    std::vector<std::array<uint64_t, 256>> length;
+    // where the expansion of (k, c) was first written, so repeats are one memcpy
+    std::vector<std::array<int64_t, 256>> firstAt;
+    char* out = nullptr;
+    char* begin = nullptr;
+
+    void expand(unsigned char c, int k) {
+        if (k == 0 || !hasRule[c]) {
+            *out++ = c;
+            return;
+        }
+        int64_t& first = firstAt[k][c];
+        if (first >= 0) {
+            std::memcpy(out, begin + first, length[k][c]);
+            out += length[k][c];
+            return;
+        }
+        int64_t start = out - begin;
+        for (unsigned char d: rules[c]) expand(d, k - 1);
+        first = start;
+    }
+};
+}
+
+LSystemString LSystemGrammar::generatePlain(int iterations) const {
+    Expander expander;
+    for (int c = 0; c < 256; c++) {
+        if (m_productions[c].empty()) continue;
+        expander.hasRule[c] = true;
+        for (const Module& module: m_productions[c].front().successor) expander.rules[c] += char(module.symbol);
+    }
+
+    // every length up front, so the whole string is written once into a buffer of the right size
+    expander.length.resize(iterations + 1);
+    expander.length[0].fill(1);
+    for (int k = 1; k <= iterations; k++) {
+        for (int c = 0; c < 256; c++) {
+            if (!expander.hasRule[c]) {
+                expander.length[k][c] = 1;
+                continue;
+            }
+            uint64_t sum = 0;
+            for (unsigned char d: expander.rules[c]) sum = std::min(sum + expander.length[k - 1][d], MAX_LENGTH + 1);
+            expander.length[k][c] = sum;
+        }
+    }
+    uint64_t total = 0;
+    for (const Module& module: m_axiom) total = std::min(total + expander.length[iterations][module.symbol], MAX_LENGTH + 1);
+    if (total > MAX_LENGTH) {
+        std::cout << "L-system would be longer than " << MAX_LENGTH << " symbols after " << iterations
+                  << " iterations, not generating it" << std::endl;
+        return {};
+    }
+
+    LSystemString result;
+    result.symbols.assign(total, '\0');
+    expander.firstAt.resize(iterations + 1);
+    for (auto& row: expander.firstAt) row.fill(-1);
+    expander.begin = expander.out = result.symbols.data();
+    for (const Module& module: m_axiom) expander.expand(module.symbol, iterations);
+    return result;
+}
+
+LSystemString LSystemGrammar::generateModules(int iterations, uint32_t seed) const {
+    LSystemRandom random(seed);
+    auto append = [](LSystemString& out, const Module& module, const float* params) {
+        out.symbols += char(module.symbol);
+        for (const Expression& expression: module.params) out.params.push_back(expression.evaluate(params));
+        out.paramBegin.push_back(out.params.size());
+    };
+
+    LSystemString current;
+    current.paramBegin.push_back(0);
+    for (const Module& module: m_axiom) append(current, module, nullptr);
+
+    LSystemString next;
+    std::vector<const Production*> candidates;
+    for (int k = 0; k < iterations; k++) {
+        next.symbols.clear();
+        next.params.clear();
+        next.paramBegin.assign(1, 0);
+        for (size_t i = 0; i < current.symbols.size(); i++) {
+            unsigned char symbol = current.symbols[i];
+            const float* params = current.params.data() + current.paramBegin[i];
+            int arity = current.paramBegin[i + 1] - current.paramBegin[i];
+
+            // the productions that apply here, then one of them by weight
+            candidates.clear();
+            float totalWeight = 0.f;
+            for (const Production& production: m_productions[symbol]) {
+                if (production.arity != arity || production.condition.evaluate(params) == 0.f) continue;
+                candidates.push_back(&production);
+                totalWeight += production.weight;
+            }
+            if (candidates.empty()) {
+                next.symbols += char(symbol);
+                next.params.insert(next.params.end(), params, params + arity);
+                next.paramBegin.push_back(next.params.size());
+                continue;
+            }
+            const Production* chosen = candidates.front();
+            if (candidates.size() > 1) {
+                float pick = random.uniform(0.f, totalWeight);
+                for (const Production* candidate: candidates) {
+                    chosen = candidate;
+                    pick -= candidate->weight;
+                    if (pick < 0.f) break;
+                }
+            }
+            for (const Module& module: chosen->successor) append(next, module, params);
+        }
+        if (next.symbols.size() > MAX_LENGTH) {
+            std::cout << "L-system would be longer than " << MAX_LENGTH << " symbols after " << k + 1
+                      << " iterations, not generating it" << std::endl;
+            return {};
+        }
+        std::swap(current, next);
+    }
+    // plain strings leave paramBegin empty, so keep it only when some module has parameters
+    if (current.params.empty()) current.paramBegin.clear();
+    return current;
+}
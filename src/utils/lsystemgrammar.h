@@ -0,0 +1,88 @@
+#ifndef LSYSTEMGRAMMAR_H
+#define LSYSTEMGRAMMAR_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scenedata.h"
+
+// A generated L-system: one byte per module, plus the parameters of the modules that have any
+struct LSystemString {
+    std::string symbols;
+    // module i's parameters are params[paramBegin[i]] up to params[paramBegin[i + 1]];
+    // empty when no module has parameters
+    std::vector<uint32_t> paramBegin;
+    std::vector<float> params;
+
+    // the module's first parameter, or fallback when it has none
+    float param(size_t i, float fallback) const {
+        if (paramBegin.empty() || paramBegin[i] == paramBegin[i + 1]) return fallback;
+        return params[paramBegin[i]];
+    }
+};
+
+// xorshift32, so a seed grows the same plant on every platform
+struct LSystemRandom {
+    uint32_t state;
+    explicit LSystemRandom(uint32_t seed);
+    uint32_t next();
+    float uniform(float low = 0.f, float high = 1.f) { return low + (high - low) * (next() >> 8) * (1.f / 16777216.f); }
+};
+
+// The rules of a ScenePlant, compiled once: successors are split into modules, and every
+// parameter and condition becomes a small stack program over the predecessor's parameters.
+// Plain rules (one production per symbol, no parameters or conditions) are expanded in one
+// pass with repeated expansions copied; the rest are rewritten module by module, with the
+// stochastic choices drawn from the seed.
+class LSystemGrammar
+{
+public:
+    // longest string generate will produce, to keep a typo in the rules from eating all memory
+    static constexpr uint64_t MAX_LENGTH = uint64_t(1) << 28;
+
+    // false, with a message, if a rule does not parse
+    bool compile(const ScenePlant& plant);
+    // whether generate depends on its seed
+    bool stochastic() const { return m_stochastic; }
+    // empty, with a message, if the result would be longer than MAX_LENGTH
+    LSystemString generate(int iterations, uint32_t seed) const;
+
+private:
+    static constexpr int MAX_STACK = 16;
+
+    struct Instruction {
+        enum Op : uint8_t {
+            CONSTANT, PARAMETER, ADD, SUBTRACT, MULTIPLY, DIVIDE, POWER, NEGATE,
+            LESS, GREATER, LESS_EQUAL, GREATER_EQUAL, EQUAL, NOT_EQUAL, AND, OR
+        } op;
+        float value = 0.f; // CONSTANT
+        int index = 0;     // PARAMETER
+    };
+    // postfix code; empty evaluates to 1, so a missing condition always holds
+    struct Expression {
+        std::vector<Instruction> code;
+        float evaluate(const float* params) const;
+    };
+    struct Module {
+        unsigned char symbol;
+        std::vector<Expression> params;
+    };
+    struct Production {
+        int arity = 0; // formal parameters; only modules with as many parameters match
+        Expression condition;
+        float weight = 1.f;
+        std::vector<Module> successor;
+    };
+    class Parser;
+
+    LSystemString generatePlain(int iterations) const;
+    LSystemString generateModules(int iterations, uint32_t seed) const;
+
+    std::array<std::vector<Production>, 256> m_productions;
+    std::vector<Module> m_axiom;
+    bool m_plain = true;
+    bool m_stochastic = false;
+};
+
+#endif // LSYSTEMGRAMMAR_H
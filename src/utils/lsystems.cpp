@@ -1,154 +1,189 @@
 #include "realtime.h"
 
-std::pair<QString, QString> substringInsideAndAfterMatchingBracket(const QString &s) {
-    if (s.isEmpty() || s[0] != '[') {
-        throw std::runtime_error("String does not start with '['");
-    }
-
-    int depth = 0;
-    int startInside = 1;  // first character after '['
-
-    for (int i = 0; i < s.length(); i++) {
-        if (s[i] == '[') {
-            depth++;
-        } else if (s[i] == ']') {
-            depth--;
-
-            if (depth == 0) {
-                // i = index of matching ']'
-                QString inside = s.mid(startInside, i - startInside); // substring inside brackets
-                QString after  = s.mid(i + 1);                        // substring after brackets
-                return { inside, after };
-            }
+#include <algorithm>
+#include <glm/gtx/transform.hpp>
+
+void Realtime::interpretLSystem(const LSystemString& string, const ScenePlant& plant, LSystemGeometry& geometry) {
+    const std::string& data = string.symbols;
+    // matching bracket of every '[', found once instead of rescanning the rest of the string per branch
+    std::vector<int> match(data.size(), -1);
+    std::vector<int> open;
+    for (int i = 0; i < data.size(); i++) {
+        if (data[i] == '[') {
+            open.push_back(i);
+        } else if (data[i] == ']' && !open.empty()) {
+            match[open.back()] = i;
+            open.pop_back();
         }
     }
-
-    throw std::runtime_error("Unbalanced brackets");
-}
-
-ScenePrimitive defaultPrimitive() {
-    ScenePrimitive LSystemBasePrimitive;
-
-    SceneMaterial LSystemGlobalMaterial;
-    LSystemGlobalMaterial.cAmbient = glm::vec4(1, 1, 1, 1);
-    LSystemGlobalMaterial.cDiffuse = glm::vec4(0.3, 1, 0.3, 1);
-    LSystemGlobalMaterial.cSpecular = glm::vec4(0.2, 0.2, 0.2, 1);
-    LSystemGlobalMaterial.shininess = 0.4;
-
-    LSystemBasePrimitive.type = PrimitiveType::PRIMITIVE_CYLINDER;
-    LSystemBasePrimitive.material = LSystemGlobalMaterial;
-
-    return LSystemBasePrimitive;
-}
-
-SceneNode* Realtime::createLSystemNodeHelper(QString data, float localScale, float angle) {
-    SceneTransformation *transformationTranslate = new SceneTransformation;
-    transformationTranslate->type = TransformationType::TRANSFORMATION_TRANSLATE;
-    SceneNode *node = new SceneNode;
-    float updatedAngle = angle;
-    int currIndex = 0;
-
-    if (data.length() == 0) {
-        return node;
+    if (!open.empty()) {
+        std::cout << "L-system has unbalanced brackets, not drawing it" << std::endl;
+        return;
     }
 
-    ScenePrimitive *primitive = new ScenePrimitive;
-    *primitive = defaultPrimitive();
-    node->primitives.push_back(primitive);
-
-    for (int i = 0; i < data.length(); i++) {
-        if (data[i] == "F") {
-            if (updatedAngle == 0) {
-                transformationTranslate->translate = glm::vec3(0.0, m_LSystemScaler * localScale, 0.0);
-                node->transformations.push_back(transformationTranslate);
-            } else {
-                SceneTransformation *transformationRotate = new SceneTransformation;
-                transformationRotate->type = TransformationType::TRANSFORMATION_ROTATE;
-
-                //float xRotation = MiscUtilities::randomGen(0, 1);
-                float xRotation = 0;
-                transformationRotate->rotate = glm::vec3(xRotation, 0.0, 1.0);
-                transformationRotate->angle = updatedAngle;
-                float translateScale = m_LSystemScaler;
-
-                float horizontalTranslation = 0.5 * translateScale * cos((M_PI / 2) + updatedAngle);
-                float verticalTranslation = 0.5 * translateScale * sin((M_PI / 2) - updatedAngle) + 0.5 * translateScale;
-
-                transformationTranslate->translate = glm::vec3(horizontalTranslation, verticalTranslation, 0.0);
-                node->transformations.push_back(transformationTranslate);
-                node->transformations.push_back(transformationRotate);
+    // turns take their angle in degrees as a parameter, F how many segment lengths it draws
+    auto turn = [&](int i) {
+        return string.paramBegin.empty() ? plant.angle : glm::radians(string.param(i, glm::degrees(plant.angle)));
+    };
+
+    // a branch is a range of the string drawn from a frame; every nonempty one draws a cylinder.
+    // parentLength is the length of the cylinder the frame belongs to, for where the next one starts
+    struct Branch {
+        int begin, end;
+        glm::mat4 ctm;
+        float localScale, angle, parentLength;
+    };
+    std::vector<Branch> stack = {Branch{0, int(data.size()), glm::mat4(1.f), 1.f, 0.f, 1.f}};
+    // at most one cylinder per F, bracket or turn, plus the root
+    geometry.branches.reserve(geometry.branches.size() + std::count_if(data.begin(), data.end(), [](char c) {
+        return c == 'F' || c == '[' || c == '+' || c == '-';
+    }) + 1);
+    glm::vec4 diffuse = plant.color;
+    glm::mat4 placement = glm::scale(plant.length * glm::vec3(plant.width, 1, plant.width));
+    glm::mat4 scaleStep = glm::scale(glm::vec3(plant.scaleProgression));
+
+    while (!stack.empty()) {
+        Branch branch = stack.back();
+        stack.pop_back();
+        if (branch.begin == branch.end) continue;
+
+        // turns up to the first F bend this branch's cylinder; the F moves it one segment up
+        float updatedAngle = branch.angle;
+        float segmentLength = 1.f;
+        int next = branch.begin;
+        glm::mat4 ctm = branch.ctm;
+        for (int i = branch.begin; i < branch.end; i++) {
+            if (data[i] == 'F') {
+                segmentLength = string.param(i, 1.f);
+                if (updatedAngle == 0) {
+                    // from the middle of the last cylinder to the middle of this one; only moves the last column
+                    ctm[3] += ctm[1] * (plant.length * branch.localScale * 0.5f * (branch.parentLength + segmentLength));
+                } else {
+                    // translate(horizontal, vertical, 0) * rotate(updatedAngle, z), written out
+                    float translateScale = plant.length;
+                    float sine = std::sin(updatedAngle), cosine = std::cos(updatedAngle);
+                    float horizontalTranslation = -0.5f * translateScale * segmentLength * sine;
+                    float verticalTranslation = 0.5f * translateScale * (segmentLength * cosine + branch.parentLength);
+                    glm::mat4 local(cosine, sine, 0.f, 0.f,
+                                    -sine, cosine, 0.f, 0.f,
+                                    0.f, 0.f, 1.f, 0.f,
+                                    horizontalTranslation, verticalTranslation, 0.f, 1.f);
+                    ctm = ctm * local;
+                }
+                next = i + 1;
+                break;
+            } else if (data[i] == '-') {
+                updatedAngle -= turn(i);
+            } else if (data[i] == '+') {
+                updatedAngle += turn(i);
             }
-
-            currIndex = i + 1;
-
-            break;
-        } else if (data[i] == "-") {
-            //updatedAngle -= m_angle + MiscUtilities::randomGen(-0.2, 0.2);
-            updatedAngle -= m_angle;
-        } else if (data[i] == "+") {
-            //updatedAngle += m_angle + MiscUtilities::randomGen(-0.2, 0.2);
-            updatedAngle -= m_angle;
         }
-    }
-
-    updatedAngle = 0;
-
-    // No need for scaling if uniform size
-    if (m_LSystemScaleProgression != 1) {
-        SceneTransformation *transformationScale = new SceneTransformation;
-        transformationScale->type = TransformationType::TRANSFORMATION_SCALE;
-        transformationScale->scale = glm::vec3(m_LSystemScaleProgression, m_LSystemScaleProgression, m_LSystemScaleProgression);
-        node->transformations.push_back(transformationScale);
-    }
-
-    for (int i = currIndex; i < data.length(); i++) {
-        if (data[i] == "F") {
-            SceneNode *child = createLSystemNodeHelper(data.mid(i), localScale * m_LSystemScaleProgression, updatedAngle);
-            node->children.push_back(child);
-
-            break;
-        } else if (data[i] == "[") {
-            std::pair<QString, QString> branchStrings = substringInsideAndAfterMatchingBracket(data.mid(i));
-
-            SceneNode *leftChild = createLSystemNodeHelper(branchStrings.first, localScale * m_LSystemScaleProgression, updatedAngle);
-            SceneNode *rightChild = createLSystemNodeHelper(branchStrings.second, localScale * m_LSystemScaleProgression, 0);
-
-            node->children.push_back(leftChild);
-            node->children.push_back(rightChild);
 
-            break;
-        } else if (data[i] == "-") {
-            //updatedAngle -= m_angle + MiscUtilities::randomGen(-0.2, 0.2);
-            updatedAngle -= m_angle;
-        } else if (data[i] == "+") {
-            //updatedAngle += m_angle + MiscUtilities::randomGen(-0.2, 0.2);
-            updatedAngle += m_angle;
+        // No need for scaling if uniform size
+        if (plant.scaleProgression != 1) ctm = ctm * scaleStep;
+        glm::mat4 model = ctm * placement;
+        model[1] *= segmentLength;
+        geometry.branches.push_back(LSystemInstance{model, diffuse});
+
+        // then the turns up to the next F or branch point carry on in a child
+        updatedAngle = 0;
+        float childScale = branch.localScale * plant.scaleProgression;
+        bool tip = true;
+        for (int i = next; i < branch.end; i++) {
+            if (data[i] == 'F') {
+                stack.push_back(Branch{i, branch.end, ctm, childScale, updatedAngle, segmentLength});
+                tip = false;
+                break;
+            } else if (data[i] == '[') {
+                // pushed in reverse so the bracket's contents are drawn before what follows it
+                stack.push_back(Branch{match[i] + 1, branch.end, ctm, childScale, 0.f, segmentLength});
+                stack.push_back(Branch{i + 1, match[i], ctm, childScale, updatedAngle, segmentLength});
+                tip = false;
+                break;
+            } else if (data[i] == '-') {
+                updatedAngle -= turn(i);
+            } else if (data[i] == '+') {
+                updatedAngle += turn(i);
+            }
+        }
+        // nothing grows out of this cylinder, so a leaf goes on its top end
+        if (tip) {
+            glm::vec4 top = model * glm::vec4(0.f, 0.5f, 0.f, 1.f);
+            geometry.leaves.push_back(glm::vec4(glm::vec3(top), LSYSTEM_LEAF_SIZE * plant.length * childScale));
         }
     }
-
-    return node;
 }
 
-SceneNode* Realtime::createLSystemNode(QString data) {
-    return createLSystemNodeHelper(data, 1, 0);
+namespace {
+uint32_t packColor(const SceneColor& color) {
+    glm::uvec4 bytes = glm::uvec4(glm::clamp(color, 0.f, 1.f) * 255.f + 0.5f);
+    return bytes.r | bytes.g << 8 | bytes.b << 16 | bytes.a << 24;
+}
 }
 
-QString Realtime::generateLSystemString(std::map<QChar, QString> rules, QString axiom, int numIterations) {
-    QString state = axiom;
+// runs on the simulation task; every variant of every plant is grown as its own pool job
+void Realtime::growForest(const std::vector<RenderPlantData>& plants, LSystemForest& forest) {
+    struct Species {
+        LSystemGrammar grammar;
+        int firstVariant = 0;
+        int variants = 0; // none if the rules do not compile
+    };
+    std::vector<Species> species(plants.size());
+    std::vector<int> variantSpecies;
+    for (int s = 0; s < plants.size(); s++) {
+        const ScenePlant& plant = plants[s].plant;
+        if (plant.count == 0 || !species[s].grammar.compile(plant)) continue;
+        // without stochastic rules every seed grows the same plant
+        species[s].variants = species[s].grammar.stochastic() ? plant.variants : 1;
+        species[s].firstVariant = variantSpecies.size();
+        variantSpecies.insert(variantSpecies.end(), species[s].variants, s);
+    }
 
-    for (int i = 0; i < numIterations; i++) {
-        QString newState = "";
+    std::vector<LSystemGeometry> variants(variantSpecies.size());
+    auto grow = [&](int v) {
+        int s = variantSpecies[v];
+        const ScenePlant& plant = plants[s].plant;
+        uint32_t seed = plant.seed * 0x9e3779b1u + (v - species[s].firstVariant);
+        interpretLSystem(species[s].grammar.generate(plant.iterations, seed), plant, variants[v]);
+    };
+    if (m_threadPool) {
+        m_threadPool->parallelFor(variants.size(), grow);
+    } else {
+        for (int v = 0; v < variants.size(); v++) grow(v);
+    }
 
-        for (QChar c : state) {
-            if (rules.find(c) != rules.end()) {
-                newState += rules[c];
-            } else {
-                newState += c;
+    // scatter the instances, each picking a variant, then group them by variant for drawing
+    std::vector<std::vector<glm::mat4>> plantsOf(variants.size());
+    for (int s = 0; s < species.size(); s++) {
+        if (species[s].variants == 0) continue;
+        const ScenePlant& plant = plants[s].plant;
+        LSystemRandom random(plant.seed ^ 0x5bd1e995u);
+        uint32_t leafColor = packColor(plant.leafColor);
+        for (int i = 0; i < plant.count; i++) {
+            int v = species[s].firstVariant + random.next() % species[s].variants;
+            glm::mat4 transform = plants[s].ctm;
+            if (plant.count > 1) {
+                glm::vec2 position = glm::vec2(random.uniform(-1.f, 1.f), random.uniform(-1.f, 1.f)) * plant.scatterExtent;
+                transform = transform * glm::translate(glm::vec3(position.x, 0.f, position.y))
+                            * glm::rotate(random.uniform(0.f, 2.f * M_PI), glm::vec3(0.f, 1.f, 0.f));
+            }
+            transform = transform * glm::scale(glm::vec3(random.uniform(plant.plantScale.x, plant.plantScale.y)));
+            plantsOf[v].push_back(transform);
+
+            // a fraction of the branches, so they are simply placed on the CPU
+            float leafScale = glm::length(glm::vec3(transform[0]));
+            for (const glm::vec4& leaf: variants[v].leaves) {
+                forest.leaves.push_back(glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(leaf), 1.f)), leaf.w * leafScale));
+                forest.leafColors.push_back(leafColor);
             }
         }
-
-        state = newState;
     }
 
-    return state;
+    for (int v = 0; v < variants.size(); v++) {
+        if (plantsOf[v].empty() || variants[v].branches.empty()) continue;
+        forest.batches.push_back(LSystemForest::Batch{int(forest.branches.size()), int(variants[v].branches.size()),
+                                                      int(forest.plants.size()), int(plantsOf[v].size())});
+        forest.branches.insert(forest.branches.end(), variants[v].branches.begin(), variants[v].branches.end());
+        forest.plants.insert(forest.plants.end(), plantsOf[v].begin(), plantsOf[v].end());
+    }
 }
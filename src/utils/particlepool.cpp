@@ -0,0 +1,379 @@
+#include "particlepool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PARTICLES_AVX 1
+#endif
+
+namespace {
+// spreads one seed over the lanes; xorshift lanes must never be zero
+uint32_t seedLane(uint32_t seed, int lane) {
+    uint32_t x = seed + 0x9e3779b9u * (lane + 1);
+    x = (x ^ (x >> 16)) * 0x85ebca6bu;
+    x = (x ^ (x >> 13)) * 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x != 0 ? x : 1;
+}
+}
+
+ParticlePool::ParticlePool(int capacity, uint32_t seed)
+    : m_capacity(capacity)
+{
+    for (std::vector<float>* stream: {&px, &py, &pz, &vx, &vy, &vz, &size, &life, &lifetime}) {
+        stream->resize(capacity);
+    }
+    for (int lane = 0; lane < 4; lane++) m_rng[lane] = seedLane(seed, lane);
+    m_moved.assign(capacity, 1);
+}
+
+void ParticlePool::random(float* dst, int n, float low, float high) {
+    // xorshift32 per lane; the top 24 bits become a float in [0, 1)
+    const float scale = (high - low) / 16777216.f;
+#ifdef PARTICLES_SSE
+    __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(m_rng));
+    __m128 vScale = _mm_set1_ps(scale), vLow = _mm_set1_ps(low);
+    alignas(16) float tail[4];
+    for (int i = 0; i < n; i += 4) {
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+        __m128 f = _mm_add_ps(vLow, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), vScale));
+        if (i + 4 <= n) {
+            _mm_storeu_ps(dst + i, f);
+        } else {
+            _mm_store_ps(tail, f);
+            std::copy(tail, tail + (n - i), dst + i);
+        }
+    }
+    _mm_store_si128(reinterpret_cast<__m128i*>(m_rng), x);
+#else
+    for (int i = 0; i < n; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint32_t& x = m_rng[lane];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            if (i + lane < n) dst[i + lane] = low + (x >> 8) * scale;
+        }
+    }
+#endif
+}
+
+int ParticlePool::spawn(int count, const SpawnRanges& ranges) {
+    count = std::min(count, m_capacity - m_count);
+    if (count <= 0) return 0;
+    int first = m_count;
+    random(&px[first], count, ranges.positionMin.x, ranges.positionMax.x);
+    random(&py[first], count, ranges.positionMin.y, ranges.positionMax.y);
+    random(&pz[first], count, ranges.positionMin.z, ranges.positionMax.z);
+    if (ranges.coneAngle >= 0.f) {
+        random(&vx[first], count, ranges.speedMin, ranges.speedMax);
+        random(&vy[first], count, std::cos(std::min(ranges.coneAngle, float(M_PI))), 1.f);
+        random(&vz[first], count, 0.f, 2.f * M_PI);
+        coneVelocities(first, count, ranges);
+    } else {
+        random(&vx[first], count, ranges.velocityMin.x, ranges.velocityMax.x);
+        random(&vy[first], count, ranges.velocityMin.y, ranges.velocityMax.y);
+        random(&vz[first], count, ranges.velocityMin.z, ranges.velocityMax.z);
+    }
+    random(&size[first], count, ranges.sizeMin, ranges.sizeMax);
+    random(&life[first], count, ranges.lifeMin, ranges.lifeMax);
+    std::copy(&life[first], &life[first] + count, &lifetime[first]);
+    std::fill(m_moved.begin() + first, m_moved.begin() + first + count, 1);
+    m_count += count;
+    m_sorted = false;
+    return count;
+}
+
+void ParticlePool::coneVelocities(int first, int count, const SpawnRanges& ranges) {
+    // a basis around the cone axis
+    glm::vec3 axis = glm::normalize(ranges.direction);
+    glm::vec3 side = glm::normalize(glm::cross(axis, std::abs(axis.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+    glm::vec3 up = glm::cross(side, axis);
+    for (int i = first; i < first + count; i++) {
+        // uniform cos(angle) is uniform over the spherical cap
+        float speed = vx[i], cosAngle = vy[i], azimuth = vz[i];
+        float sinAngle = std::sqrt(std::max(0.f, 1.f - cosAngle * cosAngle));
+        glm::vec3 v = speed * (cosAngle * axis + sinAngle * (std::cos(azimuth) * side + std::sin(azimuth) * up));
+        vx[i] = v.x; vy[i] = v.y; vz[i] = v.z;
+    }
+}
+
+void ParticlePool::update(float dt, const glm::vec3& acceleration, float velocityScale, float drag) {
+    integrate(dt, acceleration, velocityScale, std::max(0.f, 1.f - drag * dt));
+    removeDead();
+    m_sorted = false;
+}
+
+void ParticlePool::integrate(float dt, const glm::vec3& acceleration, float velocityScale, float damping) {
+    // explicit Euler: velocity first (accelerated, then damped), then position with the new velocity
+    const glm::vec3 dv = acceleration * dt;
+    const float step = dt * velocityScale;
+    int i = 0;
+#ifdef PARTICLES_AVX
+    {
+        __m256 vdt = _mm256_set1_ps(dt), vstep = _mm256_set1_ps(step), vdamp = _mm256_set1_ps(damping);
+        __m256 dvx = _mm256_set1_ps(dv.x), dvy = _mm256_set1_ps(dv.y), dvz = _mm256_set1_ps(dv.z);
+        for (; i + 8 <= m_count; i += 8) {
+            _mm256_storeu_ps(&life[i], _mm256_sub_ps(_mm256_loadu_ps(&life[i]), vdt));
+            __m256 velX = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&vx[i]), dvx), vdamp);
+            __m256 velY = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&vy[i]), dvy), vdamp);
+            __m256 velZ = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&vz[i]), dvz), vdamp);
+            _mm256_storeu_ps(&vx[i], velX);
+            _mm256_storeu_ps(&vy[i], velY);
+            _mm256_storeu_ps(&vz[i], velZ);
+            _mm256_storeu_ps(&px[i], _mm256_add_ps(_mm256_loadu_ps(&px[i]), _mm256_mul_ps(velX, vstep)));
+            _mm256_storeu_ps(&py[i], _mm256_add_ps(_mm256_loadu_ps(&py[i]), _mm256_mul_ps(velY, vstep)));
+            _mm256_storeu_ps(&pz[i], _mm256_add_ps(_mm256_loadu_ps(&pz[i]), _mm256_mul_ps(velZ, vstep)));
+        }
+    }
+#endif
+#ifdef PARTICLES_SSE
+    {
+        __m128 vdt = _mm_set1_ps(dt), vstep = _mm_set1_ps(step), vdamp = _mm_set1_ps(damping);
+        __m128 dvx = _mm_set1_ps(dv.x), dvy = _mm_set1_ps(dv.y), dvz = _mm_set1_ps(dv.z);
+        for (; i + 4 <= m_count; i += 4) {
+            _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), vdt));
+            __m128 velX = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vx[i]), dvx), vdamp);
+            __m128 velY = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vy[i]), dvy), vdamp);
+            __m128 velZ = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vz[i]), dvz), vdamp);
+            _mm_storeu_ps(&vx[i], velX);
+            _mm_storeu_ps(&vy[i], velY);
+            _mm_storeu_ps(&vz[i], velZ);
+            _mm_storeu_ps(&px[i], _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(velX, vstep)));
+            _mm_storeu_ps(&py[i], _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(velY, vstep)));
+            _mm_storeu_ps(&pz[i], _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(velZ, vstep)));
+        }
+    }
+#endif
+    for (; i < m_count; i++) {
+        life[i] -= dt;
+        vx[i] = (vx[i] + dv.x) * damping;
+        vy[i] = (vy[i] + dv.y) * damping;
+        vz[i] = (vz[i] + dv.z) * damping;
+        px[i] += vx[i] * step;
+        py[i] += vy[i] * step;
+        pz[i] += vz[i] * step;
+    }
+}
+
+void ParticlePool::removeDead() {
+    // the last live particle fills each hole; order does not matter for additive sprites
+    int i = 0;
+    while (i < m_count) {
+        if (life[i] > 0.f) {
+            i++;
+            continue;
+        }
+        int last = --m_count;
+        px[i] = px[last]; py[i] = py[last]; pz[i] = pz[last];
+        vx[i] = vx[last]; vy[i] = vy[last]; vz[i] = vz[last];
+        size[i] = size[last];
+        life[i] = life[last];
+        lifetime[i] = lifetime[last];
+        m_moved[i] = 1;
+    }
+}
+
+void ParticlePool::writePositionSize(float* dst, float rewind) const {
+    int i = 0;
+#ifdef PARTICLES_SSE
+    // four particles at a time: transposing the x, y, z and size rows gives four xyzs columns
+    __m128 back = _mm_set1_ps(rewind);
+    for (; i + 4 <= m_count; i += 4) {
+        __m128 r0 = _mm_sub_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(_mm_loadu_ps(&vx[i]), back));
+        __m128 r1 = _mm_sub_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(_mm_loadu_ps(&vy[i]), back));
+        __m128 r2 = _mm_sub_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(_mm_loadu_ps(&vz[i]), back));
+        __m128 r3 = _mm_loadu_ps(&size[i]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(dst + 4 * i, r0);
+        _mm_storeu_ps(dst + 4 * i + 4, r1);
+        _mm_storeu_ps(dst + 4 * i + 8, r2);
+        _mm_storeu_ps(dst + 4 * i + 12, r3);
+    }
+#endif
+    for (; i < m_count; i++) {
+        dst[4 * i] = px[i] - vx[i] * rewind;
+        dst[4 * i + 1] = py[i] - vy[i] * rewind;
+        dst[4 * i + 2] = pz[i] - vz[i] * rewind;
+        dst[4 * i + 3] = size[i];
+    }
+}
+
+namespace {
+// squared distances are never negative, so their bits sort like the floats; inverted for farthest first
+inline uint32_t farthestFirstKey(float dx, float dy, float dz) {
+    float d2 = dx * dx + dy * dy + dz * dz;
+    uint32_t bits;
+    std::memcpy(&bits, &d2, sizeof(bits));
+    return ~bits;
+}
+
+// insertion sort of nearly sorted pairs; gives up once more than budget elements had to move
+bool insertionSort(uint32_t* keys, uint32_t* values, int n, long long budget) {
+    for (int i = 1; i < n; i++) {
+        uint32_t key = keys[i], value = values[i];
+        int j = i;
+        while (j > 0 && keys[j - 1] > key) {
+            keys[j] = keys[j - 1];
+            values[j] = values[j - 1];
+            j--;
+        }
+        keys[j] = key;
+        values[j] = value;
+        budget -= i - j;
+        if (budget < 0) return false;
+    }
+    return true;
+}
+}
+
+void ParticlePool::radixSort(uint32_t* keys, uint32_t* values, int n, uint32_t* scratch) {
+    // least significant digit first, 11 bits a pass. One read up front counts all three digits,
+    // and a pass where every key has the same digit is skipped
+    if (n <= 0) return;
+    constexpr int BITS = 11, BUCKETS = 1 << BITS, PASSES = 3;
+    static thread_local std::vector<int> histograms(PASSES * BUCKETS);
+    std::fill(histograms.begin(), histograms.end(), 0);
+    for (int i = 0; i < n; i++) {
+        uint32_t key = keys[i];
+        histograms[key & (BUCKETS - 1)]++;
+        histograms[BUCKETS + ((key >> BITS) & (BUCKETS - 1))]++;
+        histograms[2 * BUCKETS + (key >> 2 * BITS)]++;
+    }
+
+    uint32_t* srcKeys = keys; uint32_t* srcValues = values;
+    uint32_t* dstKeys = scratch; uint32_t* dstValues = scratch + n;
+    for (int pass = 0; pass < PASSES; pass++) {
+        int shift = pass * BITS;
+        int* offsets = &histograms[pass * BUCKETS];
+        if (offsets[(srcKeys[0] >> shift) & (BUCKETS - 1)] == n) continue;
+        int sum = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            int count = offsets[b];
+            offsets[b] = sum;
+            sum += count;
+        }
+        for (int i = 0; i < n; i++) {
+            int slot = offsets[(srcKeys[i] >> shift) & (BUCKETS - 1)]++;
+            dstKeys[slot] = srcKeys[i];
+            dstValues[slot] = srcValues[i];
+        }
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+    if (srcKeys != keys) {
+        std::copy(srcKeys, srcKeys + n, keys);
+        std::copy(srcValues, srcValues + n, values);
+    }
+}
+
+void ParticlePool::permute(const uint32_t* order) {
+    m_gather.resize(m_capacity);
+    for (std::vector<float>* stream: {&px, &py, &pz, &vx, &vy, &vz, &size, &life, &lifetime}) {
+        const float* src = stream->data();
+        for (int i = 0; i < m_count; i++) m_gather[i] = src[order[i]];
+        // the gathered copy becomes the stream, and the old stream the next gather target
+        stream->swap(m_gather);
+    }
+}
+
+void ParticlePool::writeColors(uint32_t* dst, const glm::vec4& start, const glm::vec4& end) const {
+    auto channel = [](float c) { return uint32_t(std::clamp(c, 0.f, 1.f) * 255.f + 0.5f); };
+    for (int i = 0; i < m_count; i++) {
+        glm::vec4 c = glm::mix(end, start, std::max(life[i], 0.f) / lifetime[i]);
+        // bytes r, g, b, a in memory, as the GL_UNSIGNED_BYTE attribute reads them on little endian
+        dst[i] = channel(c.r) | channel(c.g) << 8 | channel(c.b) << 16 | channel(c.a) << 24;
+    }
+}
+
+bool ParticlePool::sortBackToFront(const glm::vec3& eye) {
+    // nothing moved, spawned or died and the eye is where it was: still in order
+    if (m_sorted && eye == m_sortedEye) return true;
+    m_sorted = true;
+    m_sortedEye = eye;
+
+    int n = m_count;
+    m_sortKeys.resize(n);
+    m_sortValues.resize(n);
+    m_sortScratch.resize(2 * n);
+    m_order.resize(n);
+    if (n < 2) {
+        std::fill(m_moved.begin(), m_moved.begin() + n, 0);
+        return true;
+    }
+
+    // particles that kept their place go first, in array order; moved ones after them
+    int clean = 0, moved = n;
+    for (int i = 0; i < n; i++) {
+        int slot = m_moved[i] ? --moved : clean++;
+        m_sortKeys[slot] = farthestFirstKey(px[i] - eye.x, py[i] - eye.y, pz[i] - eye.z);
+        m_sortValues[slot] = i;
+    }
+    int numMoved = n - clean;
+    std::fill(m_moved.begin(), m_moved.begin() + n, 0);
+
+    // a small camera or particle step only swaps near neighbours, so the kept ones are nearly
+    // sorted; a shift costs about a tenth of a radix sorted element, so give up after 8 per particle
+    bool incremental = numMoved <= n / 4 && insertionSort(m_sortKeys.data(), m_sortValues.data(), clean, 8LL * n);
+    if (!incremental) {
+        radixSort(m_sortKeys.data(), m_sortValues.data(), n, m_sortScratch.data());
+        permute(m_sortValues.data());
+        return false;
+    }
+    if (numMoved == 0) {
+        permute(m_sortValues.data());
+        return true;
+    }
+
+    uint32_t* movedKeys = m_sortKeys.data() + clean;
+    uint32_t* movedValues = m_sortValues.data() + clean;
+    radixSort(movedKeys, movedValues, numMoved, m_sortScratch.data());
+    int a = 0, b = 0;
+    for (int i = 0; i < n; i++) {
+        bool takeClean = b == numMoved || (a < clean && m_sortKeys[a] <= movedKeys[b]);
+        m_order[i] = takeClean ? m_sortValues[a++] : movedValues[b++];
+    }
+    permute(m_order.data());
+    return true;
+}
+
+ParticlePool::SortTimings ParticlePool::benchmarkSort(int count) {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+    SpawnRanges ranges{glm::vec3(-5.f), glm::vec3(5.f), glm::vec3(-0.3f), glm::vec3(0.3f), 0.03f, 0.1f, 4.f, 7.f};
+    SortTimings timings;
+
+    ParticlePool pool(count, 7);
+    pool.spawn(count, ranges);
+    // std::sort gets the same key + index pairs packed into one integer
+    std::vector<uint64_t> keys(count);
+    glm::vec3 eye(0.f, 0.f, 20.f);
+    for (int i = 0; i < count; i++) {
+        keys[i] = uint64_t(farthestFirstKey(pool.px[i] - eye.x, pool.py[i] - eye.y, pool.pz[i] - eye.z)) << 32 | uint32_t(i);
+    }
+    auto start = Clock::now();
+    std::sort(keys.begin(), keys.end());
+    timings.stdSort = ms(start);
+
+    start = Clock::now();
+    pool.sortBackToFront(eye);
+    timings.radix = ms(start);
+
+    // one 60 Hz step later: everything moved a little, the camera too, and a few particles respawned
+    pool.update(1.f / 60.f, glm::vec3(0.f, -9.81f, 0.f) * 0.01f, 5.f);
+    pool.spawn(count - pool.count(), ranges);
+    start = Clock::now();
+    timings.coherent = pool.sortBackToFront(eye + glm::vec3(0.05f, 0.f, 0.f));
+    timings.incremental = ms(start);
+    return timings;
+}
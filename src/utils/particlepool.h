@@ -0,0 +1,93 @@
+#ifndef PARTICLEPOOL_H
+#define PARTICLEPOOL_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Live particles as structure-of-arrays: particle i is element i of every stream, and
+// particles [0, count) are exactly the live ones. Dead particles are swap-removed, so the
+// streams never have holes, the update kernel runs over them 4 (SSE) or 8 (AVX, built with
+// -DPARTICLES_AVX=ON) at a time, and the instance buffer is a straight copy of the first
+// count entries.
+class ParticlePool
+{
+public:
+    // uniform ranges new particles are drawn from
+    struct SpawnRanges {
+        glm::vec3 positionMin, positionMax;
+        glm::vec3 velocityMin, velocityMax;
+        float sizeMin, sizeMax;
+        float lifeMin, lifeMax; // seconds
+        // with coneAngle >= 0 (radians) velocities instead point within coneAngle of direction,
+        // uniformly over that cap of the sphere, at a speed in [speedMin, speedMax]
+        glm::vec3 direction = glm::vec3(0.f, 1.f, 0.f);
+        float coneAngle = -1.f;
+        float speedMin = 0.f, speedMax = 0.f;
+    };
+
+    ParticlePool() = default;
+    ParticlePool(int capacity, uint32_t seed);
+
+    // adds up to count particles, fewer when the pool is full; returns how many were added
+    int spawn(int count, const SpawnRanges& ranges);
+    // ages every particle by dt, integrates velocity then position, and removes the dead ones;
+    // drag takes that fraction of the velocity away per second
+    void update(float dt, const glm::vec3& acceleration, float velocityScale, float drag = 0.f);
+    // interleaved x, y, z, size per live particle: the instance attribute layout of particles.vert.
+    // Positions are taken rewind seconds back along the current velocity, which for a rewind
+    // within the last update is where the particle was then
+    void writePositionSize(float* dst, float rewind = 0.f) const;
+    // RGBA8 per live particle, from start at spawn to end at death
+    void writeColors(uint32_t* dst, const glm::vec4& start, const glm::vec4& end) const;
+
+    // reorders the live particles farthest from eye first, for alpha blending. The order is kept
+    // between calls, so usually only the particles spawned or moved by a removal since the last
+    // sort are radix sorted and merged into the rest, which only need an insertion sort for how
+    // far they drifted. Returns false when that did not pay off and everything was radix sorted.
+    // Does nothing when neither the particles (spawn, update) nor the eye changed since the last sort.
+    bool sortBackToFront(const glm::vec3& eye);
+
+    // milliseconds for one full radix sort, one incremental sort a step later, and std::sort on
+    // the same keys, with count particles in a 10 unit cube; both radix times include the reorder
+    struct SortTimings {
+        double radix = 0, incremental = 0, stdSort = 0;
+        bool coherent = false; // whether the second sort took the incremental path
+    };
+    static SortTimings benchmarkSort(int count);
+
+    int count() const { return m_count; }
+    int capacity() const { return m_capacity; }
+
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> size;
+    std::vector<float> life;
+    std::vector<float> lifetime; // life at spawn
+
+private:
+    void integrate(float dt, const glm::vec3& acceleration, float velocityScale, float damping);
+    // turns the speed, angle and azimuth left in vx, vy, vz by random() into velocities in the cone
+    void coneVelocities(int first, int count, const SpawnRanges& ranges);
+    void removeDead();
+    // sorts n (key, value) pairs by key, ascending; scratch holds 2 * n entries
+    static void radixSort(uint32_t* keys, uint32_t* values, int n, uint32_t* scratch);
+    // particle i becomes particle order[i]
+    void permute(const uint32_t* order);
+    // fills dst[0, n) with uniform floats in [low, high)
+    void random(float* dst, int n, float low, float high);
+
+    int m_count = 0;
+    int m_capacity = 0;
+    // set for particles written since the last sort; everything else kept its relative order
+    std::vector<uint8_t> m_moved;
+    // whether the particles are still in order for m_sortedEye; spawn and update clear it
+    bool m_sorted = false;
+    glm::vec3 m_sortedEye = glm::vec3(0.f);
+    std::vector<uint32_t> m_sortKeys, m_sortValues, m_sortScratch, m_order;
+    std::vector<float> m_gather;
+    // four independent xorshift32 lanes, stepped together
+    alignas(16) uint32_t m_rng[4] = {1, 2, 3, 4};
+};
+
+#endif // PARTICLEPOOL_H
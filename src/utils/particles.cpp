@@ -1,63 +1,238 @@
 #include "realtime.h"
 
-// Finds a Particle in ParticlesContainer which isn't used yet.
-// (i.e. life < 0);
-int Realtime::FindUnusedParticle() {
-
-    for (int i = m_lastUsedParticle; i < m_maxNumParticles; i++){
-        if (m_particles[i].life < 0){
-            m_lastUsedParticle = i;
-            return i;
+#include <chrono>
+#include <filesystem>
+#include <QImage>
+#include "settings.h"
+#include "utils/stats.h"
+
+namespace {
+glm::vec3 maxScale(const glm::mat4& ctm) {
+    return glm::vec3(glm::length(glm::vec3(ctm[0])), glm::length(glm::vec3(ctm[1])), glm::length(glm::vec3(ctm[2])));
+}
+}
+
+void Realtime::createEmitters(const std::string& scenePath) {
+    m_emitters.clear();
+    // PARTICLE_COUNT overrides every emitter's pool size, e.g. to measure the update kernel with a million particles
+    int countOverride = 0;
+    if (const char* env = std::getenv("PARTICLE_COUNT")) countOverride = std::max(1, std::atoi(env));
+
+    std::filesystem::path basepath = std::filesystem::path(scenePath).parent_path();
+    std::vector<std::string> spriteFiles;
+    uint32_t seed = 1;
+    for (const RenderEmitterData& data: m_renderdata.emitters) {
+        ParticleEmitter emitter;
+        emitter.settings = data.emitter;
+        emitter.ctm = data.ctm;
+        SceneEmitter& e = emitter.settings;
+        if (countOverride > 0) {
+            // keep the pool as full as before
+            e.rate *= float(countOverride) / e.maxParticles;
+            e.maxParticles = countOverride;
+        }
+
+        emitter.spawn = ParticlePool::SpawnRanges{-e.spawnExtent, e.spawnExtent, glm::vec3(0.f), glm::vec3(0.f),
+                                                  e.size.x, e.size.y, e.lifetime.x, e.lifetime.y};
+        emitter.spawn.direction = e.direction;
+        emitter.spawn.coneAngle = e.coneAngle;
+        emitter.spawn.speedMin = e.speed.x;
+        emitter.spawn.speedMax = e.speed.y;
+
+        // the farthest a particle gets: the spawn box, then flying straight out and falling for its whole life
+        glm::vec3 scale = maxScale(data.ctm);
+        float reach = glm::length(e.spawnExtent * scale) + e.speed.y * e.lifetime.y * glm::max(scale.x, glm::max(scale.y, scale.z))
+                      + 0.5f * glm::length(e.gravity) * e.lifetime.y * e.lifetime.y + e.size.y;
+        emitter.center = glm::vec3(data.ctm * glm::vec4(0.f, 0.f, 0.f, 1.f));
+        emitter.radius = reach;
+
+        if (!e.textureFile.empty()) {
+            auto found = std::find(spriteFiles.begin(), spriteFiles.end(), e.textureFile);
+            emitter.spriteLayer = found - spriteFiles.begin();
+            if (found == spriteFiles.end()) spriteFiles.push_back(e.textureFile);
         }
+
+        // start in the steady state instead of filling up from nothing
+        emitter.pool = ParticlePool(e.maxParticles, seed++);
+        int initial = std::min<float>(e.maxParticles, e.rate * 0.5f * (e.lifetime.x + e.lifetime.y));
+        int spawned = emitter.pool.spawn(initial, emitter.spawn);
+        ParticlePool& pool = emitter.pool;
+        for (int i = pool.count() - spawned; i < pool.count(); i++) {
+            glm::vec3 p(data.ctm * glm::vec4(pool.px[i], pool.py[i], pool.pz[i], 1.f));
+            glm::vec3 v(glm::mat3(data.ctm) * glm::vec3(pool.vx[i], pool.vy[i], pool.vz[i]));
+            pool.px[i] = p.x; pool.py[i] = p.y; pool.pz[i] = p.z;
+            pool.vx[i] = v.x; pool.vy[i] = v.y; pool.vz[i] = v.z;
+            // spread over their lives, as if they had been spawned at the rate all along
+            pool.life[i] *= float(i + 1) / (spawned + 1);
+        }
+        m_emitters.push_back(std::move(emitter));
     }
 
-    for(int i = 0; i < m_lastUsedParticle; i++){
-        if (m_particles[i].life < 0){
-            m_lastUsedParticle = i;
-            return i;
+    // one layer per distinct sprite file; a texture array so every emitter still shares the draw
+    if (m_particleSprites != 0) glDeleteTextures(1, &m_particleSprites);
+    glGenTextures(1, &m_particleSprites);
+    glActiveTexture(GL_TEXTURE0 + PARTICLE_SPRITE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_particleSprites);
+    int layers = std::max<int>(1, spriteFiles.size());
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, layers, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    for (int layer = 0; layer < spriteFiles.size(); layer++) {
+        QString path = QString((basepath / spriteFiles[layer]).string().c_str());
+        QImage image(path);
+        if (image.isNull()) {
+            std::cout << "No such particle sprite: " << spriteFiles[layer] << std::endl;
+            image = QImage(PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, QImage::Format_RGBA8888);
+            image.fill(Qt::white);
         }
+        image = image.scaled(PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                    .convertToFormat(QImage::Format_RGBA8888).mirrored();
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, image.bits());
+    }
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glUseProgram(m_particleShader);
+    glUniform1i(glGetUniformLocation(m_particleShader, "sprites"), PARTICLE_SPRITE_TEXTURE_UNIT);
+    glUseProgram(0);
+
+    // the GPU path runs the first emitter in its own space, with the cone widened to the box around it
+    m_maxNumParticles = 0;
+    if (!m_emitters.empty()) {
+        const ParticleEmitter& first = m_emitters.front();
+        const SceneEmitter& e = first.settings;
+        m_particleCtm = first.ctm;
+        m_particleSpawn = first.spawn;
+        glm::vec3 axis = glm::normalize(e.direction);
+        glm::vec3 lateral(e.speed.y * std::sin(std::min(e.coneAngle, float(M_PI) / 2.f)));
+        m_particleSpawn.velocityMin = glm::min(axis * e.speed.x, axis * e.speed.y) - lateral;
+        m_particleSpawn.velocityMax = glm::max(axis * e.speed.x, axis * e.speed.y) + lateral;
+        m_particleGravity = glm::inverse(glm::mat3(first.ctm)) * e.gravity;
+        m_maxNumParticles = e.maxParticles;
     }
+    deleteGpuParticles();
+
+    int total = 0;
+    for (const ParticleEmitter& emitter: m_emitters) total += emitter.settings.maxParticles;
+    std::cout << "Particles: " << m_emitters.size() << " emitters, up to " << total << " particles, "
+              << spriteFiles.size() << " sprites" << std::endl;
+}
 
-    return 0; // All particles are taken, override the first one
+void Realtime::cullEmitters() {
+    // an emitter out of view is paused rather than stepped; it picks up where it left off
+    Frustum frustum(m_simViewProj);
+    m_emitterOrder.clear();
+    for (int i = 0; i < m_emitters.size(); i++) {
+        ParticleEmitter& emitter = m_emitters[i];
+        emitter.visible = frustum.intersectsSphere(emitter.center, emitter.radius);
+        if (emitter.visible) m_emitterOrder.push_back(i);
+    }
+    // emitters overlap rarely, so drawing them farthest first is enough to keep the blending right
+    std::sort(m_emitterOrder.begin(), m_emitterOrder.end(), [this](int a, int b) {
+        return glm::distance(m_emitters[a].center, m_simEye) > glm::distance(m_emitters[b].center, m_simEye);
+    });
+}
+
+void Realtime::stepEmitter(ParticleEmitter& emitter, float dt) {
+    const SceneEmitter& e = emitter.settings;
+    ParticlePool& pool = emitter.pool;
+
+    pool.update(dt, e.gravity, 1.f, e.drag);
+    // new particles at the emitter's rate, from its space into the world
+    emitter.spawnDebt += e.rate * dt;
+    int wanted = int(emitter.spawnDebt);
+    emitter.spawnDebt -= wanted;
+    int spawned = pool.spawn(wanted, emitter.spawn);
+    for (int i = pool.count() - spawned; i < pool.count(); i++) {
+        glm::vec3 p(emitter.ctm * glm::vec4(pool.px[i], pool.py[i], pool.pz[i], 1.f));
+        glm::vec3 v(glm::mat3(emitter.ctm) * glm::vec3(pool.vx[i], pool.vy[i], pool.vz[i]));
+        pool.px[i] = p.x; pool.py[i] = p.y; pool.pz[i] = p.z;
+        pool.vx[i] = v.x; pool.vy[i] = v.y; pool.vz[i] = v.z;
+    }
+}
+
+void Realtime::stepParticles(const SimStep& step) {
+    if (settings.gpuParticles) return;
+    cullEmitters();
+
+    // only the pools and the back frame are touched, nothing the frame being drawn reads
+    m_threadPool->parallelFor(m_emitterOrder.size(), [this, &step](int k) {
+        ParticleEmitter& emitter = m_emitters[m_emitterOrder[k]];
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < step.steps; i++) stepEmitter(emitter, step.dt);
+        auto simulated = std::chrono::steady_clock::now();
+
+        // blended sprites have to be drawn back to front
+        if (settings.sortParticles) {
+            m_particleSortsCoherent += emitter.pool.sortBackToFront(m_simEye);
+            m_particleSorts++;
+            m_particleSortNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - simulated).count();
+        }
+        m_particleStatNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(simulated - start).count();
+    });
+
+    // positions + sizes, colors and sprite layers of every visible emitter, in draw order. The
+    // positions are moved back along the velocity of the last step, which puts them where they
+    // were alpha of the way through it
+    ParticleFrame& frame = m_particleFrames[1 - m_particleFront];
+    int count = 0;
+    for (int i: m_emitterOrder) count += m_emitters[i].pool.count();
+    frame.posSize.resize(4 * count);
+    frame.colors.resize(count);
+    frame.layers.resize(count);
+    frame.emitters = m_emitterOrder.size();
+    int written = 0;
+    for (int i: m_emitterOrder) {
+        const ParticleEmitter& emitter = m_emitters[i];
+        int n = emitter.pool.count();
+        emitter.pool.writePositionSize(frame.posSize.data() + 4 * written, (1.f - step.alpha) * step.dt);
+        emitter.pool.writeColors(frame.colors.data() + written, emitter.settings.colorStart, emitter.settings.colorEnd);
+        std::fill(frame.layers.begin() + written, frame.layers.begin() + written + n, emitter.spriteLayer);
+        written += n;
+    }
+}
+
+void Realtime::publishParticles(const SimStep& step) {
+    m_particleFront = 1 - m_particleFront;
+    if (settings.gpuParticles) m_gpuParticleSteps += step.steps;
 }
 
 void Realtime::particleUpdate() {
-    m_numParticles = 0;
-
-    for (int i = 0; i < m_maxNumParticles; i++) {
-        Particle& p = m_particles[i]; // shortcut
-
-        if (p.life > 0.0f) {
-            // Decrease life
-            p.life -= m_dt;
-
-            if (p.life > 0.0f) {
-                // Simulate simple physics : gravity only, no collisions
-                p.velocity += glm::vec3(0.0f, -9.81f, 0.0f) * (float)m_dt * 0.01f;
-                //commented out for debugging
-                p.pos += p.velocity * (float)m_dt * m_particleVelocityGlobal;
-                p.cameraDistance = glm::length(p.pos - glm::vec3(0, 0, 0));
-                //ParticlesContainer[i].pos += glm::vec3(0.0f,10.0f, 0.0f) * (float)delta;
-
-                // Fill the GPU buffer
-                for (int j = 0; j < 3; j++) {
-                    m_particulePositionSizeData[4 * m_numParticles + j] = p.pos[j];
-                }
-
-                m_particulePositionSizeData[4 * m_numParticles + 3] = p.size;
-
-                //for (int j = 0; j < 4; j++) {
-                //    m_particuleColorData[4 * m_numParticles + j] = p.color[j];
-                //}
-            } else {
-                // Particles that just died will be put at the end of the buffer in SortParticles();
-                p.cameraDistance = -1.0f;
-            }
+    // Fill the GPU buffer: one allocation holds the published positions + sizes, then colors, then sprite layers
+    const ParticleFrame& frame = m_particleFrames[m_particleFront];
+    m_numParticles = frame.layers.size();
+    StreamBuffer::Allocation allocation = m_streamBuffer.allocate(m_numParticles * 6 * sizeof(GLfloat), 4 * sizeof(GLfloat));
+    if (allocation.data == nullptr) {
+        m_numParticles = 0;
+    } else {
+        float* posSize = static_cast<float*>(allocation.data);
+        uint32_t* colors = reinterpret_cast<uint32_t*>(posSize + 4 * m_numParticles);
+        float* layers = reinterpret_cast<float*>(colors + m_numParticles);
+        std::copy(frame.posSize.begin(), frame.posSize.end(), posSize);
+        std::copy(frame.colors.begin(), frame.colors.end(), colors);
+        std::copy(frame.layers.begin(), frame.layers.end(), layers);
+        m_streamBuffer.commit(allocation);
+        m_particleInstanceOffset = allocation.offset;
+    }
 
-            m_numParticles++;
-        } else {
-            m_particles[i] = Particle(glm::vec3(0, 0, 0));
-            m_numParticles++;
+    if (++m_particleStatFrames == STATS_PERIOD_FRAMES) {
+        if (statsEnabled()) {
+            std::cout << "Particles: " << m_numParticles << " live in " << frame.emitters << "/" << m_emitters.size()
+                      << " visible emitters, update " << m_particleStatNanos / STATS_PERIOD_FRAMES / 1000.f << " us/frame";
+            if (settings.sortParticles) {
+                std::cout << ", sort " << m_particleSortNanos / STATS_PERIOD_FRAMES / 1000.f << " us/frame ("
+                          << m_particleSortsCoherent << "/" << m_particleSorts << " incremental)";
+            }
+            std::cout << std::endl;
         }
+        m_particleStatFrames = 0;
+        m_particleStatNanos = 0;
+        m_particleSortNanos = 0;
+        m_particleSorts = 0;
+        m_particleSortsCoherent = 0;
     }
 }
@@ -0,0 +1,74 @@
+#include "quadtreeallocator.h"
+#include <algorithm>
+
+QuadtreeAllocator::QuadtreeAllocator(int size, int minSize)
+    : m_size(size)
+    , m_minSize(minSize)
+{
+    for (int nodeSize = size; nodeSize >= minSize; nodeSize /= 2) {
+        int dim = size / nodeSize;
+        m_levels.emplace_back(dim * dim, FREE);
+    }
+}
+
+void QuadtreeAllocator::clear() {
+    for (std::vector<State>& level: m_levels) {
+        std::fill(level.begin(), level.end(), FREE);
+    }
+    m_usedArea = 0;
+}
+
+bool QuadtreeAllocator::allocate(int size, Rect& out) {
+    int target = 0;
+    for (int nodeSize = m_size; nodeSize / 2 >= size && nodeSize / 2 >= m_minSize; nodeSize /= 2) target++;
+    if (m_levels.empty() || (m_size >> target) < size) return false;
+
+    // first try to fit into nodes that are already split, so whole free quadrants stay free
+    // for later large requests; only then split a free node
+    if (!allocateIn(0, 0, 0, target, false, out) && !allocateIn(0, 0, 0, target, true, out)) return false;
+    m_usedArea += out.size * out.size;
+    return true;
+}
+
+bool QuadtreeAllocator::allocateIn(int level, int x, int y, int target, bool splitFree, Rect& out) {
+    State& state = node(level, x, y);
+    if (state == USED) return false;
+    if (level == target) {
+        if (state != FREE) return false;
+        state = USED;
+        int nodeSize = m_size >> level;
+        out = Rect{x * nodeSize, y * nodeSize, nodeSize};
+        return true;
+    }
+    if (state == FREE) {
+        if (!splitFree) return false;
+        state = SPLIT;
+    }
+    for (int child = 0; child < 4; child++) {
+        if (allocateIn(level + 1, 2 * x + (child & 1), 2 * y + (child >> 1), target, splitFree, out)) return true;
+    }
+    return false;
+}
+
+void QuadtreeAllocator::free(const Rect& rect) {
+    if (rect.size == 0) return;
+    int level = 0;
+    while ((m_size >> level) > rect.size) level++;
+    int x = rect.x / rect.size, y = rect.y / rect.size;
+    node(level, x, y) = FREE;
+    m_usedArea -= rect.size * rect.size;
+
+    // merge upwards while all four siblings are free
+    while (level > 0) {
+        int px = x / 2, py = y / 2;
+        bool allFree = true;
+        for (int child = 0; child < 4; child++) {
+            allFree = allFree && node(level, 2 * px + (child & 1), 2 * py + (child >> 1)) == FREE;
+        }
+        if (!allFree) break;
+        level--;
+        x = px;
+        y = py;
+        node(level, x, y) = FREE;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef QUADTREEALLOCATOR_H
+#define QUADTREEALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+
+// Hands out power-of-two squares of a size x size area (e.g. a shadow atlas). Every node of
+// the quadtree is free, split into four children, or used; freeing a square merges it back
+// with its siblings, so the area never fragments into pieces smaller than it has to.
+class QuadtreeAllocator
+{
+public:
+    struct Rect {
+        int x = 0;
+        int y = 0;
+        int size = 0;
+    };
+
+    QuadtreeAllocator() = default;
+    QuadtreeAllocator(int size, int minSize);
+
+    // size is rounded up to a power of two no smaller than minSize
+    bool allocate(int size, Rect& out);
+    void free(const Rect& rect);
+    void clear();
+
+    int size() const { return m_size; }
+    int usedArea() const { return m_usedArea; }
+
+private:
+    enum State : uint8_t { FREE, SPLIT, USED };
+
+    State& node(int level, int x, int y) { return m_levels[level][y * (1 << level) + x]; }
+    bool allocateIn(int level, int x, int y, int target, bool splitFree, Rect& out);
+
+    int m_size = 0;
+    int m_minSize = 0;
+    int m_usedArea = 0;
+    // m_levels[l] is the (2^l)^2 grid of nodes of size m_size >> l
+    std::vector<std::vector<State>> m_levels;
+};
+
+#endif // QUADTREEALLOCATOR_H
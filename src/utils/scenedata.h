@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -21,6 +23,13 @@ enum class PrimitiveType {
     PRIMITIVE_MESH
 };
 
+// Where a skinned mesh's vertices get deformed: in anim.vert, or on the CPU with one of two kernels
+enum class SkinningMode {
+    SKINNING_GPU,
+    SKINNING_CPU_LINEAR,
+    SKINNING_CPU_DUAL_QUATERNION
+};
+
 // Enum of the types of transformations that can be applied
 enum class TransformationType {
     TRANSFORMATION_TRANSLATE,
@@ -149,6 +158,7 @@ struct ScenePrimitive {
     PrimitiveType type;
     SceneMaterial material;
     std::string meshfile; // Used for triangle meshes
+    SkinningMode skinning = SkinningMode::SKINNING_GPU; // Only applicable to animated meshes
 };
 
 // Struct which contains data for a transformation.
@@ -162,10 +172,59 @@ struct SceneTransformation {
     glm::mat4 matrix;    // Only applicable when transforming by a custom matrix. This is that custom matrix.
 };
 
+// Struct which contains data for a particle emitter, in the space of its group
+struct SceneEmitter {
+    float rate = 30.f;                      // particles spawned per second
+    int maxParticles = 200;                 // the pool never holds more than this
+    glm::vec2 lifetime = glm::vec2(4, 7);   // seconds, uniform in [x, y]
+    glm::vec3 spawnExtent = glm::vec3(0.f); // half size of the box particles appear in
+    glm::vec3 direction = glm::vec3(0, 1, 0);
+    float coneAngle = 0.f;                  // in RADIANS; velocities lie within this of direction
+    glm::vec2 speed = glm::vec2(1, 1);
+    glm::vec2 size = glm::vec2(0.05f, 0.1f);
+    glm::vec3 gravity = glm::vec3(0.f);     // acceleration in world space
+    float drag = 0.f;                       // fraction of velocity lost per second
+    SceneColor colorStart = SceneColor(1);  // color over life, from spawn to death
+    SceneColor colorEnd = SceneColor(1);
+    std::string textureFile;                // sprite, relative to the scene file; round dots when empty
+};
+
+// One production of an L-system plant. A predecessor may have several: those whose condition
+// holds for the module being rewritten are candidates, and one of them is picked by weight.
+struct ScenePlantRule {
+    std::string predecessor; // a symbol, with formal parameters for parametric rules, e.g. "A(l,w)"
+    std::string successor;   // modules, whose parameters are expressions of those, e.g. "F(l)[+A(l*0.7,w)]"
+    std::string condition;   // an expression of the formal parameters; empty always holds
+    float weight = 1.f;
+    bool operator==(const ScenePlantRule&) const = default;
+};
+
+// Struct which contains data for an L-system plant, or a scattered stand of them, in the space of its group.
+// Plants grow up y in their xy plane; F draws a segment, + and - turn, [ and ] push and pop a branch.
+struct ScenePlant {
+    std::string axiom;
+    std::vector<ScenePlantRule> rules;
+    int iterations = 3;
+    float angle = 25.f * M_PI / 180.f;     // in RADIANS; the turn of + and - without a parameter
+    float length = 0.25f;                  // of a segment drawn by F, F(x) draws x of them
+    float width = 0.15f;                   // segment thickness, relative to its length
+    float scaleProgression = 1.f;          // every branch is this much smaller than its parent
+    SceneColor color = SceneColor(0.3f, 1.f, 0.3f, 1.f);
+    SceneColor leafColor = SceneColor(0.35f, 0.7f, 0.25f, 1.f);
+    uint32_t seed = 1;                     // picks the productions of stochastic rules, and the scatter
+    int variants = 1;                      // distinct plants generated, shared by every instance
+    int count = 1;                         // instances scattered; more than one also turns each about y
+    glm::vec2 scatterExtent = glm::vec2(0.f); // half size of the x by z rectangle they are placed in
+    glm::vec2 plantScale = glm::vec2(1.f);    // each instance is scaled uniformly within [x, y]
+    bool operator==(const ScenePlant&) const = default;
+};
+
 // Struct which represents a node in the scene graph/tree, to be parsed by the student's `SceneParser`.
 struct SceneNode {
     std::vector<SceneTransformation*> transformations; // Note the order of transformations described in lab 5
     std::vector<ScenePrimitive*> primitives;
     std::vector<SceneLight*> lights;
+    std::vector<SceneEmitter*> emitters;
+    std::vector<ScenePlant*> plants;
     std::vector<SceneNode*> children;
 };
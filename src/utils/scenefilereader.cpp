@@ -43,8 +43,18 @@ ScenefileReader::~ScenefileReader() {
         {
             delete (m_nodes[node])->primitives[i];
         }
+        for (size_t i = 0; i < (m_nodes[node])->emitters.size(); i++)
+        {
+            delete (m_nodes[node])->emitters[i];
+        }
+        for (size_t i = 0; i < (m_nodes[node])->plants.size(); i++)
+        {
+            delete (m_nodes[node])->plants[i];
+        }
         (m_nodes[node])->transformations.clear();
         (m_nodes[node])->primitives.clear();
+        (m_nodes[node])->emitters.clear();
+        (m_nodes[node])->plants.clear();
         (m_nodes[node])->children.clear();
         delete m_nodes[node];
     }
@@ -580,7 +590,7 @@ bool ScenefileReader::parseTemplateGroupData(const QJsonObject &templateGroup) {
  * NAME OF NODE CANNOT REFERENCE TEMPLATE NODE
  */
 bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node) {
-    QStringList optionalFields = {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "groups"};
+    QStringList optionalFields = {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "emitters", "plants", "groups"};
     QStringList allFields = optionalFields;
     for (auto &field : object.keys()) {
         if (!allFields.contains(field)) {
@@ -753,6 +763,44 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
         }
     }
 
+    // parse particle emitters if any
+    if (object.contains("emitters")) {
+        if (!object["emitters"].isArray()) {
+            std::cout << "group emitters must be of type array" << std::endl;
+            return false;
+        }
+        QJsonArray emittersArray = object["emitters"].toArray();
+        for (auto emitter : emittersArray) {
+            if (!emitter.isObject()) {
+                std::cout << "emitter must be of type object" << std::endl;
+                return false;
+            }
+
+            if (!parseEmitter(emitter.toObject(), node)) {
+                return false;
+            }
+        }
+    }
+
+    // parse L-system plants if any
+    if (object.contains("plants")) {
+        if (!object["plants"].isArray()) {
+            std::cout << "group plants must be of type array" << std::endl;
+            return false;
+        }
+        QJsonArray plantsArray = object["plants"].toArray();
+        for (auto plant : plantsArray) {
+            if (!plant.isObject()) {
+                std::cout << "plant must be of type object" << std::endl;
+                return false;
+            }
+
+            if (!parsePlant(plant.toObject(), node)) {
+                return false;
+            }
+        }
+    }
+
     // parse children groups if any
     if (object.contains("groups")) {
         if (!parseGroups(object["groups"], node)) {
@@ -810,7 +858,7 @@ bool ScenefileReader::parsePrimitive(const QJsonObject &prim, SceneNode *node) {
     QStringList requiredFields = {"type"};
     QStringList optionalFields = {
         "meshFile", "ambient", "diffuse", "specular", "reflective", "transparent", "shininess", "ior",
-        "blend", "textureFile", "textureU", "textureV", "bumpMapFile", "bumpMapU", "bumpMapV", "isScrolling"};
+        "blend", "textureFile", "textureU", "textureV", "bumpMapFile", "bumpMapU", "bumpMapV", "isScrolling", "skinning"};
 
     QStringList allFields = requiredFields + optionalFields;
     for (auto field : prim.keys()) {
@@ -864,6 +912,24 @@ bool ScenefileReader::parsePrimitive(const QJsonObject &prim, SceneNode *node) {
 
         std::filesystem::path relativePath(prim["meshFile"].toString().toStdString());
         primitive->meshfile = (basepath / relativePath).string();
+
+        if (prim.contains("skinning")) {
+            if (!prim["skinning"].isString()) {
+                std::cout << "primitive skinning must be of type string" << std::endl;
+                return false;
+            }
+            std::string skinning = prim["skinning"].toString().toStdString();
+            if (skinning == "gpu")
+                primitive->skinning = SkinningMode::SKINNING_GPU;
+            else if (skinning == "linear")
+                primitive->skinning = SkinningMode::SKINNING_CPU_LINEAR;
+            else if (skinning == "dualQuaternion")
+                primitive->skinning = SkinningMode::SKINNING_CPU_DUAL_QUATERNION;
+            else {
+                std::cout << "unknown skinning mode \"" << skinning << "\"" << std::endl;
+                return false;
+            }
+        }
     }
     else {
         std::cout << "unknown primitive type \"" << primType << "\"" << std::endl;
@@ -1050,3 +1116,186 @@ bool ScenefileReader::parsePrimitive(const QJsonObject &prim, SceneNode *node) {
 
     return true;
 }
+
+namespace {
+// reads a number (n == 1) or an array of n numbers into out; object names the kind of object in messages
+bool readObjectFloats(const QJsonObject &data, const char *object, const char *field, float *out, int n) {
+    QJsonValue value = data[field];
+    if (n == 1) {
+        if (!value.isDouble()) {
+            std::cout << object << " " << field << " must be of type float" << std::endl;
+            return false;
+        }
+        out[0] = value.toDouble();
+        return true;
+    }
+    if (!value.isArray()) {
+        std::cout << object << " " << field << " must be of type array" << std::endl;
+        return false;
+    }
+    QJsonArray array = value.toArray();
+    if (array.size() != n) {
+        std::cout << object << " " << field << " must have " << n << " elements" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!array[i].isDouble()) {
+            std::cout << object << " " << field << " must contain floating-point values" << std::endl;
+            return false;
+        }
+        out[i] = array[i].toDouble();
+    }
+    return true;
+}
+
+// reads an integer field into out
+bool readObjectInt(const QJsonObject &data, const char *object, const char *field, int *out) {
+    if (!data[field].isDouble()) {
+        std::cout << object << " " << field << " must be of type integer" << std::endl;
+        return false;
+    }
+    *out = data[field].toInt();
+    return true;
+}
+
+// reads a string field into out
+bool readObjectString(const QJsonObject &data, const char *object, const char *field, std::string *out) {
+    if (!data[field].isString()) {
+        std::cout << object << " " << field << " must be of type string" << std::endl;
+        return false;
+    }
+    *out = data[field].toString().toStdString();
+    return true;
+}
+}
+
+/**
+ * Parse an emitter object into node. Every field is optional and falls back to SceneEmitter's defaults.
+ */
+bool ScenefileReader::parseEmitter(const QJsonObject &emitterData, SceneNode *node) {
+    QStringList optionalFields = {
+        "rate", "maxParticles", "lifetime", "spawnBox", "direction", "coneAngle", "speed", "size",
+        "gravity", "drag", "colorStart", "colorEnd", "textureFile"};
+    for (auto &field : emitterData.keys()) {
+        if (!optionalFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on emitter object" << std::endl;
+            return false;
+        }
+    }
+
+    SceneEmitter *emitter = new SceneEmitter();
+    node->emitters.push_back(emitter);
+
+    if (emitterData.contains("rate") && !readObjectFloats(emitterData, "emitter", "rate", &emitter->rate, 1)) return false;
+    if (emitterData.contains("maxParticles") && !readObjectInt(emitterData, "emitter", "maxParticles", &emitter->maxParticles)) return false;
+    if (emitterData.contains("lifetime") && !readObjectFloats(emitterData, "emitter", "lifetime", &emitter->lifetime[0], 2)) return false;
+    if (emitterData.contains("spawnBox") && !readObjectFloats(emitterData, "emitter", "spawnBox", &emitter->spawnExtent[0], 3)) return false;
+    if (emitterData.contains("direction") && !readObjectFloats(emitterData, "emitter", "direction", &emitter->direction[0], 3)) return false;
+    if (emitterData.contains("coneAngle")) {
+        if (!readObjectFloats(emitterData, "emitter", "coneAngle", &emitter->coneAngle, 1)) return false;
+        emitter->coneAngle *= M_PI / 180.f;
+    }
+    if (emitterData.contains("speed") && !readObjectFloats(emitterData, "emitter", "speed", &emitter->speed[0], 2)) return false;
+    if (emitterData.contains("size") && !readObjectFloats(emitterData, "emitter", "size", &emitter->size[0], 2)) return false;
+    if (emitterData.contains("gravity") && !readObjectFloats(emitterData, "emitter", "gravity", &emitter->gravity[0], 3)) return false;
+    if (emitterData.contains("drag") && !readObjectFloats(emitterData, "emitter", "drag", &emitter->drag, 1)) return false;
+    if (emitterData.contains("colorStart") && !readObjectFloats(emitterData, "emitter", "colorStart", &emitter->colorStart[0], 4)) return false;
+    if (emitterData.contains("colorEnd") && !readObjectFloats(emitterData, "emitter", "colorEnd", &emitter->colorEnd[0], 4)) return false;
+    if (emitterData.contains("textureFile") && !readObjectString(emitterData, "emitter", "textureFile", &emitter->textureFile)) return false;
+
+    if (glm::length(emitter->direction) == 0.f) {
+        std::cout << "emitter direction must not be zero" << std::endl;
+        return false;
+    }
+    emitter->direction = glm::normalize(emitter->direction);
+    if (emitter->maxParticles < 1 || emitter->rate < 0.f || emitter->lifetime.x <= 0.f || emitter->lifetime.y < emitter->lifetime.x) {
+        std::cout << "emitter needs maxParticles >= 1, rate >= 0 and 0 < lifetime[0] <= lifetime[1]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Parse a plant object into node. The axiom and rules are required, everything else falls back to
+ * ScenePlant's defaults. Each rule is an object with a predecessor and successor, and optionally a
+ * weight (for stochastic rules) and a condition (for parametric ones).
+ */
+bool ScenefileReader::parsePlant(const QJsonObject &plantData, SceneNode *node) {
+    QStringList requiredFields = {"axiom", "rules"};
+    QStringList optionalFields = {
+        "iterations", "angle", "length", "width", "scaleProgression", "color", "leafColor", "seed", "variants",
+        "count", "scatterExtent", "plantScale"};
+    QStringList allFields = requiredFields + optionalFields;
+    for (auto &field : requiredFields) {
+        if (!plantData.contains(field)) {
+            std::cout << "missing required field \"" << field.toStdString() << "\" on plant object" << std::endl;
+            return false;
+        }
+    }
+    for (auto &field : plantData.keys()) {
+        if (!allFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on plant object" << std::endl;
+            return false;
+        }
+    }
+
+    ScenePlant *plant = new ScenePlant();
+    node->plants.push_back(plant);
+
+    if (!readObjectString(plantData, "plant", "axiom", &plant->axiom)) return false;
+    if (!plantData["rules"].isArray()) {
+        std::cout << "plant rules must be of type array" << std::endl;
+        return false;
+    }
+    for (auto ruleValue : plantData["rules"].toArray()) {
+        if (!ruleValue.isObject()) {
+            std::cout << "plant rule must be of type object" << std::endl;
+            return false;
+        }
+        QJsonObject ruleData = ruleValue.toObject();
+        for (auto &field : ruleData.keys()) {
+            if (field != "predecessor" && field != "successor" && field != "weight" && field != "condition") {
+                std::cout << "unknown field \"" << field.toStdString() << "\" on plant rule" << std::endl;
+                return false;
+            }
+        }
+        ScenePlantRule rule;
+        if (!readObjectString(ruleData, "plant rule", "predecessor", &rule.predecessor)) return false;
+        if (!readObjectString(ruleData, "plant rule", "successor", &rule.successor)) return false;
+        if (ruleData.contains("condition") && !readObjectString(ruleData, "plant rule", "condition", &rule.condition)) return false;
+        if (ruleData.contains("weight") && !readObjectFloats(ruleData, "plant rule", "weight", &rule.weight, 1)) return false;
+        if (rule.weight < 0.f) {
+            std::cout << "plant rule weight must not be negative" << std::endl;
+            return false;
+        }
+        plant->rules.push_back(rule);
+    }
+
+    if (plantData.contains("iterations") && !readObjectInt(plantData, "plant", "iterations", &plant->iterations)) return false;
+    if (plantData.contains("angle")) {
+        if (!readObjectFloats(plantData, "plant", "angle", &plant->angle, 1)) return false;
+        plant->angle *= M_PI / 180.f;
+    }
+    if (plantData.contains("length") && !readObjectFloats(plantData, "plant", "length", &plant->length, 1)) return false;
+    if (plantData.contains("width") && !readObjectFloats(plantData, "plant", "width", &plant->width, 1)) return false;
+    if (plantData.contains("scaleProgression") && !readObjectFloats(plantData, "plant", "scaleProgression", &plant->scaleProgression, 1)) return false;
+    if (plantData.contains("color") && !readObjectFloats(plantData, "plant", "color", &plant->color[0], 4)) return false;
+    if (plantData.contains("leafColor") && !readObjectFloats(plantData, "plant", "leafColor", &plant->leafColor[0], 4)) return false;
+    if (plantData.contains("seed")) {
+        int seed;
+        if (!readObjectInt(plantData, "plant", "seed", &seed)) return false;
+        plant->seed = seed;
+    }
+    if (plantData.contains("variants") && !readObjectInt(plantData, "plant", "variants", &plant->variants)) return false;
+    if (plantData.contains("count") && !readObjectInt(plantData, "plant", "count", &plant->count)) return false;
+    if (plantData.contains("scatterExtent") && !readObjectFloats(plantData, "plant", "scatterExtent", &plant->scatterExtent[0], 2)) return false;
+    if (plantData.contains("plantScale") && !readObjectFloats(plantData, "plant", "plantScale", &plant->plantScale[0], 2)) return false;
+
+    if (plant->iterations < 0 || plant->variants < 1 || plant->count < 0 || plant->length <= 0.f
+        || plant->plantScale.x <= 0.f || plant->plantScale.y < plant->plantScale.x) {
+        std::cout << "plant needs iterations >= 0, variants >= 1, count >= 0, length > 0 and 0 < plantScale[0] <= plantScale[1]"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -37,6 +37,8 @@ private:
     bool parseGroupData(const QJsonObject &object, SceneNode *node);
     bool parsePrimitive(const QJsonObject &prim, SceneNode *node);
     bool parseLightData(const QJsonObject &lightData, SceneNode *node);
+    bool parseEmitter(const QJsonObject &emitterData, SceneNode *node);
+    bool parsePlant(const QJsonObject &plantData, SceneNode *node);
 
     std::string file_name;
 
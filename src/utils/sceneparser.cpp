@@ -25,6 +25,8 @@ bool SceneParser::parse(std::string filepath, RenderData &renderData) {
 
     renderData.shapes.clear();
     renderData.lights.clear();
+    renderData.emitters.clear();
+    renderData.plants.clear();
     SceneNode* root = fileReader.getRootNode();
 
     parseRecursive(renderData, root, glm::mat4{1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1});
@@ -58,6 +60,14 @@ void SceneParser::parseRecursive(RenderData &renderData, SceneNode* node, glm::m
                                                    newctm * glm::vec4{0, 0, 0, 1}, newctm * lit->dir, lit->penumbra, lit->angle, lit->width, lit->height});
     }
 
+    for (SceneEmitter* emitter: node->emitters) {
+        renderData.emitters.push_back(RenderEmitterData{*emitter, newctm});
+    }
+
+    for (ScenePlant* plant: node->plants) {
+        renderData.plants.push_back(RenderPlantData{*plant, newctm});
+    }
+
     for (SceneNode* child: node->children) {
         parseRecursive(renderData, child, newctm);
     }
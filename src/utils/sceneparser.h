@@ -9,6 +9,20 @@ struct RenderShapeData {
     ScenePrimitive primitive;
     glm::mat4 ctm; // the cumulative transformation matrix
     glm::mat4 ctm_inv_trans;
+    int lod = 0; // level of detail drawn last frame, kept for hysteresis
+};
+
+// Struct which contains a particle emitter and the transformation of its group
+struct RenderEmitterData {
+    SceneEmitter emitter;
+    glm::mat4 ctm;
+};
+
+// Struct which contains an L-system plant and the transformation of its group
+struct RenderPlantData {
+    ScenePlant plant;
+    glm::mat4 ctm;
+    bool operator==(const RenderPlantData&) const = default;
 };
 
 // Struct which contains all the data needed to render a scene
@@ -18,6 +32,8 @@ struct RenderData {
 
     std::vector<SceneLightData> lights;
     std::vector<RenderShapeData> shapes;
+    std::vector<RenderEmitterData> emitters;
+    std::vector<RenderPlantData> plants;
 };
 
 class SceneParser {
@@ -8,6 +8,7 @@
 #include <QFile>
 #include <QTextStream>
 #include <iostream>
+#include <vector>
 
 class ShaderLoader{
 public:
@@ -44,20 +45,116 @@ public:
         return programID;
     }
 
-private:
-    static GLuint createShader(GLenum shaderType, const char *filepath){
-        GLuint shaderID = glCreateShader(shaderType);
+    // Same as createShaderProgram, with a geometry shader between the two stages.
+    static GLuint createShaderProgram(const char * vertex_file_path, const char * geometry_file_path, const char * fragment_file_path){
+        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
+        GLuint geometryShaderID = createShader(GL_GEOMETRY_SHADER, geometry_file_path);
+        GLuint fragmentShaderID = createShader(GL_FRAGMENT_SHADER, fragment_file_path);
 
-        // Read shader file.
-        std::string code;
+        GLuint programID = glCreateProgram();
+        glAttachShader(programID, vertexShaderID);
+        glAttachShader(programID, geometryShaderID);
+        glAttachShader(programID, fragmentShaderID);
+        glLinkProgram(programID);
+
+        GLint status;
+        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+        if (status == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length, '\0');
+            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+
+            glDeleteProgram(programID);
+            throw std::runtime_error(log);
+        }
+
+        glDeleteShader(vertexShaderID);
+        glDeleteShader(geometryShaderID);
+        glDeleteShader(fragmentShaderID);
+
+        return programID;
+    }
+
+    // Same as createShaderProgram, but the fragment shader is generated at runtime rather than read from a file.
+    static GLuint createShaderProgramFromSource(const char * vertex_file_path, const std::string& fragment_source){
+        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
+        GLuint fragmentShaderID = createShaderFromSource(GL_FRAGMENT_SHADER, fragment_source);
+
+        GLuint programID = glCreateProgram();
+        glAttachShader(programID, vertexShaderID);
+        glAttachShader(programID, fragmentShaderID);
+        glLinkProgram(programID);
+
+        GLint status;
+        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+        if (status == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length, '\0');
+            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+
+            glDeleteProgram(programID);
+            throw std::runtime_error(log);
+        }
+
+        glDeleteShader(vertexShaderID);
+        glDeleteShader(fragmentShaderID);
+
+        return programID;
+    }
+
+    // A vertex-only program whose outputs are captured, interleaved in the given order, by transform feedback.
+    static GLuint createTransformFeedbackProgram(const char * vertex_file_path, const std::vector<const char*>& varyings){
+        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
+
+        GLuint programID = glCreateProgram();
+        glAttachShader(programID, vertexShaderID);
+        // has to be set before linking
+        glTransformFeedbackVaryings(programID, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(programID);
+
+        GLint status;
+        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+        if (status == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length, '\0');
+            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+
+            glDeleteProgram(programID);
+            throw std::runtime_error(log);
+        }
+
+        glDeleteShader(vertexShaderID);
+
+        return programID;
+    }
+
+    static std::string readFile(const char *filepath){
         QString filepathStr = QString(filepath);
         QFile file(filepathStr);
         if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
             QTextStream stream(&file);
-            code = stream.readAll().toStdString();
-        }else{
-            throw std::runtime_error(std::string("Failed to open shader: ")+filepath);
+            return stream.readAll().toStdString();
         }
+        throw std::runtime_error(std::string("Failed to open shader: ")+filepath);
+    }
+
+private:
+    static GLuint createShader(GLenum shaderType, const char *filepath){
+        // Read shader file.
+        return createShaderFromSource(shaderType, readFile(filepath));
+    }
+
+    static GLuint createShaderFromSource(GLenum shaderType, const std::string& code){
+        GLuint shaderID = glCreateShader(shaderType);
 
         // Compile shader code.
         const char *codePtr = code.c_str();
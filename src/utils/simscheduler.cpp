@@ -0,0 +1,121 @@
+#include "utils/simscheduler.h"
+#include "utils/stats.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+SimScheduler::SimScheduler(ThreadPool* pool, float step, int maxSteps)
+    : m_pool(pool), m_dt(step), m_maxSteps(std::max(1, maxSteps)) {
+    m_step.dt = m_dt;
+}
+
+SimScheduler::TaskId SimScheduler::addTask(Task task) {
+    TaskId id = m_tasks.size();
+    std::vector<TaskId> dependsOn;
+    for (TaskId dependency: task.dependsOn) {
+        if (dependency < 0 || dependency >= id) {
+            std::cout << "simulation task " << task.name << " depends on a task registered after it" << std::endl;
+            continue;
+        }
+        if (task.mainThread && !m_tasks[dependency].mainThread) {
+            std::cout << "simulation task " << task.name << " runs on the main thread and cannot wait for "
+                      << m_tasks[dependency].name << std::endl;
+            continue;
+        }
+        dependsOn.push_back(dependency);
+        m_states[dependency]->dependents.push_back(id);
+    }
+    task.dependsOn = dependsOn;
+    m_tasks.push_back(std::move(task));
+    m_states.push_back(std::make_unique<TaskState>());
+    return id;
+}
+
+void SimScheduler::launch(float frameSeconds, bool threaded) {
+    wait();
+
+    m_accumulator += frameSeconds;
+    int steps = int(m_accumulator / m_dt);
+    if (steps > m_maxSteps) {
+        // too far behind, e.g. after a stall: drop the time instead of trying to catch up
+        m_statDropped += steps - m_maxSteps;
+        steps = m_maxSteps;
+        m_accumulator = std::fmod(m_accumulator, double(m_dt));
+    } else {
+        m_accumulator -= steps * double(m_dt);
+    }
+    m_step.steps = steps;
+    m_step.time += steps * double(m_dt);
+    m_step.alpha = m_accumulator / m_dt;
+    m_statSteps += steps;
+
+    m_launched = true;
+    m_threaded = threaded && m_pool != nullptr;
+    if (!m_threaded) {
+        // registration order already puts every task after the ones it depends on
+        for (TaskId id = 0; id < (TaskId)m_tasks.size(); id++) runTask(id);
+        return;
+    }
+
+    for (TaskId id = 0; id < (TaskId)m_tasks.size(); id++) {
+        m_states[id]->waitingOn.store(m_tasks[id].dependsOn.size(), std::memory_order_relaxed);
+    }
+    for (TaskId id = 0; id < (TaskId)m_tasks.size(); id++) {
+        if (m_tasks[id].mainThread) runTask(id);
+    }
+    // the ones whose dependencies were all main thread tasks were submitted as those finished
+    for (TaskId id = 0; id < (TaskId)m_tasks.size(); id++) {
+        if (!m_tasks[id].mainThread && m_tasks[id].dependsOn.empty()) submit(id);
+    }
+}
+
+void SimScheduler::submit(TaskId id) {
+    m_pool->submit(m_group, [this, id] { runTask(id); });
+}
+
+void SimScheduler::runTask(TaskId id) {
+    auto start = std::chrono::steady_clock::now();
+    m_tasks[id].run(m_step);
+    m_states[id]->nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    if (!m_threaded) return;
+
+    // submitting from inside the task keeps the group pending until the dependents are queued
+    for (TaskId dependent: m_states[id]->dependents) {
+        if (m_states[dependent]->waitingOn.fetch_sub(1, std::memory_order_acq_rel) == 1 && !m_tasks[dependent].mainThread) {
+            submit(dependent);
+        }
+    }
+}
+
+void SimScheduler::wait() {
+    if (!m_launched) return;
+    if (m_threaded) {
+        auto start = std::chrono::steady_clock::now();
+        m_pool->wait(m_group);
+        m_statBlockedNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    m_launched = false;
+
+    for (const Task& task: m_tasks) {
+        if (task.publish) task.publish(m_step);
+    }
+    if (++m_statLaunches == STATS_PERIOD_FRAMES) logStats();
+}
+
+void SimScheduler::logStats() {
+    // per frame averages, so the tasks can be compared with the time the frame spent blocked on them
+    if (statsEnabled()) {
+        std::cout << "Simulation: " << float(m_statSteps) / m_statLaunches << " steps/frame, " << m_statDropped
+                  << " dropped, blocked " << m_statBlockedNanos / m_statLaunches / 1000.f << " us/frame;";
+        for (TaskId id = 0; id < (TaskId)m_tasks.size(); id++) {
+            std::cout << " " << m_tasks[id].name << " " << m_states[id]->nanos / m_statLaunches / 1000.f << " us";
+        }
+        std::cout << std::endl;
+    }
+    for (auto& state: m_states) state->nanos = 0;
+    m_statLaunches = 0;
+    m_statSteps = 0;
+    m_statDropped = 0;
+    m_statBlockedNanos = 0;
+}
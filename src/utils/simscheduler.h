@@ -0,0 +1,77 @@
+#ifndef SIMSCHEDULER_H
+#define SIMSCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "threadpool.h"
+
+// One launch's worth of fixed simulation steps
+struct SimStep {
+    int steps = 0;     // whole steps to take, possibly none when frames come faster than steps
+    float dt = 0.f;    // seconds per step
+    double time = 0.0; // simulation time once the steps are taken
+    float alpha = 0.f; // leftover frame time, as a fraction of a step
+    // frames show the state between the last two steps, alpha of the way from the earlier one
+    double renderTime() const { return time - (1.0 - alpha) * dt; }
+};
+
+// Advances the simulation in fixed steps however often frames are drawn: frame time goes into
+// an accumulator and each launch takes the whole steps it holds. Systems register as tasks,
+// each listing the tasks it needs to finish first. Main thread tasks run in launch(); the rest
+// run on the pool, each as soon as what it depends on is done, while the caller draws the
+// previous results. wait() then lets every task publish its results for the next frame.
+class SimScheduler
+{
+public:
+    using TaskId = int;
+    struct Task {
+        std::string name;
+        std::function<void(const SimStep&)> run;
+        std::function<void(const SimStep&)> publish; // optional, on the caller in wait()
+        std::vector<TaskId> dependsOn;                // tasks registered before this one
+        bool mainThread = false; // for tasks that touch GL or the widget; they cannot wait for pool tasks
+    };
+
+    SimScheduler(ThreadPool* pool, float step, int maxSteps);
+
+    TaskId addTask(Task task);
+
+    // waits for the previous launch, adds frameSeconds to the accumulator and starts every task
+    // on the steps it now holds; threaded = false runs them all on the caller instead
+    void launch(float frameSeconds, bool threaded);
+    // blocks until the launched tasks are done, then publishes their results
+    void wait();
+
+    const SimStep& lastStep() const { return m_step; }
+
+private:
+    struct TaskState {
+        std::atomic<int> waitingOn{0};
+        std::atomic<long long> nanos{0};
+        std::vector<TaskId> dependents;
+    };
+
+    void runTask(TaskId id);
+    void submit(TaskId id);
+    void logStats();
+
+    ThreadPool* m_pool;
+    float m_dt;
+    int m_maxSteps;
+    std::vector<Task> m_tasks;
+    std::vector<std::unique_ptr<TaskState>> m_states;
+    TaskGroup m_group;
+    bool m_launched = false;
+    bool m_threaded = true;
+    double m_accumulator = 0.0;
+    SimStep m_step;
+
+    int m_statLaunches = 0;
+    int m_statSteps = 0;
+    int m_statDropped = 0;
+    long long m_statBlockedNanos = 0;
+};
+
+#endif // SIMSCHEDULER_H
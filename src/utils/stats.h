@@ -0,0 +1,15 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdlib>
+
+// The periodic performance logs (simulation, animation, shadows, lights, particles, ...) average
+// over this many frames, and are only printed when the LOG_STATS environment variable is set
+constexpr int STATS_PERIOD_FRAMES = 300;
+
+inline bool statsEnabled() {
+    static const bool enabled = std::getenv("LOG_STATS") != nullptr;
+    return enabled;
+}
+
+#endif // STATS_H
@@ -0,0 +1,145 @@
+#include "streambuffer.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+constexpr GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+void StreamBuffer::create(GLsizeiptr frameBytes) {
+    destroy();
+    m_persistent = GLEW_ARB_buffer_storage;
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_uniformAlignment = std::max(alignment, 16);
+    allocateStorage(frameBytes);
+    std::cout << "Stream buffer: " << m_frameBytes / 1024 << " KB per frame, "
+              << (m_persistent ? "persistently mapped" : "orphaned each frame") << std::endl;
+}
+
+void StreamBuffer::allocateStorage(GLsizeiptr frameBytes) {
+    // segments start on an alignment every user is happy with
+    m_frameBytes = alignUp(frameBytes, std::max<GLsizeiptr>(m_uniformAlignment, 256));
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    if (m_persistent) {
+        glBufferStorage(GL_COPY_WRITE_BUFFER, m_frameBytes * PERSISTENT_SEGMENTS, nullptr, PERSISTENT_FLAGS);
+        m_mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_frameBytes * PERSISTENT_SEGMENTS, PERSISTENT_FLAGS));
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, m_frameBytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_segment = 0;
+    m_head = 0;
+    m_generation++;
+}
+
+void StreamBuffer::release() {
+    for (GLsync& fence: m_fences) {
+        if (fence != nullptr) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (m_buffer != 0 && m_mapped != nullptr) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    m_mapped = nullptr;
+    m_head = 0;
+}
+
+void StreamBuffer::destroy() {
+    release();
+    if (m_buffer != 0) m_retired.push_back(m_buffer);
+    // anything still drawing from them keeps the storage alive until it is done
+    if (!m_retired.empty()) glDeleteBuffers(m_retired.size(), m_retired.data());
+    m_retired.clear();
+    m_buffer = 0;
+}
+
+void StreamBuffer::grow(GLsizeiptr needed) {
+    // this frame's earlier allocations, and texture views of them, keep using the old buffer;
+    // it is only deleted at the start of the next frame
+    GLsizeiptr frameBytes = std::max(m_frameBytes * 2, needed);
+    release();
+    m_retired.push_back(m_buffer);
+    allocateStorage(frameBytes);
+    std::cout << "Stream buffer grew to " << m_frameBytes / 1024 << " KB per frame" << std::endl;
+}
+
+void StreamBuffer::beginFrame() {
+    m_head = 0;
+    if (!m_retired.empty()) {
+        glDeleteBuffers(m_retired.size(), m_retired.data());
+        m_retired.clear();
+    }
+    if (!m_persistent) {
+        // fresh storage: nothing the GPU still reads can be overwritten, so ranges map unsynchronized
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_frameBytes, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+    m_segment = (m_segment + 1) % PERSISTENT_SEGMENTS;
+    GLsync& fence = m_fences[m_segment];
+    if (fence != nullptr) {
+        // the frame that last wrote this segment was three frames ago
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void StreamBuffer::endFrame() {
+    if (!m_persistent || m_head == 0) return;
+    GLsync& fence = m_fences[m_segment];
+    if (fence != nullptr) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(GLsizeiptr bytes, GLsizeiptr alignment) {
+    Allocation allocation;
+    if (m_buffer == 0 || bytes <= 0) return allocation;
+    GLsizeiptr start = alignUp(m_head, alignment);
+    if (start + bytes > m_frameBytes) {
+        grow(bytes + alignment);
+        start = 0;
+    }
+    m_head = start + bytes;
+
+    allocation.size = bytes;
+    if (m_persistent) {
+        allocation.offset = m_frameBytes * m_segment + start;
+        allocation.data = m_mapped != nullptr ? m_mapped + allocation.offset : nullptr;
+        return allocation;
+    }
+    // only one range of the buffer can be mapped at a time, so commit before the next allocate
+    allocation.offset = start;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    allocation.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, bytes,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return allocation;
+}
+
+void StreamBuffer::commit(const Allocation& allocation) {
+    if (m_persistent || allocation.data == nullptr) return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE) {
+        std::cout << "stream buffer was corrupted while mapped" << std::endl;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+GLintptr StreamBuffer::upload(const void* data, GLsizeiptr bytes, GLsizeiptr alignment) {
+    Allocation allocation = allocate(bytes, alignment);
+    if (allocation.data == nullptr) return -1;
+    std::copy(static_cast<const char*>(data), static_cast<const char*>(data) + bytes, static_cast<char*>(allocation.data));
+    commit(allocation);
+    return allocation.offset;
+}
@@ -0,0 +1,66 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <vector>
+
+// One buffer that everything rewritten each frame is sub-allocated from: particle instances,
+// bone palettes, light cluster lists, uniform blocks. With ARB_buffer_storage it stays mapped
+// and is split into three frame segments, each fenced after the frame that filled it, so
+// writing never waits on the GPU unless it is three frames behind. Without it the buffer is
+// orphaned once per frame and each allocation maps its own range of the fresh storage.
+class StreamBuffer
+{
+public:
+    struct Allocation {
+        void* data = nullptr; // write here until commit
+        GLintptr offset = 0;  // byte offset of data in buffer()
+        GLsizeiptr size = 0;
+    };
+
+    // frameBytes is a first guess, the buffer grows when a frame needs more
+    void create(GLsizeiptr frameBytes);
+    void destroy();
+
+    // GL thread only, around everything a frame allocates and draws
+    void beginFrame();
+    void endFrame();
+
+    // offset is a multiple of alignment; data is null if the buffer could not be mapped
+    Allocation allocate(GLsizeiptr bytes, GLsizeiptr alignment);
+    // call once the allocation is written and before anything draws from it
+    void commit(const Allocation& allocation);
+    // allocate + copy + commit; returns the offset, or -1 on failure
+    GLintptr upload(const void* data, GLsizeiptr bytes, GLsizeiptr alignment);
+
+    GLuint buffer() const { return m_buffer; }
+    // changes whenever buffer() names a new buffer, so texture buffer views can be re-pointed
+    int generation() const { return m_generation; }
+    GLsizeiptr uniformAlignment() const { return m_uniformAlignment; }
+    GLsizeiptr frameBytes() const { return m_frameBytes; }
+
+private:
+    static constexpr int PERSISTENT_SEGMENTS = 3;
+
+    void allocateStorage(GLsizeiptr frameBytes);
+    // drops the mapping and fences of the current buffer
+    void release();
+    void grow(GLsizeiptr needed);
+
+    bool m_persistent = false;
+    GLuint m_buffer = 0;
+    GLsizeiptr m_frameBytes = 0;
+    GLsizeiptr m_uniformAlignment = 256;
+    GLsync m_fences[PERSISTENT_SEGMENTS] = {nullptr, nullptr, nullptr};
+    char* m_mapped = nullptr;
+    int m_segment = 0;
+    GLsizeiptr m_head = 0; // bytes used in this frame's segment
+    int m_generation = 0;
+    std::vector<GLuint> m_retired; // outgrown buffers, deleted next frame
+};
+
+#endif // STREAMBUFFER_H
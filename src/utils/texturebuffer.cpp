@@ -0,0 +1,26 @@
+#include "texturebuffer.h"
+
+#include <algorithm>
+
+void TextureBuffer::upload(GLenum format, const void* data, size_t bytes, GLenum usage) {
+    if (buffer == 0) {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // never empty, a zero-sized buffer cannot back a texture
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), nullptr, usage);
+    if (bytes > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void TextureBuffer::destroy() {
+    if (buffer) glDeleteBuffers(1, &buffer);
+    if (texture) glDeleteTextures(1, &texture);
+    buffer = 0;
+    texture = 0;
+}
@@ -0,0 +1,22 @@
+#ifndef TEXTUREBUFFER_H
+#define TEXTUREBUFFER_H
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <cstddef>
+
+// A buffer that shaders read through a buffer texture (texelFetch on a samplerBuffer).
+// Both objects are created by the first upload.
+struct TextureBuffer {
+    GLuint buffer = 0;
+    GLuint texture = 0;
+
+    // (re)fills the buffer; orphaning the old storage keeps the driver from waiting on last frame's draws
+    void upload(GLenum format, const void* data, size_t bytes, GLenum usage = GL_STREAM_DRAW);
+    void destroy();
+};
+
+#endif // TEXTUREBUFFER_H
@@ -0,0 +1,132 @@
+#include "utils/threadpool.h"
+
+#include <algorithm>
+
+namespace {
+// index of the queue owned by the current thread, -1 for threads outside the pool
+thread_local int t_queueIndex = -1;
+}
+
+int ThreadPool::defaultWorkerCount() {
+    // the submitting thread also runs tasks while it waits, so leave a core for it
+    int cores = std::thread::hardware_concurrency();
+    return std::max(0, cores - 1);
+}
+
+ThreadPool::ThreadPool(int numWorkers) {
+    numWorkers = std::max(0, numWorkers);
+    for (int i = 0; i < numWorkers + 1; i++) {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(m_sleepLock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    // workers drain the queues before they leave; whatever is left (a pool without workers,
+    // or a task pushed as the last worker left) runs here, so no group is left waiting
+    for (std::thread& thread: m_threads) {
+        thread.join();
+    }
+    Task task;
+    while (tryPop(-1, task)) {
+        run(task);
+    }
+}
+
+void ThreadPool::submit(TaskGroup& group, std::function<void()> task) {
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+
+    // workers push onto their own deque, everyone else spreads work round-robin
+    int target = t_queueIndex;
+    if (target < 0 || target >= (int)m_queues.size()) {
+        target = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_queues[target]->lock);
+        m_queues[target]->tasks.push_back(Task{std::move(task), &group});
+    }
+    m_queued.fetch_add(1, std::memory_order_release);
+    {
+        // taking the lock orders this notify after a worker's empty-check
+        std::lock_guard<std::mutex> guard(m_sleepLock);
+    }
+    m_wake.notify_one();
+}
+
+bool ThreadPool::tryPop(int self, Task& out) {
+    int n = m_queues.size();
+    if (self >= 0) {
+        WorkQueue& own = *m_queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            out = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    int start = (self >= 0) ? self + 1 : 0;
+    for (int i = 0; i < n; i++) {
+        int victim = (start + i) % n;
+        if (victim == self) continue;
+        WorkQueue& other = *m_queues[victim];
+        std::lock_guard<std::mutex> guard(other.lock);
+        if (!other.tasks.empty()) {
+            out = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(Task& task) {
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    task.fn();
+    task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::workerLoop(int self) {
+    t_queueIndex = self;
+    Task task;
+    while (true) {
+        if (tryPop(self, task)) {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(m_sleepLock);
+        m_wake.wait(guard, [this] { return m_stopping || m_queued.load(std::memory_order_acquire) > 0; });
+        if (m_stopping && m_queued.load(std::memory_order_acquire) == 0) return;
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    Task task;
+    while (!group.idle()) {
+        if (tryPop(t_queueIndex, task)) {
+            run(task);
+        } else {
+            // remaining tasks are in flight on workers
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& body, int grain) {
+    if (count <= 0) return;
+    grain = std::max(1, grain);
+    TaskGroup group;
+    for (int begin = 0; begin < count; begin += grain) {
+        int end = std::min(count, begin + grain);
+        submit(group, [&body, begin, end] {
+            for (int i = begin; i < end; i++) body(i);
+        });
+    }
+    wait(group);
+}
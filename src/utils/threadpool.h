@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tracks a batch of tasks submitted to the pool so the caller can wait on just that batch
+struct TaskGroup {
+    std::atomic<int> pending{0};
+    bool idle() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Small work-stealing pool: every worker owns a deque, pops its own work LIFO and
+// steals FIFO from the others when it runs dry. The thread calling wait() helps out,
+// so a pool with zero workers still makes progress (everything just runs on the caller).
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int numWorkers = defaultWorkerCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(TaskGroup& group, std::function<void()> task);
+    void wait(TaskGroup& group);
+    // splits [0, count) into chunks and blocks until all of them have run
+    void parallelFor(int count, const std::function<void(int)>& body, int grain = 1);
+
+    int numWorkers() const { return m_threads.size(); }
+    static int defaultWorkerCount();
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group = nullptr;
+    };
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(int self);
+    bool tryPop(int self, Task& out);
+    void run(Task& task);
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues; // one per worker, plus one for outside threads
+    std::vector<std::thread> m_threads;
+    std::atomic<int> m_nextQueue{0};
+    std::atomic<int> m_queued{0};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_sleepLock;
+    std::condition_variable m_wake;
+};
+
+#endif // THREADPOOL_H